@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* bench */
+#include "alloc.h"
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static atomic_uint_fast64_t allocations;
+static atomic_uint_fast64_t allocated;
+
+static void reset(void);
+
+#if defined(__GLIBC__)
+
+static void count(size_t size);
+
+/* The allocator of glibc under its own names, so the counting does not recurse */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+void*
+malloc(size_t size)
+{
+   count(size);
+   return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb, size_t size)
+{
+   count(nmemb * size);
+   return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr, size_t size)
+{
+   count(size);
+   return __libc_realloc(ptr, size);
+}
+
+void*
+aligned_alloc(size_t alignment, size_t size)
+{
+   count(size);
+   return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void** memptr, size_t alignment, size_t size)
+{
+   void* ptr = NULL;
+
+   if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+   {
+      return EINVAL;
+   }
+
+   count(size);
+   ptr = __libc_memalign(alignment, size);
+   if (ptr == NULL)
+   {
+      return ENOMEM;
+   }
+
+   *memptr = ptr;
+
+   return 0;
+}
+
+static void
+count(size_t size)
+{
+   atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+   atomic_fetch_add_explicit(&allocated, size, memory_order_relaxed);
+}
+
+#endif
+
+void
+pgexporter_alloc_count(uint64_t* number, uint64_t* bytes)
+{
+   *number = atomic_load_explicit(&allocations, memory_order_relaxed);
+   *bytes = atomic_load_explicit(&allocated, memory_order_relaxed);
+}
+
+__attribute__((constructor)) static void
+alloc_start(void)
+{
+   /* A forked worker reports its own allocations */
+   pthread_atfork(NULL, NULL, reset);
+}
+
+__attribute__((destructor)) static void
+alloc_report(void)
+{
+   struct rusage usage;
+   char line[128];
+   char* path = NULL;
+   int length;
+   int fd;
+
+   path = getenv("PGEXPORTER_ALLOC_FILE");
+   if (path == NULL || getrusage(RUSAGE_SELF, &usage))
+   {
+      return;
+   }
+
+   length = snprintf(line, sizeof(line), "%d %llu %llu %ld\n", (int)getpid(),
+                     (unsigned long long)atomic_load(&allocations),
+                     (unsigned long long)atomic_load(&allocated),
+                     usage.ru_maxrss);
+
+   /* A line is appended in one write, so the processes do not mix their lines */
+   fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0600);
+   if (fd != -1)
+   {
+      if (write(fd, line, length) != length)
+      {
+         /* Nothing to do */
+      }
+      close(fd);
+   }
+}
+
+static void
+reset(void)
+{
+   atomic_store(&allocations, 0);
+   atomic_store(&allocated, 0);
+}
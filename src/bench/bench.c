@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <utils.h>
+
+/* bench */
+#include "bench.h"
+#include "alloc/alloc.h"
+
+/* system */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SAMPLES         7
+#define BENCH_SAMPLE_TIME     50000000
+#define BENCH_MAX_ROUNDS      1048576
+
+#define NUMBER_OF_FAMILIES   16
+
+static char* families[NUMBER_OF_FAMILIES] = {
+   "pg_stat_user_tables_seq_scan",
+   "pg_stat_user_tables_idx_scan",
+   "pg_stat_user_tables_n_live_tup",
+   "pg_stat_user_tables_n_dead_tup",
+   "pg_statio_user_tables_heap_blks_read",
+   "pg_statio_user_tables_heap_blks_hit",
+   "pg_stat_user_indexes_idx_tup_read",
+   "pg_stat_user_indexes_idx_tup_fetch",
+   "pg_stat_statements_calls",
+   "pg_stat_statements_total_exec_time",
+   "pg_database_size",
+   "pg_locks_count",
+   "pg_settings_setting",
+   "pg_stat_bgwriter_buffers_clean",
+   "pg_stat_database_xact_commit",
+   "pg_stat_database_blks_hit"
+};
+
+struct suite
+{
+   char* name;          /**< The name of the suite */
+   void (*run)(void);   /**< The benchmarks of the suite */
+};
+
+static struct suite suites[] = {
+   {"art", pgexporter_bench_art},
+   {"deque", pgexporter_bench_deque},
+   {"json", pgexporter_bench_json},
+   {"compression", pgexporter_bench_compression},
+   {"message", pgexporter_bench_message},
+   {"queries", pgexporter_bench_queries},
+   {"servers", pgexporter_bench_servers},
+   {"value", pgexporter_bench_value},
+};
+
+static uint64_t now(void);
+static int compare_samples(const void* a, const void* b);
+static void usage(void);
+
+int
+main(int argc, char** argv)
+{
+   int n = sizeof(suites) / sizeof(struct suite);
+   bool found;
+
+   for (int i = 1; i < argc; i++)
+   {
+      found = false;
+      for (int j = 0; j < n; j++)
+      {
+         if (!strcmp(argv[i], suites[j].name))
+         {
+            found = true;
+         }
+      }
+
+      if (!found)
+      {
+         usage();
+         return 1;
+      }
+   }
+
+   printf("benchmark\tops\tns/op\tMB/s\tallocs/op\n");
+
+   for (int j = 0; j < n; j++)
+   {
+      found = argc == 1;
+      for (int i = 1; i < argc; i++)
+      {
+         if (!strcmp(argv[i], suites[j].name))
+         {
+            found = true;
+         }
+      }
+
+      if (found)
+      {
+         suites[j].run();
+      }
+   }
+
+   return 0;
+}
+
+void
+pgexporter_bench_run(char* name, bench_round round, void* arg, size_t ops, size_t bytes)
+{
+   size_t rounds = 1;
+   uint64_t start;
+   uint64_t duration;
+   uint64_t median;
+   uint64_t samples[BENCH_SAMPLES];
+   uint64_t allocations;
+   uint64_t allocated;
+   uint64_t number;
+
+   /* Warm up the caches and the allocator */
+   round(arg);
+
+   while (true)
+   {
+      start = now();
+      for (size_t r = 0; r < rounds; r++)
+      {
+         round(arg);
+      }
+      duration = now() - start;
+
+      if (duration >= BENCH_SAMPLE_TIME || rounds >= BENCH_MAX_ROUNDS)
+      {
+         break;
+      }
+
+      rounds *= 2;
+   }
+
+   for (int i = 0; i < BENCH_SAMPLES; i++)
+   {
+      start = now();
+      for (size_t r = 0; r < rounds; r++)
+      {
+         round(arg);
+      }
+      samples[i] = now() - start;
+   }
+
+   qsort(samples, BENCH_SAMPLES, sizeof(uint64_t), compare_samples);
+   median = MAX(samples[BENCH_SAMPLES / 2], 1);
+
+   /* The allocations of a round are the same every time */
+   pgexporter_alloc_count(&allocations, &allocated);
+   round(arg);
+   pgexporter_alloc_count(&number, &allocated);
+
+   printf("%s\t%zu\t%.1f\t%.1f\t%.2f\n", name, ops,
+          (double)median / ((double)rounds * ops),
+          bytes > 0 ? (double)bytes * rounds * 1000.0 / median : 0.0,
+          (double)(number - allocations) / ops);
+   fflush(stdout);
+}
+
+char*
+pgexporter_bench_metric_key(int i)
+{
+   char key[MISC_LENGTH];
+
+   /* The family changes fastest, so consecutive keys do not share their prefix */
+   snprintf(&key[0], sizeof(key), "pgexporter_%s{server=\"s%02d\",database=\"db%02d\",relation=\"rel%05d\"}",
+            families[i % NUMBER_OF_FAMILIES],
+            (i / NUMBER_OF_FAMILIES) % 4,
+            (i / (NUMBER_OF_FAMILIES * 4)) % 8,
+            i / (NUMBER_OF_FAMILIES * 32));
+
+   return pgexporter_append(NULL, &key[0]);
+}
+
+char*
+pgexporter_bench_exposition(int series)
+{
+   char* data = NULL;
+   char* key = NULL;
+
+   for (int f = 0; f < NUMBER_OF_FAMILIES; f++)
+   {
+      data = pgexporter_vappend(data, 5, "#HELP pgexporter_", families[f], "\n#TYPE pgexporter_", families[f], " gauge\n");
+
+      for (int i = f; i < series; i += NUMBER_OF_FAMILIES)
+      {
+         key = pgexporter_bench_metric_key(i);
+         data = pgexporter_vappend(data, 2, key, " ");
+         data = pgexporter_append_ulong(data, (unsigned long)i * 7919 % 1000003);
+         data = pgexporter_append(data, "\n");
+         free(key);
+      }
+
+      data = pgexporter_append(data, "\n");
+   }
+
+   return data;
+}
+
+static uint64_t
+now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int
+compare_samples(const void* a, const void* b)
+{
+   uint64_t x = *(const uint64_t*)a;
+   uint64_t y = *(const uint64_t*)b;
+
+   return x < y ? -1 : x > y;
+}
+
+static void
+usage(void)
+{
+   int n = sizeof(suites) / sizeof(struct suite);
+
+   printf("pgexporter-bench %s\n", PGEXPORTER_VERSION);
+   printf("  Microbenchmarks of pgexporter\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgexporter-bench [ SUITE ... ]\n");
+   printf("\n");
+   printf("Suites:\n");
+   for (int j = 0; j < n; j++)
+   {
+      printf("  %s\n", suites[j].name);
+   }
+   printf("\n");
+   printf("Each line of the output has the benchmark, the operations of a round,\n");
+   printf("the median time of an operation, the throughput and the allocations\n");
+   printf("of an operation, separated by tabs\n");
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_BENCH_H
+#define PGEXPORTER_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <json.h>
+
+#include <stdlib.h>
+
+/**
+ * Run one round of a benchmark
+ * @param arg The argument of the benchmark
+ */
+typedef void (*bench_round)(void* arg);
+
+/**
+ * Run a benchmark, and print its result.
+ *
+ * The round is repeated until a sample lasts long enough to be timed,
+ * and the median of the samples is reported, so the result does not
+ * depend on the speed of the machine beyond the cost itself.
+ *
+ * @param name The name of the benchmark
+ * @param round The round
+ * @param arg The argument of the round
+ * @param ops The number of operations in a round
+ * @param bytes The number of bytes processed by a round, or 0
+ */
+void
+pgexporter_bench_run(char* name, bench_round round, void* arg, size_t ops, size_t bytes);
+
+/**
+ * Create a metric name like key, which is the same for the same index
+ * @param i The index
+ * @return The key, which must be freed
+ */
+char*
+pgexporter_bench_metric_key(int i);
+
+/**
+ * Create a Prometheus exposition of a number of series,
+ * which is the same for the same number
+ * @param series The number of series
+ * @return The exposition, which must be freed
+ */
+char*
+pgexporter_bench_exposition(int series);
+
+/**
+ * Benchmark the adaptive radix tree
+ */
+void
+pgexporter_bench_art(void);
+
+/**
+ * Benchmark the deque
+ */
+void
+pgexporter_bench_deque(void);
+
+/**
+ * Benchmark the json functions
+ */
+void
+pgexporter_bench_json(void);
+
+/**
+ * Parse a json string with the parser as it was before it worked in a single pass
+ * @param str The json string
+ * @param obj The resulting json
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_bench_json_parse_baseline(char* str, struct json** obj);
+
+/**
+ * Benchmark the compression functions
+ */
+void
+pgexporter_bench_compression(void);
+
+/**
+ * Benchmark the parse of the DataRows of a response
+ */
+void
+pgexporter_bench_message(void);
+
+/**
+ * Benchmark the merge of the queries of the servers
+ */
+void
+pgexporter_bench_queries(void);
+
+/**
+ * Benchmark the collector loops over the servers
+ */
+void
+pgexporter_bench_servers(void);
+
+/**
+ * Benchmark the values
+ */
+void
+pgexporter_bench_value(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
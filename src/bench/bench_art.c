@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <art.h>
+#include <utils.h>
+#include <value.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct art_bench
+{
+   char** keys;      /**< The keys */
+   int n;            /**< The number of keys */
+   struct art* tree; /**< The tree holding all the keys */
+};
+
+static void art_keys(char* set, char* (*key)(int i), int n);
+static char* family_key(int i);
+static void art_build(void* arg);
+static void art_search(void* arg);
+static void art_iterate(void* arg);
+
+void
+pgexporter_bench_art(void)
+{
+   /* The names of the families of a scrape fit in the cache, the series of large clusters do not */
+   art_keys("families_1k", family_key, 1000);
+   art_keys("series_10k", pgexporter_bench_metric_key, 10000);
+   art_keys("series_100k", pgexporter_bench_metric_key, 100000);
+   art_keys("series_1m", pgexporter_bench_metric_key, 1000000);
+}
+
+/**
+ * Run the benchmarks of the tree on a key set
+ * @param set The name of the key set
+ * @param key The function creating the key of an index
+ * @param n The number of keys
+ */
+static void
+art_keys(char* set, char* (*key)(int i), int n)
+{
+   char name[MISC_LENGTH];
+   struct art_bench b;
+
+   b.n = n;
+   b.keys = calloc(b.n, sizeof(char*));
+
+   pgexporter_art_create(&b.tree);
+
+   for (int i = 0; i < b.n; i++)
+   {
+      b.keys[i] = key(i);
+      pgexporter_art_insert(b.tree, b.keys[i], (uintptr_t)i, ValueInt32);
+   }
+
+   snprintf(name, sizeof(name), "art_build_%s", set);
+   pgexporter_bench_run(name, art_build, &b, b.n, 0);
+   snprintf(name, sizeof(name), "art_search_%s", set);
+   pgexporter_bench_run(name, art_search, &b, b.n, 0);
+   snprintf(name, sizeof(name), "art_iterate_%s", set);
+   pgexporter_bench_run(name, art_iterate, &b, b.n, 0);
+
+   pgexporter_art_destroy(b.tree);
+
+   for (int i = 0; i < b.n; i++)
+   {
+      free(b.keys[i]);
+   }
+   free(b.keys);
+}
+
+/**
+ * Create the name of a family, like the ones of the metrics of a server
+ * @param i The index
+ * @return The key, which must be freed
+ */
+static char*
+family_key(int i)
+{
+   char key[MISC_LENGTH];
+   char* suffixes[4] = {"", "_bucket", "_sum", "_count"};
+
+   snprintf(&key[0], sizeof(key), "pgexporter_pg_stat_%s_%03d%s",
+            i % 2 == 0 ? "user_tables" : "database", i / 8, suffixes[(i / 2) % 4]);
+
+   return pgexporter_append(NULL, &key[0]);
+}
+
+/**
+ * Insert all the keys in a new tree, and destroy it
+ * @param arg The benchmark
+ */
+static void
+art_build(void* arg)
+{
+   struct art* tree = NULL;
+   struct art_bench* b = (struct art_bench*)arg;
+
+   pgexporter_art_create(&tree);
+
+   for (int i = 0; i < b->n; i++)
+   {
+      pgexporter_art_insert(tree, b->keys[i], (uintptr_t)i, ValueInt32);
+   }
+
+   pgexporter_art_destroy(tree);
+}
+
+/**
+ * Search all the keys
+ * @param arg The benchmark
+ */
+static void
+art_search(void* arg)
+{
+   uintptr_t sum = 0;
+   struct art_bench* b = (struct art_bench*)arg;
+
+   for (int i = 0; i < b->n; i++)
+   {
+      sum += pgexporter_art_search(b->tree, b->keys[i]);
+   }
+
+   if (sum == 0)
+   {
+      abort();
+   }
+}
+
+/**
+ * Iterate over all the keys in order
+ * @param arg The benchmark
+ */
+static void
+art_iterate(void* arg)
+{
+   int n = 0;
+   struct art_iterator* iter = NULL;
+   struct art_bench* b = (struct art_bench*)arg;
+
+   pgexporter_art_iterator_create(b->tree, &iter);
+
+   while (pgexporter_art_iterator_next(iter))
+   {
+      n++;
+   }
+
+   pgexporter_art_iterator_destroy(iter);
+
+   if (n != b->n)
+   {
+      abort();
+   }
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <bzip2_compression.h>
+#include <compression.h>
+#include <gzip_compression.h>
+#include <lz4_compression.h>
+#include <zstandard_compression.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_OF_SERIES 10000
+#define BLOCK_SIZE       8192
+
+struct codec
+{
+   char* compress;                                                   /**< The name of the compression benchmark */
+   char* decompress;                                                 /**< The name of the decompression benchmark */
+   int (*encode)(char* s, unsigned char** buffer, size_t* buffer_size); /**< The compression function */
+   int (*decode)(unsigned char* buffer, size_t buffer_size, char** s);  /**< The decompression function */
+};
+
+struct compression_bench
+{
+   struct codec* codec;   /**< The codec */
+   char* text;            /**< The exposition */
+   size_t size;           /**< The size of the exposition */
+   unsigned char* buffer; /**< The compressed exposition */
+   size_t buffer_size;    /**< The size of the compressed exposition */
+};
+
+static struct codec codecs[] = {
+   {"gzip_compress", "gzip_decompress", pgexporter_gzip_string, pgexporter_gunzip_string},
+   {"zstd_compress", "zstd_decompress", pgexporter_zstdc_string, pgexporter_zstdd_string},
+   {"lz4_compress", "lz4_decompress", pgexporter_lz4c_string, pgexporter_lz4d_string},
+   {"bzip2_compress", "bzip2_decompress", pgexporter_bzip2_string, pgexporter_bunzip2_string},
+};
+
+static void compress(void* arg);
+static void decompress(void* arg);
+static void round_trips(void);
+static int round_trip(struct compressor* encoder, struct compressor* decoder, unsigned char* data, size_t size);
+static int append(struct compressor* c, unsigned char** buffer, size_t* size);
+
+void
+pgexporter_bench_compression(void)
+{
+   struct compression_bench b;
+
+   round_trips();
+
+   b.text = pgexporter_bench_exposition(NUMBER_OF_SERIES);
+   b.size = strlen(b.text);
+
+   for (size_t i = 0; i < sizeof(codecs) / sizeof(struct codec); i++)
+   {
+      b.codec = &codecs[i];
+      b.buffer = NULL;
+      b.buffer_size = 0;
+
+      if (b.codec->encode(b.text, &b.buffer, &b.buffer_size))
+      {
+         abort();
+      }
+
+      pgexporter_bench_run(b.codec->compress, compress, &b, 1, b.size);
+      pgexporter_bench_run(b.codec->decompress, decompress, &b, 1, b.size);
+
+      free(b.buffer);
+   }
+
+   free(b.text);
+}
+
+/**
+ * Compress the exposition
+ * @param arg The benchmark
+ */
+static void
+compress(void* arg)
+{
+   unsigned char* buffer = NULL;
+   size_t buffer_size = 0;
+   struct compression_bench* b = (struct compression_bench*)arg;
+
+   if (b->codec->encode(b->text, &buffer, &buffer_size))
+   {
+      abort();
+   }
+
+   free(buffer);
+}
+
+/**
+ * Decompress the exposition
+ * @param arg The benchmark
+ */
+static void
+decompress(void* arg)
+{
+   char* text = NULL;
+   struct compression_bench* b = (struct compression_bench*)arg;
+
+   if (b->codec->decode(b->buffer, b->buffer_size, &text))
+   {
+      abort();
+   }
+
+   free(text);
+}
+
+/**
+ * Check that the streaming compressors give back their input before they are timed:
+ * for empty input, for data ending on the boundary of their output buffer, and with
+ * the contexts reused after a reset
+ */
+static void
+round_trips(void)
+{
+   int codecs[] = {COMPRESSION_CLIENT_GZIP, COMPRESSION_CLIENT_ZSTD, COMPRESSION_CLIENT_LZ4, COMPRESSION_CLIENT_BZIP2};
+   size_t sizes[] = {0, 1, BLOCK_SIZE - 1, BLOCK_SIZE, BLOCK_SIZE + 1, 4 * BLOCK_SIZE};
+   unsigned char* data = NULL;
+   uint32_t seed = 42;
+   struct compressor* encoder = NULL;
+   struct compressor* decoder = NULL;
+
+   /* Random data does not compress, so the output ends where the input does */
+   data = malloc(4 * BLOCK_SIZE);
+   for (size_t i = 0; i < 4 * BLOCK_SIZE; i++)
+   {
+      seed = seed * 1103515245 + 12345;
+      data[i] = (unsigned char)(seed >> 16);
+   }
+
+   for (size_t i = 0; i < sizeof(codecs) / sizeof(int); i++)
+   {
+      if (pgexporter_compressor_create(codecs[i], true, 0, &encoder) ||
+          pgexporter_compressor_create(codecs[i], false, 0, &decoder))
+      {
+         fprintf(stderr, "compression: codec %d could not be created\n", codecs[i]);
+         abort();
+      }
+
+      for (size_t j = 0; j < sizeof(sizes) / sizeof(size_t); j++)
+      {
+         if (round_trip(encoder, decoder, data, sizes[j]))
+         {
+            fprintf(stderr, "compression: codec %d failed the round trip of %zu bytes\n", codecs[i], sizes[j]);
+            abort();
+         }
+      }
+
+      pgexporter_compressor_destroy(encoder);
+      pgexporter_compressor_destroy(decoder);
+      encoder = NULL;
+      decoder = NULL;
+   }
+
+   free(data);
+}
+
+/**
+ * Compress data, decompress it in a single update, and reset the compressors
+ * @param encoder The compressor
+ * @param decoder The decompressor
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 if the data came back, otherwise 1
+ */
+static int
+round_trip(struct compressor* encoder, struct compressor* decoder, unsigned char* data, size_t size)
+{
+   unsigned char* compressed = NULL;
+   size_t compressed_size = 0;
+   unsigned char* decompressed = NULL;
+   size_t decompressed_size = 0;
+   int ret = 1;
+
+   if (pgexporter_compressor_update(encoder, data, size) || append(encoder, &compressed, &compressed_size) ||
+       pgexporter_compressor_finish(encoder) || append(encoder, &compressed, &compressed_size))
+   {
+      goto done;
+   }
+
+   if (pgexporter_compressor_update(decoder, compressed, compressed_size) || append(decoder, &decompressed, &decompressed_size) ||
+       pgexporter_compressor_finish(decoder) || append(decoder, &decompressed, &decompressed_size))
+   {
+      goto done;
+   }
+
+   if (decompressed_size != size || (size > 0 && memcmp(decompressed, data, size)))
+   {
+      goto done;
+   }
+
+   if (pgexporter_compressor_reset(encoder) || pgexporter_compressor_reset(decoder))
+   {
+      goto done;
+   }
+
+   ret = 0;
+
+done:
+
+   free(compressed);
+   free(decompressed);
+
+   return ret;
+}
+
+/**
+ * Append the output of the last call of a compressor
+ * @param c The compressor
+ * @param buffer The buffer
+ * @param size The size of the buffer
+ * @return 0 upon success, otherwise 1
+ */
+static int
+append(struct compressor* c, unsigned char** buffer, size_t* size)
+{
+   unsigned char* b = NULL;
+
+   b = realloc(*buffer, *size + c->output_size + 1);
+   if (b == NULL)
+   {
+      return 1;
+   }
+
+   if (c->output_size > 0)
+   {
+      memcpy(b + *size, c->output, c->output_size);
+   }
+
+   *buffer = b;
+   *size += c->output_size;
+
+   return 0;
+}
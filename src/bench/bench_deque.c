@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <deque.h>
+#include <value.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_OF_NODES 100000
+
+struct deque_bench
+{
+   char** tags;          /**< The tags */
+   int n;                /**< The number of tags */
+   struct deque* deque;  /**< The deque holding all the tags, with an index */
+};
+
+static void deque_add_poll(void* arg);
+static void deque_iterate(void* arg);
+static void deque_get(void* arg);
+static void deque_sort(void* arg);
+
+void
+pgexporter_bench_deque(void)
+{
+   struct deque_bench b;
+
+   b.n = NUMBER_OF_NODES;
+   b.tags = calloc(b.n, sizeof(char*));
+
+   pgexporter_deque_create(false, &b.deque);
+   pgexporter_deque_index(b.deque);
+
+   for (int i = 0; i < b.n; i++)
+   {
+      b.tags[i] = pgexporter_bench_metric_key(i);
+      pgexporter_deque_add(b.deque, b.tags[i], (uintptr_t)i + 1, ValueInt32);
+   }
+
+   pgexporter_bench_run("deque_add_poll", deque_add_poll, &b, b.n, 0);
+   pgexporter_bench_run("deque_iterate", deque_iterate, &b, b.n, 0);
+   pgexporter_bench_run("deque_get", deque_get, &b, b.n, 0);
+   pgexporter_bench_run("deque_sort", deque_sort, &b, b.n, 0);
+
+   pgexporter_deque_destroy(b.deque);
+
+   for (int i = 0; i < b.n; i++)
+   {
+      free(b.tags[i]);
+   }
+   free(b.tags);
+}
+
+/**
+ * Add all the tags to a new deque, and poll them
+ * @param arg The benchmark
+ */
+static void
+deque_add_poll(void* arg)
+{
+   char* tag = NULL;
+   struct deque* deque = NULL;
+   struct deque_bench* b = (struct deque_bench*)arg;
+
+   pgexporter_deque_create(false, &deque);
+
+   for (int i = 0; i < b->n; i++)
+   {
+      pgexporter_deque_add(deque, b->tags[i], (uintptr_t)i, ValueInt32);
+   }
+
+   while (pgexporter_deque_size(deque) > 0)
+   {
+      pgexporter_deque_poll(deque, &tag);
+      free(tag);
+      tag = NULL;
+   }
+
+   pgexporter_deque_destroy(deque);
+}
+
+/**
+ * Iterate over the deque
+ * @param arg The benchmark
+ */
+static void
+deque_iterate(void* arg)
+{
+   int n = 0;
+   struct deque_iterator* iter = NULL;
+   struct deque_bench* b = (struct deque_bench*)arg;
+
+   pgexporter_deque_iterator_create(b->deque, &iter);
+
+   while (pgexporter_deque_iterator_next(iter))
+   {
+      n++;
+   }
+
+   pgexporter_deque_iterator_destroy(iter);
+
+   if (n != b->n)
+   {
+      abort();
+   }
+}
+
+/**
+ * Get every tag through the index
+ * @param arg The benchmark
+ */
+static void
+deque_get(void* arg)
+{
+   uintptr_t sum = 0;
+   struct deque_bench* b = (struct deque_bench*)arg;
+
+   for (int i = 0; i < b->n; i++)
+   {
+      sum += pgexporter_deque_get(b->deque, b->tags[i]);
+   }
+
+   if (sum == 0)
+   {
+      abort();
+   }
+}
+
+/**
+ * Add all the tags to a new deque in the order of the series, and sort them
+ * @param arg The benchmark
+ */
+static void
+deque_sort(void* arg)
+{
+   char* tag = NULL;
+   struct deque* deque = NULL;
+   struct deque_bench* b = (struct deque_bench*)arg;
+
+   pgexporter_deque_create(false, &deque);
+
+   for (int i = 0; i < b->n; i++)
+   {
+      pgexporter_deque_add(deque, b->tags[i], (uintptr_t)i, ValueInt32);
+   }
+
+   pgexporter_deque_sort(deque);
+
+   pgexporter_deque_peek(deque, &tag);
+   if (tag == NULL || strcmp(tag, b->tags[0]) > 0)
+   {
+      abort();
+   }
+
+   pgexporter_deque_destroy(deque);
+}
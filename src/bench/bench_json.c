@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <json.h>
+#include <utils.h>
+#include <value.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_OF_METRICS 500
+#define NUMBER_OF_COLUMNS   6
+
+struct json_bench
+{
+   struct json* document; /**< The document */
+   char* text;            /**< The document as compact text */
+   size_t size;           /**< The size of the text */
+};
+
+static struct json* json_document(void);
+static void json_parse(void* arg);
+static void json_parse_baseline(void* arg);
+static void json_to_string(void* arg);
+static void json_clone(void* arg);
+
+void
+pgexporter_bench_json(void)
+{
+   struct json_bench b;
+
+   b.document = json_document();
+   b.text = pgexporter_json_to_string(b.document, FORMAT_JSON_COMPACT, NULL, 0);
+   b.size = strlen(b.text);
+
+   pgexporter_bench_run("json_parse", json_parse, &b, 1, b.size);
+   pgexporter_bench_run("json_parse_baseline", json_parse_baseline, &b, 1, b.size);
+   pgexporter_bench_run("json_to_string", json_to_string, &b, 1, b.size);
+   pgexporter_bench_run("json_clone", json_clone, &b, 1, b.size);
+
+   pgexporter_json_destroy(b.document);
+   free(b.text);
+}
+
+/**
+ * Create a document shaped like a metrics configuration
+ * @return The document
+ */
+static struct json*
+json_document(void)
+{
+   char name[MISC_LENGTH];
+   char* key = NULL;
+   struct json* document = NULL;
+   struct json* metrics = NULL;
+   struct json* metric = NULL;
+   struct json* queries = NULL;
+   struct json* query = NULL;
+   struct json* columns = NULL;
+   struct json* column = NULL;
+
+   pgexporter_json_create(&document);
+   pgexporter_json_create(&metrics);
+
+   for (int i = 0; i < NUMBER_OF_METRICS; i++)
+   {
+      key = pgexporter_bench_metric_key(i);
+
+      pgexporter_json_create(&metric);
+      pgexporter_json_create(&queries);
+      pgexporter_json_create(&query);
+      pgexporter_json_create(&columns);
+
+      for (int c = 0; c < NUMBER_OF_COLUMNS; c++)
+      {
+         snprintf(&name[0], sizeof(name), "column_%d", c);
+
+         pgexporter_json_create(&column);
+         pgexporter_json_put(column, "name", (uintptr_t)&name[0], ValueString);
+         pgexporter_json_put(column, "type", (uintptr_t)(c == 0 ? "label" : "gauge"), ValueString);
+         pgexporter_json_put(column, "description", (uintptr_t)"The value of the column, as reported by the server", ValueString);
+         pgexporter_json_append(columns, (uintptr_t)column, ValueJSON);
+      }
+
+      pgexporter_json_put(query, "query", (uintptr_t)key, ValueString);
+      pgexporter_json_put(query, "version", (uintptr_t)(10 + i % 8), ValueInt32);
+      pgexporter_json_put(query, "columns", (uintptr_t)columns, ValueJSON);
+      pgexporter_json_append(queries, (uintptr_t)query, ValueJSON);
+
+      pgexporter_json_put(metric, "tag", (uintptr_t)key, ValueString);
+      pgexporter_json_put(metric, "collector", (uintptr_t)"bench", ValueString);
+      pgexporter_json_put(metric, "server", (uintptr_t)(i % 2 == 0), ValueBool);
+      pgexporter_json_put(metric, "queries", (uintptr_t)queries, ValueJSON);
+      pgexporter_json_append(metrics, (uintptr_t)metric, ValueJSON);
+
+      free(key);
+   }
+
+   pgexporter_json_put(document, "version", (uintptr_t)1, ValueInt32);
+   pgexporter_json_put(document, "metrics", (uintptr_t)metrics, ValueJSON);
+
+   return document;
+}
+
+/**
+ * Parse the document
+ * @param arg The benchmark
+ */
+static void
+json_parse(void* arg)
+{
+   struct json* document = NULL;
+   struct json_bench* b = (struct json_bench*)arg;
+
+   if (pgexporter_json_parse_string(b->text, &document))
+   {
+      abort();
+   }
+
+   pgexporter_json_destroy(document);
+}
+
+/**
+ * Parse the document with the parser as it was before
+ * @param arg The benchmark
+ */
+static void
+json_parse_baseline(void* arg)
+{
+   struct json* document = NULL;
+   struct json_bench* b = (struct json_bench*)arg;
+
+   if (pgexporter_bench_json_parse_baseline(b->text, &document))
+   {
+      abort();
+   }
+
+   pgexporter_json_destroy(document);
+}
+
+/**
+ * Serialize the document
+ * @param arg The benchmark
+ */
+static void
+json_to_string(void* arg)
+{
+   char* text = NULL;
+   struct json_bench* b = (struct json_bench*)arg;
+
+   text = pgexporter_json_to_string(b->document, FORMAT_JSON_COMPACT, NULL, 0);
+
+   free(text);
+}
+
+/**
+ * Clone the document
+ * @param arg The benchmark
+ */
+static void
+json_clone(void* arg)
+{
+   struct json* clone = NULL;
+   struct json_bench* b = (struct json_bench*)arg;
+
+   if (pgexporter_json_clone(b->document, &clone))
+   {
+      abort();
+   }
+
+   pgexporter_json_destroy(clone);
+}
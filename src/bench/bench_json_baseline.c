@@ -0,0 +1,412 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <json.h>
+#include <utils.h>
+#include <value.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The json parser as it was before it worked in a single pass, kept as the
+ * baseline of the json suite. It grows keys and values a character at a
+ * time, and takes the length of the whole input for every value.
+ */
+
+static int parse_string(char* str, uint64_t* index, struct json** obj);
+static int json_add(struct json* obj, char* key, uintptr_t val, enum value_type type);
+static int fill_value(char* str, char* key, uint64_t* index, struct json* o);
+static bool value_start(char ch);
+static int handle_escape_char(char* str, uint64_t* index, uint64_t len, char* ch);
+
+int
+pgexporter_bench_json_parse_baseline(char* str, struct json** obj)
+{
+   uint64_t idx = 0;
+   if (str == NULL || strlen(str) < 2)
+   {
+      return 1;
+   }
+
+   return parse_string(str, &idx, obj);
+}
+
+static int
+parse_string(char* str, uint64_t* index, struct json** obj)
+{
+   enum json_type type;
+   struct json* o = NULL;
+   uint64_t idx = *index;
+   char ch = str[idx];
+   char* key = NULL;
+   uint64_t len = strlen(str);
+
+   if (ch == '{')
+   {
+      type = JSONItem;
+   }
+   else if (ch == '[')
+   {
+      type = JSONArray;
+   }
+   else
+   {
+      goto error;
+   }
+   idx++;
+   pgexporter_json_create(&o);
+   if (type == JSONItem)
+   {
+      while (idx < len)
+      {
+         // pre key
+         while (idx < len && isspace(str[idx]))
+         {
+            idx++;
+         }
+         if (idx == len)
+         {
+            goto error;
+         }
+         if (str[idx] == ',')
+         {
+            idx++;
+         }
+         else if (str[idx] == '}')
+         {
+            idx++;
+            break;
+         }
+         else if (!(str[idx] == '"' && o->type == JSONUnknown))
+         {
+            // if it's first key we won't see comma, otherwise we must see comma
+            goto error;
+         }
+         while (idx < len && str[idx] != '"')
+         {
+            idx++;
+         }
+         if (idx == len)
+         {
+            goto error;
+         }
+         idx++;
+         // The key
+         while (idx < len && str[idx] != '"')
+         {
+            char ec_ch;
+            // handle escape character
+            if (str[idx] == '\\')
+            {
+               if (handle_escape_char(str, &idx, len, &ec_ch))
+               {
+                  goto error;
+               }
+               key = pgexporter_append_char(key, ec_ch);
+               continue;
+            }
+
+            key = pgexporter_append_char(key, str[idx++]);
+         }
+         if (idx == len || key == NULL)
+         {
+            goto error;
+         }
+         // The lands between
+         while (idx < len && (str[idx] == '"' || isspace(str[idx])))
+         {
+            idx++;
+         }
+         if (idx == len || str[idx] != ':')
+         {
+            goto error;
+         }
+         while (idx < len && (str[idx] == ':' || isspace(str[idx])))
+         {
+            idx++;
+         }
+         if (idx == len)
+         {
+            goto error;
+         }
+         // The value
+         if (fill_value(str, key, &idx, o))
+         {
+            goto error;
+         }
+         free(key);
+         key = NULL;
+      }
+   }
+   else
+   {
+      while (idx < len)
+      {
+         while (idx < len && isspace(str[idx]))
+         {
+            idx++;
+         }
+         if (idx == len)
+         {
+            goto error;
+         }
+         if (str[idx] == ',')
+         {
+            idx++;
+         }
+         else if (str[idx] == ']')
+         {
+            idx++;
+            break;
+         }
+         else if (!(value_start(str[idx]) && o->type == JSONUnknown))
+         {
+            // if it's first key we won't see comma, otherwise we must see comma
+            goto error;
+         }
+         while (idx < len && !value_start(str[idx]))
+         {
+            idx++;
+         }
+         if (idx == len)
+         {
+            goto error;
+         }
+
+         if (fill_value(str, key, &idx, o))
+         {
+            goto error;
+         }
+      }
+   }
+
+   *index = idx;
+   *obj = o;
+   return 0;
+error:
+   pgexporter_json_destroy(o);
+   free(key);
+   return 1;
+}
+
+static int
+json_add(struct json* obj, char* key, uintptr_t val, enum value_type type)
+{
+   if (obj == NULL)
+   {
+      return 1;
+   }
+   if (key == NULL)
+   {
+      return pgexporter_json_append(obj, val, type);
+   }
+   return pgexporter_json_put(obj, key, val, type);
+}
+
+static bool
+value_start(char ch)
+{
+   return (isdigit(ch) || ch == '-' || ch == '+') || // number
+          (ch == '[') || // array
+          (ch == '{') || // item
+          (ch == '"' || ch == 'n') || // string or null string
+          (ch == 't' || ch == 'f'); // potential boolean value
+}
+
+static int
+fill_value(char* str, char* key, uint64_t* index, struct json* o)
+{
+   uint64_t idx = *index;
+   uint64_t len = strlen(str);
+   if (str[idx] == '"')
+   {
+      char* val = NULL;
+      idx++;
+      while (idx < len && str[idx] != '"')
+      {
+         char ec_ch;
+         if (str[idx] == '\\')
+         {
+            if (handle_escape_char(str, &idx, len, &ec_ch))
+            {
+               goto error;
+            }
+            val = pgexporter_append_char(val, ec_ch);
+            continue;
+         }
+
+         val = pgexporter_append_char(val, str[idx++]);
+      }
+      if (idx == len)
+      {
+         goto error;
+      }
+      if (val == NULL)
+      {
+         json_add(o, key, (uintptr_t)"", ValueString);
+      }
+      else
+      {
+         json_add(o, key, (uintptr_t)val, ValueString);
+      }
+      idx++;
+      free(val);
+   }
+   else if (str[idx] == '-' || str[idx] == '+' || isdigit(str[idx]))
+   {
+      bool has_digit = false;
+      char* val_str = NULL;
+      while (idx < len && (isdigit(str[idx]) || str[idx] == '.' || str[idx] == '-' || str[idx] == '+'))
+      {
+         if (str[idx] == '.')
+         {
+            has_digit = true;
+         }
+         val_str = pgexporter_append_char(val_str, str[idx++]);
+      }
+      if (has_digit)
+      {
+         double val = 0.;
+         if (sscanf(val_str, "%lf", &val) != 1)
+         {
+            free(val_str);
+            goto error;
+         }
+         json_add(o, key, pgexporter_value_from_double(val), ValueDouble);
+         free(val_str);
+      }
+      else
+      {
+         int64_t val = 0;
+         if (sscanf(val_str, "%" PRId64, &val) != 1)
+         {
+            free(val_str);
+            goto error;
+         }
+         json_add(o, key, (uintptr_t)val, ValueInt64);
+         free(val_str);
+      }
+   }
+   else if (str[idx] == '{')
+   {
+      struct json* val = NULL;
+      if (parse_string(str, &idx, &val))
+      {
+         goto error;
+      }
+      json_add(o, key, (uintptr_t)val, ValueJSON);
+   }
+   else if (str[idx] == '[')
+   {
+      struct json* val = NULL;
+      if (parse_string(str, &idx, &val))
+      {
+         goto error;
+      }
+      json_add(o, key, (uintptr_t)val, ValueJSON);
+   }
+   else if (str[idx] == 'n' || str[idx] == 't' || str[idx] == 'f')
+   {
+      char* val = NULL;
+      while (idx < len && str[idx] >= 'a' && str[idx] <= 'z')
+      {
+         val = pgexporter_append_char(val, str[idx++]);
+      }
+      if (pgexporter_compare_string(val, "null"))
+      {
+         json_add(o, key, 0, ValueString);
+      }
+      else if (pgexporter_compare_string(val, "true"))
+      {
+         json_add(o, key, true, ValueBool);
+      }
+      else if (pgexporter_compare_string(val, "false"))
+      {
+         json_add(o, key, false, ValueBool);
+      }
+      else
+      {
+         free(val);
+         goto error;
+      }
+      free(val);
+   }
+   else
+   {
+      goto error;
+   }
+   *index = idx;
+   return 0;
+error:
+   return 1;
+}
+
+static int
+handle_escape_char(char* str, uint64_t* index, uint64_t len, char* ch)
+{
+   uint64_t idx = *index;
+   idx++;
+   if (idx == len)   // security check
+   {
+      return 1;
+   }
+   // Check the next character after checking '\' character
+   switch (str[idx])
+   {
+      case '\"':
+      case '\\':
+         *ch = str[idx];
+         break;
+      case 'n':
+         *ch = '\n';
+         break;
+      case 't':
+         *ch = '\t';
+         break;
+      case 'r':
+         *ch = '\r';
+         break;
+      default:
+         return 1;
+   }
+   *index = idx + 1;
+   return 0;
+}
+
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <message.h>
+#include <utils.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_OF_ROWS 10000
+
+struct message_bench
+{
+   char* data;      /**< The response */
+   size_t size;     /**< The size of the response */
+   size_t length;   /**< The length of the response */
+};
+
+static void message_put(struct message_bench* b, void* data, size_t length);
+static void message_put_int16(struct message_bench* b, int16_t i);
+static void message_put_int32(struct message_bench* b, int32_t i);
+static void message_put_column(struct message_bench* b, char* value);
+static void message_end(struct message_bench* b, size_t start);
+static void datarow_scan(void* arg);
+static void datarow_extract(void* arg);
+static void datarow_view(void* arg);
+
+void
+pgexporter_bench_message(void)
+{
+   char value[MISC_LENGTH];
+   size_t start;
+   struct message_bench b;
+
+   b.size = 1024 * 1024;
+   b.data = malloc(b.size);
+   b.length = 0;
+
+   /* A response like the one of a metric of a database label and a gauge */
+   start = b.length;
+   message_put(&b, "T", 1);
+   message_put_int32(&b, 0);
+   message_put_int16(&b, 2);
+   message_put(&b, "database", 9);
+   message_put(&b, "\0\0\0\0\0\0\0\0\0\x19\xff\xff\xff\xff\xff\xff\0\0", 18);
+   message_put(&b, "value", 6);
+   message_put(&b, "\0\0\0\0\0\0\0\0\0\x19\xff\xff\xff\xff\xff\xff\0\0", 18);
+   message_end(&b, start);
+
+   for (int i = 0; i < NUMBER_OF_ROWS; i++)
+   {
+      start = b.length;
+      message_put(&b, "D", 1);
+      message_put_int32(&b, 0);
+      message_put_int16(&b, 2);
+      snprintf(value, sizeof(value), "database_%07d", i);
+      message_put_column(&b, value);
+      snprintf(value, sizeof(value), "%d", i * 7919);
+      message_put_column(&b, value);
+      message_end(&b, start);
+   }
+
+   start = b.length;
+   message_put(&b, "C", 1);
+   message_put_int32(&b, 0);
+   snprintf(value, sizeof(value), "SELECT %d", NUMBER_OF_ROWS);
+   message_put(&b, value, strlen(value) + 1);
+   message_end(&b, start);
+
+   start = b.length;
+   message_put(&b, "Z", 1);
+   message_put_int32(&b, 0);
+   message_put(&b, "I", 1);
+   message_end(&b, start);
+
+   pgexporter_bench_run("datarow_scan", datarow_scan, &b, NUMBER_OF_ROWS, b.length);
+   pgexporter_bench_run("datarow_extract", datarow_extract, &b, NUMBER_OF_ROWS, b.length);
+   pgexporter_bench_run("datarow_view", datarow_view, &b, NUMBER_OF_ROWS, b.length);
+
+   free(b.data);
+}
+
+static void
+message_put(struct message_bench* b, void* data, size_t length)
+{
+   if (b->length + length > b->size)
+   {
+      b->size *= 2;
+      b->data = realloc(b->data, b->size);
+   }
+
+   memcpy(b->data + b->length, data, length);
+   b->length += length;
+}
+
+static void
+message_put_int16(struct message_bench* b, int16_t i)
+{
+   char data[2];
+
+   data[0] = (char)((i >> 8) & 0xFF);
+   data[1] = (char)(i & 0xFF);
+
+   message_put(b, data, 2);
+}
+
+static void
+message_put_int32(struct message_bench* b, int32_t i)
+{
+   char data[4];
+
+   pgexporter_write_int32(data, i);
+
+   message_put(b, data, 4);
+}
+
+static void
+message_put_column(struct message_bench* b, char* value)
+{
+   message_put_int32(b, (int32_t)strlen(value));
+   message_put(b, value, strlen(value));
+}
+
+static void
+message_end(struct message_bench* b, size_t start)
+{
+   pgexporter_write_int32(b->data + start + 1, (int32_t)(b->length - start - 1));
+}
+
+/**
+ * Look for an error in the response, like a query does before it parses it
+ * @param arg The benchmark
+ */
+static void
+datarow_scan(void* arg)
+{
+   struct message_bench* b = (struct message_bench*)arg;
+
+   if (pgexporter_has_message('E', b->data, b->length))
+   {
+      abort();
+   }
+}
+
+/**
+ * Frame the response with a copy of each message, and read the columns of the DataRows
+ * @param arg The benchmark
+ */
+static void
+datarow_extract(void* arg)
+{
+   size_t offset = 0;
+   size_t sum = 0;
+   struct message* msg = NULL;
+   struct message_bench* b = (struct message_bench*)arg;
+
+   while (offset < b->length)
+   {
+      offset = pgexporter_extract_message_offset(offset, b->data, &msg);
+
+      if (msg->kind == 'D')
+      {
+         sum += pgexporter_read_int32((char*)msg->data + 7);
+      }
+
+      pgexporter_free_message(msg);
+      msg = NULL;
+   }
+
+   if (sum == 0)
+   {
+      abort();
+   }
+}
+
+/**
+ * Frame the response through views, and read the columns of the DataRows
+ * @param arg The benchmark
+ */
+static void
+datarow_view(void* arg)
+{
+   size_t offset = 0;
+   size_t sum = 0;
+   struct message msg;
+   struct message_bench* b = (struct message_bench*)arg;
+
+   while (offset < b->length)
+   {
+      offset = pgexporter_view_message_offset(offset, b->data, &msg);
+
+      if (msg.kind == 'D')
+      {
+         sum += pgexporter_read_int32((char*)msg.data + 7);
+      }
+   }
+
+   if (sum == 0)
+   {
+      abort();
+   }
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <queries.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_OF_QUERIES 64
+#define NUMBER_OF_ROWS    500
+
+struct queries_bench
+{
+   struct tuple* tuples;                        /**< The tuples of all the queries */
+   int* order;                                  /**< The order of the rows of a query */
+   struct query* queries[NUMBER_OF_QUERIES];    /**< The queries of a round */
+};
+
+static void merge_sorted(void* arg);
+static void merge_unsorted(void* arg);
+static void merge_concat(void* arg);
+static void merge(struct queries_bench* b, bool sorted, int sort);
+
+void
+pgexporter_bench_queries(void)
+{
+   char name[MISC_LENGTH];
+   int k;
+   int tmp;
+   struct tuple* t = NULL;
+   struct queries_bench b;
+
+   b.tuples = calloc(NUMBER_OF_QUERIES * NUMBER_OF_ROWS, sizeof(struct tuple));
+   b.order = calloc(NUMBER_OF_ROWS, sizeof(int));
+
+   /* Each server has the same databases, like the rows of a metric across servers */
+   for (int i = 0; i < NUMBER_OF_QUERIES; i++)
+   {
+      for (int j = 0; j < NUMBER_OF_ROWS; j++)
+      {
+         t = &b.tuples[i * NUMBER_OF_ROWS + j];
+         t->server = i;
+         t->data = calloc(2, sizeof(char*));
+
+         snprintf(name, sizeof(name), "database_%05d", j);
+         t->data[0] = strdup(name);
+         snprintf(name, sizeof(name), "%d", i * j);
+         t->data[1] = strdup(name);
+      }
+   }
+
+   /* A fixed shuffle, so the unsorted rounds sort the same rows */
+   for (int j = 0; j < NUMBER_OF_ROWS; j++)
+   {
+      b.order[j] = j;
+   }
+   for (int j = NUMBER_OF_ROWS - 1; j > 0; j--)
+   {
+      k = (j * 7919) % (j + 1);
+      tmp = b.order[j];
+      b.order[j] = b.order[k];
+      b.order[k] = tmp;
+   }
+
+   pgexporter_bench_run("merge_sorted_64x500", merge_sorted, &b, NUMBER_OF_QUERIES * NUMBER_OF_ROWS, 0);
+   pgexporter_bench_run("merge_unsorted_64x500", merge_unsorted, &b, NUMBER_OF_QUERIES * NUMBER_OF_ROWS, 0);
+   pgexporter_bench_run("merge_concat_64x500", merge_concat, &b, NUMBER_OF_QUERIES * NUMBER_OF_ROWS, 0);
+
+   for (int i = 0; i < NUMBER_OF_QUERIES * NUMBER_OF_ROWS; i++)
+   {
+      free(b.tuples[i].data[0]);
+      free(b.tuples[i].data[1]);
+      free(b.tuples[i].data);
+   }
+   free(b.tuples);
+   free(b.order);
+}
+
+/**
+ * Merge the queries of all the servers on the first column, where each is sorted
+ * @param arg The benchmark
+ */
+static void
+merge_sorted(void* arg)
+{
+   merge((struct queries_bench*)arg, true, SORT_DATA0);
+}
+
+/**
+ * Merge the queries of all the servers on the first column, where each must be sorted first
+ * @param arg The benchmark
+ */
+static void
+merge_unsorted(void* arg)
+{
+   merge((struct queries_bench*)arg, false, SORT_DATA0);
+}
+
+/**
+ * Concatenate the queries of all the servers
+ * @param arg The benchmark
+ */
+static void
+merge_concat(void* arg)
+{
+   merge((struct queries_bench*)arg, true, SORT_NAME);
+}
+
+/**
+ * Link the tuples of each query, and merge the queries.
+ * The merge consumes the queries, so they are created in each round,
+ * while the tuples are kept and only linked again.
+ * @param b The benchmark
+ * @param sorted Are the tuples of a query linked in order
+ * @param sort The sort key
+ */
+static void
+merge(struct queries_bench* b, bool sorted, int sort)
+{
+   int n = 0;
+   struct tuple* base = NULL;
+   struct tuple* t = NULL;
+   struct query* result = NULL;
+
+   for (int i = 0; i < NUMBER_OF_QUERIES; i++)
+   {
+      base = &b->tuples[i * NUMBER_OF_ROWS];
+
+      for (int j = 0; j < NUMBER_OF_ROWS; j++)
+      {
+         t = &base[sorted ? j : b->order[j]];
+         t->next = j + 1 < NUMBER_OF_ROWS ? &base[sorted ? j + 1 : b->order[j + 1]] : NULL;
+      }
+
+      b->queries[i] = malloc(sizeof(struct query));
+      memcpy(b->queries[i]->tag, "bench", 6);
+      b->queries[i]->number_of_columns = 2;
+      b->queries[i]->tuples = &base[sorted ? 0 : b->order[0]];
+   }
+
+   result = pgexporter_merge_all_queries(&b->queries[0], NUMBER_OF_QUERIES, sort);
+
+   for (t = result->tuples; t != NULL; t = t->next)
+   {
+      n++;
+   }
+
+   if (n != NUMBER_OF_QUERIES * NUMBER_OF_ROWS)
+   {
+      abort();
+   }
+
+   /* The tuples belong to the benchmark */
+   result->tuples = NULL;
+   free(result);
+}
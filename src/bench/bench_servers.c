@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUMBER_OF_PASSES 8
+
+/**
+ * The layout of a server before its connection state was split out,
+ * where the state sits between the strings of the server
+ */
+struct server_before
+{
+   char name[MISC_LENGTH];             /**< The name of the server */
+   char host[MISC_LENGTH];             /**< The host name of the server */
+   int port;                           /**< The port of the server */
+   char username[MAX_USERNAME_LENGTH]; /**< The user name */
+   char data[MISC_LENGTH];             /**< The data directory */
+   char wal[MISC_LENGTH];              /**< The WAL directory */
+   SSL* ssl;                           /**< The SSL structure */
+   int fd;                             /**< The socket descriptor */
+   bool new;                           /**< Is the connection new */
+   int backend_pid;                    /**< The process id of the backend */
+   int backend_secret;                 /**< The secret key of the backend */
+   bool extension;                     /**< Is the pgexporter_ext extension installed */
+   int state;                          /**< The state of the server */
+   int version;                        /**< The major version of the server*/
+   int minor_version;                  /**< The minor version of the server*/
+   char tls_cert_file[MISC_LENGTH];    /**< TLS certificate path */
+   char tls_key_file[MISC_LENGTH];     /**< TLS key path */
+   char tls_ca_file[MISC_LENGTH];      /**< TLS CA certificate path */
+   struct plan plan;                   /**< The scrape plan */
+   struct catalogue catalogue;         /**< The extension function catalogue */
+} __attribute__ ((aligned (64)));
+
+struct servers_bench
+{
+   int n;                          /**< The number of servers */
+   struct server_before* before;   /**< The servers in the layout before */
+   struct server_state* states;    /**< The states of the servers */
+};
+
+static void servers_count(int n);
+static void servers_before(void* arg);
+static void servers_states(void* arg);
+
+void
+pgexporter_bench_servers(void)
+{
+   /* A server in the layout before takes more than 13 kB, so 4096 of them do not fit in most caches */
+   servers_count(64);
+   servers_count(4096);
+}
+
+/**
+ * Run the collector loops on a number of servers in both layouts
+ * @param n The number of servers
+ */
+static void
+servers_count(int n)
+{
+   char name[MISC_LENGTH];
+   struct servers_bench b;
+
+   b.n = n;
+   b.before = aligned_alloc(64, n * sizeof(struct server_before));
+   b.states = aligned_alloc(64, n * sizeof(struct server_state));
+
+   memset(b.before, 0, n * sizeof(struct server_before));
+   memset(b.states, 0, n * sizeof(struct server_state));
+
+   /* Some servers are down, and half of them have the extension */
+   for (int i = 0; i < n; i++)
+   {
+      b.before[i].fd = i % 7 != 0 ? i : -1;
+      b.before[i].state = SERVER_PRIMARY;
+      b.before[i].version = 17;
+      b.before[i].extension = i % 2 == 0;
+
+      b.states[i].fd = b.before[i].fd;
+      b.states[i].state = b.before[i].state;
+      b.states[i].version = b.before[i].version;
+      b.states[i].extension = b.before[i].extension;
+   }
+
+   snprintf(name, sizeof(name), "servers_before_%d", n);
+   pgexporter_bench_run(name, servers_before, &b, (size_t)NUMBER_OF_PASSES * n, 0);
+   snprintf(name, sizeof(name), "servers_states_%d", n);
+   pgexporter_bench_run(name, servers_states, &b, (size_t)NUMBER_OF_PASSES * n, 0);
+
+   free(b.before);
+   free(b.states);
+}
+
+/**
+ * The passes of the collectors of a scrape over the servers in the layout before
+ * @param arg The benchmark
+ */
+static void
+servers_before(void* arg)
+{
+   int active = 0;
+   struct servers_bench* b = (struct servers_bench*)arg;
+
+   for (int pass = 0; pass < NUMBER_OF_PASSES; pass++)
+   {
+      for (int i = 0; i < b->n; i++)
+      {
+         if (b->before[i].fd != -1 && b->before[i].state == SERVER_PRIMARY &&
+             (pass % 2 == 0 || (b->before[i].extension && b->before[i].version >= 13)))
+         {
+            active++;
+         }
+      }
+   }
+
+   if (active == 0)
+   {
+      abort();
+   }
+}
+
+/**
+ * The passes of the collectors of a scrape over the states of the servers
+ * @param arg The benchmark
+ */
+static void
+servers_states(void* arg)
+{
+   int active = 0;
+   struct servers_bench* b = (struct servers_bench*)arg;
+
+   for (int pass = 0; pass < NUMBER_OF_PASSES; pass++)
+   {
+      for (int i = 0; i < b->n; i++)
+      {
+         if (b->states[i].fd != -1 && b->states[i].state == SERVER_PRIMARY &&
+             (pass % 2 == 0 || (b->states[i].extension && b->states[i].version >= 13)))
+         {
+            active++;
+         }
+      }
+   }
+
+   if (active == 0)
+   {
+      abort();
+   }
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <value.h>
+
+/* bench */
+#include "bench.h"
+
+/* system */
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NUMBER_OF_VALUES 10000
+
+struct value_bench
+{
+   char** strings;         /**< The strings */
+   struct value** values;  /**< The values to convert */
+   int n;                  /**< The number of values */
+};
+
+static void value_create_string(void* arg);
+static void value_create_int64(void* arg);
+static void value_to_string(void* arg);
+
+void
+pgexporter_bench_value(void)
+{
+   struct value_bench b;
+
+   b.n = NUMBER_OF_VALUES;
+   b.strings = calloc(b.n, sizeof(char*));
+   b.values = calloc(b.n, sizeof(struct value*));
+
+   for (int i = 0; i < b.n; i++)
+   {
+      b.strings[i] = pgexporter_bench_metric_key(i);
+   }
+
+   pgexporter_bench_run("value_create_string", value_create_string, &b, b.n, 0);
+   pgexporter_bench_run("value_create_int64", value_create_int64, &b, b.n, 0);
+
+   /* The values of a document are strings, integers and doubles */
+   for (int i = 0; i < b.n; i++)
+   {
+      if (i % 3 == 0)
+      {
+         pgexporter_value_create(ValueString, (uintptr_t)b.strings[i], &b.values[i]);
+      }
+      else if (i % 3 == 1)
+      {
+         pgexporter_value_create(ValueInt64, (uintptr_t)i * 7919, &b.values[i]);
+      }
+      else
+      {
+         pgexporter_value_create(ValueDouble, pgexporter_value_from_double(i / 7.0), &b.values[i]);
+      }
+   }
+
+   pgexporter_bench_run("value_to_string_text", value_to_string, &b, b.n, 0);
+
+   for (int i = 0; i < b.n; i++)
+   {
+      pgexporter_value_destroy(b.values[i]);
+      free(b.strings[i]);
+   }
+   free(b.values);
+   free(b.strings);
+}
+
+/**
+ * Create a copy of every string as a value, and destroy it
+ * @param arg The benchmark
+ */
+static void
+value_create_string(void* arg)
+{
+   struct value* value = NULL;
+   struct value_bench* b = (struct value_bench*)arg;
+
+   for (int i = 0; i < b->n; i++)
+   {
+      pgexporter_value_create(ValueString, (uintptr_t)b->strings[i], &value);
+      pgexporter_value_destroy(value);
+   }
+}
+
+/**
+ * Create an integer value, and destroy it
+ * @param arg The benchmark
+ */
+static void
+value_create_int64(void* arg)
+{
+   struct value* value = NULL;
+   struct value_bench* b = (struct value_bench*)arg;
+
+   for (int i = 0; i < b->n; i++)
+   {
+      pgexporter_value_create(ValueInt64, (uintptr_t)i, &value);
+      pgexporter_value_destroy(value);
+   }
+}
+
+/**
+ * Convert every value to text
+ * @param arg The benchmark
+ */
+static void
+value_to_string(void* arg)
+{
+   char* s = NULL;
+   struct value_bench* b = (struct value_bench*)arg;
+
+   for (int i = 0; i < b->n; i++)
+   {
+      s = pgexporter_value_to_string(b->values[i], FORMAT_TEXT, NULL, 0);
+      if (s == NULL)
+      {
+         abort();
+      }
+      free(s);
+   }
+}
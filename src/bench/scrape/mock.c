@@ -0,0 +1,1540 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <art.h>
+#include <internal.h>
+#include <utils.h>
+
+/* bench */
+#include "mock.h"
+
+/* system */
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <yaml.h>
+
+#define MOCK_VERSION          "17.2"
+#define MOCK_SETTINGS         5
+#define MOCK_SSL_REQUEST      80877103
+#define MOCK_CANCEL_REQUEST   80877102
+#define MOCK_MAX_MESSAGE      (1024 * 1024)
+#define MOCK_MAX_DEPTH        32
+#define MOCK_ITERATIONS       4096
+#define MOCK_SALT_LENGTH      16
+#define MOCK_NONCE_LENGTH     18
+
+#define MOCK_LABEL            0
+#define MOCK_GAUGE            1
+#define MOCK_HISTOGRAM        2
+
+struct answer
+{
+   char* data;      /**< The messages of the answer */
+   size_t length;   /**< The length of the messages */
+};
+
+struct mock
+{
+   int number_of_servers;                     /**< The number of servers */
+   int* fds;                                  /**< The listening sockets */
+   int* ports;                                /**< The ports */
+   int rows;                                  /**< The number of rows of a result with labels */
+   int latency;                               /**< The latency of a query in milliseconds */
+   int authentication;                        /**< The authentication method */
+   char* password;                            /**< The password */
+   unsigned char stored_key[EVP_MAX_MD_SIZE]; /**< The SCRAM-SHA-256 StoredKey */
+   unsigned char server_key[EVP_MAX_MD_SIZE]; /**< The SCRAM-SHA-256 ServerKey */
+   char* salt;                                /**< The SCRAM-SHA-256 salt in base64 */
+   struct art* queries;                       /**< The index of the answer of each query */
+   struct answer* answers;                    /**< The answers of the queries */
+   int number_of_answers;                     /**< The number of answers */
+   atomic_bool running;                       /**< Is the mock running */
+   pthread_t acceptor;                        /**< The thread accepting connections */
+};
+
+struct buffer
+{
+   char* data;      /**< The data */
+   size_t length;   /**< The length of the data */
+   size_t size;     /**< The size of the allocation */
+};
+
+struct connection
+{
+   struct mock* mock;   /**< The mock */
+   int fd;              /**< The socket */
+};
+
+struct mock_column
+{
+   char* name;   /**< The name of the column, or NULL */
+   int type;     /**< The type of the column */
+};
+
+struct mock_query
+{
+   char* sql;                                          /**< The query */
+   int number_of_columns;                              /**< The number of columns */
+   struct mock_column columns[MAX_NUMBER_OF_COLUMNS];  /**< The columns */
+};
+
+struct frame
+{
+   bool mapping;               /**< Is the frame a mapping, otherwise a sequence */
+   bool value;                 /**< Is the next scalar of the mapping a value */
+   char parent[MISC_LENGTH];   /**< The key of the frame in its mapping */
+   char key[MISC_LENGTH];      /**< The current key of the mapping */
+};
+
+static void* accept_connections(void* arg);
+static void* serve_connection(void* arg);
+static int authenticate(struct mock* mock, int fd, char* user, struct buffer* out);
+static int authenticate_md5(struct mock* mock, int fd, char* user, struct buffer* out);
+static int authenticate_scram(struct mock* mock, int fd, struct buffer* out);
+static int scram_keys(struct mock* mock);
+static int read_message(int fd, char* kind, char** body, int32_t* length);
+static int read_fully(int fd, void* data, size_t length);
+static int write_fully(int fd, void* data, size_t length);
+static int answer(struct mock* mock, char* sql, struct buffer* out);
+
+static int load_queries(struct mock* mock, char* yaml_path);
+static int load_file(struct mock* mock, FILE* file);
+static void finish_query(struct mock* mock, struct mock_query* query);
+static void clear_query(struct mock_query* query);
+static char* normalize(char* sql);
+
+static void reserve(struct buffer* buffer, size_t length);
+static void append(struct buffer* buffer, void* data, size_t length);
+static void append_int16(struct buffer* buffer, int16_t i);
+static void append_int32(struct buffer* buffer, int32_t i);
+static void append_string(struct buffer* buffer, char* s);
+static size_t begin_message(struct buffer* buffer, char kind);
+static void end_message(struct buffer* buffer, size_t start);
+static void row_description(struct buffer* buffer, int columns, char** names);
+static void data_row(struct buffer* buffer, int columns, char** values);
+static void command_complete(struct buffer* buffer, char* tag);
+static void result(struct buffer* buffer, int columns, char** names, int rows, char** values);
+static void error(struct buffer* buffer, char* code, char* message);
+
+int
+pgexporter_mock_start(struct mock_options* options, struct mock** mock)
+{
+   struct mock* m = NULL;
+   struct sockaddr_in address;
+   socklen_t length;
+   int enable = 1;
+
+   *mock = NULL;
+
+   m = calloc(1, sizeof(struct mock));
+   if (m == NULL)
+   {
+      goto error;
+   }
+
+   m->fds = calloc(options->servers, sizeof(int));
+   m->ports = calloc(options->servers, sizeof(int));
+   if (m->fds == NULL || m->ports == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < options->servers; i++)
+   {
+      m->fds[i] = -1;
+   }
+   m->number_of_servers = options->servers;
+   m->rows = options->rows;
+   m->latency = options->latency;
+   m->authentication = options->authentication;
+
+   if (m->authentication != MOCK_AUTH_TRUST)
+   {
+      if (options->password == NULL)
+      {
+         goto error;
+      }
+
+      m->password = strdup(options->password);
+      if (m->password == NULL)
+      {
+         goto error;
+      }
+   }
+
+   /* The keys only depend on the password, so the iterations are done once */
+   if (m->authentication == MOCK_AUTH_SCRAM && scram_keys(m))
+   {
+      goto error;
+   }
+
+   if (pgexporter_art_create(&m->queries) || load_queries(m, options->yaml_path))
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < m->number_of_servers; i++)
+   {
+      m->fds[i] = socket(AF_INET, SOCK_STREAM, 0);
+      if (m->fds[i] == -1)
+      {
+         goto error;
+      }
+
+      setsockopt(m->fds[i], SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+      memset(&address, 0, sizeof(address));
+      address.sin_family = AF_INET;
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      address.sin_port = 0;
+
+      if (bind(m->fds[i], (struct sockaddr*)&address, sizeof(address)) || listen(m->fds[i], 128))
+      {
+         goto error;
+      }
+
+      length = sizeof(address);
+      if (getsockname(m->fds[i], (struct sockaddr*)&address, &length))
+      {
+         goto error;
+      }
+      m->ports[i] = ntohs(address.sin_port);
+   }
+
+   atomic_store(&m->running, true);
+   if (pthread_create(&m->acceptor, NULL, accept_connections, m))
+   {
+      atomic_store(&m->running, false);
+      goto error;
+   }
+
+   *mock = m;
+
+   return 0;
+
+error:
+
+   if (m != NULL)
+   {
+      for (int i = 0; m->fds != NULL && i < m->number_of_servers; i++)
+      {
+         if (m->fds[i] != -1)
+         {
+            close(m->fds[i]);
+         }
+      }
+      for (int i = 0; i < m->number_of_answers; i++)
+      {
+         free(m->answers[i].data);
+      }
+      pgexporter_art_destroy(m->queries);
+      free(m->answers);
+      free(m->password);
+      free(m->salt);
+      free(m->fds);
+      free(m->ports);
+      free(m);
+   }
+
+   return 1;
+}
+
+int
+pgexporter_mock_port(struct mock* mock, int server)
+{
+   return mock->ports[server];
+}
+
+void
+pgexporter_mock_stop(struct mock* mock)
+{
+   if (mock == NULL)
+   {
+      return;
+   }
+
+   atomic_store(&mock->running, false);
+   pthread_join(mock->acceptor, NULL);
+
+   for (int i = 0; i < mock->number_of_servers; i++)
+   {
+      close(mock->fds[i]);
+   }
+
+   /* The connections are gone with pgexporter, but a late one may still use the answers */
+   free(mock->fds);
+   free(mock->ports);
+}
+
+static void*
+accept_connections(void* arg)
+{
+   struct mock* mock = (struct mock*)arg;
+   struct pollfd* fds = NULL;
+   struct connection* connection = NULL;
+   pthread_t thread;
+   int fd;
+
+   fds = calloc(mock->number_of_servers, sizeof(struct pollfd));
+   if (fds == NULL)
+   {
+      return NULL;
+   }
+
+   for (int i = 0; i < mock->number_of_servers; i++)
+   {
+      fds[i].fd = mock->fds[i];
+      fds[i].events = POLLIN;
+   }
+
+   while (atomic_load(&mock->running))
+   {
+      if (poll(fds, mock->number_of_servers, 100) <= 0)
+      {
+         continue;
+      }
+
+      for (int i = 0; i < mock->number_of_servers; i++)
+      {
+         if (!(fds[i].revents & POLLIN))
+         {
+            continue;
+         }
+
+         fd = accept(fds[i].fd, NULL, NULL);
+         if (fd == -1)
+         {
+            continue;
+         }
+
+         connection = malloc(sizeof(struct connection));
+         if (connection == NULL)
+         {
+            close(fd);
+            continue;
+         }
+         connection->mock = mock;
+         connection->fd = fd;
+
+         if (pthread_create(&thread, NULL, serve_connection, connection))
+         {
+            close(fd);
+            free(connection);
+            continue;
+         }
+         pthread_detach(thread);
+      }
+   }
+
+   free(fds);
+
+   return NULL;
+}
+
+static void*
+serve_connection(void* arg)
+{
+   struct connection* connection = (struct connection*)arg;
+   struct mock* mock = connection->mock;
+   struct buffer out = {0};
+   struct timespec latency;
+   char header[4];
+   char user[MISC_LENGTH];
+   char kind;
+   char* body = NULL;
+   char* sql = NULL;
+   char* end = NULL;
+   char* parameter = NULL;
+   size_t start;
+   int32_t length;
+   int32_t code;
+   int fd = connection->fd;
+
+   free(connection);
+
+   latency.tv_sec = mock->latency / 1000;
+   latency.tv_nsec = (mock->latency % 1000) * 1000000L;
+
+   /* The startup packet, which may follow a SSL request */
+   while (true)
+   {
+      if (read_fully(fd, header, 4))
+      {
+         goto done;
+      }
+
+      length = pgexporter_read_int32(header);
+      if (length < 8 || length > MOCK_MAX_MESSAGE)
+      {
+         goto done;
+      }
+
+      body = calloc(1, length - 4 + 1);
+      if (body == NULL || read_fully(fd, body, length - 4))
+      {
+         goto done;
+      }
+
+      code = pgexporter_read_int32(body);
+      if (code == MOCK_SSL_REQUEST)
+      {
+         free(body);
+         body = NULL;
+
+         if (write_fully(fd, "N", 1))
+         {
+            goto done;
+         }
+         continue;
+      }
+      else if (code == MOCK_CANCEL_REQUEST)
+      {
+         goto done;
+      }
+
+      break;
+   }
+
+   /* The parameters are pairs of strings after the protocol version */
+   memset(user, 0, sizeof(user));
+   parameter = body + 4;
+   while (parameter < body + length - 4 && *parameter != '\0')
+   {
+      if (!strcmp(parameter, "user"))
+      {
+         snprintf(user, sizeof(user), "%s", parameter + strlen(parameter) + 1);
+      }
+      parameter += strlen(parameter) + 1;
+      parameter += strlen(parameter) + 1;
+   }
+
+   free(body);
+   body = NULL;
+
+   if (authenticate(mock, fd, user, &out))
+   {
+      goto done;
+   }
+
+   start = begin_message(&out, 'S');
+   append_string(&out, "server_version");
+   append_string(&out, MOCK_VERSION);
+   end_message(&out, start);
+
+   start = begin_message(&out, 'K');
+   append_int32(&out, fd);
+   append_int32(&out, 4242);
+   end_message(&out, start);
+
+   start = begin_message(&out, 'Z');
+   append(&out, "I", 1);
+   end_message(&out, start);
+
+   if (write_fully(fd, out.data, out.length))
+   {
+      goto done;
+   }
+
+   while (true)
+   {
+      if (read_message(fd, &kind, &body, &length))
+      {
+         goto done;
+      }
+
+      if (kind == 'X')
+      {
+         goto done;
+      }
+
+      out.length = 0;
+
+      if (kind == 'Q')
+      {
+         if (mock->latency > 0)
+         {
+            nanosleep(&latency, NULL);
+         }
+
+         /* Each statement of a query is answered until one fails */
+         sql = body;
+         while (sql != NULL && *sql != '\0')
+         {
+            end = strchr(sql, ';');
+            if (end != NULL)
+            {
+               *end = '\0';
+            }
+
+            while (isspace((unsigned char)*sql))
+            {
+               sql++;
+            }
+
+            if (*sql != '\0' && answer(mock, sql, &out))
+            {
+               break;
+            }
+
+            sql = end != NULL ? end + 1 : NULL;
+         }
+      }
+      else
+      {
+         error(&out, "0A000", "unsupported by mock");
+      }
+
+      start = begin_message(&out, 'Z');
+      append(&out, "I", 1);
+      end_message(&out, start);
+
+      free(body);
+      body = NULL;
+
+      if (write_fully(fd, out.data, out.length))
+      {
+         goto done;
+      }
+   }
+
+done:
+
+   free(body);
+   free(out.data);
+   close(fd);
+
+   return NULL;
+}
+
+static int
+authenticate(struct mock* mock, int fd, char* user, struct buffer* out)
+{
+   size_t start;
+   int status = 0;
+
+   if (mock->authentication == MOCK_AUTH_MD5)
+   {
+      status = authenticate_md5(mock, fd, user, out);
+   }
+   else if (mock->authentication == MOCK_AUTH_SCRAM)
+   {
+      status = authenticate_scram(mock, fd, out);
+   }
+
+   if (status)
+   {
+      out->length = 0;
+      error(out, "28P01", "password authentication failed");
+      write_fully(fd, out->data, out->length);
+
+      return 1;
+   }
+
+   /*
+    * The AuthenticationOk is sent with the rest of the startup, as pgexporter
+    * reads the parameters of the server from the last message of the authentication
+    */
+   start = begin_message(out, 'R');
+   append_int32(out, 0);
+   end_message(out, start);
+
+   return 0;
+}
+
+static int
+authenticate_md5(struct mock* mock, int fd, char* user, struct buffer* out)
+{
+   unsigned char salt[4];
+   unsigned char digest[EVP_MAX_MD_SIZE];
+   unsigned int digest_length;
+   char shadow[36];
+   char expected[36];
+   char kind;
+   char* body = NULL;
+   char* pwdusr = NULL;
+   size_t start;
+   int32_t length;
+
+   if (RAND_bytes(salt, sizeof(salt)) != 1)
+   {
+      goto error;
+   }
+
+   start = begin_message(out, 'R');
+   append_int32(out, 5);
+   append(out, salt, sizeof(salt));
+   end_message(out, start);
+
+   if (write_fully(fd, out->data, out->length) || read_message(fd, &kind, &body, &length) || kind != 'p')
+   {
+      goto error;
+   }
+
+   /* md5(md5(password || user) || salt) in hex, after md5 */
+   pwdusr = pgexporter_vappend(NULL, 2, mock->password, user);
+   if (pwdusr == NULL || EVP_Digest(pwdusr, strlen(pwdusr), digest, &digest_length, EVP_md5(), NULL) != 1)
+   {
+      goto error;
+   }
+
+   for (unsigned int i = 0; i < digest_length; i++)
+   {
+      sprintf(&shadow[i * 2], "%02x", digest[i]);
+   }
+   memcpy(&shadow[32], salt, sizeof(salt));
+
+   if (EVP_Digest(shadow, sizeof(shadow), digest, &digest_length, EVP_md5(), NULL) != 1)
+   {
+      goto error;
+   }
+
+   memcpy(expected, "md5", 3);
+   for (unsigned int i = 0; i < digest_length; i++)
+   {
+      sprintf(&expected[3 + i * 2], "%02x", digest[i]);
+   }
+
+   if (strcmp(body, expected))
+   {
+      goto error;
+   }
+
+   out->length = 0;
+
+   free(pwdusr);
+   free(body);
+
+   return 0;
+
+error:
+
+   free(pwdusr);
+   free(body);
+
+   return 1;
+}
+
+static int
+authenticate_scram(struct mock* mock, int fd, struct buffer* out)
+{
+   unsigned char random[MOCK_NONCE_LENGTH];
+   unsigned char signature[EVP_MAX_MD_SIZE];
+   unsigned char client_key[EVP_MAX_MD_SIZE];
+   unsigned char stored_key[EVP_MAX_MD_SIZE];
+   unsigned int signature_length;
+   unsigned int stored_key_length;
+   char kind;
+   char* body = NULL;
+   char* first = NULL;
+   char* first_bare = NULL;
+   char* client_nonce = NULL;
+   char* server_nonce = NULL;
+   char* server_first = NULL;
+   char* final = NULL;
+   char* proof_base64 = NULL;
+   char* auth_message = NULL;
+   char* server_signature = NULL;
+   char* end = NULL;
+   unsigned char* proof = NULL;
+   size_t proof_length;
+   size_t server_nonce_length;
+   size_t server_signature_length;
+   size_t start;
+   int32_t length;
+
+   start = begin_message(out, 'R');
+   append_int32(out, 10);
+   append_string(out, "SCRAM-SHA-256");
+   append(out, "", 1);
+   end_message(out, start);
+
+   if (write_fully(fd, out->data, out->length) || read_message(fd, &kind, &body, &length) || kind != 'p')
+   {
+      goto error;
+   }
+
+   /* SCRAM-SHA-256, the length of the message, and n,,n=,r=<nonce> */
+   if (strcmp(body, "SCRAM-SHA-256") || length < 14 + 4 + 3)
+   {
+      goto error;
+   }
+
+   first = body + 14 + 4;
+   first_bare = strstr(first, "n=");
+   client_nonce = strstr(first, ",r=");
+   if (strncmp(first, "n,,", 3) || first_bare == NULL || client_nonce == NULL)
+   {
+      goto error;
+   }
+   first_bare = strdup(first_bare);
+   client_nonce += 3;
+
+   if (first_bare == NULL || RAND_bytes(random, sizeof(random)) != 1 ||
+       pgexporter_base64_encode(random, sizeof(random), &server_nonce, &server_nonce_length))
+   {
+      goto error;
+   }
+
+   server_first = pgexporter_vappend(NULL, 6, "r=", client_nonce, server_nonce, ",s=", mock->salt, ",i=4096");
+   if (server_first == NULL)
+   {
+      goto error;
+   }
+
+   out->length = 0;
+   start = begin_message(out, 'R');
+   append_int32(out, 11);
+   append(out, server_first, strlen(server_first));
+   end_message(out, start);
+
+   free(body);
+   body = NULL;
+
+   if (write_fully(fd, out->data, out->length) || read_message(fd, &kind, &body, &length) || kind != 'p')
+   {
+      goto error;
+   }
+
+   /* c=biws,r=<nonce>,p=<proof> */
+   end = strstr(body, ",p=");
+   if (end == NULL)
+   {
+      goto error;
+   }
+   proof_base64 = end + 3;
+   *end = '\0';
+   final = body;
+
+   if (pgexporter_base64_decode(proof_base64, strlen(proof_base64), (void**)&proof, &proof_length) ||
+       proof_length != SHA256_DIGEST_LENGTH)
+   {
+      goto error;
+   }
+
+   auth_message = pgexporter_vappend(NULL, 5, first_bare, ",", server_first, ",", final);
+   if (auth_message == NULL ||
+       HMAC(EVP_sha256(), mock->stored_key, SHA256_DIGEST_LENGTH,
+            (unsigned char*)auth_message, strlen(auth_message), signature, &signature_length) == NULL)
+   {
+      goto error;
+   }
+
+   /* The proof is the ClientKey masked by the ClientSignature */
+   for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+   {
+      client_key[i] = proof[i] ^ signature[i];
+   }
+
+   if (EVP_Digest(client_key, SHA256_DIGEST_LENGTH, stored_key, &stored_key_length, EVP_sha256(), NULL) != 1 ||
+       memcmp(stored_key, mock->stored_key, SHA256_DIGEST_LENGTH))
+   {
+      goto error;
+   }
+
+   if (HMAC(EVP_sha256(), mock->server_key, SHA256_DIGEST_LENGTH,
+            (unsigned char*)auth_message, strlen(auth_message), signature, &signature_length) == NULL ||
+       pgexporter_base64_encode(signature, signature_length, &server_signature, &server_signature_length))
+   {
+      goto error;
+   }
+
+   out->length = 0;
+   start = begin_message(out, 'R');
+   append_int32(out, 12);
+   append(out, "v=", 2);
+   append(out, server_signature, strlen(server_signature));
+   end_message(out, start);
+
+   free(body);
+   free(first_bare);
+   free(server_nonce);
+   free(server_first);
+   free(proof);
+   free(auth_message);
+   free(server_signature);
+
+   return 0;
+
+error:
+
+   free(body);
+   free(first_bare);
+   free(server_nonce);
+   free(server_first);
+   free(proof);
+   free(auth_message);
+   free(server_signature);
+
+   return 1;
+}
+
+static int
+scram_keys(struct mock* mock)
+{
+   unsigned char salt[MOCK_SALT_LENGTH];
+   unsigned char salted_password[SHA256_DIGEST_LENGTH];
+   unsigned char client_key[EVP_MAX_MD_SIZE];
+   unsigned int length;
+   size_t salt_length;
+
+   if (RAND_bytes(salt, sizeof(salt)) != 1 ||
+       pgexporter_base64_encode(salt, sizeof(salt), &mock->salt, &salt_length))
+   {
+      return 1;
+   }
+
+   if (PKCS5_PBKDF2_HMAC(mock->password, strlen(mock->password), salt, sizeof(salt), MOCK_ITERATIONS,
+                         EVP_sha256(), sizeof(salted_password), salted_password) != 1)
+   {
+      return 1;
+   }
+
+   if (HMAC(EVP_sha256(), salted_password, sizeof(salted_password),
+            (unsigned char*)"Client Key", 10, client_key, &length) == NULL ||
+       EVP_Digest(client_key, length, mock->stored_key, &length, EVP_sha256(), NULL) != 1 ||
+       HMAC(EVP_sha256(), salted_password, sizeof(salted_password),
+            (unsigned char*)"Server Key", 10, mock->server_key, &length) == NULL)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+answer(struct mock* mock, char* sql, struct buffer* out)
+{
+   char* recovery[] = {"pg_is_in_recovery"};
+   char* version[] = {"major", "minor"};
+   char* load[] = {"pg_conf_load_time", "pg_postmaster_start_time"};
+   char* start[] = {"floor"};
+   char* primary[] = {"case"};
+   char* settings[] = {"name", "setting", "short_desc"};
+   char* one[] = {"?column?"};
+   char* values[MOCK_SETTINGS * 3];
+   char names[MOCK_SETTINGS][MISC_LENGTH];
+   char settings_values[MOCK_SETTINGS][MISC_LENGTH];
+   char* key = NULL;
+   uintptr_t index = 0;
+
+   /* The queries of the metrics first, as the queries below match on a part of the query */
+   key = normalize(sql);
+   if (key != NULL)
+   {
+      index = pgexporter_art_search(mock->queries, key);
+      free(key);
+   }
+
+   if (index > 0)
+   {
+      append(out, mock->answers[index - 1].data, mock->answers[index - 1].length);
+   }
+   else if (strstr(sql, "SELECT * FROM pg_is_in_recovery()") != NULL)
+   {
+      values[0] = "f";
+      result(out, 1, recovery, 1, values);
+   }
+   else if (strstr(sql, "split_part(version()") != NULL)
+   {
+      values[0] = "17";
+      values[1] = "2";
+      result(out, 2, version, 1, values);
+   }
+   else if (strstr(sql, "pg_conf_load_time") != NULL)
+   {
+      values[0] = "2025-01-01 00:00:00";
+      values[1] = "2025-01-01 00:00:00";
+      result(out, 2, load, 1, values);
+   }
+   else if (strstr(sql, "pg_postmaster_start_time") != NULL)
+   {
+      values[0] = "1735689600";
+      result(out, 1, start, 1, values);
+   }
+   else if (strstr(sql, "pg_is_in_recovery() WHEN") != NULL)
+   {
+      values[0] = "t";
+      result(out, 1, primary, 1, values);
+   }
+   else if (strstr(sql, "FROM pg_settings") != NULL)
+   {
+      for (int i = 0; i < MOCK_SETTINGS; i++)
+      {
+         snprintf(names[i], MISC_LENGTH, "setting_%03d", i);
+         snprintf(settings_values[i], MISC_LENGTH, "%d", i);
+         values[i * 3] = names[i];
+         values[i * 3 + 1] = settings_values[i];
+         values[i * 3 + 2] = "A setting";
+      }
+      result(out, 3, settings, MOCK_SETTINGS, values);
+   }
+   else if (!strcmp(sql, "SELECT 1"))
+   {
+      values[0] = "1";
+      result(out, 1, one, 1, values);
+   }
+   else if (!strncmp(sql, "SET", 3))
+   {
+      command_complete(out, "SET");
+   }
+   else
+   {
+      /* Like a server without the pgexporter_ext extension */
+      error(out, "42883", "unsupported by mock");
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+load_queries(struct mock* mock, char* yaml_path)
+{
+   char path[MAX_PATH];
+   struct stat st;
+   struct dirent* entry = NULL;
+   DIR* dir = NULL;
+   FILE* file = NULL;
+   char* extension = NULL;
+
+   /* The internal metrics are always there */
+   file = fmemopen(INTERNAL_YAML, strlen(INTERNAL_YAML), "r");
+   if (file == NULL || load_file(mock, file))
+   {
+      goto error;
+   }
+   fclose(file);
+   file = NULL;
+
+   if (yaml_path == NULL)
+   {
+      return 0;
+   }
+
+   if (stat(yaml_path, &st))
+   {
+      goto error;
+   }
+
+   if (!S_ISDIR(st.st_mode))
+   {
+      file = fopen(yaml_path, "r");
+      if (file == NULL || load_file(mock, file))
+      {
+         goto error;
+      }
+      fclose(file);
+
+      return 0;
+   }
+
+   dir = opendir(yaml_path);
+   if (dir == NULL)
+   {
+      goto error;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      extension = strrchr(entry->d_name, '.');
+      if (extension == NULL || (strcmp(extension, ".yaml") && strcmp(extension, ".yml")))
+      {
+         continue;
+      }
+
+      snprintf(path, sizeof(path), "%s/%s", yaml_path, entry->d_name);
+      file = fopen(path, "r");
+      if (file == NULL || load_file(mock, file))
+      {
+         goto error;
+      }
+      fclose(file);
+      file = NULL;
+   }
+
+   closedir(dir);
+
+   return 0;
+
+error:
+
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   return 1;
+}
+
+static int
+load_file(struct mock* mock, FILE* file)
+{
+   yaml_parser_t parser;
+   yaml_event_t event;
+   struct frame frames[MOCK_MAX_DEPTH];
+   struct frame* top = NULL;
+   struct mock_query query;
+   struct mock_column* column = NULL;
+   char* scalar = NULL;
+   char* key = NULL;
+   int depth = 0;
+   bool done = false;
+
+   memset(&query, 0, sizeof(query));
+
+   if (!yaml_parser_initialize(&parser))
+   {
+      return 1;
+   }
+   yaml_parser_set_input_file(&parser, file);
+
+   /*
+    * The queries are the mappings in the sequences of a queries key, and
+    * their columns the mappings in the sequences of a columns key
+    */
+   while (!done)
+   {
+      if (!yaml_parser_parse(&parser, &event))
+      {
+         goto error;
+      }
+
+      top = depth > 0 ? &frames[depth - 1] : NULL;
+
+      switch (event.type)
+      {
+         case YAML_MAPPING_START_EVENT:
+         case YAML_SEQUENCE_START_EVENT:
+            if (depth == MOCK_MAX_DEPTH)
+            {
+               yaml_event_delete(&event);
+               goto error;
+            }
+
+            key = top == NULL ? "" : top->mapping ? top->key : top->parent;
+            frames[depth].mapping = event.type == YAML_MAPPING_START_EVENT;
+            frames[depth].value = false;
+            snprintf(frames[depth].parent, MISC_LENGTH, "%s", key);
+            frames[depth].key[0] = '\0';
+
+            if (top != NULL && top->mapping)
+            {
+               top->value = false;
+            }
+
+            if (frames[depth].mapping && top != NULL && !top->mapping)
+            {
+               if (!strcmp(key, "queries"))
+               {
+                  clear_query(&query);
+                  column = NULL;
+               }
+               else if (!strcmp(key, "columns") && query.number_of_columns < MAX_NUMBER_OF_COLUMNS)
+               {
+                  column = &query.columns[query.number_of_columns++];
+                  column->type = MOCK_GAUGE;
+               }
+               else
+               {
+                  column = NULL;
+               }
+            }
+
+            depth++;
+            break;
+         case YAML_MAPPING_END_EVENT:
+         case YAML_SEQUENCE_END_EVENT:
+            if (top == NULL)
+            {
+               yaml_event_delete(&event);
+               goto error;
+            }
+
+            if (top->mapping && !strcmp(top->parent, "queries"))
+            {
+               finish_query(mock, &query);
+               clear_query(&query);
+               column = NULL;
+            }
+
+            depth--;
+            break;
+         case YAML_SCALAR_EVENT:
+            if (top == NULL || !top->mapping)
+            {
+               break;
+            }
+
+            scalar = (char*)event.data.scalar.value;
+
+            if (!top->value)
+            {
+               snprintf(top->key, MISC_LENGTH, "%s", scalar);
+               top->value = true;
+               break;
+            }
+            top->value = false;
+
+            if (!strcmp(top->parent, "queries") && !strcmp(top->key, "query"))
+            {
+               free(query.sql);
+               query.sql = strdup(scalar);
+            }
+            else if (!strcmp(top->parent, "columns") && column != NULL)
+            {
+               if (!strcmp(top->key, "name"))
+               {
+                  free(column->name);
+                  column->name = strdup(scalar);
+               }
+               else if (!strcmp(top->key, "type"))
+               {
+                  column->type = !strcmp(scalar, "label") ? MOCK_LABEL :
+                                 !strcmp(scalar, "histogram") ? MOCK_HISTOGRAM : MOCK_GAUGE;
+               }
+            }
+            break;
+         case YAML_STREAM_END_EVENT:
+            done = true;
+            break;
+         default:
+            break;
+      }
+
+      yaml_event_delete(&event);
+   }
+
+   clear_query(&query);
+   yaml_parser_delete(&parser);
+
+   return 0;
+
+error:
+
+   clear_query(&query);
+   yaml_parser_delete(&parser);
+
+   return 1;
+}
+
+static void
+finish_query(struct mock* mock, struct mock_query* query)
+{
+   struct buffer out = {0};
+   struct answer* answers = NULL;
+   struct mock_column* column = NULL;
+   char* names[MAX_NUMBER_OF_COLUMNS * 4];
+   char* values[MAX_NUMBER_OF_COLUMNS * 4];
+   char histograms[MAX_NUMBER_OF_COLUMNS][4][MISC_LENGTH];
+   char label[MISC_LENGTH];
+   char number[MISC_LENGTH];
+   char tag[MISC_LENGTH];
+   char* key = NULL;
+   char* name = NULL;
+   int columns = 0;
+   int rows = 1;
+
+   if (query->sql == NULL || query->number_of_columns == 0)
+   {
+      return;
+   }
+
+   /* The first of the queries with the same text is kept, like the versions of a query */
+   key = normalize(query->sql);
+   if (key == NULL || pgexporter_art_contains_key(mock->queries, key))
+   {
+      goto done;
+   }
+
+   /* A histogram is its sum, count, bounds and buckets, and a query without labels has one row */
+   for (int i = 0; i < query->number_of_columns; i++)
+   {
+      column = &query->columns[i];
+      name = column->name != NULL ? column->name : "";
+
+      if (column->type == MOCK_HISTOGRAM)
+      {
+         snprintf(histograms[i][0], MISC_LENGTH, "%s_sum", name);
+         snprintf(histograms[i][1], MISC_LENGTH, "%s_count", name);
+         snprintf(histograms[i][2], MISC_LENGTH, "%s", name);
+         snprintf(histograms[i][3], MISC_LENGTH, "%s_bucket", name);
+
+         names[columns] = histograms[i][0];
+         values[columns++] = number;
+         names[columns] = histograms[i][1];
+         values[columns++] = "10";
+         names[columns] = histograms[i][2];
+         values[columns++] = "{1,5,10}";
+         names[columns] = histograms[i][3];
+         values[columns++] = "{2,6,9}";
+      }
+      else
+      {
+         names[columns] = column->name != NULL ? column->name : "?column?";
+         values[columns++] = column->type == MOCK_LABEL ? label : number;
+
+         if (column->type == MOCK_LABEL)
+         {
+            rows = mock->rows;
+         }
+      }
+   }
+
+   row_description(&out, columns, names);
+   for (int i = 0; i < rows; i++)
+   {
+      snprintf(label, sizeof(label), "label_%07d", i);
+      snprintf(number, sizeof(number), "%d", i);
+      data_row(&out, columns, values);
+   }
+   snprintf(tag, sizeof(tag), "SELECT %d", rows);
+   command_complete(&out, tag);
+
+   answers = realloc(mock->answers, (mock->number_of_answers + 1) * sizeof(struct answer));
+   if (answers == NULL)
+   {
+      goto done;
+   }
+   mock->answers = answers;
+
+   mock->answers[mock->number_of_answers].data = out.data;
+   mock->answers[mock->number_of_answers].length = out.length;
+   out.data = NULL;
+
+   mock->number_of_answers++;
+   pgexporter_art_insert(mock->queries, key, (uintptr_t)mock->number_of_answers, ValueInt64);
+
+done:
+
+   free(key);
+   free(out.data);
+}
+
+static void
+clear_query(struct mock_query* query)
+{
+   free(query->sql);
+   for (int i = 0; i < query->number_of_columns; i++)
+   {
+      free(query->columns[i].name);
+   }
+
+   memset(query, 0, sizeof(struct mock_query));
+}
+
+static char*
+normalize(char* sql)
+{
+   char* key = NULL;
+   size_t length = 0;
+   bool space = false;
+
+   key = malloc(strlen(sql) + 1);
+   if (key == NULL)
+   {
+      return NULL;
+   }
+
+   /* Whitespace is folded like a multi-line YAML scalar, and the ; is left out */
+   for (char* c = sql; *c != '\0'; c++)
+   {
+      if (isspace((unsigned char)*c))
+      {
+         space = length > 0;
+         continue;
+      }
+
+      if (space)
+      {
+         key[length++] = ' ';
+         space = false;
+      }
+      key[length++] = *c;
+   }
+
+   while (length > 0 && (key[length - 1] == ';' || key[length - 1] == ' '))
+   {
+      length--;
+   }
+   key[length] = '\0';
+
+   if (length == 0)
+   {
+      free(key);
+      return NULL;
+   }
+
+   return key;
+}
+
+static int
+read_message(int fd, char* kind, char** body, int32_t* length)
+{
+   char header[5];
+
+   *body = NULL;
+
+   if (read_fully(fd, header, sizeof(header)))
+   {
+      return 1;
+   }
+
+   *kind = header[0];
+   *length = pgexporter_read_int32(header + 1) - 4;
+   if (*length < 0 || *length > MOCK_MAX_MESSAGE)
+   {
+      return 1;
+   }
+
+   /* The body is terminated, so a string at its end can be read as it is */
+   *body = calloc(1, *length + 1);
+   if (*body == NULL || read_fully(fd, *body, *length))
+   {
+      free(*body);
+      *body = NULL;
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+read_fully(int fd, void* data, size_t length)
+{
+   ssize_t r;
+   size_t offset = 0;
+
+   while (offset < length)
+   {
+      r = read(fd, (char*)data + offset, length - offset);
+      if (r <= 0)
+      {
+         if (r == -1 && errno == EINTR)
+         {
+            continue;
+         }
+         return 1;
+      }
+      offset += r;
+   }
+
+   return 0;
+}
+
+static int
+write_fully(int fd, void* data, size_t length)
+{
+   ssize_t w;
+   size_t offset = 0;
+
+   while (offset < length)
+   {
+      w = send(fd, (char*)data + offset, length - offset, MSG_NOSIGNAL);
+      if (w <= 0)
+      {
+         if (w == -1 && errno == EINTR)
+         {
+            continue;
+         }
+         return 1;
+      }
+      offset += w;
+   }
+
+   return 0;
+}
+
+static void
+reserve(struct buffer* buffer, size_t length)
+{
+   size_t size;
+
+   if (buffer->length + length <= buffer->size)
+   {
+      return;
+   }
+
+   size = buffer->size > 0 ? buffer->size : 8192;
+   while (size < buffer->length + length)
+   {
+      size *= 2;
+   }
+
+   buffer->data = realloc(buffer->data, size);
+   if (buffer->data == NULL)
+   {
+      abort();
+   }
+   buffer->size = size;
+}
+
+static void
+append(struct buffer* buffer, void* data, size_t length)
+{
+   reserve(buffer, length);
+   memcpy(buffer->data + buffer->length, data, length);
+   buffer->length += length;
+}
+
+static void
+append_int16(struct buffer* buffer, int16_t i)
+{
+   uint16_t n = htons((uint16_t)i);
+
+   append(buffer, &n, sizeof(n));
+}
+
+static void
+append_int32(struct buffer* buffer, int32_t i)
+{
+   reserve(buffer, 4);
+   pgexporter_write_int32(buffer->data + buffer->length, i);
+   buffer->length += 4;
+}
+
+static void
+append_string(struct buffer* buffer, char* s)
+{
+   append(buffer, s, strlen(s) + 1);
+}
+
+static size_t
+begin_message(struct buffer* buffer, char kind)
+{
+   size_t start = buffer->length;
+
+   append(buffer, &kind, 1);
+   append_int32(buffer, 0);
+
+   return start;
+}
+
+static void
+end_message(struct buffer* buffer, size_t start)
+{
+   pgexporter_write_int32(buffer->data + start + 1, (int32_t)(buffer->length - start - 1));
+}
+
+static void
+row_description(struct buffer* buffer, int columns, char** names)
+{
+   size_t start = begin_message(buffer, 'T');
+
+   append_int16(buffer, columns);
+   for (int i = 0; i < columns; i++)
+   {
+      append_string(buffer, names[i]);
+      append_int32(buffer, 0);       /* Table */
+      append_int16(buffer, 0);       /* Column */
+      append_int32(buffer, 25);      /* text */
+      append_int16(buffer, -1);      /* Size */
+      append_int32(buffer, -1);      /* Modifier */
+      append_int16(buffer, 0);       /* Text format */
+   }
+
+   end_message(buffer, start);
+}
+
+static void
+data_row(struct buffer* buffer, int columns, char** values)
+{
+   size_t start = begin_message(buffer, 'D');
+   size_t length;
+
+   append_int16(buffer, columns);
+   for (int i = 0; i < columns; i++)
+   {
+      length = strlen(values[i]);
+      append_int32(buffer, (int32_t)length);
+      append(buffer, values[i], length);
+   }
+
+   end_message(buffer, start);
+}
+
+static void
+command_complete(struct buffer* buffer, char* tag)
+{
+   size_t start = begin_message(buffer, 'C');
+
+   append_string(buffer, tag);
+   end_message(buffer, start);
+}
+
+static void
+result(struct buffer* buffer, int columns, char** names, int rows, char** values)
+{
+   char tag[MISC_LENGTH];
+
+   row_description(buffer, columns, names);
+   for (int i = 0; i < rows; i++)
+   {
+      data_row(buffer, columns, values + i * columns);
+   }
+
+   snprintf(tag, sizeof(tag), "SELECT %d", rows);
+   command_complete(buffer, tag);
+}
+
+static void
+error(struct buffer* buffer, char* code, char* message)
+{
+   size_t start = begin_message(buffer, 'E');
+
+   append(buffer, "SERROR", 7);
+   append(buffer, "C", 1);
+   append_string(buffer, code);
+   append(buffer, "M", 1);
+   append_string(buffer, message);
+   append(buffer, "", 1);
+   end_message(buffer, start);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_MOCK_H
+#define PGEXPORTER_MOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MOCK_AUTH_TRUST 0
+#define MOCK_AUTH_MD5   1
+#define MOCK_AUTH_SCRAM 2
+
+struct mock;
+
+/** @struct mock_options
+ * The options of the mock servers
+ */
+struct mock_options
+{
+   int servers;          /**< The number of servers */
+   int rows;             /**< The number of rows of a result with labels */
+   int latency;          /**< The latency of a query in milliseconds */
+   int authentication;   /**< The authentication method */
+   char* password;       /**< The password of the user, unless trust */
+   char* yaml_path;      /**< The YAML file or directory of the queries */
+};
+
+/**
+ * Start a number of mock PostgreSQL servers on 127.0.0.1.
+ *
+ * Each server speaks enough of the wire protocol to be connected to and
+ * scraped: it authenticates with trust, md5 or SCRAM-SHA-256, answers the
+ * queries pgexporter runs on a new connection, and answers the queries of
+ * the internal metrics and of the YAML file with a result of the columns
+ * of the query, of a number of rows when the query has labels.
+ *
+ * @param options The options
+ * @param mock The resulting mock
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_mock_start(struct mock_options* options, struct mock** mock);
+
+/**
+ * Get the port of a mock server
+ * @param mock The mock
+ * @param server The server
+ * @return The port
+ */
+int
+pgexporter_mock_port(struct mock* mock, int server);
+
+/**
+ * Stop the mock servers
+ * @param mock The mock
+ */
+void
+pgexporter_mock_stop(struct mock* mock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,848 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <cmd.h>
+#include <utils.h>
+
+/* bench */
+#include "mock.h"
+
+/* system */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCRAPE_WARMUP     2
+#define SCRAPE_STARTUP    100
+#define SCRAPE_REPORTS    50
+
+struct client
+{
+   int port;            /**< The metrics port */
+   int scrapes;         /**< The number of scrapes */
+   double* latencies;   /**< The latency of each scrape in milliseconds */
+   size_t bytes;        /**< The number of bytes of the responses */
+   bool failed;         /**< Did a scrape fail */
+   pthread_t thread;    /**< The thread */
+};
+
+static void usage(void);
+static int free_port(void);
+static int write_yaml(char* directory, int metrics);
+static int write_configuration(char* directory, struct mock* mock, char* user, int servers, int port);
+static int wait_for(int port);
+static int scrape(int port, size_t* bytes);
+static void* run_client(void* arg);
+static int compare(const void* a, const void* b);
+static double now(void);
+static int wait_for_reports(char* path, int reports);
+static void report_allocations(char* path, int first, pid_t pid);
+static void report_memory(pid_t pid);
+static int join(char* directory, char* file, char* path);
+static void remove_directory(char* directory);
+
+int
+main(int argc, char** argv)
+{
+   char* users_path = "/etc/pgexporter/pgexporter_users.conf";
+   char* pgexporter = "pgexporter";
+   char* user = "pgexporter";
+   char* authentication = "trust";
+   char* alloc = NULL;
+   char directory[MISC_LENGTH];
+   char configuration_path[MAX_PATH];
+   char yaml_path[MAX_PATH];
+   char log_path[MAX_PATH];
+   char alloc_path[MAX_PATH];
+   struct mock_options mock_options = {0};
+   struct mock* mock = NULL;
+   struct client* clients = NULL;
+   double* latencies = NULL;
+   double start;
+   double elapsed;
+   size_t bytes = 0;
+   size_t warmup;
+   pid_t pid = -1;
+   int reports = 0;
+   int servers = 4;
+   int metrics = 10;
+   int rows = 100;
+   int scrapes = 100;
+   int number_of_clients = 1;
+   int latency = 0;
+   int port;
+   int status;
+   int optind = 0;
+   int num_options = 0;
+   int num_results = 0;
+   char* filepath = NULL;
+   cli_option options[] = {
+      {"u", "users", true},
+      {"U", "user", true},
+      {"p", "pgexporter", true},
+      {"s", "servers", true},
+      {"m", "metrics", true},
+      {"r", "rows", true},
+      {"n", "scrapes", true},
+      {"c", "clients", true},
+      {"a", "authentication", true},
+      {"P", "password", true},
+      {"l", "latency", true},
+      {"Y", "yaml", true},
+      {"A", "alloc", true},
+      {"?", "help", false},
+   };
+
+   num_options = sizeof(options) / sizeof(options[0]);
+   cli_result results[num_options];
+
+   num_results = cmd_parse(argc, argv, options, num_options, results, num_options, false, &filepath, &optind);
+
+   if (num_results < 0)
+   {
+      usage();
+      return 1;
+   }
+
+   for (int i = 0; i < num_results; i++)
+   {
+      char* optname = results[i].option_name;
+      char* optarg = results[i].argument;
+
+      if (optname == NULL)
+      {
+         break;
+      }
+      else if (!strcmp(optname, "users") || !strcmp(optname, "u"))
+      {
+         users_path = optarg;
+      }
+      else if (!strcmp(optname, "user") || !strcmp(optname, "U"))
+      {
+         user = optarg;
+      }
+      else if (!strcmp(optname, "pgexporter") || !strcmp(optname, "p"))
+      {
+         pgexporter = optarg;
+      }
+      else if (!strcmp(optname, "servers") || !strcmp(optname, "s"))
+      {
+         servers = atoi(optarg);
+      }
+      else if (!strcmp(optname, "metrics") || !strcmp(optname, "m"))
+      {
+         metrics = atoi(optarg);
+      }
+      else if (!strcmp(optname, "rows") || !strcmp(optname, "r"))
+      {
+         rows = atoi(optarg);
+      }
+      else if (!strcmp(optname, "scrapes") || !strcmp(optname, "n"))
+      {
+         scrapes = atoi(optarg);
+      }
+      else if (!strcmp(optname, "clients") || !strcmp(optname, "c"))
+      {
+         number_of_clients = atoi(optarg);
+      }
+      else if (!strcmp(optname, "authentication") || !strcmp(optname, "a"))
+      {
+         authentication = optarg;
+      }
+      else if (!strcmp(optname, "password") || !strcmp(optname, "P"))
+      {
+         mock_options.password = optarg;
+      }
+      else if (!strcmp(optname, "latency") || !strcmp(optname, "l"))
+      {
+         latency = atoi(optarg);
+      }
+      else if (!strcmp(optname, "yaml") || !strcmp(optname, "Y"))
+      {
+         mock_options.yaml_path = optarg;
+      }
+      else if (!strcmp(optname, "alloc") || !strcmp(optname, "A"))
+      {
+         alloc = optarg;
+      }
+      else if (!strcmp(optname, "help") || !strcmp(optname, "?"))
+      {
+         usage();
+         return 0;
+      }
+   }
+
+   if (!strcmp(authentication, "trust"))
+   {
+      mock_options.authentication = MOCK_AUTH_TRUST;
+   }
+   else if (!strcmp(authentication, "md5"))
+   {
+      mock_options.authentication = MOCK_AUTH_MD5;
+   }
+   else if (!strcmp(authentication, "scram-sha-256"))
+   {
+      mock_options.authentication = MOCK_AUTH_SCRAM;
+   }
+   else
+   {
+      usage();
+      return 1;
+   }
+
+   if (servers <= 0 || metrics <= 0 || rows <= 0 || latency < 0 ||
+       scrapes <= 0 || number_of_clients <= 0 || number_of_clients > scrapes ||
+       (mock_options.authentication != MOCK_AUTH_TRUST && mock_options.password == NULL))
+   {
+      usage();
+      return 1;
+   }
+
+   if (access(users_path, R_OK))
+   {
+      fprintf(stderr, "pgexporter-scrape-bench: USERS configuration not found: %s\n", users_path);
+      return 1;
+   }
+
+   snprintf(directory, sizeof(directory), "/tmp/pgexporter-scrape-bench.XXXXXX");
+   if (mkdtemp(directory) == NULL)
+   {
+      fprintf(stderr, "pgexporter-scrape-bench: %s\n", strerror(errno));
+      return 1;
+   }
+
+   join(directory, "pgexporter.conf", configuration_path);
+   join(directory, "bench.yaml", yaml_path);
+   join(directory, "pgexporter.log", log_path);
+   join(directory, "allocations", alloc_path);
+
+   /* The metrics of the bench, unless the ones of a YAML file are scraped */
+   if (mock_options.yaml_path == NULL)
+   {
+      if (write_yaml(directory, metrics))
+      {
+         fprintf(stderr, "pgexporter-scrape-bench: Could not write the configuration\n");
+         goto error;
+      }
+      mock_options.yaml_path = yaml_path;
+   }
+
+   mock_options.servers = servers;
+   mock_options.rows = rows;
+   mock_options.latency = latency;
+
+   if (pgexporter_mock_start(&mock_options, &mock))
+   {
+      fprintf(stderr, "pgexporter-scrape-bench: Could not start the mock servers\n");
+      goto error;
+   }
+
+   port = free_port();
+   if (port == -1 || write_configuration(directory, mock, user, servers, port))
+   {
+      fprintf(stderr, "pgexporter-scrape-bench: Could not write the configuration\n");
+      goto error;
+   }
+
+   pid = fork();
+   if (pid == -1)
+   {
+      goto error;
+   }
+   else if (pid == 0)
+   {
+      /* Each process of pgexporter reports its allocations when it exits */
+      if (alloc != NULL)
+      {
+         setenv("LD_PRELOAD", alloc, 1);
+         setenv("PGEXPORTER_ALLOC_FILE", alloc_path, 1);
+      }
+
+      if (mock_options.yaml_path == yaml_path)
+      {
+         execlp(pgexporter, pgexporter, "-c", configuration_path, "-u", users_path, "-Y", yaml_path,
+                "-C", "bench", (char*)NULL);
+      }
+      else
+      {
+         execlp(pgexporter, pgexporter, "-c", configuration_path, "-u", users_path, "-Y", mock_options.yaml_path,
+                (char*)NULL);
+      }
+      fprintf(stderr, "pgexporter-scrape-bench: Could not run %s: %s\n", pgexporter, strerror(errno));
+      _exit(1);
+   }
+
+   if (wait_for(port))
+   {
+      fprintf(stderr, "pgexporter-scrape-bench: pgexporter did not start, see %s\n", log_path);
+      goto error;
+   }
+
+   /* The first scrapes connect to the servers and read their settings */
+   for (int i = 0; i < SCRAPE_WARMUP; i++)
+   {
+      if (scrape(port, &warmup))
+      {
+         fprintf(stderr, "pgexporter-scrape-bench: Scrape failed, see %s\n", log_path);
+         goto error;
+      }
+   }
+
+   if (alloc != NULL)
+   {
+      reports = wait_for_reports(alloc_path, SCRAPE_WARMUP);
+   }
+
+   clients = calloc(number_of_clients, sizeof(struct client));
+   latencies = calloc(scrapes, sizeof(double));
+   if (clients == NULL || latencies == NULL)
+   {
+      goto error;
+   }
+
+   /* The scrapes are shared out, and each client records its latencies in its own part */
+   for (int i = 0, offset = 0; i < number_of_clients; i++)
+   {
+      clients[i].port = port;
+      clients[i].scrapes = scrapes / number_of_clients + (i < scrapes % number_of_clients ? 1 : 0);
+      clients[i].latencies = latencies + offset;
+      offset += clients[i].scrapes;
+   }
+
+   start = now();
+   for (int i = 0; i < number_of_clients; i++)
+   {
+      if (pthread_create(&clients[i].thread, NULL, run_client, &clients[i]))
+      {
+         for (int j = 0; j < i; j++)
+         {
+            pthread_join(clients[j].thread, NULL);
+         }
+         goto error;
+      }
+   }
+
+   for (int i = 0; i < number_of_clients; i++)
+   {
+      pthread_join(clients[i].thread, NULL);
+   }
+   elapsed = now() - start;
+
+   for (int i = 0; i < number_of_clients; i++)
+   {
+      if (clients[i].failed)
+      {
+         fprintf(stderr, "pgexporter-scrape-bench: Scrape failed, see %s\n", log_path);
+         goto error;
+      }
+      bytes += clients[i].bytes;
+   }
+
+   qsort(latencies, scrapes, sizeof(double), compare);
+
+   printf("servers\t%d\n", servers);
+   if (mock_options.yaml_path == yaml_path)
+   {
+      printf("series\t%d\n", servers * metrics * rows);
+   }
+   printf("bytes\t%zu\n", bytes / scrapes);
+   printf("clients\t%d\n", number_of_clients);
+   printf("scrapes\t%d\n", scrapes);
+   printf("p50_ms\t%.2f\n", latencies[(int)(scrapes * 0.50)]);
+   printf("p90_ms\t%.2f\n", latencies[(int)(scrapes * 0.90)]);
+   printf("p99_ms\t%.2f\n", latencies[(int)(scrapes * 0.99)]);
+   printf("max_ms\t%.2f\n", latencies[scrapes - 1]);
+   printf("scrapes/s\t%.1f\n", scrapes / elapsed);
+   printf("MB/s\t%.1f\n", bytes / elapsed / (1024.0 * 1024.0));
+
+   if (alloc != NULL)
+   {
+      wait_for_reports(alloc_path, reports + scrapes);
+      report_allocations(alloc_path, reports, pid);
+   }
+   report_memory(pid);
+
+   kill(pid, SIGTERM);
+   waitpid(pid, &status, 0);
+
+   pgexporter_mock_stop(mock);
+   remove_directory(directory);
+
+   free(clients);
+   free(latencies);
+
+   return 0;
+
+error:
+
+   if (pid > 0)
+   {
+      kill(pid, SIGTERM);
+      waitpid(pid, &status, 0);
+   }
+
+   pgexporter_mock_stop(mock);
+
+   free(clients);
+   free(latencies);
+
+   return 1;
+}
+
+static void
+usage(void)
+{
+   printf("pgexporter-scrape-bench\n");
+   printf("  Measure the scrapes of pgexporter against mock PostgreSQL servers\n");
+   printf("\n");
+   printf("Usage:\n");
+   printf("  pgexporter-scrape-bench [ -u USERS_CONFIG ] [ -p PGEXPORTER ] [ -s SERVERS ] ...\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("  -u, --users USERS_CONFIG  Set the path to the pgexporter_users.conf file\n");
+   printf("  -U, --user USER           Set the user of the servers (default: pgexporter)\n");
+   printf("  -p, --pgexporter PATH     Set the path to the pgexporter executable\n");
+   printf("  -s, --servers NUMBER      Set the number of servers (default: 4)\n");
+   printf("  -m, --metrics NUMBER      Set the number of metrics of a server (default: 10)\n");
+   printf("  -r, --rows NUMBER         Set the number of rows of a metric (default: 100)\n");
+   printf("  -n, --scrapes NUMBER      Set the number of scrapes (default: 100)\n");
+   printf("  -c, --clients NUMBER      Set the number of concurrent scrapers (default: 1)\n");
+   printf("  -a, --authentication AUTH Set the authentication of the servers to trust, md5\n");
+   printf("                            or scram-sha-256 (default: trust)\n");
+   printf("  -P, --password PASSWORD   Set the password of the user in the USERS configuration\n");
+   printf("  -l, --latency MS          Set the latency of a query of the servers (default: 0)\n");
+   printf("  -Y, --yaml PATH           Scrape the metrics of a YAML file or directory instead\n");
+   printf("  -A, --alloc PATH          Set the path to the pgexporter-alloc library, to report\n");
+   printf("                            the allocations of a scrape\n");
+   printf("  -?, --help                Display help\n");
+   printf("\n");
+}
+
+static int
+free_port(void)
+{
+   struct sockaddr_in address;
+   socklen_t length = sizeof(address);
+   int fd;
+   int port = -1;
+
+   fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd == -1)
+   {
+      return -1;
+   }
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   if (!bind(fd, (struct sockaddr*)&address, sizeof(address)) &&
+       !getsockname(fd, (struct sockaddr*)&address, &length))
+   {
+      port = ntohs(address.sin_port);
+   }
+
+   close(fd);
+
+   return port;
+}
+
+static int
+write_yaml(char* directory, int metrics)
+{
+   char path[MAX_PATH];
+   FILE* file = NULL;
+
+   if (join(directory, "bench.yaml", path))
+   {
+      return 1;
+   }
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+   fprintf(file, "version: 10\n");
+   fprintf(file, "metrics:\n");
+   for (int i = 0; i < metrics; i++)
+   {
+      fprintf(file, "  - queries:\n");
+      fprintf(file, "    - query: SELECT * FROM pgexporter_bench(%d);\n", i);
+      fprintf(file, "      version: 10\n");
+      fprintf(file, "      columns:\n");
+      fprintf(file, "        - name: database\n");
+      fprintf(file, "          type: label\n");
+      fprintf(file, "        - name: value\n");
+      fprintf(file, "          type: gauge\n");
+      fprintf(file, "          description: A bench metric\n");
+      fprintf(file, "    tag: bench_%d\n", i);
+      fprintf(file, "    collector: bench\n");
+   }
+   fclose(file);
+
+   return 0;
+}
+
+static int
+write_configuration(char* directory, struct mock* mock, char* user, int servers, int port)
+{
+   char path[MAX_PATH];
+   FILE* file = NULL;
+
+   if (join(directory, "pgexporter.conf", path))
+   {
+      goto error;
+   }
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      goto error;
+   }
+
+   fprintf(file, "[pgexporter]\n");
+   fprintf(file, "host = 127.0.0.1\n");
+   fprintf(file, "metrics = %d\n", port);
+   fprintf(file, "metrics_cache_max_age = 0\n");
+   fprintf(file, "log_type = file\n");
+   fprintf(file, "log_level = info\n");
+   fprintf(file, "log_path = %s/pgexporter.log\n", directory);
+   fprintf(file, "unix_socket_dir = %s\n", directory);
+   for (int i = 0; i < servers; i++)
+   {
+      fprintf(file, "\n[server%d]\n", i);
+      fprintf(file, "host = 127.0.0.1\n");
+      fprintf(file, "port = %d\n", pgexporter_mock_port(mock, i));
+      fprintf(file, "user = %s\n", user);
+   }
+   fclose(file);
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+wait_for(int port)
+{
+   struct sockaddr_in address;
+   int fd;
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(port);
+
+   for (int i = 0; i < SCRAPE_STARTUP; i++)
+   {
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (fd != -1 && !connect(fd, (struct sockaddr*)&address, sizeof(address)))
+      {
+         close(fd);
+         return 0;
+      }
+
+      if (fd != -1)
+      {
+         close(fd);
+      }
+
+      usleep(100000);
+   }
+
+   return 1;
+}
+
+static int
+scrape(int port, size_t* bytes)
+{
+   struct sockaddr_in address;
+   char request[MISC_LENGTH];
+   char buffer[65536];
+   char status[16];
+   size_t length = 0;
+   ssize_t r;
+   int fd;
+
+   *bytes = 0;
+
+   fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   address.sin_port = htons(port);
+
+   if (connect(fd, (struct sockaddr*)&address, sizeof(address)))
+   {
+      goto error;
+   }
+
+   snprintf(request, sizeof(request), "GET /metrics HTTP/1.1\r\nHost: 127.0.0.1:%d\r\nConnection: close\r\n\r\n", port);
+   if (send(fd, request, strlen(request), MSG_NOSIGNAL) != (ssize_t)strlen(request))
+   {
+      goto error;
+   }
+
+   memset(status, 0, sizeof(status));
+   while ((r = read(fd, buffer, sizeof(buffer))) != 0)
+   {
+      if (r == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         goto error;
+      }
+
+      if (length < sizeof(status) - 1)
+      {
+         memcpy(status + length, buffer, MIN((size_t)r, sizeof(status) - 1 - length));
+      }
+      length += r;
+   }
+
+   close(fd);
+
+   if (strncmp(status, "HTTP/1.1 200", 12))
+   {
+      return 1;
+   }
+
+   *bytes = length;
+
+   return 0;
+
+error:
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+static void*
+run_client(void* arg)
+{
+   struct client* client = (struct client*)arg;
+   size_t bytes;
+   double start;
+
+   for (int i = 0; i < client->scrapes; i++)
+   {
+      start = now();
+      if (scrape(client->port, &bytes))
+      {
+         client->failed = true;
+         break;
+      }
+      client->latencies[i] = (now() - start) * 1000.0;
+      client->bytes += bytes;
+   }
+
+   return NULL;
+}
+
+static int
+compare(const void* a, const void* b)
+{
+   double x = *(const double*)a;
+   double y = *(const double*)b;
+
+   return (x > y) - (x < y);
+}
+
+static double
+now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static int
+join(char* directory, char* file, char* path)
+{
+   int length = snprintf(path, MAX_PATH, "%s/%s", directory, file);
+
+   return length < 0 || length >= MAX_PATH;
+}
+
+static void
+remove_directory(char* directory)
+{
+   char path[MAX_PATH];
+   char* files[] = {"pgexporter.conf", "bench.yaml", "pgexporter.log", "allocations"};
+
+   for (int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++)
+   {
+      if (!join(directory, files[i], path))
+      {
+         unlink(path);
+      }
+   }
+
+   rmdir(directory);
+}
+
+static int
+wait_for_reports(char* path, int reports)
+{
+   FILE* file = NULL;
+   int lines = 0;
+   int c;
+
+   /* A worker reports when it exits, which may be after its response is read */
+   for (int i = 0; i < SCRAPE_REPORTS; i++)
+   {
+      lines = 0;
+
+      file = fopen(path, "r");
+      if (file != NULL)
+      {
+         while ((c = fgetc(file)) != EOF)
+         {
+            if (c == '\n')
+            {
+               lines++;
+            }
+         }
+         fclose(file);
+      }
+
+      if (lines >= reports)
+      {
+         break;
+      }
+
+      usleep(100000);
+   }
+
+   return lines;
+}
+
+static void
+report_allocations(char* path, int first, pid_t pid)
+{
+   FILE* file = NULL;
+   unsigned long long allocations;
+   unsigned long long bytes;
+   unsigned long long total_allocations = 0;
+   unsigned long long total_bytes = 0;
+   long maxrss;
+   long max_maxrss = 0;
+   int process;
+   int line = 0;
+   int workers = 0;
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      return;
+   }
+
+   /* The lines of the warmup are skipped, and pgexporter itself has not exited */
+   while (fscanf(file, "%d %llu %llu %ld", &process, &allocations, &bytes, &maxrss) == 4)
+   {
+      if (line++ < first || process == pid)
+      {
+         continue;
+      }
+
+      total_allocations += allocations;
+      total_bytes += bytes;
+      max_maxrss = MAX(max_maxrss, maxrss);
+      workers++;
+   }
+   fclose(file);
+
+   if (workers == 0)
+   {
+      return;
+   }
+
+   printf("allocs/scrape\t%.0f\n", (double)total_allocations / workers);
+   printf("alloc_MB/scrape\t%.2f\n", (double)total_bytes / workers / (1024.0 * 1024.0));
+   printf("worker_maxrss_kB\t%ld\n", max_maxrss);
+}
+
+static void
+report_memory(pid_t pid)
+{
+   char path[MISC_LENGTH];
+   char line[MISC_LENGTH];
+   FILE* file = NULL;
+
+   snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+
+   file = fopen(path, "r");
+   if (file == NULL)
+   {
+      return;
+   }
+
+   /* The resident memory of pgexporter itself, now and at its peak */
+   while (fgets(line, sizeof(line), file) != NULL)
+   {
+      if (!strncmp(line, "VmRSS:", 6))
+      {
+         printf("rss_kB\t%ld\n", strtol(line + 6, NULL, 10));
+      }
+      else if (!strncmp(line, "VmHWM:", 6))
+      {
+         printf("hwm_kB\t%ld\n", strtol(line + 6, NULL, 10));
+      }
+   }
+   fclose(file);
+}
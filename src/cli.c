@@ -35,6 +35,7 @@
 #include <management.h>
 #include <memory.h>
 #include <network.h>
+#include <registry.h>
 #include <security.h>
 #include <shmem.h>
 #include <utils.h>
@@ -129,6 +130,7 @@ usage(void)
    printf("  -F, --format text|json|raw                     Set the output format\n");
    printf("  -C, --compress none|gz|zstd|lz4|bz2            Compress the wire protocol\n");
    printf("  -E, --encrypt none|aes|aes256|aes192|aes128    Encrypt the wire protocol\n");
+   printf("  -B, --binary                                   Send a compressed or encrypted payload as a binary frame\n");
    printf("  -?, --help                                     Display help\n");
    printf("\n");
    printf("Commands:\n");
@@ -244,6 +246,7 @@ main(int argc, char** argv)
    int32_t output_format = MANAGEMENT_OUTPUT_FORMAT_TEXT;
    int32_t compression = MANAGEMENT_COMPRESSION_NONE;
    int32_t encryption = MANAGEMENT_ENCRYPTION_NONE;
+   bool binary = false;
    size_t command_count = sizeof(command_table) / sizeof(struct pgexporter_command);
    struct pgexporter_parsed_command parsed = {.cmd = NULL, .args = {0}};
 
@@ -267,7 +270,8 @@ main(int argc, char** argv)
       {"F", "format", true},
       {"?", "help", false},
       {"C", "compress", true},
-      {"E", "encrypt", true}
+      {"E", "encrypt", true},
+      {"B", "binary", false}
    };
 
    num_options = sizeof(options) / sizeof(cli_option);
@@ -398,6 +402,10 @@ main(int argc, char** argv)
             exit(1);
          }
       }
+      else if (!strcmp(optname, "binary") || !strcmp(optname, "B"))
+      {
+         binary = true;
+      }
       else if (!strcmp(optname, "help") || !strcmp(optname, "?"))
       {
          usage();
@@ -431,7 +439,11 @@ main(int argc, char** argv)
       warnx("pgexporter-cli: Error creating shared memory");
       exit(1);
    }
-   pgexporter_init_configuration(shmem);
+   if (pgexporter_init_configuration(shmem))
+   {
+      warnx("pgexporter-cli: Error creating the registry");
+      exit(1);
+   }
 
    if (configuration_path != NULL)
    {
@@ -579,6 +591,13 @@ password:
       }
    }
 
+   /* A compressed or encrypted payload is only sent as a binary frame instead of base64 when asked,
+      since an older pgexporter reads base64 */
+   if (binary && (compression != MANAGEMENT_COMPRESSION_NONE || encryption != MANAGEMENT_ENCRYPTION_NONE))
+   {
+      compression |= MANAGEMENT_FRAME_BINARY;
+   }
+
    if (parsed.cmd->action == MANAGEMENT_SHUTDOWN)
    {
       exit_code = pgexporter_shutdown(s_ssl, socket, compression, encryption, output_format);
@@ -641,6 +660,8 @@ done:
    pgexporter_disconnect(socket);
 
    pgexporter_stop_logging();
+   config = (struct configuration*)shmem;
+   pgexporter_registry_destroy(config->registry);
    pgexporter_destroy_shared_memory(shmem, size);
 
    pgexporter_memory_destroy();
@@ -36,8 +36,27 @@ extern "C" {
 #include <pgexporter.h>
 #include <json.h>
 
+#include <stdbool.h>
+#include <stdlib.h>
+
 #include <openssl/ssl.h>
 
+/** @struct cipher
+ * Defines a streaming encryption or decryption.
+ * The output of each call replaces the output of the previous one
+ */
+struct cipher
+{
+   EVP_CIPHER_CTX* context;               /**< The cipher context */
+   int mode;                              /**< The aes mode */
+   bool encrypt;                          /**< Encrypt, otherwise decrypt */
+   unsigned char key[EVP_MAX_KEY_LENGTH]; /**< The key */
+   unsigned char iv[EVP_MAX_IV_LENGTH];   /**< The initialization vector */
+   unsigned char* output;                 /**< The output of the last call */
+   size_t output_size;                    /**< The size of the output */
+   size_t capacity;                       /**< The capacity of the output */
+};
+
 /**
  * Encrypt a string
  * @param plaintext The string
@@ -86,6 +105,50 @@ pgexporter_encrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsi
 int
 pgexporter_decrypt_buffer(unsigned char* origin_buffer, size_t origin_size, unsigned char** dec_buffer, size_t* dec_size, int mode);
 
+/**
+ * Create a cipher, the key is derived once per password and mode in a process
+ * @param password The master password
+ * @param mode The aes mode
+ * @param encrypt Encrypt if true, otherwise decrypt
+ * @param cipher [out] The cipher
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_cipher_create(char* password, int mode, bool encrypt, struct cipher** cipher);
+
+/**
+ * Feed data to a cipher
+ * @param cipher The cipher
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_cipher_update(struct cipher* cipher, void* data, size_t size);
+
+/**
+ * End the stream of a cipher, which outputs the last block
+ * @param cipher The cipher
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_cipher_finish(struct cipher* cipher);
+
+/**
+ * Reset a cipher for a new stream, keeping its context and key
+ * @param cipher The cipher
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_cipher_reset(struct cipher* cipher);
+
+/**
+ * Destroy a cipher
+ * @param cipher The cipher
+ */
+void
+pgexporter_cipher_destroy(struct cipher* cipher);
+
 #ifdef __cplusplus
 }
 #endif
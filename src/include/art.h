@@ -38,7 +38,9 @@ extern "C" {
 
 #include <stdint.h>
 
-#define MAX_PREFIX_LEN 10
+/* Prefixes longer than this are resolved through the left most leaf of the node,
+ * storing them in full is left for a follow-up */
+#define MAX_PREFIX_LEN 55
 
 typedef int (*art_callback)(void* data, const char* key, struct value* value);
 
@@ -51,18 +53,39 @@ struct art
 {
    struct art_node* root;                 /**< The root node of ART */
    uint64_t size;                         /**< The size of the ART */
+   void** slabs;                          /**< The slabs of the inner nodes */
+   uint32_t number_of_slabs;              /**< The number of slabs */
+   uint32_t capacity;                     /**< The capacity of the slabs array */
+   uint32_t allocated[4];                 /**< The number of inner nodes in the slabs, by type */
+   void* free_nodes[4];                   /**< The free inner nodes, by type */
+};
+
+/** @struct art_iterator_frame
+ * Defines a node on the path of an art_iterator
+ */
+struct art_iterator_frame
+{
+   struct art_node* node;       /**< The node */
+   int index;                   /**< The position of the next child */
 };
 
 /** @struct art_iterator
- * Defines an art_iterator
+ * Defines an art_iterator, that returns the keys in order
  */
 struct art_iterator
 {
-   struct deque* que;           /**< The deque */
-   struct art* tree;            /**< The ART */
-   uint32_t count;              /**< The count of the iterator */
-   char* key;                   /**< The key */
-   struct value* value;         /**< The value */
+   struct art* tree;                  /**< The ART */
+   uint32_t count;                    /**< The count of the iterator */
+   char* key;                         /**< The key */
+   struct value* value;               /**< The value */
+   bool started;                      /**< If the iterator is positioned */
+   struct art_leaf* next;             /**< The next leaf */
+   struct art_iterator_frame* stack;  /**< The path to the next leaf */
+   uint32_t depth;                    /**< The depth of the path */
+   uint32_t capacity;                 /**< The capacity of the path */
+   char* prefix;                      /**< The prefix of the keys, or NULL */
+   char* from;                        /**< The lower bound of the keys, or NULL */
+   char* to;                          /**< The upper bound of the keys, exclusive, or NULL */
 };
 
 /**
@@ -163,6 +186,25 @@ pgexporter_art_iterator_remove(struct art_iterator* iter);
 int
 pgexporter_art_iterator_create(struct art* t, struct art_iterator** iter);
 
+/**
+ * Restrict the iterator to the keys starting with a prefix, and restart it
+ * @param iter The iterator
+ * @param prefix The prefix, or NULL for all keys
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_art_iterator_seek(struct art_iterator* iter, char* prefix);
+
+/**
+ * Restrict the iterator to a range of keys, and restart it
+ * @param iter The iterator
+ * @param from The first key, or NULL
+ * @param to The key after the last key, or NULL
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_art_iterator_range(struct art_iterator* iter, char* from, char* to);
+
 /**
  * Destroy the iterator
  * @param iter The iterator
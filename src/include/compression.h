@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_COMPRESSION_H
+#define PGEXPORTER_COMPRESSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/** @struct compressor
+ * Defines a streaming compressor or decompressor.
+ * The output of each call replaces the output of the previous one.
+ * The gzip, zstd and bzip2 streams are the same as the ones of the string functions,
+ * while lz4 uses the frame format instead of a single block
+ */
+struct compressor
+{
+   int codec;              /**< The codec, one of COMPRESSION_CLIENT_* */
+   bool compress;          /**< Compress, otherwise decompress */
+   int level;              /**< The compression level, 0 for the default */
+   void* context;          /**< The context of the codec */
+   bool started;           /**< If the stream has started */
+   bool ended;             /**< If the stream has ended */
+   unsigned char* output;  /**< The output of the last call */
+   size_t output_size;     /**< The size of the output */
+   size_t capacity;        /**< The capacity of the output */
+};
+
+/**
+ * Create a compressor
+ * @param codec The codec
+ * @param compress Compress if true, otherwise decompress
+ * @param level The compression level, 0 for the default of the codec
+ * @param compressor [out] The compressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_compressor_create(int codec, bool compress, int level, struct compressor** compressor);
+
+/**
+ * Feed data to a compressor, the data may be binary
+ * @param compressor The compressor
+ * @param data The data
+ * @param size The size of the data
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_compressor_update(struct compressor* compressor, void* data, size_t size);
+
+/**
+ * End the stream of a compressor.
+ * A decompressor fails if the stream is not complete
+ * @param compressor The compressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_compressor_finish(struct compressor* compressor);
+
+/**
+ * Reset a compressor for a new stream, keeping its context
+ * @param compressor The compressor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_compressor_reset(struct compressor* compressor);
+
+/**
+ * Destroy a compressor
+ * @param compressor The compressor
+ */
+void
+pgexporter_compressor_destroy(struct compressor* compressor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
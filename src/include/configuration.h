@@ -43,6 +43,7 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_METRICS_PATH               "metrics_path"
 #define CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_AGE      "metrics_cache_max_age"
 #define CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_SIZE     "metrics_cache_max_size"
+#define CONFIGURATION_ARGUMENT_METRICS_SCRAPE_TIMEOUT     "metrics_scrape_timeout"
 #define CONFIGURATION_ARGUMENT_BRIDGE                     "bridge"
 #define CONFIGURATION_ARGUMENT_BRIDGE_ENDPOINTS           "bridge_endpoints"
 #define CONFIGURATION_ARGUMENT_BRIDGE_CACHE_MAX_AGE       "bridge_cache_max_age"
@@ -96,6 +97,29 @@ pgexporter_init_configuration(void* shmem);
 int
 pgexporter_read_configuration(void* shmem, char* filename);
 
+/**
+ * Reserve room for the servers of the configuration. The servers
+ * and their states are moved to larger sections of the current arena
+ * of the registry when needed, and the new states start out disconnected.
+ * The smaller sections are given back when the arena is reused
+ * @param config The configuration
+ * @param number_of_servers The number of servers
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_reserve_servers(struct configuration* config, int number_of_servers);
+
+/**
+ * Reserve room for the metrics of the configuration. The metrics
+ * are moved to a larger section of the current arena of the registry
+ * when needed
+ * @param config The configuration
+ * @param number_of_metrics The number of metrics
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_reserve_metrics(struct configuration* config, int number_of_metrics);
+
 /**
  * Validate the configuration
  * @param shmem The shared memory segment
@@ -48,6 +48,8 @@ struct deque_node
    char* tag;               /**< The tag */
    struct deque_node* next; /**< The next pointer */
    struct deque_node* prev; /**< The previous pointer */
+   uint32_t hash;           /**< The hash of the tag */
+   struct deque_node* link; /**< The next node in the same bucket of the index */
 };
 
 /** @struct deque
@@ -55,11 +57,13 @@ struct deque_node
  */
 struct deque
 {
-   uint32_t size;            /**< The size of the deque */
-   bool thread_safe;         /**< If the deque is thread safe */
-   pthread_rwlock_t mutex;   /**< The mutex of the deque */
-   struct deque_node* start; /**< The start node */
-   struct deque_node* end;   /**< The end node */
+   uint32_t size;             /**< The size of the deque */
+   bool thread_safe;          /**< If the deque is thread safe */
+   pthread_rwlock_t mutex;    /**< The mutex of the deque */
+   struct deque_node* start;  /**< The start node */
+   struct deque_node* end;    /**< The end node */
+   struct deque_node** index; /**< The buckets of the tag index, or NULL */
+   uint32_t buckets;          /**< The number of buckets of the index */
 };
 
 /** @struct deque_iterator
@@ -82,6 +86,15 @@ struct deque_iterator
 int
 pgexporter_deque_create(bool thread_safe, struct deque** deque);
 
+/**
+ * Maintain a hash index on the tags of the deque,
+ * so the lookups by tag no longer scan the deque
+ * @param deque The deque
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_deque_index(struct deque* deque);
+
 /**
  * Add a node to deque's tail, the tag will be copied
  * This function is thread safe
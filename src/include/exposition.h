@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_EXPOSITION_H
+#define PGEXPORTER_EXPOSITION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <message.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define EXPOSITION_TEXT        0
+#define EXPOSITION_OPENMETRICS 1
+#define EXPOSITION_PROTOBUF    2
+
+struct families;
+
+/** @struct exposition
+ * Defines the text exposition of a response that is sent in another format
+ */
+struct exposition
+{
+   int format;                 /**< The format of the response */
+   char* text;                 /**< The text exposition not parsed yet */
+   size_t length;              /**< The length of the text */
+   size_t capacity;            /**< The capacity of the text */
+   struct families* families;  /**< The metric families parsed so far */
+   char** parsed;              /**< The parsed texts, which the families point into */
+   int n_parsed;               /**< The number of parsed texts */
+};
+
+/**
+ * Negotiate the format of a response from the Accept header of a request
+ * @param msg The request
+ * @return The format
+ */
+int
+pgexporter_exposition_negotiate(struct message* msg);
+
+/**
+ * Is a gzip encoded response accepted by the Accept-Encoding header of a request
+ * @param msg The request
+ * @return True if gzip is accepted, otherwise false
+ */
+bool
+pgexporter_exposition_gzip(struct message* msg);
+
+/**
+ * Get the content type of a format
+ * @param format The format
+ * @return The content type
+ */
+char*
+pgexporter_exposition_content_type(int format);
+
+/**
+ * Create an exposition
+ * @param format The format of the response
+ * @param exposition The resulting exposition
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_exposition_create(int format, struct exposition** exposition);
+
+/**
+ * Append text to an exposition
+ * @param exposition The exposition
+ * @param data The text
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_exposition_append(struct exposition* exposition, char* data);
+
+/**
+ * Encode the families of an exposition that are complete so far, which are the
+ * ones of the text up to its last line. A family of the text appended later
+ * is continued, without the series already encoded
+ * @param exposition The exposition
+ * @param data The resulting data
+ * @param size The size of the data
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_exposition_flush(struct exposition* exposition, char** data, size_t* size);
+
+/**
+ * Encode the rest of an exposition in its format, and end it. The text of the exposition is consumed
+ * @param exposition The exposition
+ * @param data The resulting data
+ * @param size The size of the data
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_exposition_encode(struct exposition* exposition, char** data, size_t* size);
+
+/**
+ * Destroy an exposition
+ * @param exposition The exposition
+ */
+void
+pgexporter_exposition_destroy(struct exposition* exposition);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
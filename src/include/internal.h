@@ -236,15 +236,15 @@ extern "C" {
         "                FROM\n" \
         "                  pg_stat_activity,\n" \
         "                  UNNEST(ARRAY[1, 2, 5, 15, 30, 60, 90, 120, 300]) AS le\n" \
+        "                WHERE state = 'idle'\n" \
         "                GROUP BY application_name, le\n" \
-        "                ORDER BY application_name, le\n" \
         "              )\n" \
         "              SELECT\n" \
         "                application_name,\n" \
         "                process_idle_seconds_sum as seconds_sum,\n" \
         "                process_idle_seconds_count as seconds_count,\n" \
-        "                ARRAY_AGG(le) AS seconds,\n" \
-        "                ARRAY_AGG(bucket) AS seconds_bucket\n" \
+        "                ARRAY_AGG(le ORDER BY le) AS seconds,\n" \
+        "                ARRAY_AGG(bucket ORDER BY le) AS seconds_bucket\n" \
         "              FROM metrics JOIN buckets USING (application_name)\n" \
         "              GROUP BY 1, 2, 3;\n" \
         "      version: 10\n" \
@@ -691,17 +691,22 @@ extern "C" {
         "\n" \
         "# Shared memory histogram\n" \
         "  - queries:\n" \
-        "    - query: SELECT\n" \
-        "                SUM(sum) AS size_sum,\n" \
-        "                '1' AS size_count,\n" \
-        "                array_agg((bucket - 1) * (50000))::int[] AS size,\n" \
-        "                array_agg(count)::int[] AS size_bucket\n" \
-        "              FROM (\n" \
-        "                  SELECT width_bucket(allocated_size, 0, 5000000, 100) AS bucket, COUNT(*), SUM(allocated_size)\n" \
-        "                  FROM pg_shmem_allocations\n" \
-        "                  GROUP BY bucket\n" \
-        "                  ORDER BY bucket\n" \
-        "              ) t;\n" \
+        "    - query: WITH\n" \
+        "              buckets AS (\n" \
+        "                SELECT\n" \
+        "                  le,\n" \
+        "                  COUNT(*) FILTER (WHERE allocated_size <= le) AS bucket\n" \
+        "                FROM\n" \
+        "                  pg_shmem_allocations,\n" \
+        "                  generate_series(50000, 5000000, 50000) AS le\n" \
+        "                GROUP BY le\n" \
+        "              )\n" \
+        "              SELECT\n" \
+        "                (SELECT SUM(allocated_size) FROM pg_shmem_allocations) AS size_sum,\n" \
+        "                (SELECT COUNT(*) FROM pg_shmem_allocations) AS size_count,\n" \
+        "                ARRAY_AGG(le ORDER BY le) AS size,\n" \
+        "                ARRAY_AGG(bucket ORDER BY le) AS size_bucket\n" \
+        "              FROM buckets;\n" \
         "      version: 13\n" \
         "      columns:\n" \
         "        - name: size\n" \
@@ -45,14 +45,14 @@ pgexporter_read_json_metrics_configuration(void* shmem);
 
 /**
  * Read and load JSON configuration from file pointer.
- * @param prometheus The array of data structures where the JSON configuration is loaded
+ * @param config The configuration where the JSON configuration is loaded
  * @param prometheus_idx The index of the data structure in the array
  * @param number_of_metrics The number of metrics the configuration has. This value will be set by the function.
  * @param file File pointer
  * @return 0 upon success, otherwise 1
  */
 int
-pgexporter_read_json_from_file_pointer(struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, FILE* file);
+pgexporter_read_json_from_file_pointer(struct configuration* config, int prometheus_idx, int* number_of_metrics, FILE* file);
 
 /**
  * Read and parse a single JSON file into the prometheus metrics structure
@@ -63,7 +63,7 @@ pgexporter_read_json_from_file_pointer(struct prometheus* prometheus, int promet
  * @return 0 upon success, otherwise 1
  */
 int
-pgexporter_read_json(struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics);
+pgexporter_read_json(struct configuration* config, int prometheus_idx, char* filename, int* number_of_metrics);
 
 /**
  * Get all JSON files from a directory
@@ -33,8 +33,10 @@
 extern "C" {
 #endif
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
 #define PGEXPORTER_LOGGING_TYPE_CONSOLE 0
 #define PGEXPORTER_LOGGING_TYPE_FILE    1
@@ -57,6 +59,57 @@ extern "C" {
 
 #define PGEXPORTER_LOGGING_DEFAULT_LOG_LINE_PREFIX "%Y-%m-%d %H:%M:%S"
 
+/**
+ * The number of slots in the logging buffer.
+ * Must be a power of two.
+ */
+#define LOGGING_BUFFER_SLOTS 4096
+
+/**
+ * The payload of a slot in the logging buffer (in bytes).
+ * Longer records span several consecutive slots.
+ */
+#define LOGGING_SLOT_SIZE 236
+
+/**
+ * The maximum number of slots of a single record.
+ * Longer records are truncated.
+ */
+#define LOGGING_RECORD_SLOTS 512
+
+/** @struct log_slot
+ * Defines a slot in the logging buffer
+ */
+struct log_slot
+{
+   atomic_ulong sequence;         /**< The position the slot is ready for */
+   int level;                     /**< The logging level of the record */
+   int slots;                     /**< The number of slots of the record */
+   int length;                    /**< The length of the payload */
+   char data[LOGGING_SLOT_SIZE];  /**< The payload */
+} __attribute__ ((aligned (64)));
+
+/** @struct log_buffer
+ * Defines the logging buffer.
+ *
+ * The processes write their formatted records into the buffer, and
+ * the logging process writes them to the log file, the console or syslog.
+ * A slot at position p is free when its sequence is p, and holds
+ * a record when its sequence is p + 1.
+ */
+struct log_buffer
+{
+   atomic_bool active;                            /**< Is the logging process running */
+   atomic_bool running;                           /**< Should the logging process keep running */
+   atomic_bool sleeping;                          /**< Is the logging process waiting for records */
+   atomic_int producers;                          /**< The number of processes writing a record */
+   int wakeup[2];                                 /**< The pipe waking up the logging process */
+   pid_t ppid;                                    /**< The main process */
+   atomic_ulong head __attribute__ ((aligned (64))); /**< The next position to claim */
+   atomic_ulong tail __attribute__ ((aligned (64))); /**< The next position to write */
+   struct log_slot slots[LOGGING_BUFFER_SLOTS];   /**< The slots */
+} __attribute__ ((aligned (64)));
+
 #define pgexporter_log_trace(...) pgexporter_log_line(PGEXPORTER_LOGGING_LEVEL_DEBUG5, __FILE__, __LINE__, __VA_ARGS__)
 #define pgexporter_log_debug(...) pgexporter_log_line(PGEXPORTER_LOGGING_LEVEL_DEBUG1, __FILE__, __LINE__, __VA_ARGS__)
 #define pgexporter_log_info(...)  pgexporter_log_line(PGEXPORTER_LOGGING_LEVEL_INFO, __FILE__, __LINE__, __VA_ARGS__)
@@ -71,6 +124,47 @@ extern "C" {
 int
 pgexporter_init_logging(void);
 
+/**
+ * Allocate the logging buffer
+ * @param p_size The size of the buffer
+ * @param p_shmem The buffer
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_init_logging_buffer(size_t* p_size, void** p_shmem);
+
+/**
+ * Run the logging process.
+ *
+ * Writes the records of the logging buffer until the main process
+ * stops it, or exits
+ */
+void
+pgexporter_logging_process(void);
+
+/**
+ * Activate the logging buffer once the logging process is running
+ */
+void
+pgexporter_logging_activate(void);
+
+/**
+ * Suspend the logging buffer if the logging process is gone.
+ *
+ * The logging is done directly until the buffer is activated again
+ */
+void
+pgexporter_logging_suspend(void);
+
+/**
+ * Stop the logging process, after it has written all the records.
+ *
+ * The logging is done directly afterwards
+ * @param pid The logging process
+ */
+void
+pgexporter_logging_deactivate(pid_t pid);
+
 /**
  * Start the logging system
  * @return 0 upon success, otherwise 1
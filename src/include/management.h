@@ -55,6 +55,9 @@ extern "C" {
 #define MANAGEMENT_ENCRYPTION_AES192    2
 #define MANAGEMENT_ENCRYPTION_AES128    3
 
+/* Set on the compression method when the payload is a binary frame instead of base64 */
+#define MANAGEMENT_FRAME_BINARY         0x80
+
 /**
  * Management commands
  */
@@ -350,7 +353,7 @@ pgexporter_management_read_json(SSL* ssl, int socket, uint8_t* compression, uint
  * Write the management JSON
  * @param ssl The SSL connection
  * @param socket The socket descriptor
- * @param compression The compress method for wire protocol
+ * @param compression The compress method for wire protocol, with MANAGEMENT_FRAME_BINARY for a binary frame
  * @param encryption The encrypt method for wire protocol
  * @param json The JSON structure
  * @return 0 upon success, otherwise 1
@@ -36,6 +36,7 @@ extern "C" {
 #include <pgexporter.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include <openssl/ssl.h>
@@ -75,6 +76,46 @@ pgexporter_read_block_message(SSL* ssl, int socket, struct message** msg);
 int
 pgexporter_read_timeout_message(SSL* ssl, int socket, int timeout, struct message** msg);
 
+/**
+ * Read a message with a deadline
+ * @param ssl The SSL struct
+ * @param socket The socket descriptor
+ * @param deadline The monotonic deadline in microseconds, or 0 for none
+ * @param msg The resulting message
+ * @return One of MESSAGE_STATUS_ZERO, MESSAGE_STATUS_OK or MESSAGE_STATUS_ERROR
+ */
+int
+pgexporter_read_deadline_message(SSL* ssl, int socket, uint64_t deadline, struct message** msg);
+
+/**
+ * Read data in blocking mode into a buffer.
+ *
+ * The data isn't framed into messages
+ * @param ssl The SSL struct
+ * @param socket The socket descriptor
+ * @param data The buffer
+ * @param size The size of the buffer
+ * @param length The number of bytes read
+ * @return One of MESSAGE_STATUS_ZERO, MESSAGE_STATUS_OK or MESSAGE_STATUS_ERROR
+ */
+int
+pgexporter_read_block_data(SSL* ssl, int socket, void* data, size_t size, size_t* length);
+
+/**
+ * Read data with a deadline into a buffer.
+ *
+ * The data isn't framed into messages
+ * @param ssl The SSL struct
+ * @param socket The socket descriptor
+ * @param deadline The monotonic deadline in microseconds, or 0 for none
+ * @param data The buffer
+ * @param size The size of the buffer
+ * @param length The number of bytes read
+ * @return One of MESSAGE_STATUS_ZERO, MESSAGE_STATUS_OK or MESSAGE_STATUS_ERROR
+ */
+int
+pgexporter_read_deadline_data(SSL* ssl, int socket, uint64_t deadline, void* data, size_t size, size_t* length);
+
 /**
  * Write a message using a socket
  * @param ssl The SSL struct
@@ -141,6 +182,16 @@ pgexporter_write_notice(SSL* ssl, int socket);
 int
 pgexporter_write_terminate(SSL* ssl, int socket);
 
+/**
+ * Write a cancel request message
+ * @param socket The socket descriptor of a new connection to the server
+ * @param pid The process id of the backend
+ * @param secret The secret key of the backend
+ * @return MESSAGE_STATUS_OK upon success
+ */
+int
+pgexporter_write_cancel_request(int socket, int pid, int secret);
+
 /**
  * Write an empty message
  * @param ssl The SSL struct
@@ -64,12 +64,16 @@ extern "C" {
 
 #define MAX_PATH             1024
 #define MISC_LENGTH           128
-#define NUMBER_OF_SERVERS      64
 #define NUMBER_OF_USERS        64
 #define NUMBER_OF_ADMINS        8
-#define NUMBER_OF_METRICS     256
 #define NUMBER_OF_COLLECTORS  256
 #define NUMBER_OF_ENDPOINTS    32
+#define NUMBER_OF_EXTENSION_FUNCTIONS 32
+#define NUMBER_OF_INTERNAL_TAGS 32
+#define NUMBER_OF_BUCKETS      9
+
+#define INITIAL_NUMBER_OF_SERVERS  16
+#define INITIAL_NUMBER_OF_METRICS 256
 
 #define STATE_FREE        0
 #define STATE_IN_USE      1
@@ -87,9 +91,6 @@ extern "C" {
 #define HUGEPAGE_TRY 1
 #define HUGEPAGE_ON  2
 
-#define MAX_QUERY_LENGTH      2048
-#define MAX_COLLECTOR_LENGTH  1024
-
 #define LABEL_TYPE      0
 #define COUNTER_TYPE    1
 #define GAUGE_TYPE      2
@@ -213,6 +214,91 @@ extern void* bridge_cache_shmem;
  */
 extern void* bridge_json_cache_shmem;
 
+/**
+ * Shared memory used to contain the rendered
+ * pg_settings metrics.
+ */
+extern void* prometheus_settings_shmem;
+
+/**
+ * Shared memory used to contain the
+ * statistics of pgexporter itself.
+ */
+extern void* prometheus_statistics_shmem;
+
+/**
+ * Shared memory used to contain the
+ * logging buffer.
+ */
+extern void* logging_shmem;
+
+/** @struct extension_function
+ * Defines a function of the pgexporter_ext extension
+ */
+struct extension_function
+{
+   char name[MISC_LENGTH];        /**< The name of the function */
+   bool input;                    /**< Does the function take a location */
+   char description[MISC_LENGTH]; /**< The description of the metric */
+   char type[MISC_LENGTH];        /**< The type of the metric */
+};
+
+/** @struct catalogue
+ * Defines the functions of the pgexporter_ext extension of a server.
+ *
+ * The catalogue is read once per server version, and is read
+ * again when the version of the server changes.
+ */
+struct catalogue
+{
+   bool valid;                                                         /**< Is the catalogue valid */
+   int version;                                                        /**< The server version the catalogue was read for */
+   int number_of_functions;                                            /**< The number of functions */
+   struct extension_function functions[NUMBER_OF_EXTENSION_FUNCTIONS]; /**< The functions */
+};
+
+/** @struct plan
+ * Defines the compiled scrape plan of a server.
+ *
+ * The plan holds the query alternative resolved for each metric
+ * against the version and the role of the server, so a scrape
+ * only has to execute the queries and format the results.
+ *
+ * The plan is built when the server is first connected, and is
+ * rebuilt only when the version or the role of the server changes,
+ * or when the configuration is reloaded. The collectors are fixed
+ * at startup.
+ */
+struct plan
+{
+   bool valid;                                       /**< Is the plan valid */
+   atomic_schar lock;                                /**< The lock of the plan builders */
+   int version;                                      /**< The server version the plan was built for */
+   int state;                                        /**< The server state the plan was built for */
+   struct query_alts** query_alts;                   /**< The query alternative per metric, NULL if skipped */
+};
+
+/** @struct server_state
+ * Defines the connection state of a server.
+ *
+ * The states are kept in their own section, index by index with
+ * the servers, so a scrape loop over the servers reads a single
+ * cache line per server instead of the whole server definition.
+ */
+struct server_state
+{
+   int fd;             /**< The socket descriptor */
+   int state;          /**< The state of the server */
+   int version;        /**< The major version of the server*/
+   int minor_version;  /**< The minor version of the server*/
+   SSL* ssl;           /**< The SSL structure */
+   bool new;           /**< Is the connection new */
+   bool extension;     /**< Is the pgexporter_ext extension installed */
+   int backend_pid;    /**< The process id of the backend */
+   int backend_secret; /**< The secret key of the backend */
+   struct plan plan;   /**< The scrape plan */
+} __attribute__ ((aligned (64)));
+
 /** @struct server
  * Defines a server
  */
@@ -224,16 +310,10 @@ struct server
    char username[MAX_USERNAME_LENGTH]; /**< The user name */
    char data[MISC_LENGTH];             /**< The data directory */
    char wal[MISC_LENGTH];              /**< The WAL directory */
-   SSL* ssl;                           /**< The SSL structure */
-   int fd;                             /**< The socket descriptor */
-   bool new;                           /**< Is the connection new */
-   bool extension;                     /**< Is the pgexporter_ext extension installed */
-   int state;                          /**< The state of the server */
-   int version;                        /**< The major version of the server*/
-   int minor_version;                  /**< The minor version of the server*/
    char tls_cert_file[MISC_LENGTH];    /**< TLS certificate path */
    char tls_key_file[MISC_LENGTH];     /**< TLS key path */
    char tls_ca_file[MISC_LENGTH];      /**< TLS CA certificate path */
+   struct catalogue catalogue;         /**< The extension function catalogue */
 } __attribute__ ((aligned (64)));
 
 /** @struct user
@@ -258,13 +338,108 @@ struct user
  *
  * The `size` field stores the size of the allocated
  * `data` payload.
+ *
+ * The `collectors` field stores the collectors the request
+ * selected, and the response is only served to the same selection.
  */
 struct prometheus_cache
 {
-   time_t valid_until;   /**< when the cache will become not valid */
-   atomic_schar lock;    /**< lock to protect the cache */
-   size_t size;          /**< size of the cache */
-   char data[];          /**< the payload */
+   time_t valid_until;            /**< when the cache will become not valid */
+   atomic_schar lock;             /**< lock to protect the cache */
+   char collectors[MAX_PATH];     /**< the collectors selected for the response */
+   size_t size;                   /**< size of the cache */
+   char data[];                   /**< the payload */
+} __attribute__ ((aligned (64)));
+
+/** @struct settings_fingerprint
+ * Defines the configuration state of a server, which is empty
+ * if the server did not contribute to the rendered settings.
+ */
+struct settings_fingerprint
+{
+   char load_time[MISC_LENGTH];  /**< pg_conf_load_time() of the server */
+   char start_time[MISC_LENGTH]; /**< pg_postmaster_start_time() of the server */
+};
+
+/** @struct prometheus_settings
+ * A structure to keep the rendered pg_settings metrics
+ * between scrapes.
+ *
+ * Each server has a fingerprint of its configuration state,
+ * keyed by the index of the server.
+ * The block is served as long as the fingerprints of the servers
+ * are unchanged.
+ *
+ * The structure is protected by the lock of the Prometheus cache.
+ *
+ * The `size` field stores the size of the allocated
+ * `data` payload, and the fingerprints of `number_of_servers`
+ * servers follow the payload.
+ */
+struct prometheus_settings
+{
+   bool valid;                                 /**< is the block valid */
+   int number_of_servers;                      /**< the number of fingerprints */
+   struct settings_fingerprint* fingerprints; /**< the fingerprint of each server */
+   size_t size;                                /**< size of the block */
+   char data[];                                /**< the rendered block */
+} __attribute__ ((aligned (64)));
+
+/** @struct histogram
+ * Defines a duration histogram, where the buckets are
+ * cumulative and the sum is in microseconds
+ */
+struct histogram
+{
+   atomic_ulong buckets[NUMBER_OF_BUCKETS]; /**< The bucket counts */
+   atomic_ulong sum;                        /**< The sum in microseconds */
+   atomic_ulong count;                      /**< The count */
+};
+
+/** @struct query_statistics
+ * Defines the statistics of a query on a server
+ */
+struct query_statistics
+{
+   struct histogram duration; /**< The duration */
+   atomic_ulong rows;         /**< The number of rows returned */
+   atomic_ulong bytes;        /**< The number of bytes returned */
+   atomic_ulong timeouts;     /**< The number of timeouts */
+};
+
+/** @struct server_statistics
+ * Defines the statistics of a server
+ */
+struct server_statistics
+{
+   struct histogram connect;         /**< The connect and authentication duration */
+   struct query_statistics* queries; /**< The query statistics, one per tag slot */
+};
+
+/** @struct prometheus_statistics
+ * The statistics of pgexporter itself.
+ *
+ * The query statistics are kept per tag and server. A tag
+ * claims a slot in `tags` the first time it is executed.
+ *
+ * The slots are sized from the configuration when the statistics
+ * are created, and the sections follow the structure in the same
+ * segment. The statistics of the servers are kept with the servers
+ * in the registry, see `struct server_statistics`.
+ */
+struct prometheus_statistics
+{
+   int number_of_tags;           /**< The number of tag slots */
+   atomic_bool full;             /**< Are all the tag slots taken */
+   atomic_schar* states;         /**< The state of each tag slot */
+   char (*tags)[MISC_LENGTH];    /**< The tags */
+   struct histogram scrape;      /**< The scrape duration */
+   struct histogram render;      /**< The render duration */
+   atomic_ulong bytes;           /**< The number of bytes written */
+   atomic_ulong cache_hits;      /**< Metrics cache hits */
+   atomic_ulong cache_misses;    /**< Metrics cache misses */
+   atomic_ulong settings_hits;   /**< Settings cache hits */
+   atomic_ulong settings_misses; /**< Settings cache misses */
 } __attribute__ ((aligned (64)));
 
 /** @struct column
@@ -272,10 +447,10 @@ struct prometheus_cache
  */
 struct column
 {
-   int type;                        /**< Metrics type 0--label 1--counter 2--gauge 3--histogram*/
-   char name[MISC_LENGTH];          /**< Column name */
-   char description[MISC_LENGTH];   /**< Description of column */
-} __attribute__ ((aligned (64)));
+   int type;          /**< Metrics type 0--label 1--counter 2--gauge 3--histogram*/
+   char* name;        /**< Column name, interned */
+   char* description; /**< Description of column, interned */
+};
 
 /**
  * @struct query_alts
@@ -294,10 +469,20 @@ struct column
 struct query_alts
 {
    char version;                                   /**< Minimum required version to run query */
-   char query[MAX_QUERY_LENGTH];                   /**< Query String */
+   char* query;                                    /**< Query String, interned */
    struct column columns[MAX_NUMBER_OF_COLUMNS];   /**< Columns of query */
    int n_columns;                                  /**< No. of columns */
    bool is_histogram;                              /**< Is the query for a histogram metric */
+   int timeout;                                    /**< Timeout in milliseconds, 0 for none */
+
+   /* Compiled */
+   int histogram;                                  /**< Index of the histogram column, -1 if none */
+   int n_labels;                                   /**< No. of label columns */
+   int labels[MAX_NUMBER_OF_COLUMNS];              /**< Indexes of the label columns */
+   char* names[MAX_NUMBER_OF_COLUMNS];             /**< Column names */
+   char* metrics[MAX_NUMBER_OF_COLUMNS];           /**< Metric name of each column, NULL for labels */
+   char* headers[MAX_NUMBER_OF_COLUMNS];           /**< HELP/TYPE lines of each column, NULL for labels */
+   char* text;                                     /**< Storage of the metric names and the HELP/TYPE lines */
 
    /* AVL Tree */
    unsigned int height;       /**< Node's height, 1 if leaf, 0 if NULL */
@@ -314,8 +499,9 @@ struct prometheus
    char tag[MISC_LENGTH];                          /**< The metric name */
    int sort_type;                                  /**< Sorting type of multi queries 0--SORT_NAME 1--SORT_DATA0 */
    int server_query_type;                          /**< Query type 0--SERVER_QUERY_BOTH 1--SERVER_QUERY_PRIMARY 2--SERVER_QUERY_REPLICA */
-   char collector[MAX_COLLECTOR_LENGTH];           /**< Collector Tag for query */
+   char* collector;                                /**< Collector Tag for query, interned */
    struct query_alts* root;                        /**< Root of the Query Alternatives' AVL Tree */
+   bool compiled;                                  /**< Are the Query Alternatives compiled */
 } __attribute__ ((aligned (64)));
 
 /** @struct endpoint
@@ -340,6 +526,7 @@ struct configuration
    int metrics;                   /**< The metrics port */
    int metrics_cache_max_age;     /**< Number of seconds to cache the Prometheus response */
    size_t metrics_cache_max_size; /**< Number of bytes max to cache the Prometheus response */
+   int metrics_scrape_timeout;    /**< Number of seconds a scrape may take when Prometheus doesn't tell */
    int management;                /**< The management port */
 
    int bridge;                        /**< The bridge port */
@@ -384,6 +571,9 @@ struct configuration
    int number_of_admins;         /**< The number of admins */
    int number_of_metrics;        /**< The number of metrics*/
    int number_of_collectors;     /**< Number of total collectors */
+   int max_servers;              /**< The capacity of the servers section */
+   int max_metrics;              /**< The capacity of the metrics section */
+   size_t max_plans;             /**< The capacity of the plans section */
    int number_of_endpoints;      /**< The number of endpoints */
 
    char metrics_path[MAX_PATH]; /**< The metrics path */
@@ -393,12 +583,16 @@ struct configuration
    atomic_ulong logging_error; /**< Logging: ERROR */
    atomic_ulong logging_fatal; /**< Logging: FATAL */
 
-   char collectors[NUMBER_OF_COLLECTORS][MAX_COLLECTOR_LENGTH]; /**< List of collectors in total */
-   struct server servers[NUMBER_OF_SERVERS];                    /**< The servers */
-   struct user users[NUMBER_OF_USERS];                          /**< The users */
-   struct user admins[NUMBER_OF_ADMINS];                        /**< The admins */
-   struct prometheus prometheus[NUMBER_OF_METRICS];             /**< The Prometheus metrics */
-   struct endpoint endpoints[NUMBER_OF_ENDPOINTS];              /**< The Prometheus metrics */
+   struct registry* registry;                      /**< The registry of the sections below */
+   char** collectors;                              /**< List of collectors in total */
+   struct server* servers;                         /**< The servers */
+   struct server_state* states;                    /**< The connection states of the servers */
+   struct query_alts** plans;                      /**< The query alternatives of the plans of the servers */
+   struct server_statistics* statistics;           /**< The statistics of the servers, NULL if not tracked */
+   struct user users[NUMBER_OF_USERS];             /**< The users */
+   struct user admins[NUMBER_OF_ADMINS];           /**< The admins */
+   struct prometheus* prometheus;                  /**< The Prometheus metrics */
+   struct endpoint endpoints[NUMBER_OF_ENDPOINTS]; /**< The Prometheus metrics */
 } __attribute__((aligned(64)));
 
 #ifdef __cplusplus
@@ -33,7 +33,10 @@
 extern "C" {
 #endif
 
+#include <pgexporter.h>
+
 #include <ev.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /*
@@ -57,6 +60,12 @@ extern "C" {
  */
 #define PROMETHEUS_DEFAULT_CACHE_SIZE (256 * 1024)
 
+/**
+ * Size of the rendered pg_settings block (in bytes).
+ * If the block exceeds this size it is not kept.
+ */
+#define PROMETHEUS_SETTINGS_SIZE (1024 * 1024)
+
 /**
  * Create a prometheus instance
  * @param fd The client descriptor
@@ -77,6 +86,56 @@ pgexporter_prometheus_reset(void);
 void
 pgexporter_prometheus_logging(int logging);
 
+/**
+ * Compile the metrics of a configuration.
+ *
+ * Every query alternative gets its label and histogram column
+ * indexes resolved, and its metric names and HELP/TYPE lines
+ * pre-rendered into shared memory. The plans and the statistics
+ * of the servers are allocated in the registry.
+ *
+ * Must be invoked by the main process after the metrics
+ * have been read.
+ *
+ * @param config The configuration
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_prometheus_compile(struct configuration* config);
+
+/**
+ * Build the scrape plan of a server.
+ *
+ * The plan resolves the query alternative of each metric against
+ * the collectors, and the version and the role of the server. The
+ * plan is kept as long as the version and the role are the same.
+ *
+ * @param server The server
+ */
+void
+pgexporter_prometheus_plan(int server);
+
+/**
+ * Carry the statistics of the servers over to a reloaded
+ * configuration, which must be compiled. A kept server keeps
+ * its statistics even if its position changed, and the other
+ * servers start out empty.
+ *
+ * Must be invoked by the main process.
+ *
+ * @param config The configuration in use
+ * @param reload The reloaded configuration
+ * @param servers The previous index of each server, -1 if the server changed
+ */
+void
+pgexporter_prometheus_statistics_transfer(struct configuration* config, struct configuration* reload, int* servers);
+
+/**
+ * Invalidate the cached response and the rendered settings
+ */
+void
+pgexporter_prometheus_invalidate(void);
+
 /**
  * Allocates, for the first time, the Prometheus cache.
  *
@@ -101,6 +160,63 @@ pgexporter_prometheus_logging(int logging);
 int
 pgexporter_init_prometheus_cache(size_t* p_size, void** p_shmem);
 
+/**
+ * Allocates the shared memory for the rendered pg_settings metrics.
+ *
+ * Assumes the shared memory for the configuration is already set.
+ *
+ * @param p_size a pointer to where to store the size of
+ * allocated chunk of memory
+ * @param p_shmem the pointer to the pointer at which the allocated chunk
+ * of shared memory is going to be inserted
+ *
+ * @return 0 on success
+ */
+int
+pgexporter_init_prometheus_settings(size_t* p_size, void** p_shmem);
+
+/**
+ * Allocates the shared memory for the statistics of pgexporter.
+ *
+ * Assumes the shared memory for the configuration is already set.
+ *
+ * @param p_size a pointer to where to store the size of
+ * allocated chunk of memory
+ * @param p_shmem the pointer to the pointer at which the allocated chunk
+ * of shared memory is going to be inserted
+ *
+ * @return 0 on success
+ */
+int
+pgexporter_init_prometheus_statistics(size_t* p_size, void** p_shmem);
+
+/**
+ * Add the statistics of a query
+ * @param server The server
+ * @param tag The tag of the query
+ * @param duration The duration in microseconds
+ * @param rows The number of rows returned
+ * @param bytes The number of bytes returned
+ */
+void
+pgexporter_prometheus_query(int server, char* tag, uint64_t duration, unsigned long rows, unsigned long bytes);
+
+/**
+ * Count a query cancelled at its timeout
+ * @param server The server
+ * @param tag The tag of the query
+ */
+void
+pgexporter_prometheus_timeout(int server, char* tag);
+
+/**
+ * Add the duration of a connect and authentication
+ * @param server The server
+ * @param duration The duration in microseconds
+ */
+void
+pgexporter_prometheus_connect(int server, uint64_t duration);
+
 #ifdef __cplusplus
 }
 #endif
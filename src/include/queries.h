@@ -36,6 +36,7 @@ extern "C" {
 #include <pgexporter.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 /** @struct tuple
@@ -92,6 +93,53 @@ pgexporter_query_get_functions(int server, struct query** query);
 int
 pgexporter_query_execute(int server, char* sql, char* tag, struct query** query);
 
+/**
+ * Set the deadline of the queries of this process.
+ *
+ * A query that hasn't completed by the deadline fails, and is
+ * cancelled on the server. No query is sent after the deadline.
+ * Once the connections are open each server gets an equal share
+ * of the time left, so a slow server doesn't leave the others
+ * without time
+ * @param deadline The monotonic deadline in microseconds, or 0 for none
+ */
+void
+pgexporter_set_query_deadline(uint64_t deadline);
+
+/**
+ * Are the results of a server partial, because queries were
+ * cancelled or not sent when the deadline passed
+ * @param server The server
+ * @return True if partial, otherwise false
+ */
+bool
+pgexporter_query_partial(int server);
+
+/**
+ * Send a query without waiting for the result, so several
+ * servers can execute their queries at the same time
+ * @param server The server
+ * @param sql The SQL query, which may hold several statements
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_query_send(int server, char* sql);
+
+/**
+ * Receive the results of a query sent with pgexporter_query_send.
+ *
+ * A failing statement makes the server skip the rest of the query,
+ * and the results of the statements before it are kept
+ * @param server The server
+ * @param tag The tag
+ * @param n The number of statements in the query
+ * @param queries The resulting queries, one per statement
+ * @param completed The number of completed statements, or -1 if there is no response
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_query_receive(int server, char* tag, int n, struct query** queries, int* completed);
+
 /**
  * Query for used disk space
  * @param server The server
@@ -212,6 +260,16 @@ pgexporter_query_stat_database_conflicts(int server, struct query** query);
 int
 pgexporter_query_settings(int server, struct query** query);
 
+/**
+ * Query the configuration fingerprint, which is the
+ * configuration load time and the start time of the server
+ * @param server The server
+ * @param query The resulting query
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_query_settings_fingerprint(int server, struct query** query);
+
 /**
  * Query custom metrics
  * @param server The server
@@ -219,21 +277,29 @@ pgexporter_query_settings(int server, struct query** query);
  * @param tag
  * @param columns
  * @param names
+ * @param timeout The timeout in milliseconds, or 0 for none
  * @param query The resulting query
  * @return 0 upon success, otherwise 1
  */
 int
-pgexporter_custom_query(int server, char* qs, char* tag, int columns, char** names, struct query** query);
+pgexporter_custom_query(int server, char* qs, char* tag, int columns, char** names, int timeout, struct query** query);
 
 /**
- * Merge queries
- * @param q1 The first query
- * @param q2 The second query
+ * Merge the queries of several servers in one pass.
+ *
+ * With SORT_NAME the tuples are concatenated in order. With SORT_DATA0
+ * the tuples are grouped on the first column with a k-way merge, and
+ * within a group the tuples keep the order of the queries.
+ *
+ * The queries are consumed, and their entries are set to NULL.
+ *
+ * @param queries The queries, where entries may be NULL
+ * @param n The number of queries
  * @param sort The sort key
- * @return The resulting list
+ * @return The resulting query
  */
 struct query*
-pgexporter_merge_queries(struct query* q1, struct query* q2, int sort);
+pgexporter_merge_all_queries(struct query** queries, int n, int sort);
 
 /**
  * Free allocated memory for tuples linked list
@@ -268,6 +334,15 @@ pgexporter_get_column(int col, struct tuple* tuple);
 void
 pgexporter_query_debug(struct query* query);
 
+/**
+ * Get the index of a column by name
+ * @param name The column name
+ * @param query The query
+ * @return The index, or -1 if not found
+ */
+int
+pgexporter_get_column_index(char* name, struct query* query);
+
 /**
  * Get column from a tuple by name
  * @param name The column name
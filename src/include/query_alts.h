@@ -27,6 +27,7 @@
  */
 
 #include <pgexporter.h>
+#include <registry.h>
 
 /**
  * Query Alternatives, or query_alts, are alternatives of the same query with
@@ -54,7 +55,7 @@ pgexporter_get_query_alt(struct query_alts* root, int server);
 /**
  * @brief Insert a node `new_node` into the AVL tree `root`
  * @param root Root of the AVL tree
- * @param new_node New node to add (Memory is free'd if node is not used)
+ * @param new_node New node to add (Set to NULL if node is not used)
  * @return query_alts* Returns root of AVL Tree. Can ignore.
  */
 struct query_alts*
@@ -62,11 +63,21 @@ pgexporter_insert_node_avl (struct query_alts* root, struct query_alts** new_nod
 
 /**
  * @brief Copy query alternative from `src` to `dst`
+ * @param registry The registry of `dst`
  * @param dst Destination
  * @param src Source
  */
 void
-pgexporter_copy_query_alts(struct query_alts** dst, struct query_alts* src);
+pgexporter_copy_query_alts(struct registry* registry, struct query_alts** dst, struct query_alts* src);
+
+/**
+ * @brief Compare two query alternatives, including their subtrees
+ * @param a The first query alternative
+ * @param b The second query alternative
+ * @return true if the query alternatives are the same, otherwise false
+ */
+bool
+pgexporter_equal_query_alts(struct query_alts* a, struct query_alts* b);
 
 /**
  * @brief Free the Query Alternatives of a configuration
@@ -76,7 +87,8 @@ void
 pgexporter_free_query_alts(struct configuration* config);
 
 /**
- * @brief Free allocated memory for an AVL Tree Node for Query Alternatives given its root
+ * @brief Free allocated memory for an AVL Tree Node for Query Alternatives given its root.
+ * The nodes belong to the registry of the configuration, so only the compiled text is freed
  * @param root Root of the AVL tree
  */
 void
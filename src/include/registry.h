@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_REGISTRY_H
+#define PGEXPORTER_REGISTRY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <art.h>
+
+#include <stdlib.h>
+
+/** @struct registry
+ * Defines a registry of shared memory for the sections of the
+ * configuration which depend on the number of servers and metrics.
+ *
+ * The registry reserves two arenas of a fixed size before the
+ * workers are forked, so the sections are at the same address in every
+ * process. The sections are allocated one after the other in the
+ * current arena.
+ *
+ * A reload builds the new configuration in the other arena, and makes it
+ * the active one once it is complete. The arena of the previous
+ * configuration is reused by the next reload once every process forked
+ * while it was active is gone. Each arena has a pipe whose write end is
+ * held by these processes, so the arena is free at the end of file of
+ * the pipe.
+ *
+ * Strings are interned, so a string shared by several queries or columns
+ * is only stored once. The index of the strings is private to the process
+ * creating the registry.
+ */
+struct registry
+{
+   size_t size;            /**< The size of each arena */
+   int active;             /**< The arena of the configuration in use */
+   int current;            /**< The arena the sections are allocated from */
+   size_t used[2];         /**< The number of bytes used of each arena */
+   int pipes[2][2];        /**< The pipe of each arena, -1 if none */
+   struct art* strings[2]; /**< The index of the strings of each arena */
+   char* arenas[2];        /**< The arenas */
+};
+
+/**
+ * Create a registry
+ * @param registry [out] The registry
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_registry_create(struct registry** registry);
+
+/**
+ * Allocate a section in the current arena of a registry. The section
+ * is zeroed, and aligned to a cache line
+ * @param registry The registry
+ * @param size The size of the section
+ * @return The section, or NULL upon error
+ */
+void*
+pgexporter_registry_allocate(struct registry* registry, size_t size);
+
+/**
+ * Intern a string in the current arena of a registry
+ * @param registry The registry
+ * @param s The string
+ * @return The interned string, or NULL upon error or if the string is NULL
+ */
+char*
+pgexporter_registry_intern(struct registry* registry, char* s);
+
+/**
+ * Start to allocate from the other arena of a registry, which
+ * is emptied first. Waits a little for the processes using the
+ * arena to finish
+ * @param registry The registry
+ * @return 0 upon success, otherwise 1 if the arena is still in use
+ */
+int
+pgexporter_registry_begin(struct registry* registry);
+
+/**
+ * Make the current arena of a registry the active one. The
+ * previous arena is kept until its processes are gone
+ * @param registry The registry
+ */
+void
+pgexporter_registry_commit(struct registry* registry);
+
+/**
+ * Give up the current arena of a registry, and allocate
+ * from the active arena again
+ * @param registry The registry
+ */
+void
+pgexporter_registry_rollback(struct registry* registry);
+
+/**
+ * Detach a long running process from the arenas of a registry,
+ * so it doesn't keep them in use. The process must not use the
+ * sections of the registry
+ * @param registry The registry
+ */
+void
+pgexporter_registry_detach(struct registry* registry);
+
+/**
+ * Get the size of the sections of the active arena of a registry
+ * @param registry The registry
+ * @return The size
+ */
+size_t
+pgexporter_registry_size(struct registry* registry);
+
+/**
+ * Destroy a registry
+ * @param registry The registry
+ */
+void
+pgexporter_registry_destroy(struct registry* registry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
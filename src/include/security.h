@@ -104,6 +104,15 @@ pgexporter_close_ssl(SSL* ssl);
 int
 pgexporter_extract_server_parameters(struct deque** server_parameters);
 
+/**
+ * Extract the backend key data recevied during the latest authentication
+ * @param pid The process id of the backend
+ * @param secret The secret key of the backend
+ * @return 0 on success, otherwise 1
+ */
+int
+pgexporter_extract_backend_key(int* pid, int* secret);
+
 #ifdef __cplusplus
 }
 #endif
@@ -45,6 +45,16 @@ extern "C" {
 int
 pgexporter_create_shared_memory(size_t size, unsigned char hp, void** shmem);
 
+/**
+ * Reserve a shared memory segment. The memory is zeroed, and is only
+ * backed once it is used
+ * @param size The size of the segment
+ * @param shmem The shared memory segment
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_reserve_shared_memory(size_t size, void** shmem);
+
 /**
  * Resize a shared memory segment
  * @param size The size of the segment
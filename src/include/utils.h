@@ -164,6 +164,19 @@ pgexporter_extract_message(char type, struct message* msg, struct message** extr
 size_t
 pgexporter_extract_message_offset(size_t offset, void* data, struct message** extracted);
 
+/**
+ * View a message based on an offset.
+ *
+ * The view points into the data segment, so it is only
+ * valid as long as the data segment is
+ * @param offset The offset
+ * @param data The data segment
+ * @param view The resulting view
+ * @return The next offset
+ */
+size_t
+pgexporter_view_message_offset(size_t offset, void* data, struct message* view);
+
 /**
  * Extract a message based on a type
  * @param type The type
@@ -521,6 +534,13 @@ pgexporter_get_files(char* base, int* number_of_files, char*** files);
 char*
 pgexporter_get_timestamp_string(time_t start_time, time_t end_time, int32_t* seconds);
 
+/**
+ * Get the monotonic time
+ * @return The time in microseconds
+ */
+uint64_t
+pgexporter_get_monotonic_time(void);
+
 /**
  * Remove a file
  * @param file The file
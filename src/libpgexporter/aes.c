@@ -31,6 +31,28 @@
 #include <logging.h>
 #include <security.h>
 
+#include <limits.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#define NUMBER_OF_MODES (ENCRYPTION_AES_128_CTR + 1)
+
+/** @struct derived_key
+ * Defines a key and initialization vector derived from a password
+ */
+struct derived_key
+{
+   bool derived;                                /**< Has a key been derived */
+   unsigned char digest[SHA256_DIGEST_LENGTH];  /**< The SHA-256 digest of the password */
+   unsigned char key[EVP_MAX_KEY_LENGTH];       /**< The key */
+   unsigned char iv[EVP_MAX_IV_LENGTH];         /**< The initialization vector */
+};
+
+/* The keys derived in this process, by mode */
+static struct derived_key derived_keys[NUMBER_OF_MODES];
+
+static int cipher_reserve(struct cipher* cipher, size_t size);
 static int derive_key_iv(char* password, unsigned char* key, unsigned char* iv, int mode);
 static int aes_encrypt(char* plaintext, unsigned char* key, unsigned char* iv, char** ciphertext, int* ciphertext_length, int mode);
 static int aes_decrypt(char* ciphertext, int ciphertext_length, unsigned char* key, unsigned char* iv, char** plaintext, int mode);
@@ -72,17 +94,214 @@ pgexporter_decrypt(char* ciphertext, int ciphertext_length, char* password, char
    return aes_decrypt(ciphertext, ciphertext_length, key, iv, plaintext, mode);
 }
 
+int
+pgexporter_cipher_create(char* password, int mode, bool encrypt, struct cipher** cipher)
+{
+   struct cipher* c = NULL;
+
+   *cipher = NULL;
+
+   c = malloc(sizeof(struct cipher));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   memset(c, 0, sizeof(struct cipher));
+   c->mode = mode;
+   c->encrypt = encrypt;
+
+   if (derive_key_iv(password, c->key, c->iv, mode))
+   {
+      pgexporter_log_error("Cipher: Failed to derive key and iv");
+      goto error;
+   }
+
+   c->context = EVP_CIPHER_CTX_new();
+   if (c->context == NULL)
+   {
+      goto error;
+   }
+
+   if (EVP_CipherInit_ex(c->context, get_cipher(mode)(), NULL, c->key, c->iv, encrypt ? 1 : 0) != 1)
+   {
+      pgexporter_log_error("Cipher: Failed to initialize cipher context");
+      goto error;
+   }
+
+   *cipher = c;
+
+   return 0;
+
+error:
+
+   pgexporter_cipher_destroy(c);
+
+   return 1;
+}
+
+int
+pgexporter_cipher_update(struct cipher* cipher, void* data, size_t size)
+{
+   unsigned char* in = (unsigned char*)data;
+   size_t n;
+   int length;
+
+   cipher->output_size = 0;
+
+   while (size > 0)
+   {
+      /* The length of an update is an int */
+      n = size < INT_MAX / 2 ? size : INT_MAX / 2;
+
+      if (cipher_reserve(cipher, n + EVP_MAX_BLOCK_LENGTH))
+      {
+         return 1;
+      }
+
+      if (EVP_CipherUpdate(cipher->context, cipher->output + cipher->output_size, &length, in, (int)n) != 1)
+      {
+         pgexporter_log_error("Cipher: Failed to process data");
+         return 1;
+      }
+
+      cipher->output_size += length;
+      in += n;
+      size -= n;
+   }
+
+   return 0;
+}
+
+int
+pgexporter_cipher_finish(struct cipher* cipher)
+{
+   int length;
+
+   cipher->output_size = 0;
+
+   if (cipher_reserve(cipher, EVP_MAX_BLOCK_LENGTH))
+   {
+      return 1;
+   }
+
+   if (EVP_CipherFinal_ex(cipher->context, cipher->output, &length) != 1)
+   {
+      pgexporter_log_error("Cipher: Failed to finalize operation");
+      return 1;
+   }
+
+   cipher->output_size = length;
+
+   return 0;
+}
+
+int
+pgexporter_cipher_reset(struct cipher* cipher)
+{
+   cipher->output_size = 0;
+
+   /* The cipher and the key are kept, so only the state is initialized */
+   if (EVP_CipherInit_ex(cipher->context, NULL, NULL, cipher->key, cipher->iv, cipher->encrypt ? 1 : 0) != 1)
+   {
+      pgexporter_log_error("Cipher: Failed to reset cipher context");
+      return 1;
+   }
+
+   return 0;
+}
+
+void
+pgexporter_cipher_destroy(struct cipher* cipher)
+{
+   if (cipher == NULL)
+   {
+      return;
+   }
+
+   if (cipher->context != NULL)
+   {
+      EVP_CIPHER_CTX_free(cipher->context);
+   }
+
+   OPENSSL_cleanse(cipher->key, sizeof(cipher->key));
+   OPENSSL_cleanse(cipher->iv, sizeof(cipher->iv));
+
+   free(cipher->output);
+   free(cipher);
+}
+
+// [private]
+static int
+cipher_reserve(struct cipher* cipher, size_t size)
+{
+   size_t capacity = cipher->capacity > 0 ? cipher->capacity : 8192;
+   unsigned char* output = NULL;
+
+   if (cipher->capacity - cipher->output_size >= size)
+   {
+      return 0;
+   }
+
+   while (capacity - cipher->output_size < size)
+   {
+      capacity *= 2;
+   }
+
+   output = realloc(cipher->output, capacity);
+   if (output == NULL)
+   {
+      pgexporter_log_error("Cipher: Allocation failure");
+      return 1;
+   }
+
+   cipher->output = output;
+   cipher->capacity = capacity;
+
+   return 0;
+}
+
 // [private]
 static int
 derive_key_iv(char* password, unsigned char* key, unsigned char* iv, int mode)
 {
+   struct derived_key* derived = NULL;
+   unsigned char digest[SHA256_DIGEST_LENGTH];
+
+   /* The password is only kept as a digest */
+   if (mode >= 0 && mode < NUMBER_OF_MODES &&
+       EVP_Digest(password, strlen(password), digest, NULL, EVP_sha256(), NULL) == 1)
+   {
+      derived = &derived_keys[mode];
+   }
+
+   /* The derivation is the same for every message with the same password */
+   if (derived != NULL && derived->derived && !CRYPTO_memcmp(derived->digest, digest, SHA256_DIGEST_LENGTH))
+   {
+      memcpy(key, derived->key, EVP_MAX_KEY_LENGTH);
+      memcpy(iv, derived->iv, EVP_MAX_IV_LENGTH);
+      OPENSSL_cleanse(digest, SHA256_DIGEST_LENGTH);
+      return 0;
+   }
+
    if (!EVP_BytesToKey(get_cipher(mode)(), EVP_sha1(), NULL,
                        (unsigned char*) password, strlen(password), 1,
                        key, iv))
    {
+      OPENSSL_cleanse(digest, SHA256_DIGEST_LENGTH);
       return 1;
    }
 
+   if (derived != NULL)
+   {
+      derived->derived = true;
+      memcpy(derived->digest, digest, SHA256_DIGEST_LENGTH);
+      memcpy(derived->key, key, EVP_MAX_KEY_LENGTH);
+      memcpy(derived->iv, iv, EVP_MAX_IV_LENGTH);
+   }
+
+   OPENSSL_cleanse(digest, SHA256_DIGEST_LENGTH);
+
    return 0;
 }
 
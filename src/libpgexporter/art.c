@@ -34,10 +34,18 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define IS_LEAF(x) (((uintptr_t)(x) & 1))
 #define SET_LEAF(x) ((void*)((uintptr_t)(x) | 1))
 #define GET_LEAF(x) ((struct art_leaf*)((void*)((uintptr_t)(x) & ~1)))
 
+#define ART_SLAB_SIZE 16384
+
 enum art_node_type {
    Node4,
    Node16,
@@ -51,7 +59,8 @@ enum art_node_type {
  * All node types should be aligned
  * because we need the last bit to be 0 as a flag bit for leaf.
  * So that leaf can be treated as a node as well and stored in the children field,
- * and only converted back when necessary
+ * and only converted back when necessary.
+ * The header fills exactly one cache line, MAX_PREFIX_LEN is sized to use the rest of it
  */
 struct art_node
 {
@@ -62,14 +71,15 @@ struct art_node
 } __attribute__ ((aligned (64)));
 
 /**
- * The ART leaf with key buffer of arbitrary size
+ * The ART leaf with key buffer of arbitrary size,
+ * the alignment of malloc is enough to keep the flag bit free
  */
 struct art_leaf
 {
    struct value* value;
    uint32_t key_len;
    unsigned char key[];
-} __attribute__ ((aligned (64)));
+};
 
 /**
  * The ART node with only 4 children,
@@ -136,24 +146,52 @@ node_get_minimum(struct art_node* node);
 static void
 create_art_leaf(struct art_leaf** leaf, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config);
 
-static void
-create_art_node(struct art_node** node, enum art_node_type type);
+/**
+ * Create an inner node out of the slabs of the tree
+ * @param t The tree
+ * @param node [out] The node
+ * @param type The node type
+ * @return 0 upon success, otherwise 1
+ */
+static int
+create_art_node(struct art* t, struct art_node** node, enum art_node_type type);
 
-static void
-create_art_node4(struct art_node4** node);
+static int
+create_art_node4(struct art* t, struct art_node4** node);
 
-static void
-create_art_node16(struct art_node16** node);
+static int
+create_art_node16(struct art* t, struct art_node16** node);
 
-static void
-create_art_node48(struct art_node48** node);
+static int
+create_art_node48(struct art* t, struct art_node48** node);
+
+static int
+create_art_node256(struct art* t, struct art_node256** node);
 
+/**
+ * Give an inner node back to the slabs of the tree
+ * @param t The tree
+ * @param node The node
+ */
 static void
-create_art_node256(struct art_node256** node);
+free_art_node(struct art* t, struct art_node* node);
+
+/**
+ * Add a slab of inner nodes of a type to the tree.
+ * The slabs double with the nodes of the type, so small trees stay small
+ * @param t The tree
+ * @param type The node type
+ * @return 0 upon success, otherwise 1
+ */
+static int
+create_art_slab(struct art* t, enum art_node_type type);
+
+static size_t
+art_node_size(enum art_node_type type);
 
 // Destroy ART nodes/leaves recursively
 static void
-destroy_art_node(struct art_node* node);
+destroy_art_node(struct art* t, struct art_node* node);
 
 static int
 art_iterate(struct art* t, art_callback cb, void* data);
@@ -207,6 +245,7 @@ find_index(unsigned char ch, const unsigned char* keys, int length);
 /**
  * Insert a value into a node recursively, adopting lazy expansion and path compression --
  * Expand the leaf, or split inner node should keys diverge within node's prefix range
+ * @param t The tree
  * @param node The node
  * @param node_ref The reference to node pointer
  * @param depth The depth into the node, which is the same as the total prefix length
@@ -216,13 +255,15 @@ find_index(unsigned char ch, const unsigned char* keys, int length);
  * @param type The value type
  * @param config The config
  * @param new If the key value is newly inserted (not replaced)
- * @return Old value if the key exists, otherwise NULL
+ * @param old_value [out] Old value if the key exists, otherwise NULL
+ * @return 0 upon success, otherwise 1 if a node couldn't be created
  */
-static struct value*
-art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new);
+static int
+art_node_insert(struct art* t, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new, struct value** old_value);
 
 /**
  * Delete a value from a node recursively.
+ * @param t The tree
  * @param node The node
  * @param node_ref The reference to node pointer
  * @param depth The depth into the node
@@ -231,32 +272,34 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
  * @return Deleted value if the key exists, otherwise NULL
  */
 static struct art_leaf*
-art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len);
+art_node_delete(struct art* t, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len);
 
 static int
 art_node_iterate(struct art_node* node, art_callback cb, void* data);
 
-static void
-node_add_child(struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child);
+static int
+node_add_child(struct art* t, struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child);
 
 /**
  * Add a child to the node. The function assumes node is not NULL,
  * nor the key character already exists.
  * If node is full, a new node of type node16 will be created. The old
  * node will be replaced by new node through node_ref.
+ * @param t The tree
  * @param node The node
  * @param node_ref The reference of the node pointer
  * @param ch The key character
  * @param child The child
+ * @return 0 upon success, otherwise 1 if the new node couldn't be created
  */
-static void
-node4_add_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child);
+static int
+node4_add_child(struct art* t, struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child);
 
-static void
-node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child);
+static int
+node16_add_child(struct art* t, struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child);
 
-static void
-node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child);
+static int
+node48_add_child(struct art* t, struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child);
 
 static void
 node256_add_child(struct art_node256* node, unsigned char ch, void* child);
@@ -264,20 +307,21 @@ node256_add_child(struct art_node256* node, unsigned char ch, void* child);
 // All removal functions assume the child to remove is leaf, meaning they don't try removing anything recursively.
 // They also do not free the leaf node for bookkeeping purpose. The key insight is that due to path compression,
 // no node will have only one child, if node has only one child after deletion, it merges with this child
+// A node that can't be downgraded for a lack of memory stays as it is
 static void
-node_remove_child(struct art_node* node, struct art_node** node_ref, unsigned char ch);
+node_remove_child(struct art* t, struct art_node* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch);
+node4_remove_child(struct art* t, struct art_node4* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node16_remove_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch);
+node16_remove_child(struct art* t, struct art_node16* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch);
+node48_remove_child(struct art* t, struct art_node48* node, struct art_node** node_ref, unsigned char ch);
 
 static void
-node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsigned char ch);
+node256_remove_child(struct art* t, struct art_node256* node, struct art_node** node_ref, unsigned char ch);
 
 static void
 copy_header(struct art_node* dest, struct art_node* src);
@@ -306,13 +350,74 @@ to_compact_json_string(struct art* t, char* tag, int indent);
 static char*
 to_text_string(struct art* t, char* tag, int indent);
 
+/**
+ * Push a node on the path of an iterator
+ * @param iter The iterator
+ * @param node The node
+ * @param index The position of the next child
+ * @return 0 if success, otherwise 1
+ */
+static int
+iterator_push(struct art_iterator* iter, struct art_node* node, int index);
+
+/**
+ * Get the next child of a node on the path of an iterator
+ * @param frame The frame of the node
+ * @return The child, or NULL if there are no more children
+ */
+static struct art_node*
+iterator_child(struct art_iterator_frame* frame);
+
+/**
+ * Walk the path of an iterator to the next leaf
+ * @param iter The iterator
+ * @return The leaf, or NULL if there are no more leaves
+ */
+static struct art_leaf*
+iterator_advance(struct art_iterator* iter);
+
+/**
+ * Walk the path of an iterator to the first leaf of a node
+ * @param iter The iterator
+ * @param node The node
+ * @return The leaf
+ */
+static struct art_leaf*
+iterator_leftmost(struct art_iterator* iter, struct art_node* node);
+
+/**
+ * Position an iterator at the first leaf that is not smaller than a key
+ * @param iter The iterator
+ * @param key The key, without the terminating zero
+ * @param key_len The length of the key
+ */
+static void
+iterator_seek(struct art_iterator* iter, unsigned char* key, uint32_t key_len);
+
+/**
+ * Position an iterator at the first leaf of its range
+ * @param iter The iterator
+ */
+static void
+iterator_position(struct art_iterator* iter);
+
+/**
+ * End an iterator when its next leaf is outside of its range
+ * @param iter The iterator
+ */
+static void
+iterator_bound(struct art_iterator* iter);
+
 int
 pgexporter_art_create(struct art** tree)
 {
    struct art* t = NULL;
-   t = malloc(sizeof(struct art));
-   t->size = 0;
-   t->root = NULL;
+   t = calloc(1, sizeof(struct art));
+   if (t == NULL)
+   {
+      *tree = NULL;
+      return 1;
+   }
    *tree = t;
    return 0;
 }
@@ -324,7 +429,12 @@ pgexporter_art_destroy(struct art* tree)
    {
       return 0;
    }
-   destroy_art_node(tree->root);
+   destroy_art_node(tree, tree->root);
+   for (uint32_t i = 0; i < tree->number_of_slabs; i++)
+   {
+      free(tree->slabs[i]);
+   }
+   free(tree->slabs);
    free(tree);
    return 0;
 }
@@ -361,7 +471,10 @@ pgexporter_art_insert(struct art* t, char* key, uintptr_t value, enum value_type
       // c'mon, at least create a tree first...
       goto error;
    }
-   old_val = art_node_insert(t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, type, NULL, &new);
+   if (art_node_insert(t, t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, type, NULL, &new, &old_val))
+   {
+      goto error;
+   }
    pgexporter_value_destroy(old_val);
    if (new)
    {
@@ -381,7 +494,10 @@ pgexporter_art_insert_with_config(struct art* t, char* key, uintptr_t value, str
    {
       goto error;
    }
-   old_val = art_node_insert(t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, ValueRef, config, &new);
+   if (art_node_insert(t, t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1, value, ValueRef, config, &new, &old_val))
+   {
+      goto error;
+   }
    pgexporter_value_destroy(old_val);
    if (new)
    {
@@ -400,7 +516,7 @@ pgexporter_art_delete(struct art* t, char* key)
    {
       return 1;
    }
-   l = art_node_delete(t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1);
+   l = art_node_delete(t, t->root, &t->root, 0, (unsigned char*)key, strlen(key) + 1);
    t->size--;
    pgexporter_value_destroy(l->value);
    free(l);
@@ -414,7 +530,7 @@ pgexporter_art_clear(struct art* t)
    {
       return 0;
    }
-   destroy_art_node(t->root);
+   destroy_art_node(t, t->root);
    t->root = NULL;
    t->size = 0;
    return 0;
@@ -468,82 +584,134 @@ create_art_leaf(struct art_leaf** leaf, unsigned char* key, uint32_t key_len, ui
    *leaf = l;
 }
 
-static void
-create_art_node(struct art_node** node, enum art_node_type type)
+static int
+create_art_node(struct art* t, struct art_node** node, enum art_node_type type)
 {
    struct art_node* n = NULL;
-   switch (type)
+
+   *node = NULL;
+
+   if (t->free_nodes[type] == NULL && create_art_slab(t, type))
    {
-      case Node4:
-      {
-         struct art_node4* n4 = malloc(sizeof(struct art_node4));
-         memset(n4, 0, sizeof(struct art_node4));
-         n4->node.type = Node4;
-         n = (struct art_node*) n4;
-         break;
-      }
-      case Node16:
-      {
-         struct art_node16* n16 = malloc(sizeof(struct art_node16));
-         memset(n16, 0, sizeof(struct art_node16));
-         n16->node.type = Node16;
-         n = (struct art_node*) n16;
-         break;
-      }
-      case Node48:
-      {
-         struct art_node48* n48 = malloc(sizeof(struct art_node48));
-         memset(n48, 0, sizeof(struct art_node48));
-         n48->node.type = Node48;
-         n = (struct art_node*) n48;
-         break;
-      }
-      case Node256:
-      {
-         struct art_node256* n256 = malloc(sizeof(struct art_node256));
-         memset(n256, 0, sizeof(struct art_node256));
-         n256->node.type = Node256;
-         n = (struct art_node*) n256;
-         break;
-      }
+      return 1;
    }
+
+   // The first bytes of a free node link to the next free node
+   n = (struct art_node*)t->free_nodes[type];
+   t->free_nodes[type] = *(void**)n;
+
+   memset(n, 0, art_node_size(type));
+   n->type = type;
    *node = n;
+   return 0;
 }
 
-static void
-create_art_node4(struct art_node4** node)
+static int
+create_art_node4(struct art* t, struct art_node4** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node4);
+   int ret = create_art_node(t, &n, Node4);
    *node = (struct art_node4*)n;
+   return ret;
 }
 
-static void
-create_art_node16(struct art_node16** node)
+static int
+create_art_node16(struct art* t, struct art_node16** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node16);
+   int ret = create_art_node(t, &n, Node16);
    *node = (struct art_node16*)n;
+   return ret;
 }
 
-static void
-create_art_node48(struct art_node48** node)
+static int
+create_art_node48(struct art* t, struct art_node48** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node48);
+   int ret = create_art_node(t, &n, Node48);
    *node = (struct art_node48*)n;
+   return ret;
 }
 
-static void
-create_art_node256(struct art_node256** node)
+static int
+create_art_node256(struct art* t, struct art_node256** node)
 {
    struct art_node* n = NULL;
-   create_art_node(&n, Node256);
+   int ret = create_art_node(t, &n, Node256);
    *node = (struct art_node256*)n;
+   return ret;
+}
+
+static void
+free_art_node(struct art* t, struct art_node* node)
+{
+   enum art_node_type type = node->type;
+
+   *(void**)node = t->free_nodes[type];
+   t->free_nodes[type] = node;
+}
+
+static int
+create_art_slab(struct art* t, enum art_node_type type)
+{
+   size_t size = art_node_size(type);
+   uint32_t number;
+   uint32_t capacity;
+   void** slabs = NULL;
+   char* slab = NULL;
+
+   number = t->allocated[type] > 0 ? t->allocated[type] : 1;
+   number = min(number, (uint32_t)MAX(ART_SLAB_SIZE / size, 1));
+
+   if (t->number_of_slabs == t->capacity)
+   {
+      capacity = t->capacity > 0 ? t->capacity * 2 : 8;
+      slabs = realloc(t->slabs, capacity * sizeof(void*));
+      if (slabs == NULL)
+      {
+         return 1;
+      }
+      t->slabs = slabs;
+      t->capacity = capacity;
+   }
+
+   slab = aligned_alloc(64, number * size);
+   if (slab == NULL)
+   {
+      return 1;
+   }
+
+   t->slabs[t->number_of_slabs++] = slab;
+   t->allocated[type] += number;
+
+   for (uint32_t i = number; i > 0; i--)
+   {
+      *(void**)(slab + (i - 1) * size) = t->free_nodes[type];
+      t->free_nodes[type] = slab + (i - 1) * size;
+   }
+
+   return 0;
+}
+
+static size_t
+art_node_size(enum art_node_type type)
+{
+   switch (type)
+   {
+      case Node4:
+         return sizeof(struct art_node4);
+      case Node16:
+         return sizeof(struct art_node16);
+      case Node48:
+         return sizeof(struct art_node48);
+      case Node256:
+         return sizeof(struct art_node256);
+   }
+   return 0;
 }
 
 static void
-destroy_art_node(struct art_node* node)
+destroy_art_node(struct art* t, struct art_node* node)
 {
    if (node == NULL)
    {
@@ -562,7 +730,7 @@ destroy_art_node(struct art_node* node)
          struct art_node4* n = (struct art_node4*) node;
          for (int i = 0; i < node->num_children; i++)
          {
-            destroy_art_node(n->children[i]);
+            destroy_art_node(t, n->children[i]);
          }
          break;
       }
@@ -571,7 +739,7 @@ destroy_art_node(struct art_node* node)
          struct art_node16* n = (struct art_node16*) node;
          for (int i = 0; i < node->num_children; i++)
          {
-            destroy_art_node(n->children[i]);
+            destroy_art_node(t, n->children[i]);
          }
          break;
       }
@@ -585,7 +753,7 @@ destroy_art_node(struct art_node* node)
             {
                continue;
             }
-            destroy_art_node(n->children[idx - 1]);
+            destroy_art_node(t, n->children[idx - 1]);
          }
          break;
       }
@@ -599,12 +767,12 @@ destroy_art_node(struct art_node* node)
             {
                continue;
             }
-            destroy_art_node(n->children[i]);
+            destroy_art_node(t, n->children[i]);
          }
          break;
       }
    }
-   free(node);
+   free_art_node(t, node);
 }
 
 static struct art_node**
@@ -615,22 +783,48 @@ node_get_child(struct art_node* node, unsigned char ch)
       case Node4:
       {
          struct art_node4* n = (struct art_node4*)node;
-         int idx = find_index(ch, n->keys, n->node.num_children);
-         if (idx == -1 || n->keys[idx] != ch)
+         for (int i = 0; i < n->node.num_children; i++)
          {
-            goto error;
+            if (n->keys[i] == ch)
+            {
+               return &n->children[i];
+            }
          }
-         return &n->children[idx];
+         goto error;
       }
       case Node16:
       {
          struct art_node16* n = (struct art_node16*)node;
+#if defined(__SSE2__)
+         // Compare all 16 keys at once, and only keep the bits of the keys in use
+         __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)ch), _mm_loadu_si128((const __m128i*)n->keys));
+         uint32_t mask = (uint32_t)_mm_movemask_epi8(cmp) & ((1u << n->node.num_children) - 1);
+         if (mask == 0)
+         {
+            goto error;
+         }
+         return &n->children[__builtin_ctz(mask)];
+#elif defined(__ARM_NEON)
+         // There is no movemask on NEON, so narrow each byte of the comparison to a nibble
+         uint8x16_t cmp = vceqq_u8(vdupq_n_u8(ch), vld1q_u8(n->keys));
+         uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(cmp), 4)), 0);
+         if (n->node.num_children < 16)
+         {
+            mask &= (1ull << (4 * n->node.num_children)) - 1;
+         }
+         if (mask == 0)
+         {
+            goto error;
+         }
+         return &n->children[__builtin_ctzll(mask) >> 2];
+#else
          int idx = find_index(ch, n->keys, n->node.num_children);
          if (idx == -1 || n->keys[idx] != ch)
          {
             goto error;
          }
          return &n->children[idx];
+#endif
       }
       case Node48:
       {
@@ -651,8 +845,8 @@ error:
    return NULL;
 }
 
-static struct value*
-art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new)
+static int
+art_node_insert(struct art* t, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len, uintptr_t value, enum value_type type, struct value_config* config, bool* new, struct value** old_value)
 {
    struct art_leaf* leaf = NULL;
    struct art_leaf* min_leaf = NULL;
@@ -661,7 +855,7 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
    struct art_node* new_node = NULL;
    struct art_node** next = NULL;
    unsigned char* leaf_key = NULL;
-   void* old_val = NULL;
+   *old_value = NULL;
    if (node == NULL)
    {
       // Lazy expansion, skip creating an inner node since it currently will have only this one leaf.
@@ -669,7 +863,7 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
       create_art_leaf(&leaf, key, key_len, value, type, config);
       *node_ref = SET_LEAF(leaf);
       *new = true;
-      return NULL;
+      return 0;
    }
    // base case, reaching leaf, either replace or expand
    if (IS_LEAF(node))
@@ -678,9 +872,9 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
       // If the key already exists, replace with new value and return old value
       if (leaf_match(GET_LEAF(node), key, key_len))
       {
-         old_val = GET_LEAF(node)->value;
+         *old_value = GET_LEAF(node)->value;
          pgexporter_value_create(type, value, &(GET_LEAF(node)->value));
-         return old_val;
+         return 0;
       }
       // If the key does not match with existing key, old key and new key diverged some point after depth
       // Even if we merely store a partial prefix for each node, it couldn't have diverged before depth.
@@ -688,7 +882,10 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
       // we compare with the existing key in the left most leaf and find an exact diverging point to split the node (see details below).
       // This way we inductively guarantee that all children to a parent share the same prefix even if it's only partially stored
       leaf_key = GET_LEAF(node)->key;
-      create_art_node(&new_node, Node4);
+      if (create_art_node(t, &new_node, Node4))
+      {
+         return 1;
+      }
       create_art_leaf(&leaf, key, key_len, value, type, config);
       // Get the diverging index after point of depth
       for (idx = depth; idx < min(key_len, GET_LEAF(node)->key_len); idx++)
@@ -704,12 +901,12 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
       }
       new_node->prefix_len = idx - depth;
       depth += new_node->prefix_len;
-      node_add_child(new_node, &new_node, key[depth], SET_LEAF(leaf));
-      node_add_child(new_node, &new_node, leaf_key[depth], (void*)node);
+      node_add_child(t, new_node, &new_node, key[depth], SET_LEAF(leaf));
+      node_add_child(t, new_node, &new_node, leaf_key[depth], (void*)node);
       // replace with new node
       *node_ref = new_node;
       *new = true;
-      return NULL;
+      return 0;
    }
 
    // There are several cases,
@@ -720,7 +917,7 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
    // For case 1, go to the next child to add node recursively, or add leaf to current node in place
    // For case 2, split the current node and add child to new node.
    // Note that it's tricky to check case 2.2, or in that case know the exact diverging point,
-   // since we merely store the first 10 (MAX_PREFIX_LEN) bytes of the prefix.
+   // since we merely store the first MAX_PREFIX_LEN bytes of the prefix.
    // In this case we use the key in the left most leaf of the node to determine the diverging point.
    // Theoretically we inductively guarantee that all children to the same parent share the same prefixes.
    // So we can use the key inside any leaf under this node to see if the diverging point goes beyond the current prefix,
@@ -730,7 +927,10 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
    if (diff_len < node->prefix_len)
    {
       // case 2, split the node
-      create_art_node(&new_node, Node4);
+      if (create_art_node(t, &new_node, Node4))
+      {
+         return 1;
+      }
       create_art_leaf(&leaf, key, key_len, value, type, config);
       new_node->prefix_len = diff_len;
       memcpy(new_node->prefix, node->prefix, min(MAX_PREFIX_LEN, diff_len));
@@ -740,8 +940,8 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
       if (node->prefix_len <= MAX_PREFIX_LEN)
       {
          node->prefix_len = node->prefix_len - (diff_len + 1);
-         node_add_child(new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
-         node_add_child(new_node, &new_node, node->prefix[diff_len], node);
+         node_add_child(t, new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
+         node_add_child(t, new_node, &new_node, node->prefix[diff_len], node);
          // Update node's prefix info since we move it downwards
          // The first diverging character serves as the key byte in keys array,
          // so we don't duplicate store it in the prefix.
@@ -755,15 +955,15 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
       {
          node->prefix_len = node->prefix_len - (diff_len + 1);
          min_leaf = node_get_minimum(node);
-         node_add_child(new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
-         node_add_child(new_node, &new_node, min_leaf->key[depth + diff_len], node);
+         node_add_child(t, new_node, &new_node, key[depth + diff_len], SET_LEAF(leaf));
+         node_add_child(t, new_node, &new_node, min_leaf->key[depth + diff_len], node);
          // node is moved downwards
          memmove(node->prefix, min_leaf->key + depth + diff_len + 1, min(MAX_PREFIX_LEN, node->prefix_len));
       }
       // replace
       *node_ref = new_node;
       *new = true;
-      return NULL;
+      return 0;
    }
    else
    {
@@ -777,21 +977,26 @@ art_node_insert(struct art_node* node, struct art_node** node_ref, uint32_t dept
          {
             node->num_children++;
          }
-         return art_node_insert(*next, next, depth + 1, key, key_len, value, type, config, new);
+         return art_node_insert(t, *next, next, depth + 1, key, key_len, value, type, config, new, old_value);
       }
       else
       {
          // add a child to current node since the spot is available
          create_art_leaf(&leaf, key, key_len, value, type, config);
-         node_add_child(node, node_ref, key[depth], SET_LEAF(leaf));
+         if (node_add_child(t, node, node_ref, key[depth], SET_LEAF(leaf)))
+         {
+            pgexporter_value_destroy(leaf->value);
+            free(leaf);
+            return 1;
+         }
          *new = true;
-         return NULL;
+         return 0;
       }
    }
 }
 
 static struct art_leaf*
-art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len)
+art_node_delete(struct art* t, struct art_node* node, struct art_node** node_ref, uint32_t depth, unsigned char* key, uint32_t key_len)
 {
    struct art_leaf* l = NULL;
    struct art_node** child = NULL;
@@ -834,7 +1039,7 @@ art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t dept
          if (leaf_match(GET_LEAF(*child), key, key_len))
          {
             l = GET_LEAF(*child);
-            node_remove_child(node, node_ref, key[depth]);
+            node_remove_child(t, node, node_ref, key[depth]);
             return l;
          }
          else
@@ -844,7 +1049,7 @@ art_node_delete(struct art_node* node, struct art_node** node_ref, uint32_t dept
       }
       else
       {
-         return art_node_delete(*child, child, depth + 1, key, key_len);
+         return art_node_delete(t, *child, child, depth + 1, key, key_len);
       }
    }
 }
@@ -936,28 +1141,26 @@ art_node_iterate(struct art_node* node, art_callback cb, void* data)
    return 0;
 }
 
-static void
-node_add_child(struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child)
+static int
+node_add_child(struct art* t, struct art_node* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    switch (node->type)
    {
       case Node4:
-         node4_add_child((struct art_node4*) node, node_ref, ch, child);
-         break;
+         return node4_add_child(t, (struct art_node4*) node, node_ref, ch, child);
       case Node16:
-         node16_add_child((struct art_node16*) node, node_ref, ch, child);
-         break;
+         return node16_add_child(t, (struct art_node16*) node, node_ref, ch, child);
       case Node48:
-         node48_add_child((struct art_node48*) node, node_ref, ch, child);
-         break;
+         return node48_add_child(t, (struct art_node48*) node, node_ref, ch, child);
       case Node256:
          node256_add_child((struct art_node256*) node, ch, child);
          break;
    }
+   return 0;
 }
 
-static void
-node4_add_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child)
+static int
+node4_add_child(struct art* t, struct art_node4* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    if (node->node.num_children < 4)
    {
@@ -974,20 +1177,24 @@ node4_add_child(struct art_node4* node, struct art_node** node_ref, unsigned cha
    {
       // expand
       struct art_node16* new_node = NULL;
-      create_art_node16(&new_node);
+      if (create_art_node16(t, &new_node))
+      {
+         return 1;
+      }
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       memcpy(new_node->children, node->children, node->node.num_children * sizeof(void*));
       memcpy(new_node->keys, node->keys, node->node.num_children);
       // replace the node through node reference
       *node_ref = (struct art_node*)new_node;
-      free(node);
+      free_art_node(t, (struct art_node*)node);
 
-      node16_add_child(new_node, node_ref, ch, child);
+      return node16_add_child(t, new_node, node_ref, ch, child);
    }
+   return 0;
 }
 
-static void
-node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child)
+static int
+node16_add_child(struct art* t, struct art_node16* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    if (node->node.num_children < 16)
    {
@@ -1004,7 +1211,10 @@ node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned c
    {
       // expand
       struct art_node48* new_node = NULL;
-      create_art_node48(&new_node);
+      if (create_art_node48(t, &new_node))
+      {
+         return 1;
+      }
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       memcpy(new_node->children, node->children, node->node.num_children * sizeof(void*));
       for (int i = 0; i < node->node.num_children; i++)
@@ -1013,13 +1223,14 @@ node16_add_child(struct art_node16* node, struct art_node** node_ref, unsigned c
       }
       // replace the node through node reference
       *node_ref = (struct art_node*)new_node;
-      free(node);
-      node48_add_child(new_node, node_ref, ch, child);
+      free_art_node(t, (struct art_node*)node);
+      return node48_add_child(t, new_node, node_ref, ch, child);
    }
+   return 0;
 }
 
-static void
-node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child)
+static int
+node48_add_child(struct art* t, struct art_node48* node, struct art_node** node_ref, unsigned char ch, void* child)
 {
    if (node->node.num_children < 48)
    {
@@ -1037,7 +1248,10 @@ node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned c
    {
       // expand
       struct art_node256* new_node = NULL;
-      create_art_node256(&new_node);
+      if (create_art_node256(t, &new_node))
+      {
+         return 1;
+      }
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       for (int i = 0; i < 256; i++)
       {
@@ -1049,9 +1263,10 @@ node48_add_child(struct art_node48* node, struct art_node** node_ref, unsigned c
       }
       // replace the node through node reference
       *node_ref = (struct art_node*)new_node;
-      free(node);
+      free_art_node(t, (struct art_node*)node);
       node256_add_child(new_node, ch, child);
    }
+   return 0;
 }
 
 static void
@@ -1209,27 +1424,27 @@ node_get_minimum(struct art_node* node)
 }
 
 static void
-node_remove_child(struct art_node* node, struct art_node** node_ref, unsigned char ch)
+node_remove_child(struct art* t, struct art_node* node, struct art_node** node_ref, unsigned char ch)
 {
    switch (node->type)
    {
       case Node4:
-         node4_remove_child((struct art_node4*)node, node_ref, ch);
+         node4_remove_child(t, (struct art_node4*)node, node_ref, ch);
          break;
       case Node16:
-         node16_remove_child((struct art_node16*)node, node_ref, ch);
+         node16_remove_child(t, (struct art_node16*)node, node_ref, ch);
          break;
       case Node48:
-         node48_remove_child((struct art_node48*)node, node_ref, ch);
+         node48_remove_child(t, (struct art_node48*)node, node_ref, ch);
          break;
       case Node256:
-         node256_remove_child((struct art_node256*)node, node_ref, ch);
+         node256_remove_child(t, (struct art_node256*)node, node_ref, ch);
          break;
    }
 }
 
 static void
-node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned char ch)
+node4_remove_child(struct art* t, struct art_node4* node, struct art_node** node_ref, unsigned char ch)
 {
    int idx = 0;
    uint32_t len = 0;
@@ -1246,6 +1461,7 @@ node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned
       {
          // replace directly
          *node_ref = child;
+         free_art_node(t, (struct art_node*)node);
          return;
       }
       // parent prefix bytes + byte index to child + child prefix bytes
@@ -1262,14 +1478,14 @@ node4_remove_child(struct art_node4* node, struct art_node** node_ref, unsigned
       }
       child->prefix_len = node->node.prefix_len + 1 + child->prefix_len;
       memcpy(child->prefix, node->node.prefix, min(child->prefix_len, MAX_PREFIX_LEN));
-      free(node);
+      free_art_node(t, (struct art_node*)node);
       // replace
       *node_ref = child;
    }
 }
 
 static void
-node16_remove_child(struct art_node16* node, struct art_node** node_ref, unsigned char ch)
+node16_remove_child(struct art* t, struct art_node16* node, struct art_node** node_ref, unsigned char ch)
 {
    int idx = 0;
    struct art_node4* new_node = NULL;
@@ -1279,19 +1495,18 @@ node16_remove_child(struct art_node16* node, struct art_node** node_ref, unsigne
    node->node.num_children--;
    // downgrade node
    // Trick from libart, do not downgrade immediately to avoid jumping on 4/5 boundary
-   if (node->node.num_children <= 3)
+   if (node->node.num_children <= 3 && !create_art_node4(t, &new_node))
    {
-      create_art_node4(&new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       memcpy(new_node->keys, node->keys, node->node.num_children);
       memcpy(new_node->children, node->children, node->node.num_children * sizeof(void*));
-      free(node);
+      free_art_node(t, (struct art_node*)node);
       *node_ref = (struct art_node*)new_node;
    }
 }
 
 static void
-node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigned char ch)
+node48_remove_child(struct art* t, struct art_node48* node, struct art_node** node_ref, unsigned char ch)
 {
    int idx = node->keys[ch];
    int cnt = 0;
@@ -1300,9 +1515,8 @@ node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigne
    node->keys[ch] = 0;
    node->node.num_children--;
 
-   if (node->node.num_children <= 12)
+   if (node->node.num_children <= 12 && !create_art_node16(t, &new_node))
    {
-      create_art_node16(&new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       for (int i = 0; i < 256; i++)
       {
@@ -1313,13 +1527,13 @@ node48_remove_child(struct art_node48* node, struct art_node** node_ref, unsigne
             cnt++;
          }
       }
-      free(node);
+      free_art_node(t, (struct art_node*)node);
       *node_ref = (struct art_node*)new_node;
    }
 }
 
 static void
-node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsigned char ch)
+node256_remove_child(struct art* t, struct art_node256* node, struct art_node** node_ref, unsigned char ch)
 {
    int num = 0;
    for (int i = 0; i < 48; i++)
@@ -1338,9 +1552,8 @@ node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsig
    node->children[ch] = NULL;
    node->node.num_children--;
 
-   if (node->node.num_children <= 37)
+   if (node->node.num_children <= 37 && !create_art_node48(t, &new_node))
    {
-      create_art_node48(&new_node);
       copy_header((struct art_node*)new_node, (struct art_node*)node);
       for (int i = 0; i < 256; i++)
       {
@@ -1351,7 +1564,7 @@ node256_remove_child(struct art_node256* node, struct art_node** node_ref, unsig
             cnt++;
          }
       }
-      free(node);
+      free_art_node(t, (struct art_node*)node);
       *node_ref = (struct art_node*)new_node;
    }
 }
@@ -1365,97 +1578,79 @@ pgexporter_art_iterator_create(struct art* t, struct art_iterator** iter)
       return 1;
    }
    i = malloc(sizeof(struct art_iterator));
-   i->count = 0;
+   if (i == NULL)
+   {
+      return 1;
+   }
+   memset(i, 0, sizeof(struct art_iterator));
    i->tree = t;
-   i->key = NULL;
-   i->value = NULL;
-   pgexporter_deque_create(false, &i->que);
    *iter = i;
    return 0;
 }
 
+int
+pgexporter_art_iterator_seek(struct art_iterator* iter, char* prefix)
+{
+   if (iter == NULL)
+   {
+      return 1;
+   }
+   free(iter->prefix);
+   iter->prefix = NULL;
+   if (prefix != NULL && strlen(prefix) > 0)
+   {
+      iter->prefix = strdup(prefix);
+      if (iter->prefix == NULL)
+      {
+         return 1;
+      }
+   }
+   iter->started = false;
+   iter->count = 0;
+   return 0;
+}
+
+int
+pgexporter_art_iterator_range(struct art_iterator* iter, char* from, char* to)
+{
+   if (iter == NULL)
+   {
+      return 1;
+   }
+   free(iter->from);
+   free(iter->to);
+   iter->from = from != NULL ? strdup(from) : NULL;
+   iter->to = to != NULL ? strdup(to) : NULL;
+   iter->started = false;
+   iter->count = 0;
+   if ((from != NULL && iter->from == NULL) || (to != NULL && iter->to == NULL))
+   {
+      return 1;
+   }
+   return 0;
+}
+
 bool
 pgexporter_art_iterator_next(struct art_iterator* iter)
 {
-   struct deque* que = NULL;
-   struct art* tree = NULL;
-   struct art_node* node = NULL;
-   struct art_node* child = NULL;
-   int idx = 0;
-   if (iter == NULL || iter->que == NULL || iter->tree == NULL || iter->count == iter->tree->size)
+   if (iter == NULL || iter->tree == NULL)
    {
       return false;
    }
-   que = iter->que;
-   tree = iter->tree;
-   if (iter->count == 0)
+   if (!iter->started)
    {
-      pgexporter_deque_add(que, NULL, (uintptr_t)tree->root, ValueRef);
+      iterator_position(iter);
    }
-   while (!pgexporter_deque_empty(que))
+   if (iter->next == NULL)
    {
-      node = (struct art_node*)pgexporter_deque_poll(que, NULL);
-      if (IS_LEAF(node))
-      {
-         iter->count++;
-         iter->key = (char*)GET_LEAF(node)->key;
-         iter->value = GET_LEAF(node)->value;
-         return true;
-      }
-      switch (node->type)
-      {
-         case Node4:
-         {
-            struct art_node4* n = (struct art_node4*) node;
-            for (int i = 0; i < node->num_children; i++)
-            {
-               child = n->children[i];
-               pgexporter_deque_add(que, NULL, (uintptr_t)child, ValueRef);
-            }
-            break;
-         }
-         case Node16:
-         {
-            struct art_node16* n = (struct art_node16*) node;
-            for (int i = 0; i < node->num_children; i++)
-            {
-               child = n->children[i];
-               pgexporter_deque_add(que, NULL, (uintptr_t)child, ValueRef);
-            }
-            break;
-         }
-         case Node48:
-         {
-            struct art_node48* n = (struct art_node48*) node;
-            for (int i = 0; i < 256; i++)
-            {
-               idx = n->keys[i];
-               if (idx == 0)
-               {
-                  continue;
-               }
-               child = n->children[idx - 1];
-               pgexporter_deque_add(que, NULL, (uintptr_t)child, ValueRef);
-            }
-            break;
-         }
-         case Node256:
-         {
-            struct art_node256* n = (struct art_node256*) node;
-            for (int i = 0; i < 256; i++)
-            {
-               if (n->children[i] == NULL)
-               {
-                  continue;
-               }
-               child = n->children[i];
-               pgexporter_deque_add(que, NULL, (uintptr_t)child, ValueRef);
-            }
-            break;
-         }
-      }
+      return false;
    }
-   return false;
+   iter->count++;
+   iter->key = (char*)iter->next->key;
+   iter->value = iter->next->value;
+   iter->next = iterator_advance(iter);
+   iterator_bound(iter);
+   return true;
 }
 
 bool
@@ -1465,12 +1660,18 @@ pgexporter_art_iterator_has_next(struct art_iterator* iter)
    {
       return false;
    }
-   return iter->count < iter->tree->size;
+   if (!iter->started)
+   {
+      iterator_position(iter);
+   }
+   return iter->next != NULL;
 }
 
 void
 pgexporter_art_iterator_remove(struct art_iterator* iter)
 {
+   struct art_leaf* next = NULL;
+
    if (iter == NULL || iter->tree == NULL || iter->key == NULL)
    {
       return;
@@ -1480,6 +1681,14 @@ pgexporter_art_iterator_remove(struct art_iterator* iter)
    iter->key = NULL;
    iter->value = NULL;
    iter->count--;
+
+   // the nodes on the path may have been replaced, but the next leaf is still there
+   next = iter->next;
+   if (next != NULL)
+   {
+      iterator_seek(iter, next->key, next->key_len - 1);
+      iterator_bound(iter);
+   }
 }
 
 void
@@ -1489,10 +1698,246 @@ pgexporter_art_iterator_destroy(struct art_iterator* iter)
    {
       return;
    }
-   pgexporter_deque_destroy(iter->que);
+   free(iter->stack);
+   free(iter->prefix);
+   free(iter->from);
+   free(iter->to);
    free(iter);
 }
 
+static int
+iterator_push(struct art_iterator* iter, struct art_node* node, int index)
+{
+   struct art_iterator_frame* stack = NULL;
+   uint32_t capacity = 0;
+   if (iter->depth == iter->capacity)
+   {
+      capacity = iter->capacity > 0 ? iter->capacity * 2 : 16;
+      stack = realloc(iter->stack, capacity * sizeof(struct art_iterator_frame));
+      if (stack == NULL)
+      {
+         return 1;
+      }
+      iter->stack = stack;
+      iter->capacity = capacity;
+   }
+   iter->stack[iter->depth].node = node;
+   iter->stack[iter->depth].index = index;
+   iter->depth++;
+   return 0;
+}
+
+static struct art_node*
+iterator_child(struct art_iterator_frame* frame)
+{
+   struct art_node* node = frame->node;
+   int idx = 0;
+   switch (node->type)
+   {
+      case Node4:
+      {
+         struct art_node4* n = (struct art_node4*) node;
+         if (frame->index < node->num_children)
+         {
+            return n->children[frame->index++];
+         }
+         break;
+      }
+      case Node16:
+      {
+         struct art_node16* n = (struct art_node16*) node;
+         if (frame->index < node->num_children)
+         {
+            return n->children[frame->index++];
+         }
+         break;
+      }
+      case Node48:
+      {
+         struct art_node48* n = (struct art_node48*) node;
+         while (frame->index < 256)
+         {
+            idx = n->keys[frame->index++];
+            if (idx != 0)
+            {
+               return n->children[idx - 1];
+            }
+         }
+         break;
+      }
+      case Node256:
+      {
+         struct art_node256* n = (struct art_node256*) node;
+         while (frame->index < 256)
+         {
+            if (n->children[frame->index] != NULL)
+            {
+               return n->children[frame->index++];
+            }
+            frame->index++;
+         }
+         break;
+      }
+   }
+   return NULL;
+}
+
+static struct art_leaf*
+iterator_advance(struct art_iterator* iter)
+{
+   struct art_node* child = NULL;
+   while (iter->depth > 0)
+   {
+      child = iterator_child(&iter->stack[iter->depth - 1]);
+      if (child == NULL)
+      {
+         iter->depth--;
+         continue;
+      }
+      if (IS_LEAF(child))
+      {
+         return GET_LEAF(child);
+      }
+      if (iterator_push(iter, child, 0))
+      {
+         iter->depth = 0;
+         return NULL;
+      }
+   }
+   return NULL;
+}
+
+static struct art_leaf*
+iterator_leftmost(struct art_iterator* iter, struct art_node* node)
+{
+   if (IS_LEAF(node))
+   {
+      return GET_LEAF(node);
+   }
+   if (iterator_push(iter, node, 0))
+   {
+      return NULL;
+   }
+   return iterator_advance(iter);
+}
+
+static void
+iterator_seek(struct art_iterator* iter, unsigned char* key, uint32_t key_len)
+{
+   struct art_node* node = NULL;
+   struct art_node** child = NULL;
+   struct art_leaf* leaf = NULL;
+   unsigned char* prefix = NULL;
+   uint32_t depth = 0;
+   uint32_t len = 0;
+   int index = 0;
+   int cmp = 0;
+
+   iter->depth = 0;
+   iter->next = NULL;
+
+   node = iter->tree->root;
+   while (node != NULL)
+   {
+      if (IS_LEAF(node))
+      {
+         // the key of a leaf has its terminating zero, so it sorts after a key it starts with
+         leaf = GET_LEAF(node);
+         cmp = memcmp(leaf->key, key, min(leaf->key_len, key_len));
+         iter->next = cmp >= 0 ? leaf : iterator_advance(iter);
+         return;
+      }
+
+      // compare the complete prefix, which is only partially stored in long prefixes
+      len = min(node->prefix_len, key_len - depth);
+      prefix = node->prefix_len > MAX_PREFIX_LEN ? node_get_minimum(node)->key + depth : node->prefix;
+      cmp = memcmp(prefix, key + depth, len);
+      if (cmp < 0)
+      {
+         // all the keys below the node are smaller
+         iter->next = iterator_advance(iter);
+         return;
+      }
+      if (cmp > 0 || depth + node->prefix_len >= key_len)
+      {
+         // all the keys below the node are larger
+         iter->next = iterator_leftmost(iter, node);
+         return;
+      }
+      depth += node->prefix_len;
+
+      // continue after the child of the key character once the child is done
+      if (node->type == Node4 || node->type == Node16)
+      {
+         unsigned char* keys = node->type == Node4 ? ((struct art_node4*)node)->keys : ((struct art_node16*)node)->keys;
+         index = 0;
+         while (index < node->num_children && keys[index] <= key[depth])
+         {
+            index++;
+         }
+      }
+      else
+      {
+         index = key[depth] + 1;
+      }
+      if (iterator_push(iter, node, index))
+      {
+         iter->depth = 0;
+         return;
+      }
+
+      child = node_get_child(node, key[depth]);
+      if (child == NULL || *child == NULL)
+      {
+         iter->next = iterator_advance(iter);
+         return;
+      }
+      node = *child;
+      depth++;
+   }
+}
+
+static void
+iterator_position(struct art_iterator* iter)
+{
+   char* from = iter->from;
+
+   iter->started = true;
+   iter->depth = 0;
+   iter->next = NULL;
+
+   if (iter->prefix != NULL && (from == NULL || strcmp(iter->prefix, from) > 0))
+   {
+      from = iter->prefix;
+   }
+
+   if (from != NULL)
+   {
+      iterator_seek(iter, (unsigned char*)from, strlen(from));
+   }
+   else if (iter->tree->root != NULL)
+   {
+      iter->next = iterator_leftmost(iter, iter->tree->root);
+   }
+
+   iterator_bound(iter);
+}
+
+static void
+iterator_bound(struct art_iterator* iter)
+{
+   if (iter->next == NULL)
+   {
+      return;
+   }
+   if ((iter->prefix != NULL && strncmp((char*)iter->next->key, iter->prefix, strlen(iter->prefix))) ||
+       (iter->to != NULL && strcmp((char*)iter->next->key, iter->to) >= 0))
+   {
+      iter->next = NULL;
+      iter->depth = 0;
+   }
+}
+
 void
 pgexporter_art_destroy_value_noop(void* val)
 {
@@ -30,7 +30,9 @@
 #include <pgexporter.h>
 #include <art.h>
 #include <bridge.h>
+#include <compression.h>
 #include <deque.h>
+#include <exposition.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
@@ -56,6 +58,14 @@
 #define PAGE_METRICS 2
 #define BAD_REQUEST  3
 
+/* The format negotiated by the request, and its text while the response is collected */
+static int format = EXPOSITION_TEXT;
+static struct exposition* exposition = NULL;
+
+/* Is a gzip encoded response accepted, and the encoder of the chunks while the response is sent */
+static bool gzip = false;
+static struct compressor* encoder = NULL;
+
 static int resolve_page(struct message* msg);
 static int badrequest_page(int client_fd);
 static int unknown_page(int client_fd);
@@ -64,6 +74,10 @@ static int metrics_page(int client_fd);
 static int bad_request(int client_fd);
 
 static int send_chunk(int client_fd, char* data);
+static int send_chunk_size(int client_fd, char* data, size_t size);
+static int send_exposition(int client_fd);
+static int send_encoding_end(int client_fd);
+static int write_chunk(int client_fd, void* data, size_t size);
 
 static bool is_bridge_cache_configured(void);
 static bool is_bridge_cache_valid(void);
@@ -100,6 +114,8 @@ pgexporter_bridge(int client_fd)
       goto error;
    }
 
+   format = pgexporter_exposition_negotiate(msg);
+   gzip = pgexporter_exposition_gzip(msg);
    page = resolve_page(msg);
 
    if (page == PAGE_HOME)
@@ -395,6 +411,12 @@ metrics_page(int client_fd)
    ctime_r(&start_time, &time_buf[0]);
    time_buf[strlen(time_buf) - 1] = 0;
 
+   /* A fast level, as the metrics are sent while they are collected */
+   if (gzip && pgexporter_compressor_create(COMPRESSION_CLIENT_GZIP, true, 1, &encoder))
+   {
+      pgexporter_log_warn("Unable to compress the metrics");
+   }
+
 retry_cache_locking:
    cache_is_free = STATE_FREE;
    if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
@@ -409,10 +431,11 @@ retry_cache_locking:
                               cache->valid_until);
 
          /* Header */
-         data = pgexporter_vappend(data, 7,
+         data = pgexporter_vappend(data, 10,
                                    "HTTP/1.1 200 OK\r\n",
-                                   "Content-Type: text/plain; charset=utf-8\r\n",
+                                   "Content-Type: ", pgexporter_exposition_content_type(format), "\r\n",
                                    "Date: ", &time_buf[0], "\r\n",
+                                   encoder != NULL ? "Content-Encoding: gzip\r\n" : "",
                                    "Transfer-Encoding: chunked\r\n", "\r\n");
 
          msg.kind = 0;
@@ -429,8 +452,26 @@ retry_cache_locking:
          data = NULL;
 
          /* Cache */
+         if (format != EXPOSITION_TEXT)
+         {
+            if (pgexporter_exposition_create(format, &exposition))
+            {
+               goto error;
+            }
+         }
+
          send_chunk(client_fd, cache->data);
 
+         if (exposition != NULL && send_exposition(client_fd) != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
+         if (send_encoding_end(client_fd) != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
          /* Footer */
          data = pgexporter_append(data, "0\r\n\r\n");
 
@@ -453,10 +494,11 @@ retry_cache_locking:
 
          bridge_cache_invalidate();
 
-         data = pgexporter_vappend(data, 7,
+         data = pgexporter_vappend(data, 10,
                                    "HTTP/1.1 200 OK\r\n",
-                                   "Content-Type: text/plain; version=0.0.1; charset=utf-8\r\n",
+                                   "Content-Type: ", pgexporter_exposition_content_type(format), "\r\n",
                                    "Date: ", &time_buf[0], "\r\n",
+                                   encoder != NULL ? "Content-Encoding: gzip\r\n" : "",
                                    "Transfer-Encoding: chunked\r\n",
                                    "\r\n");
 
@@ -474,8 +516,26 @@ retry_cache_locking:
          data = NULL;
 
          /* Metrics */
+         if (format != EXPOSITION_TEXT)
+         {
+            if (pgexporter_exposition_create(format, &exposition))
+            {
+               goto error;
+            }
+         }
+
          bridge_metrics(client_fd);
 
+         if (exposition != NULL && send_exposition(client_fd) != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
+         if (send_encoding_end(client_fd) != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
          /* Footer */
          data = pgexporter_append(data, "0\r\n\r\n");
 
@@ -505,12 +565,21 @@ retry_cache_locking:
       SLEEP_AND_GOTO(10000000L, retry_cache_locking);
    }
 
+   pgexporter_compressor_destroy(encoder);
+   encoder = NULL;
+
    free(data);
 
    return 0;
 
 error:
 
+   pgexporter_exposition_destroy(exposition);
+   exposition = NULL;
+
+   pgexporter_compressor_destroy(encoder);
+   encoder = NULL;
+
    free(data);
 
    return 1;
@@ -554,28 +623,78 @@ bad_request(int client_fd)
 
 static int
 send_chunk(int client_fd, char* data)
+{
+   /* A response in another format is sent once it is complete */
+   if (exposition != NULL)
+   {
+      return pgexporter_exposition_append(exposition, data) ? MESSAGE_STATUS_ERROR : MESSAGE_STATUS_OK;
+   }
+
+   return send_chunk_size(client_fd, data, strlen(data));
+}
+
+static int
+send_chunk_size(int client_fd, char* data, size_t size)
+{
+   /* The encoder keeps what it has not compressed yet for the next chunk */
+   if (encoder != NULL)
+   {
+      if (pgexporter_compressor_update(encoder, data, size))
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      return write_chunk(client_fd, encoder->output, encoder->output_size);
+   }
+
+   return write_chunk(client_fd, data, size);
+}
+
+static int
+send_encoding_end(int client_fd)
+{
+   if (encoder == NULL)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   if (pgexporter_compressor_finish(encoder))
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   return write_chunk(client_fd, encoder->output, encoder->output_size);
+}
+
+static int
+write_chunk(int client_fd, void* data, size_t size)
 {
    int status;
+   int offset;
    char* m = NULL;
    struct message msg;
 
    memset(&msg, 0, sizeof(struct message));
 
-   m = malloc(20);
+   /* An empty chunk would end the response */
+   if (size == 0)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   m = malloc(size + 20);
 
    if (m == NULL)
    {
       goto error;
    }
 
-   memset(m, 0, 20);
-
-   sprintf(m, "%zX\r\n", strlen(data));
-
-   m = pgexporter_vappend(m, 2, data, "\r\n");
+   offset = sprintf(m, "%zX\r\n", size);
+   memcpy(m + offset, data, size);
+   memcpy(m + offset + size, "\r\n", 2);
 
    msg.kind = 0;
-   msg.length = strlen(m);
+   msg.length = offset + size + 2;
    msg.data = m;
 
    status = pgexporter_write_message(NULL, client_fd, &msg);
@@ -589,6 +708,37 @@ error:
    return MESSAGE_STATUS_ERROR;
 }
 
+static int
+send_exposition(int client_fd)
+{
+   int status;
+   char* data = NULL;
+   size_t size = 0;
+   struct exposition* e = exposition;
+
+   /* From here on the chunks go to the client */
+   exposition = NULL;
+
+   if (pgexporter_exposition_encode(e, &data, &size))
+   {
+      pgexporter_log_error("Unable to encode the bridge metrics");
+      goto error;
+   }
+
+   status = send_chunk_size(client_fd, data, size);
+
+   free(data);
+   pgexporter_exposition_destroy(e);
+
+   return status;
+
+error:
+
+   pgexporter_exposition_destroy(e);
+
+   return MESSAGE_STATUS_ERROR;
+}
+
 /**
  * Checks if the Prometheus cache configuration setting
  * (`bridge_cache`) has a non-zero value, that means there
@@ -35,6 +35,7 @@
 /* system */
 #include <bzlib.h>
 #include <dirent.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -77,48 +78,53 @@ pgexporter_bzip2_string(char* s, unsigned char** buffer, size_t* buffer_size)
 int
 pgexporter_bunzip2_string(unsigned char* compressed_buffer, size_t compressed_size, char** output_string)
 {
-   int bzip2_err;
+   int bzip2_err = BZ_OUTBUFF_FULL;
    unsigned int estimated_size = compressed_size * 10;
    unsigned int new_size;
+   char* temp = NULL;
 
-   *output_string = (char*)malloc(estimated_size);
-   if (!*output_string)
-   {
-      pgexporter_log_error("Bzip2: Allocation failed");
-      return 1;
-   }
-
-   bzip2_err = BZ2_bzBuffToBuffDecompress(*output_string, &estimated_size, (char*)compressed_buffer, compressed_size, 0, 0);
+   *output_string = NULL;
 
-   if (bzip2_err == BZ_OUTBUFF_FULL)
+   /* The output grows until the stream fits, with room for the terminator */
+   while (bzip2_err == BZ_OUTBUFF_FULL)
    {
-      new_size = estimated_size * 2;
-      char* temp = realloc(*output_string, new_size);
+      temp = realloc(*output_string, (size_t)estimated_size + 1);
 
       if (!temp)
       {
-         pgexporter_log_error("Bzip2: Reallocation failed");
-         free(*output_string);
-         return 1;
+         pgexporter_log_error("Bzip2: Allocation failed");
+         goto error;
       }
 
       *output_string = temp;
+      new_size = estimated_size;
 
       bzip2_err = BZ2_bzBuffToBuffDecompress(*output_string, &new_size, (char*)compressed_buffer, compressed_size, 0, 0);
-      if (bzip2_err != BZ_OK)
+
+      if (bzip2_err == BZ_OUTBUFF_FULL)
       {
-         pgexporter_log_error("Bzip2: Decompress failed");
-         free(*output_string);
-         return 1;
+         if (estimated_size > UINT_MAX / 2)
+         {
+            break;
+         }
+         estimated_size *= 2;
       }
-      estimated_size = new_size;
    }
-   else if (bzip2_err != BZ_OK)
+
+   if (bzip2_err != BZ_OK)
    {
       pgexporter_log_error("Bzip2: Decompress failed");
-      free(*output_string);
-      return 1;
+      goto error;
    }
 
+   (*output_string)[new_size] = '\0';
+
    return 0;
+
+error:
+
+   free(*output_string);
+   *output_string = NULL;
+
+   return 1;
 }
@@ -0,0 +1,661 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <compression.h>
+#include <logging.h>
+
+/* system */
+#include <bzlib.h>
+#include <lz4frame.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#define BUFFER_LENGTH 8192
+
+static int reserve(struct compressor* c, size_t size);
+static int codec_init(struct compressor* c);
+static void codec_end(struct compressor* c);
+static int gzip_process(struct compressor* c, void* data, size_t size, bool finish);
+static int zstd_process(struct compressor* c, void* data, size_t size, bool finish);
+static int lz4_process(struct compressor* c, void* data, size_t size, bool finish);
+static int bzip2_process(struct compressor* c, void* data, size_t size, bool finish);
+static int process(struct compressor* c, void* data, size_t size, bool finish);
+
+int
+pgexporter_compressor_create(int codec, bool compress, int level, struct compressor** compressor)
+{
+   struct compressor* c = NULL;
+
+   *compressor = NULL;
+
+   c = malloc(sizeof(struct compressor));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   memset(c, 0, sizeof(struct compressor));
+   c->codec = codec;
+   c->compress = compress;
+   c->level = level;
+
+   if (codec_init(c))
+   {
+      goto error;
+   }
+
+   *compressor = c;
+
+   return 0;
+
+error:
+
+   free(c);
+
+   return 1;
+}
+
+int
+pgexporter_compressor_update(struct compressor* compressor, void* data, size_t size)
+{
+   if (compressor == NULL)
+   {
+      return 1;
+   }
+
+   compressor->output_size = 0;
+
+   if (size == 0 && compressor->started)
+   {
+      return 0;
+   }
+
+   return process(compressor, data, size, false);
+}
+
+int
+pgexporter_compressor_finish(struct compressor* compressor)
+{
+   if (compressor == NULL)
+   {
+      return 1;
+   }
+
+   compressor->output_size = 0;
+
+   if (!compressor->compress)
+   {
+      if (!compressor->ended)
+      {
+         pgexporter_log_error("Compression: The stream is incomplete");
+         return 1;
+      }
+      return 0;
+   }
+
+   if (compressor->ended)
+   {
+      return 0;
+   }
+
+   if (process(compressor, NULL, 0, true))
+   {
+      return 1;
+   }
+
+   compressor->ended = true;
+
+   return 0;
+}
+
+int
+pgexporter_compressor_reset(struct compressor* compressor)
+{
+   int ret = 0;
+
+   if (compressor == NULL)
+   {
+      return 1;
+   }
+
+   switch (compressor->codec)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+         ret = compressor->compress ? deflateReset(compressor->context) : inflateReset(compressor->context);
+         ret = ret == Z_OK ? 0 : 1;
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+         ret = compressor->compress ?
+               ZSTD_isError(ZSTD_CCtx_reset(compressor->context, ZSTD_reset_session_only)) :
+               ZSTD_isError(ZSTD_DCtx_reset(compressor->context, ZSTD_reset_session_only));
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+         // A compression context starts over with the next frame
+         if (!compressor->compress)
+         {
+            LZ4F_resetDecompressionContext(compressor->context);
+         }
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         // bzip2 has no reset, so the stream is initialized again
+         codec_end(compressor);
+         ret = codec_init(compressor);
+         break;
+      default:
+         ret = 1;
+         break;
+   }
+
+   compressor->started = false;
+   compressor->ended = false;
+   compressor->output_size = 0;
+
+   return ret;
+}
+
+void
+pgexporter_compressor_destroy(struct compressor* compressor)
+{
+   if (compressor == NULL)
+   {
+      return;
+   }
+
+   codec_end(compressor);
+   free(compressor->output);
+   free(compressor);
+}
+
+static int
+reserve(struct compressor* c, size_t size)
+{
+   size_t capacity = c->capacity > 0 ? c->capacity : BUFFER_LENGTH;
+   unsigned char* output = NULL;
+
+   if (c->capacity - c->output_size >= size)
+   {
+      return 0;
+   }
+
+   while (capacity - c->output_size < size)
+   {
+      capacity *= 2;
+   }
+
+   output = realloc(c->output, capacity);
+   if (output == NULL)
+   {
+      pgexporter_log_error("Compression: Allocation failed");
+      return 1;
+   }
+
+   c->output = output;
+   c->capacity = capacity;
+
+   return 0;
+}
+
+static int
+codec_init(struct compressor* c)
+{
+   switch (c->codec)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+      {
+         z_stream* s = calloc(1, sizeof(z_stream));
+         int ret;
+
+         if (s == NULL)
+         {
+            goto error;
+         }
+         if (c->compress)
+         {
+            ret = deflateInit2(s, c->level != 0 ? c->level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+         }
+         else
+         {
+            ret = inflateInit2(s, MAX_WBITS + 16);
+         }
+         if (ret != Z_OK)
+         {
+            free(s);
+            goto error;
+         }
+         c->context = s;
+         break;
+      }
+      case COMPRESSION_CLIENT_ZSTD:
+         if (c->compress)
+         {
+            c->context = ZSTD_createCCtx();
+            if (c->context != NULL && c->level != 0)
+            {
+               ZSTD_CCtx_setParameter(c->context, ZSTD_c_compressionLevel, c->level);
+            }
+         }
+         else
+         {
+            c->context = ZSTD_createDCtx();
+         }
+         if (c->context == NULL)
+         {
+            goto error;
+         }
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+         if (c->compress)
+         {
+            if (LZ4F_isError(LZ4F_createCompressionContext((LZ4F_cctx**)&c->context, LZ4F_VERSION)))
+            {
+               goto error;
+            }
+         }
+         else
+         {
+            if (LZ4F_isError(LZ4F_createDecompressionContext((LZ4F_dctx**)&c->context, LZ4F_VERSION)))
+            {
+               goto error;
+            }
+         }
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+      {
+         bz_stream* s = calloc(1, sizeof(bz_stream));
+         int ret;
+
+         if (s == NULL)
+         {
+            goto error;
+         }
+         if (c->compress)
+         {
+            ret = BZ2_bzCompressInit(s, c->level != 0 ? c->level : 9, 0, 0);
+         }
+         else
+         {
+            ret = BZ2_bzDecompressInit(s, 0, 0);
+         }
+         if (ret != BZ_OK)
+         {
+            free(s);
+            goto error;
+         }
+         c->context = s;
+         break;
+      }
+      default:
+         pgexporter_log_error("Compression: Unknown codec %d", c->codec);
+         return 1;
+   }
+
+   return 0;
+
+error:
+
+   c->context = NULL;
+   pgexporter_log_error("Compression: Initialization failed for codec %d", c->codec);
+
+   return 1;
+}
+
+static void
+codec_end(struct compressor* c)
+{
+   if (c->context == NULL)
+   {
+      return;
+   }
+
+   switch (c->codec)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+         if (c->compress)
+         {
+            deflateEnd(c->context);
+         }
+         else
+         {
+            inflateEnd(c->context);
+         }
+         free(c->context);
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+         if (c->compress)
+         {
+            ZSTD_freeCCtx(c->context);
+         }
+         else
+         {
+            ZSTD_freeDCtx(c->context);
+         }
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+         if (c->compress)
+         {
+            LZ4F_freeCompressionContext(c->context);
+         }
+         else
+         {
+            LZ4F_freeDecompressionContext(c->context);
+         }
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         if (c->compress)
+         {
+            BZ2_bzCompressEnd(c->context);
+         }
+         else
+         {
+            BZ2_bzDecompressEnd(c->context);
+         }
+         free(c->context);
+         break;
+      default:
+         break;
+   }
+
+   c->context = NULL;
+}
+
+static int
+process(struct compressor* c, void* data, size_t size, bool finish)
+{
+   int ret = 1;
+
+   if (c->context == NULL)
+   {
+      return 1;
+   }
+
+   switch (c->codec)
+   {
+      case COMPRESSION_CLIENT_GZIP:
+         ret = gzip_process(c, data, size, finish);
+         break;
+      case COMPRESSION_CLIENT_ZSTD:
+         ret = zstd_process(c, data, size, finish);
+         break;
+      case COMPRESSION_CLIENT_LZ4:
+         ret = lz4_process(c, data, size, finish);
+         break;
+      case COMPRESSION_CLIENT_BZIP2:
+         ret = bzip2_process(c, data, size, finish);
+         break;
+      default:
+         break;
+   }
+
+   c->started = true;
+
+   return ret;
+}
+
+static int
+gzip_process(struct compressor* c, void* data, size_t size, bool finish)
+{
+   z_stream* s = (z_stream*)c->context;
+   int ret;
+
+   s->next_in = (unsigned char*)data;
+   s->avail_in = size;
+
+   do
+   {
+      if (reserve(c, BUFFER_LENGTH))
+      {
+         return 1;
+      }
+
+      s->next_out = c->output + c->output_size;
+      s->avail_out = c->capacity - c->output_size;
+
+      if (c->compress)
+      {
+         ret = deflate(s, finish ? Z_FINISH : Z_NO_FLUSH);
+      }
+      else
+      {
+         ret = inflate(s, Z_NO_FLUSH);
+      }
+
+      c->output_size = c->capacity - s->avail_out;
+
+      if (ret == Z_STREAM_END)
+      {
+         c->ended = !c->compress;
+         break;
+      }
+      if (ret == Z_BUF_ERROR && s->avail_in == 0 && s->avail_out > 0)
+      {
+         // Nothing more can be done until there is more input
+         break;
+      }
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+      {
+         pgexporter_log_error("Gzip: %s failed", c->compress ? "Compression" : "Decompression");
+         return 1;
+      }
+   }
+   while (s->avail_in > 0 || s->avail_out == 0 || (finish && c->compress));
+
+   return 0;
+}
+
+static int
+zstd_process(struct compressor* c, void* data, size_t size, bool finish)
+{
+   ZSTD_inBuffer in = {.src = data, .size = size, .pos = 0};
+   ZSTD_outBuffer out;
+   size_t ret;
+
+   do
+   {
+      if (reserve(c, c->compress ? ZSTD_CStreamOutSize() : ZSTD_DStreamOutSize()))
+      {
+         return 1;
+      }
+
+      out.dst = c->output + c->output_size;
+      out.size = c->capacity - c->output_size;
+      out.pos = 0;
+
+      if (c->compress)
+      {
+         ret = ZSTD_compressStream2(c->context, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+      }
+      else
+      {
+         ret = ZSTD_decompressStream(c->context, &out, &in);
+      }
+
+      if (ZSTD_isError(ret))
+      {
+         pgexporter_log_error("ZSTD: %s error: %s", c->compress ? "Compression" : "Decompression", ZSTD_getErrorName(ret));
+         return 1;
+      }
+
+      c->output_size += out.pos;
+
+      if (!c->compress && ret == 0)
+      {
+         // A complete frame is flushed, and a pass without input would only ask for the next one
+         c->ended = true;
+         break;
+      }
+   }
+   while (in.pos < in.size || out.pos == out.size || (finish && ret != 0));
+
+   return 0;
+}
+
+static int
+lz4_process(struct compressor* c, void* data, size_t size, bool finish)
+{
+   LZ4F_preferences_t preferences;
+   size_t ret;
+
+   memset(&preferences, 0, sizeof(LZ4F_preferences_t));
+   preferences.compressionLevel = c->level;
+
+   if (c->compress)
+   {
+      if (!c->started)
+      {
+         if (reserve(c, LZ4F_HEADER_SIZE_MAX))
+         {
+            return 1;
+         }
+         ret = LZ4F_compressBegin(c->context, c->output + c->output_size, c->capacity - c->output_size, &preferences);
+         if (LZ4F_isError(ret))
+         {
+            goto error;
+         }
+         c->output_size += ret;
+      }
+
+      if (reserve(c, LZ4F_compressBound(size, &preferences)))
+      {
+         return 1;
+      }
+
+      if (finish)
+      {
+         ret = LZ4F_compressEnd(c->context, c->output + c->output_size, c->capacity - c->output_size, NULL);
+      }
+      else
+      {
+         ret = LZ4F_compressUpdate(c->context, c->output + c->output_size, c->capacity - c->output_size, data, size, NULL);
+      }
+      if (LZ4F_isError(ret))
+      {
+         goto error;
+      }
+      c->output_size += ret;
+   }
+   else
+   {
+      size_t consumed = 0;
+      size_t available = 0;
+      size_t produced = 0;
+      size_t read = 0;
+
+      do
+      {
+         if (reserve(c, BUFFER_LENGTH))
+         {
+            return 1;
+         }
+
+         available = c->capacity - c->output_size;
+         produced = available;
+         read = size - consumed;
+
+         ret = LZ4F_decompress(c->context, c->output + c->output_size, &produced, (char*)data + consumed, &read, NULL);
+         if (LZ4F_isError(ret))
+         {
+            goto error;
+         }
+
+         consumed += read;
+         c->output_size += produced;
+
+         if (ret == 0)
+         {
+            // A complete frame is flushed, and a pass without input would only ask for the next one
+            c->ended = true;
+            break;
+         }
+      }
+      while (consumed < size || produced == available);
+   }
+
+   return 0;
+
+error:
+
+   pgexporter_log_error("LZ4: %s error: %s", c->compress ? "Compression" : "Decompression", LZ4F_getErrorName(ret));
+
+   return 1;
+}
+
+static int
+bzip2_process(struct compressor* c, void* data, size_t size, bool finish)
+{
+   bz_stream* s = (bz_stream*)c->context;
+   int ret;
+
+   if (size == 0 && !finish)
+   {
+      // BZ2_bzCompress() rejects a run without input
+      return 0;
+   }
+
+   s->next_in = (char*)data;
+   s->avail_in = size;
+
+   do
+   {
+      if (reserve(c, BUFFER_LENGTH))
+      {
+         return 1;
+      }
+
+      s->next_out = (char*)c->output + c->output_size;
+      s->avail_out = c->capacity - c->output_size;
+
+      if (c->compress)
+      {
+         ret = BZ2_bzCompress(s, finish ? BZ_FINISH : BZ_RUN);
+      }
+      else
+      {
+         ret = BZ2_bzDecompress(s);
+      }
+
+      c->output_size = c->capacity - s->avail_out;
+
+      if (ret == BZ_STREAM_END)
+      {
+         c->ended = !c->compress;
+         break;
+      }
+      if (ret != BZ_OK && ret != BZ_RUN_OK && ret != BZ_FINISH_OK)
+      {
+         pgexporter_log_error("Bzip2: %s failed", c->compress ? "Compression" : "Decompression");
+         return 1;
+      }
+   }
+   while (s->avail_in > 0 || s->avail_out == 0 || (finish && c->compress));
+
+   return 0;
+}
@@ -36,6 +36,7 @@
 #include <network.h>
 #include <prometheus.h>
 #include <query_alts.h>
+#include <registry.h>
 #include <security.h>
 #include <shmem.h>
 #include <utils.h>
@@ -77,9 +78,16 @@ static int as_seconds(char* str, int* age, int default_age);
 static int as_bytes(char* str, long* bytes, long default_bytes);
 static int as_endpoints(char* str, struct configuration* config, bool reload);
 static bool transfer_configuration(struct configuration* config, struct configuration* reload);
-static void copy_server(struct server* dst, struct server* src);
+static int transfer_servers(struct configuration* config, struct configuration* reload, int** servers);
+static int transfer_metrics(struct configuration* config, struct configuration* reload, int** metrics);
+static int transfer_plans(struct configuration* config, struct configuration* reload);
+static void transfer_sections(struct configuration* config, struct configuration* reload, int* servers);
+static bool same_connection(struct configuration* config, struct server* server, struct configuration* reload, struct server* srv);
+static char* server_password(struct configuration* config, char* username);
+static bool same_metric(struct prometheus* p1, struct prometheus* p2);
+static bool is_identity(int* map, int size);
+static void reset_server_state(struct server_state* state);
 static void copy_user(struct user* dst, struct user* src);
-static void copy_promethus(struct prometheus* dst, struct prometheus* src);
 static void copy_endpoint(struct endpoint* dst, struct endpoint* src);
 static int restart_int(char* name, int e, int n);
 static int restart_string(char* name, char* e, char* n);
@@ -131,10 +139,10 @@ pgexporter_init_configuration(void* shm)
    atomic_init(&config->logging_error, 0);
    atomic_init(&config->logging_fatal, 0);
 
-   for (int i = 0; i < NUMBER_OF_METRICS; i++)
+   /* A reloaded configuration is built in the registry of the configuration in use */
+   if (config->registry == NULL && pgexporter_registry_create(&config->registry))
    {
-      config->prometheus[i].sort_type = SORT_NAME;
-      config->prometheus[i].server_query_type = SERVER_QUERY_BOTH;
+      return 1;
    }
 
    return 0;
@@ -185,7 +193,7 @@ pgexporter_read_configuration(void* shm, char* filename)
                memcpy(&section, line + 1, max);
                if (strcmp(section, "pgexporter"))
                {
-                  if (idx_server > 0 && idx_server <= NUMBER_OF_SERVERS)
+                  if (idx_server > 0)
                   {
                      for (int j = 0; j < idx_server - 1; j++)
                      {
@@ -197,19 +205,17 @@ pgexporter_read_configuration(void* shm, char* filename)
                         }
                      }
 
+                     if (pgexporter_reserve_servers(config, idx_server))
+                     {
+                        fclose(file);
+                        return 1;
+                     }
+
                      memcpy(&(config->servers[idx_server - 1]), &srv, sizeof(struct server));
                   }
-                  else if (idx_server > NUMBER_OF_SERVERS)
-                  {
-                     warnx("Maximum number of servers exceeded");
-                  }
 
                   memset(&srv, 0, sizeof(struct server));
                   memcpy(&srv.name, &section, strlen(section));
-                  srv.fd = -1;
-                  srv.extension = true;
-                  srv.state = SERVER_UNKNOWN;
-                  srv.version = SERVER_UNDERTERMINED_VERSION;
 
                   idx_server++;
                }
@@ -345,6 +351,20 @@ pgexporter_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "metrics_scrape_timeout"))
+               {
+                  if (!strcmp(section, "pgexporter"))
+                  {
+                     if (as_seconds(value, &config->metrics_scrape_timeout, 0))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "bridge"))
                {
                   if (!strcmp(section, "pgexporter"))
@@ -912,6 +932,12 @@ pgexporter_read_configuration(void* shm, char* filename)
          }
       }
 
+      if (pgexporter_reserve_servers(config, idx_server))
+      {
+         fclose(file);
+         return 1;
+      }
+
       memcpy(&(config->servers[idx_server - 1]), &srv, sizeof(struct server));
    }
 
@@ -921,6 +947,89 @@ pgexporter_read_configuration(void* shm, char* filename)
    return 0;
 }
 
+/**
+ *
+ */
+int
+pgexporter_reserve_servers(struct configuration* config, int number_of_servers)
+{
+   int max;
+   struct server* servers = NULL;
+   struct server_state* states = NULL;
+
+   if (number_of_servers <= config->max_servers)
+   {
+      return 0;
+   }
+
+   max = MAX(config->max_servers, INITIAL_NUMBER_OF_SERVERS);
+   while (max < number_of_servers)
+   {
+      max *= 2;
+   }
+
+   servers = pgexporter_registry_allocate(config->registry, max * sizeof(struct server));
+   states = pgexporter_registry_allocate(config->registry, max * sizeof(struct server_state));
+   if (servers == NULL || states == NULL)
+   {
+      return 1;
+   }
+
+   if (config->servers != NULL)
+   {
+      memcpy(servers, config->servers, config->max_servers * sizeof(struct server));
+      memcpy(states, config->states, config->max_servers * sizeof(struct server_state));
+   }
+
+   for (int i = config->max_servers; i < max; i++)
+   {
+      reset_server_state(&states[i]);
+   }
+
+   config->servers = servers;
+   config->states = states;
+   config->max_servers = max;
+
+   return 0;
+}
+
+/**
+ *
+ */
+int
+pgexporter_reserve_metrics(struct configuration* config, int number_of_metrics)
+{
+   int max;
+   struct prometheus* prometheus = NULL;
+
+   if (number_of_metrics <= config->max_metrics)
+   {
+      return 0;
+   }
+
+   max = MAX(config->max_metrics, INITIAL_NUMBER_OF_METRICS);
+   while (max < number_of_metrics)
+   {
+      max *= 2;
+   }
+
+   prometheus = pgexporter_registry_allocate(config->registry, max * sizeof(struct prometheus));
+   if (prometheus == NULL)
+   {
+      return 1;
+   }
+
+   if (config->prometheus != NULL)
+   {
+      memcpy(prometheus, config->prometheus, config->max_metrics * sizeof(struct prometheus));
+   }
+
+   config->prometheus = prometheus;
+   config->max_metrics = max;
+
+   return 0;
+}
+
 /**
  *
  */
@@ -1379,7 +1488,19 @@ pgexporter_reload_configuration(bool* r)
       goto error;
    }
 
-   pgexporter_init_configuration((void*)reload);
+   /* The new sections are built in the other arena of the registry, so the workers keep theirs */
+   if (pgexporter_registry_begin(config->registry))
+   {
+      pgexporter_log_error("Reload: The configuration before the last reload is still in use");
+      goto error;
+   }
+
+   reload->registry = config->registry;
+
+   if (pgexporter_init_configuration((void*)reload))
+   {
+      goto error;
+   }
 
    if (pgexporter_read_configuration((void*)reload, config->configuration_path))
    {
@@ -1429,12 +1550,7 @@ pgexporter_reload_configuration(bool* r)
 
    *r = transfer_configuration(config, reload);
 
-   /* Free Old Query Alts AVL Tree */
-   for (int i = 0; reload != NULL && i < reload->number_of_metrics; i++)
-   {
-      pgexporter_free_query_alts(reload);
-   }
-
+   /* The sections of the reloaded configuration now belong to the configuration */
    pgexporter_destroy_shared_memory((void*)reload, reload_size);
 
    pgexporter_log_debug("Reload: Success");
@@ -1443,14 +1559,13 @@ pgexporter_reload_configuration(bool* r)
 
 error:
 
-   /* Free Old Query Alts AVL Tree */
-   for (int i = 0; reload != NULL && i < reload->number_of_metrics; i++)
+   pgexporter_registry_rollback(config->registry);
+
+   if (reload != NULL)
    {
-      pgexporter_free_query_alts(reload);
+      pgexporter_destroy_shared_memory((void*)reload, reload_size);
    }
 
-   pgexporter_destroy_shared_memory((void*)reload, reload_size);
-
    pgexporter_log_debug("Reload: Failure");
 
    return 1;
@@ -1711,6 +1826,14 @@ pgexporter_conf_set(SSL* ssl, int client_fd, uint8_t compression, uint8_t encryp
          }
          pgexporter_json_put(response, key, (uintptr_t)config->metrics_cache_max_age, ValueInt64);
       }
+      else if (!strcmp(key, "metrics_scrape_timeout"))
+      {
+         if (as_seconds(config_value, &config->metrics_scrape_timeout, 0))
+         {
+            unknown = true;
+         }
+         pgexporter_json_put(response, key, (uintptr_t)config->metrics_scrape_timeout, ValueInt64);
+      }
       else if (!strcmp(key, "metrics_path"))
       {
          max = strlen(config_value);
@@ -2104,6 +2227,7 @@ add_configuration_response(struct json* res)
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_PATH, (uintptr_t)config->metrics_path, ValueString);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_AGE, (uintptr_t)config->metrics_cache_max_age, ValueInt64);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_SIZE, (uintptr_t)config->metrics_cache_max_size, ValueInt64);
+   pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_SCRAPE_TIMEOUT, (uintptr_t)config->metrics_scrape_timeout, ValueInt64);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_BRIDGE, (uintptr_t)config->bridge, ValueInt64);
 
    if (config->number_of_endpoints > 0)
@@ -2919,6 +3043,10 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 {
    char* old_endpoints = NULL;
    char* new_endpoints = NULL;
+   int number_of_servers;
+   int number_of_metrics;
+   int* servers = NULL;
+   int* metrics = NULL;
    bool changed = false;
 
 #ifdef HAVE_SYSTEMD
@@ -2928,6 +3056,7 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    memcpy(config->host, reload->host, MISC_LENGTH);
    config->metrics = reload->metrics;
    config->metrics_cache_max_age = reload->metrics_cache_max_age;
+   config->metrics_scrape_timeout = reload->metrics_scrape_timeout;
    if (restart_int("metrics_cache_max_size", config->metrics_cache_max_size, reload->metrics_cache_max_size))
    {
       changed = true;
@@ -3057,12 +3186,23 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
       changed = true;
    }
 
-   memset(&config->servers[0], 0, sizeof(struct server) * NUMBER_OF_SERVERS);
-   for (int i = 0; i < reload->number_of_servers; i++)
+   number_of_servers = config->number_of_servers;
+   number_of_metrics = config->number_of_metrics;
+
+   /* The servers are matched before the users change, as the password is part of the connection */
+   if (transfer_servers(config, reload, &servers) ||
+       transfer_metrics(config, reload, &metrics) ||
+       transfer_plans(config, reload))
    {
-      copy_server(&config->servers[i], &reload->servers[i]);
+      pgexporter_log_error("Reload: Unable to transfer %d servers and %d metrics",
+                           reload->number_of_servers, reload->number_of_metrics);
+      pgexporter_registry_rollback(config->registry);
+      free(servers);
+      free(metrics);
+      servers = NULL;
+      metrics = NULL;
+      changed = true;
    }
-   config->number_of_servers = reload->number_of_servers;
 
    memset(&config->users[0], 0, sizeof(struct user) * NUMBER_OF_USERS);
    for (int i = 0; i < reload->number_of_users; i++)
@@ -3080,11 +3220,19 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 
    /* prometheus */
    memcpy(config->metrics_path, reload->metrics_path, MISC_LENGTH);
-   for (int i = 0; i < reload->number_of_metrics; i++)
+
+   if (servers != NULL && metrics != NULL)
    {
-      copy_promethus(&config->prometheus[i], &reload->prometheus[i]);
+      transfer_sections(config, reload, servers);
+
+      /* The cached response is kept as long as the servers and the metrics are the same. The
+       * fingerprints of the rendered settings are by server, so they are reset when a server moved */
+      if (config->number_of_servers != number_of_servers || config->number_of_metrics != number_of_metrics ||
+          !is_identity(servers, config->number_of_servers) || !is_identity(metrics, config->number_of_metrics))
+      {
+         pgexporter_prometheus_invalidate();
+      }
    }
-   config->number_of_metrics = reload->number_of_metrics;
 
    /* endpoint */
    for (int i = 0; i < reload->number_of_endpoints; i++)
@@ -3099,39 +3247,286 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 
    free(old_endpoints);
    free(new_endpoints);
+   free(servers);
+   free(metrics);
 
    return changed;
 }
 
-static void
-copy_server(struct server* dst, struct server* src)
+static int
+transfer_servers(struct configuration* config, struct configuration* reload, int** servers)
 {
-   memcpy(&dst->name[0], &src->name[0], MISC_LENGTH);
-   memcpy(&dst->host[0], &src->host[0], MISC_LENGTH);
-   dst->port = src->port;
-   memcpy(&dst->username[0], &src->username[0], MAX_USERNAME_LENGTH);
-   memcpy(&dst->data[0], &src->data[0], MISC_LENGTH);
-   memcpy(&dst->wal[0], &src->wal[0], MISC_LENGTH);
-   dst->fd = src->fd;
-   dst->extension = true;
+   int j;
+   int kept = 0;
+   int* map = NULL;
+   bool* used = NULL;
+
+   *servers = NULL;
+
+   map = calloc(MAX(reload->number_of_servers, 1), sizeof(int));
+   used = calloc(MAX(config->number_of_servers, 1), sizeof(bool));
+
+   if (map == NULL || used == NULL)
+   {
+      goto error;
+   }
+
+   /* A server keeps its connection when its connection parameters did not change */
+   for (int i = 0; i < reload->number_of_servers; i++)
+   {
+      map[i] = -1;
+      for (int k = 0; map[i] == -1 && k < config->number_of_servers; k++)
+      {
+         j = (i + k) % config->number_of_servers;
+         if (!used[j] && same_connection(config, &config->servers[j], reload, &reload->servers[i]))
+         {
+            map[i] = j;
+            used[j] = true;
+            kept++;
+         }
+      }
+
+      if (map[i] != -1)
+      {
+         memcpy(&reload->states[i], &config->states[map[i]], sizeof(struct server_state));
+         memcpy(&reload->servers[i].catalogue, &config->servers[map[i]].catalogue, sizeof(struct catalogue));
+      }
+   }
+
+   pgexporter_log_debug("Reload: Kept %d of %d servers", kept, reload->number_of_servers);
+
+   free(used);
+
+   *servers = map;
+
+   return 0;
+
+error:
+
+   free(map);
+   free(used);
+
+   return 1;
+}
+
+static int
+transfer_metrics(struct configuration* config, struct configuration* reload, int** metrics)
+{
+   int j;
+   int kept = 0;
+   int* map = NULL;
+   bool* used = NULL;
+
+   *metrics = NULL;
+
+   map = calloc(MAX(reload->number_of_metrics, 1), sizeof(int));
+   used = calloc(MAX(config->number_of_metrics, 1), sizeof(bool));
+
+   if (map == NULL || used == NULL)
+   {
+      goto error;
+   }
+
+   /* The metrics that did not change keep the cached response */
+   for (int i = 0; i < reload->number_of_metrics; i++)
+   {
+      map[i] = -1;
+      for (int k = 0; map[i] == -1 && k < config->number_of_metrics; k++)
+      {
+         j = (i + k) % config->number_of_metrics;
+         if (!used[j] && same_metric(&config->prometheus[j], &reload->prometheus[i]))
+         {
+            map[i] = j;
+            used[j] = true;
+            kept++;
+         }
+      }
+   }
+
+   pgexporter_log_debug("Reload: Kept %d of %d metrics", kept, reload->number_of_metrics);
+
+   free(used);
+
+   *metrics = map;
+
+   return 0;
+
+error:
+
+   free(map);
+   free(used);
+
+   return 1;
+}
+
+static int
+transfer_plans(struct configuration* config, struct configuration* reload)
+{
+   /* The collectors are given at startup, and move to the new arena with the rest */
+   if (config->number_of_collectors > 0)
+   {
+      reload->collectors = pgexporter_registry_allocate(reload->registry, config->number_of_collectors * sizeof(char*));
+      if (reload->collectors == NULL)
+      {
+         return 1;
+      }
+
+      for (int i = 0; i < config->number_of_collectors; i++)
+      {
+         reload->collectors[i] = pgexporter_registry_intern(reload->registry, config->collectors[i]);
+      }
+   }
+   reload->number_of_collectors = config->number_of_collectors;
+
+   if (pgexporter_prometheus_compile(reload))
+   {
+      pgexporter_log_error("Reload: Unable to compile the metrics");
+      return 1;
+   }
+
+   return 0;
 }
 
 static void
-copy_user(struct user* dst, struct user* src)
+transfer_sections(struct configuration* config, struct configuration* reload, int* servers)
 {
-   memcpy(&dst->username[0], &src->username[0], MAX_USERNAME_LENGTH);
-   memcpy(&dst->password[0], &src->password[0], MAX_PASSWORD_LENGTH);
+   bool* used = NULL;
+   bool* planned = NULL;
+
+   used = calloc(MAX(config->number_of_servers, 1), sizeof(bool));
+   planned = calloc(MAX(reload->number_of_servers, 1), sizeof(bool));
+
+   for (int i = 0; i < reload->number_of_servers; i++)
+   {
+      if (servers[i] != -1)
+      {
+         if (used != NULL)
+         {
+            used[servers[i]] = true;
+         }
+
+         /* The compilation laid out the plans again */
+         if (planned != NULL)
+         {
+            planned[i] = config->states[servers[i]].plan.valid;
+         }
+      }
+   }
+
+   for (int i = 0; used != NULL && i < config->number_of_servers; i++)
+   {
+      if (!used[i] && config->states[i].fd != -1)
+      {
+         pgexporter_log_debug("Reload: Closing the connection to %s", config->servers[i].name);
+
+         /* Only the cached connections are held by the main process */
+         if (config->cache)
+         {
+            pgexporter_disconnect(config->states[i].fd);
+         }
+      }
+   }
+
+   pgexporter_prometheus_statistics_transfer(config, reload, servers);
+
+   /* A running worker never sees more servers or metrics than the sections it reads hold */
+   config->number_of_servers = MIN(config->number_of_servers, reload->number_of_servers);
+   config->number_of_metrics = MIN(config->number_of_metrics, reload->number_of_metrics);
+
+   config->servers = reload->servers;
+   config->states = reload->states;
+   config->max_servers = reload->max_servers;
+   config->prometheus = reload->prometheus;
+   config->max_metrics = reload->max_metrics;
+   config->plans = reload->plans;
+   config->max_plans = reload->max_plans;
+   config->statistics = reload->statistics;
+   config->collectors = reload->collectors;
+
+   config->number_of_servers = reload->number_of_servers;
+   config->number_of_metrics = reload->number_of_metrics;
+
+   pgexporter_registry_commit(config->registry);
+
+   for (int i = 0; planned != NULL && i < config->number_of_servers; i++)
+   {
+      if (planned[i])
+      {
+         pgexporter_prometheus_plan(i);
+      }
+   }
+
+   free(used);
+   free(planned);
+}
+
+static bool
+same_connection(struct configuration* config, struct server* server, struct configuration* reload, struct server* srv)
+{
+   return !strcmp(server->name, srv->name) &&
+          !strcmp(server->host, srv->host) &&
+          server->port == srv->port &&
+          !strcmp(server->username, srv->username) &&
+          !strcmp(server->tls_cert_file, srv->tls_cert_file) &&
+          !strcmp(server->tls_key_file, srv->tls_key_file) &&
+          !strcmp(server->tls_ca_file, srv->tls_ca_file) &&
+          pgexporter_compare_string(server_password(config, server->username),
+                                    server_password(reload, srv->username));
+}
+
+static char*
+server_password(struct configuration* config, char* username)
+{
+   for (int i = 0; i < config->number_of_users; i++)
+   {
+      if (!strcmp(config->users[i].username, username))
+      {
+         return config->users[i].password;
+      }
+   }
+
+   return NULL;
+}
+
+static bool
+same_metric(struct prometheus* p1, struct prometheus* p2)
+{
+   return !strcmp(p1->tag, p2->tag) &&
+          pgexporter_compare_string(p1->collector, p2->collector) &&
+          p1->sort_type == p2->sort_type &&
+          p1->server_query_type == p2->server_query_type &&
+          pgexporter_equal_query_alts(p1->root, p2->root);
+}
+
+static bool
+is_identity(int* map, int size)
+{
+   for (int i = 0; i < size; i++)
+   {
+      if (map[i] != i)
+      {
+         return false;
+      }
+   }
+
+   return true;
 }
 
 static void
-copy_promethus(struct prometheus* dst, struct prometheus* src)
+reset_server_state(struct server_state* state)
 {
-   memcpy(dst->tag, src->tag, MISC_LENGTH);
-   memcpy(dst->collector, src->collector, MAX_COLLECTOR_LENGTH);
-   dst->sort_type = src->sort_type;
-   dst->server_query_type = src->server_query_type;
+   memset(state, 0, sizeof(struct server_state));
+   state->fd = -1;
+   state->extension = true;
+   state->state = SERVER_UNKNOWN;
+   state->version = SERVER_UNDERTERMINED_VERSION;
+}
 
-   pgexporter_copy_query_alts(&dst->root, src->root);
+static void
+copy_user(struct user* dst, struct user* src)
+{
+   memcpy(&dst->username[0], &src->username[0], MAX_USERNAME_LENGTH);
+   memcpy(&dst->password[0], &src->password[0], MAX_PASSWORD_LENGTH);
 }
 
 static void
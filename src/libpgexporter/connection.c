@@ -102,7 +102,7 @@ pgexporter_transfer_connection_write(int server)
    msg.msg_control = cmptr;
    msg.msg_controllen = CMSG_SPACE(sizeof(int));
    msg.msg_flags = 0;
-   *(int*)CMSG_DATA(cmptr) = config->servers[server].fd;
+   *(int*)CMSG_DATA(cmptr) = config->states[server].fd;
 
    if (sendmsg(fd, &msg, 0) != 2)
    {
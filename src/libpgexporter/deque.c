@@ -86,6 +86,21 @@ deque_merge(struct deque_node* node1, struct deque_node* node2);
 static int
 tag_compare(char* tag1, char* tag2);
 
+static uint32_t
+tag_hash(char* tag);
+
+static void
+index_rebuild(struct deque* deque, uint32_t buckets);
+
+static void
+index_add(struct deque* deque, struct deque_node* node);
+
+static void
+index_remove(struct deque* deque, struct deque_node* node);
+
+static struct deque_node*
+index_find(struct deque* deque, char* tag);
+
 int
 pgexporter_deque_create(bool thread_safe, struct deque** deque)
 {
@@ -93,6 +108,8 @@ pgexporter_deque_create(bool thread_safe, struct deque** deque)
    q = malloc(sizeof(struct deque));
    q->size = 0;
    q->thread_safe = thread_safe;
+   q->index = NULL;
+   q->buckets = 0;
    if (thread_safe)
    {
       pthread_rwlock_init(&q->mutex, NULL);
@@ -105,6 +122,22 @@ pgexporter_deque_create(bool thread_safe, struct deque** deque)
    return 0;
 }
 
+int
+pgexporter_deque_index(struct deque* deque)
+{
+   if (deque == NULL)
+   {
+      return 1;
+   }
+   deque_write_lock(deque);
+   if (deque->index == NULL)
+   {
+      index_rebuild(deque, 16);
+   }
+   deque_unlock(deque);
+   return 0;
+}
+
 int
 pgexporter_deque_add(struct deque* deque, char* tag, uintptr_t data, enum value_type type)
 {
@@ -117,10 +150,22 @@ pgexporter_deque_remove(struct deque* deque, char* tag)
 {
    int cnt = 0;
    struct deque_iterator* iter = NULL;
+   struct deque_node* n = NULL;
    if (deque == NULL || tag == NULL)
    {
       return 0;
    }
+   if (deque->index != NULL)
+   {
+      deque_write_lock(deque);
+      while ((n = index_find(deque, tag)) != NULL)
+      {
+         deque_remove(deque, n);
+         cnt++;
+      }
+      deque_unlock(deque);
+      return cnt;
+   }
    pgexporter_deque_iterator_create(deque, &iter);
    while (pgexporter_deque_iterator_next(iter))
    {
@@ -180,6 +225,7 @@ pgexporter_deque_poll(struct deque* deque, char** tag)
    deque->start->next = head->next;
    head->next->prev = deque->start;
    deque->size--;
+   index_remove(deque, head);
    val = head->data;
    if (tag != NULL)
    {
@@ -215,6 +261,7 @@ pgexporter_deque_poll_last(struct deque* deque, char** tag)
    deque->end->prev = tail->prev;
    tail->prev->next = deque->end;
    deque->size--;
+   index_remove(deque, tail);
 
    val = tail->data;
    if (tag != NULL)
@@ -392,6 +439,7 @@ pgexporter_deque_destroy(struct deque* deque)
    {
       pthread_rwlock_destroy(&deque->mutex);
    }
+   free(deque->index);
    free(deque);
 }
 
@@ -515,6 +563,7 @@ deque_offer(struct deque* deque, char* tag, uintptr_t data, enum value_type type
    n->prev = last;
    n->next = deque->end;
    deque->end->prev = n;
+   index_add(deque, n);
    deque_unlock(deque);
 }
 
@@ -535,6 +584,7 @@ deque_node_create(uintptr_t data, enum value_type type, char* tag, struct value_
    if (tag != NULL)
    {
       n->tag = pgexporter_append(NULL, tag);
+      n->hash = tag_hash(tag);
    }
    else
    {
@@ -609,6 +659,10 @@ deque_find(struct deque* deque, char* tag)
    {
       return NULL;
    }
+   if (deque->index != NULL)
+   {
+      return index_find(deque, tag);
+   }
    n = deque_next(deque, deque->start);
 
    while (n != NULL)
@@ -753,6 +807,7 @@ deque_remove(struct deque* deque, struct deque_node* node)
    struct deque_node* next = node->next;
    prev->next = next;
    next->prev = prev;
+   index_remove(deque, node);
    deque_node_destroy(node);
    deque->size--;
    return prev;
@@ -879,3 +934,100 @@ tag_compare(char* tag1, char* tag2)
    }
    return strcmp(tag1, tag2);
 }
+
+static uint32_t
+tag_hash(char* tag)
+{
+   uint32_t hash = 2166136261u;
+
+   for (char* c = tag; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+
+   return hash;
+}
+
+static void
+index_rebuild(struct deque* deque, uint32_t buckets)
+{
+   struct deque_node* n = NULL;
+
+   free(deque->index);
+   deque->index = calloc(buckets, sizeof(struct deque_node*));
+   deque->buckets = buckets;
+
+   // Walk the deque in order, so each bucket keeps the nodes in the order of the deque
+   n = deque_next(deque, deque->start);
+   while (n != NULL)
+   {
+      index_add(deque, n);
+      n = deque_next(deque, n);
+   }
+}
+
+static void
+index_add(struct deque* deque, struct deque_node* node)
+{
+   struct deque_node** slot = NULL;
+
+   if (deque->index == NULL || node->tag == NULL)
+   {
+      return;
+   }
+
+   if (deque->size > deque->buckets * 2)
+   {
+      // The node is already linked into the deque, so the rebuild indexes it
+      index_rebuild(deque, deque->buckets * 4);
+      return;
+   }
+
+   // Append, so the first match is the first node with the tag
+   slot = &deque->index[node->hash & (deque->buckets - 1)];
+   while (*slot != NULL)
+   {
+      slot = &(*slot)->link;
+   }
+   node->link = NULL;
+   *slot = node;
+}
+
+static void
+index_remove(struct deque* deque, struct deque_node* node)
+{
+   struct deque_node** slot = NULL;
+
+   if (deque->index == NULL || node->tag == NULL)
+   {
+      return;
+   }
+
+   slot = &deque->index[node->hash & (deque->buckets - 1)];
+   while (*slot != NULL && *slot != node)
+   {
+      slot = &(*slot)->link;
+   }
+   if (*slot != NULL)
+   {
+      *slot = node->link;
+   }
+}
+
+static struct deque_node*
+index_find(struct deque* deque, char* tag)
+{
+   uint32_t hash = tag_hash(tag);
+   struct deque_node* n = deque->index[hash & (deque->buckets - 1)];
+
+   while (n != NULL)
+   {
+      if (n->hash == hash && !strcmp(n->tag, tag))
+      {
+         return n;
+      }
+      n = n->link;
+   }
+
+   return NULL;
+}
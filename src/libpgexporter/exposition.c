@@ -0,0 +1,1568 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <art.h>
+#include <exposition.h>
+#include <logging.h>
+#include <value.h>
+
+/* system */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define PROTOBUF_CONTENT_TYPE "application/vnd.google.protobuf"
+#define PROTOBUF_PROTO        "io.prometheus.client.MetricFamily"
+
+/* io.prometheus.client.MetricType */
+#define TYPE_COUNTER   0
+#define TYPE_GAUGE     1
+#define TYPE_UNTYPED   3
+#define TYPE_HISTOGRAM 4
+
+#define SAMPLE_VALUE  0
+#define SAMPLE_BUCKET 1
+#define SAMPLE_SUM    2
+#define SAMPLE_COUNT  3
+
+#define WIRE_VARINT 0
+#define WIRE_DOUBLE 1
+#define WIRE_LENGTH 2
+
+/** @struct sample
+ * Defines a sample of a metric family
+ */
+struct sample
+{
+   int kind;      /**< The kind of the sample */
+   char* le;      /**< The upper bound of a bucket */
+   char* value;   /**< The value */
+   size_t labels; /**< The first label in the label pool */
+   int n_labels;  /**< The number of labels */
+};
+
+/** @struct family
+ * Defines a metric family
+ */
+struct family
+{
+   char* name;             /**< The name */
+   char* help;             /**< The help */
+   int type;               /**< The type, or -1 if not known yet */
+   int defined;            /**< The number of samples before the family was defined again */
+   int sent;               /**< The number of samples encoded */
+   bool encoded;           /**< Has the family been encoded */
+   struct sample* samples; /**< The samples */
+   int size;               /**< The number of samples */
+   int capacity;           /**< The capacity of the samples */
+};
+
+/** @struct families
+ * Defines the metric families of an exposition
+ */
+struct families
+{
+   struct art* names;          /**< family::name -> family */
+   struct family** families;   /**< The families in order of appearance */
+   int size;                   /**< The number of families */
+   int capacity;               /**< The capacity of the families */
+   char** labels;              /**< The label pool, as key and value pairs */
+   size_t n_labels;            /**< The number of labels */
+   size_t labels_capacity;     /**< The capacity of the label pool */
+};
+
+/** @struct buffer
+ * Defines an output buffer
+ */
+struct buffer
+{
+   char* data;      /**< The data */
+   size_t size;     /**< The size */
+   size_t capacity; /**< The capacity */
+   bool error;      /**< An allocation failed */
+};
+
+static bool header(struct message* msg, char* name, char* value, size_t size);
+static int negotiate(char* accept);
+static bool accept_gzip(char* accept_encoding);
+static char* trim(char* s);
+
+static int families_create(struct families** families);
+static void families_destroy(struct families* families);
+static int family_find_create(struct families* families, char* name, struct family** family);
+static int family_add_sample(struct family* family, int kind, char* le, char* value, size_t labels, int n_labels);
+static bool family_sample(struct family* family, char* name, int* kind);
+static int family_of_sample(struct families* families, struct family* current, char* name, struct family** family, int* kind);
+static int add_label(struct families* families, char* key, char* value);
+static bool same_labels(struct families* families, struct sample* a, struct sample* b);
+static bool family_contains(struct families* families, struct family* family, struct sample* sample);
+static bool sample_value(char* value, double* d);
+
+static int encode(struct exposition* exposition, bool end, char** data, size_t* size);
+
+static int parse_text(char* text, struct families* families);
+static int parse_comment(struct families* families, char* line, struct family** current);
+static int parse_sample(struct families* families, char* line, struct family** current);
+
+static void unescape_help(char* help);
+
+static void encode_openmetrics(struct families* families, struct buffer* out);
+static void encode_protobuf(struct families* families, struct buffer* out);
+
+static void buffer_append(struct buffer* buffer, void* data, size_t size);
+static void buffer_string(struct buffer* buffer, char* s);
+static void buffer_escape(struct buffer* buffer, char* s);
+static void buffer_varint(struct buffer* buffer, uint64_t value);
+static void buffer_varint_field(struct buffer* buffer, int field, uint64_t value);
+static void buffer_double_field(struct buffer* buffer, int field, double value);
+static void buffer_string_field(struct buffer* buffer, int field, char* s);
+static void buffer_message_field(struct buffer* buffer, int field, struct buffer* message);
+
+int
+pgexporter_exposition_negotiate(struct message* msg)
+{
+   char accept[MAX_PATH];
+
+   if (!header(msg, "Accept", &accept[0], sizeof(accept)))
+   {
+      return EXPOSITION_TEXT;
+   }
+
+   return negotiate(&accept[0]);
+}
+
+bool
+pgexporter_exposition_gzip(struct message* msg)
+{
+   char accept_encoding[MAX_PATH];
+
+   if (!header(msg, "Accept-Encoding", &accept_encoding[0], sizeof(accept_encoding)))
+   {
+      return false;
+   }
+
+   return accept_gzip(&accept_encoding[0]);
+}
+
+char*
+pgexporter_exposition_content_type(int format)
+{
+   if (format == EXPOSITION_OPENMETRICS)
+   {
+      return "application/openmetrics-text; version=1.0.0; charset=utf-8";
+   }
+   else if (format == EXPOSITION_PROTOBUF)
+   {
+      return PROTOBUF_CONTENT_TYPE "; proto=" PROTOBUF_PROTO "; encoding=delimited";
+   }
+
+   return "text/plain; version=0.0.1; charset=utf-8";
+}
+
+int
+pgexporter_exposition_create(int format, struct exposition** exposition)
+{
+   struct exposition* e = NULL;
+
+   *exposition = NULL;
+
+   e = (struct exposition*)malloc(sizeof(struct exposition));
+   if (e == NULL)
+   {
+      goto error;
+   }
+
+   memset(e, 0, sizeof(struct exposition));
+
+   e->format = format;
+
+   *exposition = e;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgexporter_exposition_append(struct exposition* exposition, char* data)
+{
+   size_t length;
+   size_t capacity;
+   char* text = NULL;
+
+   if (exposition == NULL || data == NULL)
+   {
+      return 1;
+   }
+
+   length = strlen(data);
+
+   if (exposition->length + length + 1 > exposition->capacity)
+   {
+      capacity = exposition->capacity > 0 ? exposition->capacity : 65536;
+
+      while (exposition->length + length + 1 > capacity)
+      {
+         capacity *= 2;
+      }
+
+      text = realloc(exposition->text, capacity);
+      if (text == NULL)
+      {
+         return 1;
+      }
+
+      exposition->text = text;
+      exposition->capacity = capacity;
+   }
+
+   memcpy(exposition->text + exposition->length, data, length + 1);
+   exposition->length += length;
+
+   return 0;
+}
+
+int
+pgexporter_exposition_flush(struct exposition* exposition, char** data, size_t* size)
+{
+   return encode(exposition, false, data, size);
+}
+
+int
+pgexporter_exposition_encode(struct exposition* exposition, char** data, size_t* size)
+{
+   return encode(exposition, true, data, size);
+}
+
+void
+pgexporter_exposition_destroy(struct exposition* exposition)
+{
+   if (exposition == NULL)
+   {
+      return;
+   }
+
+   families_destroy(exposition->families);
+
+   for (int i = 0; i < exposition->n_parsed; i++)
+   {
+      free(exposition->parsed[i]);
+   }
+
+   free(exposition->parsed);
+   free(exposition->text);
+   free(exposition);
+}
+
+static int
+encode(struct exposition* exposition, bool end, char** data, size_t* size)
+{
+   char* text = NULL;
+   char** parsed = NULL;
+   size_t length;
+   struct buffer out;
+
+   *data = NULL;
+   *size = 0;
+
+   memset(&out, 0, sizeof(struct buffer));
+
+   if (exposition == NULL)
+   {
+      goto error;
+   }
+
+   if (exposition->format == EXPOSITION_TEXT)
+   {
+      *data = exposition->text != NULL ? exposition->text : strdup("");
+      *size = exposition->length;
+
+      exposition->text = NULL;
+      exposition->length = 0;
+      exposition->capacity = 0;
+
+      return *data != NULL ? 0 : 1;
+   }
+
+   if (exposition->families == NULL && families_create(&exposition->families))
+   {
+      goto error;
+   }
+
+   /* The families point into the text, so it is kept, and a line not complete yet waits for the next text */
+   length = exposition->length;
+   if (!end)
+   {
+      while (length > 0 && exposition->text[length - 1] != '\n')
+      {
+         length--;
+      }
+   }
+
+   if (length > 0)
+   {
+      text = exposition->text;
+
+      exposition->text = NULL;
+      exposition->length = 0;
+      exposition->capacity = 0;
+
+      if (text[length] != '\0' && pgexporter_exposition_append(exposition, text + length))
+      {
+         goto error;
+      }
+      text[length] = '\0';
+
+      parsed = realloc(exposition->parsed, (exposition->n_parsed + 1) * sizeof(char*));
+      if (parsed == NULL)
+      {
+         goto error;
+      }
+
+      exposition->parsed = parsed;
+      exposition->parsed[exposition->n_parsed++] = text;
+      text = NULL;
+
+      if (parse_text(exposition->parsed[exposition->n_parsed - 1], exposition->families))
+      {
+         goto error;
+      }
+   }
+
+   if (exposition->format == EXPOSITION_OPENMETRICS)
+   {
+      encode_openmetrics(exposition->families, &out);
+
+      if (end)
+      {
+         buffer_string(&out, "# EOF\n");
+      }
+   }
+   else
+   {
+      encode_protobuf(exposition->families, &out);
+   }
+
+   /* An empty protobuf response is valid, but the data must not be NULL */
+   buffer_append(&out, "", 1);
+   out.size--;
+
+   if (out.error)
+   {
+      goto error;
+   }
+
+   *data = out.data;
+   *size = out.size;
+
+   return 0;
+
+error:
+
+   free(text);
+   free(out.data);
+
+   return 1;
+}
+
+static bool
+header(struct message* msg, char* name, char* value, size_t size)
+{
+   char* line = NULL;
+   char* end = NULL;
+   size_t name_length;
+   size_t length;
+
+   if (msg == NULL || msg->data == NULL)
+   {
+      return false;
+   }
+
+   name_length = strlen(name);
+   line = strchr((char*)msg->data, '\n');
+
+   while (line != NULL)
+   {
+      line++;
+
+      if (!strncasecmp(line, name, name_length) && line[name_length] == ':')
+      {
+         line += name_length + 1;
+         end = strpbrk(line, "\r\n");
+         length = end != NULL ? (size_t)(end - line) : strlen(line);
+
+         if (length >= size)
+         {
+            length = size - 1;
+         }
+
+         memcpy(value, line, length);
+         value[length] = '\0';
+
+         return true;
+      }
+
+      line = strchr(line, '\n');
+   }
+
+   return false;
+}
+
+static int
+negotiate(char* accept)
+{
+   int format = EXPOSITION_TEXT;
+   int candidate;
+   double best = -1.0;
+   double q;
+   bool delimited;
+   char* range = NULL;
+   char* type = NULL;
+   char* parameter = NULL;
+   char* saveptr = NULL;
+   char* range_saveptr = NULL;
+
+   range = strtok_r(accept, ",", &saveptr);
+
+   while (range != NULL)
+   {
+      candidate = -1;
+      q = 1.0;
+      delimited = true;
+
+      type = trim(strtok_r(range, ";", &range_saveptr));
+      parameter = strtok_r(NULL, ";", &range_saveptr);
+
+      while (parameter != NULL)
+      {
+         parameter = trim(parameter);
+
+         if (!strncasecmp(parameter, "q=", 2))
+         {
+            q = strtod(parameter + 2, NULL);
+         }
+         else if (!strncasecmp(parameter, "proto=", 6))
+         {
+            delimited = delimited && !strcmp(parameter + 6, PROTOBUF_PROTO);
+         }
+         else if (!strncasecmp(parameter, "encoding=", 9))
+         {
+            delimited = delimited && !strcasecmp(parameter + 9, "delimited");
+         }
+
+         parameter = strtok_r(NULL, ";", &range_saveptr);
+      }
+
+      if (type != NULL)
+      {
+         if (!strcasecmp(type, PROTOBUF_CONTENT_TYPE))
+         {
+            candidate = delimited ? EXPOSITION_PROTOBUF : -1;
+         }
+         else if (!strcasecmp(type, "application/openmetrics-text"))
+         {
+            candidate = EXPOSITION_OPENMETRICS;
+         }
+         else if (!strcasecmp(type, "text/plain") || !strcasecmp(type, "text/*") || !strcmp(type, "*/*"))
+         {
+            candidate = EXPOSITION_TEXT;
+         }
+      }
+
+      /* The first of the preferred formats wins */
+      if (candidate != -1 && q > 0.0 && q > best)
+      {
+         format = candidate;
+         best = q;
+      }
+
+      range = strtok_r(NULL, ",", &saveptr);
+   }
+
+   return format;
+}
+
+static bool
+accept_gzip(char* accept_encoding)
+{
+   bool wildcard = false;
+   double q;
+   char* coding = NULL;
+   char* name = NULL;
+   char* parameter = NULL;
+   char* saveptr = NULL;
+   char* coding_saveptr = NULL;
+
+   coding = strtok_r(accept_encoding, ",", &saveptr);
+
+   while (coding != NULL)
+   {
+      q = 1.0;
+
+      name = trim(strtok_r(coding, ";", &coding_saveptr));
+      parameter = strtok_r(NULL, ";", &coding_saveptr);
+
+      while (parameter != NULL)
+      {
+         parameter = trim(parameter);
+
+         if (!strncasecmp(parameter, "q=", 2))
+         {
+            q = strtod(parameter + 2, NULL);
+         }
+
+         parameter = strtok_r(NULL, ";", &coding_saveptr);
+      }
+
+      if (name != NULL)
+      {
+         /* An explicit gzip, also with q=0, overrides the wildcard */
+         if (!strcasecmp(name, "gzip") || !strcasecmp(name, "x-gzip"))
+         {
+            return q > 0.0;
+         }
+         else if (!strcmp(name, "*"))
+         {
+            wildcard = q > 0.0;
+         }
+      }
+
+      coding = strtok_r(NULL, ",", &saveptr);
+   }
+
+   return wildcard;
+}
+
+static char*
+trim(char* s)
+{
+   char* end = NULL;
+
+   if (s == NULL)
+   {
+      return NULL;
+   }
+
+   while (*s == ' ' || *s == '\t')
+   {
+      s++;
+   }
+
+   end = s + strlen(s);
+
+   while (end > s && (*(end - 1) == ' ' || *(end - 1) == '\t'))
+   {
+      end--;
+   }
+
+   *end = '\0';
+
+   return s;
+}
+
+static int
+families_create(struct families** families)
+{
+   struct families* f = NULL;
+
+   *families = NULL;
+
+   f = (struct families*)malloc(sizeof(struct families));
+   if (f == NULL)
+   {
+      goto error;
+   }
+
+   memset(f, 0, sizeof(struct families));
+
+   if (pgexporter_art_create(&f->names))
+   {
+      goto error;
+   }
+
+   *families = f;
+
+   return 0;
+
+error:
+
+   free(f);
+
+   return 1;
+}
+
+static void
+families_destroy(struct families* families)
+{
+   if (families == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < families->size; i++)
+   {
+      free(families->families[i]->samples);
+      free(families->families[i]);
+   }
+
+   pgexporter_art_destroy(families->names);
+
+   free(families->families);
+   free(families->labels);
+   free(families);
+}
+
+static int
+family_find_create(struct families* families, char* name, struct family** family)
+{
+   int capacity;
+   struct family* f = NULL;
+   struct family** fs = NULL;
+
+   f = (struct family*)pgexporter_art_search(families->names, name);
+
+   if (f == NULL)
+   {
+      if (families->size == families->capacity)
+      {
+         capacity = families->capacity > 0 ? families->capacity * 2 : 64;
+
+         fs = realloc(families->families, capacity * sizeof(struct family*));
+         if (fs == NULL)
+         {
+            goto error;
+         }
+
+         families->families = fs;
+         families->capacity = capacity;
+      }
+
+      f = (struct family*)malloc(sizeof(struct family));
+      if (f == NULL)
+      {
+         goto error;
+      }
+
+      memset(f, 0, sizeof(struct family));
+
+      f->name = name;
+      f->type = -1;
+
+      if (pgexporter_art_insert(families->names, name, (uintptr_t)f, ValueRef))
+      {
+         free(f);
+         goto error;
+      }
+
+      families->families[families->size++] = f;
+   }
+
+   *family = f;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+family_add_sample(struct family* family, int kind, char* le, char* value, size_t labels, int n_labels)
+{
+   int capacity;
+   struct sample* samples = NULL;
+
+   if (family->size == family->capacity)
+   {
+      capacity = family->capacity > 0 ? family->capacity * 2 : 8;
+
+      samples = realloc(family->samples, capacity * sizeof(struct sample));
+      if (samples == NULL)
+      {
+         return 1;
+      }
+
+      family->samples = samples;
+      family->capacity = capacity;
+   }
+
+   family->samples[family->size].kind = kind;
+   family->samples[family->size].le = le;
+   family->samples[family->size].value = value;
+   family->samples[family->size].labels = labels;
+   family->samples[family->size].n_labels = n_labels;
+   family->size++;
+
+   return 0;
+}
+
+static bool
+family_sample(struct family* family, char* name, int* kind)
+{
+   size_t length = strlen(family->name);
+
+   if (strncmp(name, family->name, length))
+   {
+      return false;
+   }
+
+   if (family->type == TYPE_HISTOGRAM)
+   {
+      if (!strcmp(name + length, "_bucket"))
+      {
+         *kind = SAMPLE_BUCKET;
+         return true;
+      }
+      else if (!strcmp(name + length, "_sum"))
+      {
+         *kind = SAMPLE_SUM;
+         return true;
+      }
+      else if (!strcmp(name + length, "_count"))
+      {
+         *kind = SAMPLE_COUNT;
+         return true;
+      }
+
+      return false;
+   }
+
+   *kind = SAMPLE_VALUE;
+
+   return name[length] == '\0' || (family->type == TYPE_COUNTER && !strcmp(name + length, "_total"));
+}
+
+static int
+family_of_sample(struct families* families, struct family* current, char* name, struct family** family, int* kind)
+{
+   char* suffix = NULL;
+   char c;
+   struct family* f = NULL;
+
+   *family = NULL;
+   *kind = SAMPLE_VALUE;
+
+   if (current != NULL && family_sample(current, name, kind))
+   {
+      *family = current;
+      return 0;
+   }
+
+   f = (struct family*)pgexporter_art_search(families->names, name);
+
+   if (f != NULL && family_sample(f, name, kind))
+   {
+      *family = f;
+      return 0;
+   }
+
+   /* The samples of a histogram or a counter carry a suffix */
+   suffix = strrchr(name, '_');
+
+   if (suffix != NULL && suffix != name)
+   {
+      c = *suffix;
+      *suffix = '\0';
+      f = (struct family*)pgexporter_art_search(families->names, name);
+      *suffix = c;
+
+      if (f != NULL && family_sample(f, name, kind))
+      {
+         *family = f;
+         return 0;
+      }
+   }
+
+   *kind = SAMPLE_VALUE;
+
+   return family_find_create(families, name, family);
+}
+
+static int
+add_label(struct families* families, char* key, char* value)
+{
+   size_t capacity;
+   char** labels = NULL;
+
+   if (2 * (families->n_labels + 1) > families->labels_capacity)
+   {
+      capacity = families->labels_capacity > 0 ? families->labels_capacity * 2 : 1024;
+
+      labels = realloc(families->labels, capacity * sizeof(char*));
+      if (labels == NULL)
+      {
+         return 1;
+      }
+
+      families->labels = labels;
+      families->labels_capacity = capacity;
+   }
+
+   families->labels[2 * families->n_labels] = key;
+   families->labels[2 * families->n_labels + 1] = value;
+   families->n_labels++;
+
+   return 0;
+}
+
+static bool
+same_labels(struct families* families, struct sample* a, struct sample* b)
+{
+   if (a->n_labels != b->n_labels)
+   {
+      return false;
+   }
+
+   for (int i = 0; i < 2 * a->n_labels; i++)
+   {
+      if (strcmp(families->labels[2 * a->labels + i], families->labels[2 * b->labels + i]))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static bool
+family_contains(struct families* families, struct family* family, struct sample* sample)
+{
+   struct sample* s = NULL;
+
+   for (int i = 0; i < family->defined; i++)
+   {
+      s = &family->samples[i];
+
+      if (s->kind == sample->kind &&
+          (s->le == NULL) == (sample->le == NULL) &&
+          (s->le == NULL || !strcmp(s->le, sample->le)) &&
+          same_labels(families, s, sample))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static bool
+sample_value(char* value, double* d)
+{
+   char* end = NULL;
+
+   *d = strtod(value, &end);
+
+   return end != value && *end == '\0';
+}
+
+static int
+parse_text(char* text, struct families* families)
+{
+   char* line = text;
+   char* next = NULL;
+   struct family* current = NULL;
+
+   while (line != NULL && *line != '\0')
+   {
+      next = strchr(line, '\n');
+
+      if (next != NULL)
+      {
+         *next = '\0';
+         next++;
+      }
+
+      if (*line == '#')
+      {
+         if (parse_comment(families, line + 1, &current))
+         {
+            goto error;
+         }
+      }
+      else if (*line != '\0')
+      {
+         if (parse_sample(families, line, &current))
+         {
+            goto error;
+         }
+      }
+
+      line = next;
+   }
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+parse_comment(struct families* families, char* line, struct family** current)
+{
+   bool help;
+   char* name = NULL;
+   char* rest = NULL;
+   struct family* family = NULL;
+
+   while (*line == ' ')
+   {
+      line++;
+   }
+
+   /* Other comments are dropped */
+   if (strncmp(line, "HELP ", 5) && strncmp(line, "TYPE ", 5))
+   {
+      return 0;
+   }
+
+   help = *line == 'H';
+
+   name = line + 5;
+
+   while (*name == ' ')
+   {
+      name++;
+   }
+
+   rest = strchr(name, ' ');
+
+   if (rest != NULL)
+   {
+      *rest = '\0';
+      rest++;
+
+      while (*rest == ' ')
+      {
+         rest++;
+      }
+   }
+
+   if (*name == '\0')
+   {
+      return 0;
+   }
+
+   if (family_find_create(families, name, &family))
+   {
+      return 1;
+   }
+
+   /* A family defined again is merged, without the series it already has */
+   if (family != *current && family->size > 0)
+   {
+      family->defined = family->size;
+   }
+
+   /* The first definition of a family wins */
+   if (help)
+   {
+      if (family->help == NULL && rest != NULL)
+      {
+         unescape_help(rest);
+         family->help = rest;
+      }
+   }
+   else if (family->type == -1 && rest != NULL)
+   {
+      if (!strcmp(rest, "counter"))
+      {
+         family->type = TYPE_COUNTER;
+      }
+      else if (!strcmp(rest, "gauge"))
+      {
+         family->type = TYPE_GAUGE;
+      }
+      else if (!strcmp(rest, "histogram"))
+      {
+         family->type = TYPE_HISTOGRAM;
+      }
+      else
+      {
+         family->type = TYPE_UNTYPED;
+      }
+   }
+
+   *current = family;
+
+   return 0;
+}
+
+static int
+parse_sample(struct families* families, char* line, struct family** current)
+{
+   int kind;
+   int n_labels = 0;
+   bool labels;
+   size_t first;
+   char* p = NULL;
+   char* w = NULL;
+   char* key = NULL;
+   char* value = NULL;
+   char* le = NULL;
+   struct family* family = NULL;
+
+   first = families->n_labels;
+
+   p = line + strcspn(line, "{ ");
+
+   if (*p == '\0' || p == line)
+   {
+      goto malformed;
+   }
+
+   labels = *p == '{';
+   *p = '\0';
+   p++;
+
+   if (family_of_sample(families, *current, line, &family, &kind))
+   {
+      goto error;
+   }
+
+   while (labels)
+   {
+      while (*p == ' ' || *p == ',')
+      {
+         p++;
+      }
+
+      if (*p == '}')
+      {
+         p++;
+         break;
+      }
+
+      key = p;
+      p = strchr(p, '=');
+
+      if (p == NULL || *(p + 1) != '"')
+      {
+         goto malformed;
+      }
+
+      *p = '\0';
+      p += 2;
+
+      /* Unescape the value in place */
+      value = p;
+      w = p;
+
+      while (*p != '"')
+      {
+         if (*p == '\0')
+         {
+            goto malformed;
+         }
+
+         if (*p == '\\' && *(p + 1) != '\0')
+         {
+            p++;
+            *w++ = *p == 'n' ? '\n' : *p;
+            p++;
+         }
+         else
+         {
+            *w++ = *p++;
+         }
+      }
+
+      *w = '\0';
+      p++;
+
+      if (kind == SAMPLE_BUCKET && !strcmp(key, "le"))
+      {
+         le = value;
+      }
+      else
+      {
+         if (add_label(families, key, value))
+         {
+            goto error;
+         }
+
+         n_labels++;
+      }
+   }
+
+   while (*p == ' ')
+   {
+      p++;
+   }
+
+   value = p;
+   p += strcspn(p, " \r");
+   *p = '\0';
+
+   if (*value == '\0' || (kind == SAMPLE_BUCKET && le == NULL))
+   {
+      goto malformed;
+   }
+
+   if (family->defined > 0)
+   {
+      struct sample sample = {.kind = kind, .le = le, .value = value, .labels = first, .n_labels = n_labels};
+
+      if (family_contains(families, family, &sample))
+      {
+         families->n_labels = first;
+         *current = family;
+         return 0;
+      }
+   }
+
+   if (family_add_sample(family, kind, le, value, first, n_labels))
+   {
+      goto error;
+   }
+
+   *current = family;
+
+   return 0;
+
+malformed:
+
+   pgexporter_log_debug("Exposition: Dropping malformed sample %s", line);
+
+   families->n_labels = first;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static void
+unescape_help(char* help)
+{
+   char* w = help;
+
+   /* The HELP of the text format escapes a backslash and a line feed, and any other backslash is kept */
+   while (*help != '\0')
+   {
+      if (*help == '\\' && (*(help + 1) == '\\' || *(help + 1) == 'n'))
+      {
+         help++;
+         *w++ = *help == 'n' ? '\n' : '\\';
+         help++;
+      }
+      else
+      {
+         *w++ = *help++;
+      }
+   }
+
+   *w = '\0';
+}
+
+static void
+encode_openmetrics(struct families* families, struct buffer* out)
+{
+   int type;
+   size_t length;
+   double d;
+   char* key = NULL;
+   struct family* family = NULL;
+   struct sample* sample = NULL;
+
+   for (int i = 0; i < families->size; i++)
+   {
+      family = families->families[i];
+      type = family->type != -1 ? family->type : TYPE_UNTYPED;
+
+      /* A family encoded before is only continued by the samples it got since */
+      if (family->encoded && family->sent == family->size)
+      {
+         continue;
+      }
+
+      /* The samples of a counter carry the _total suffix, its family does not */
+      length = strlen(family->name);
+      if (type == TYPE_COUNTER && length > 6 && !strcmp(family->name + length - 6, "_total"))
+      {
+         length -= 6;
+      }
+
+      buffer_string(out, "# TYPE ");
+      buffer_append(out, family->name, length);
+
+      if (type == TYPE_COUNTER)
+      {
+         buffer_string(out, " counter\n");
+      }
+      else if (type == TYPE_GAUGE)
+      {
+         buffer_string(out, " gauge\n");
+      }
+      else if (type == TYPE_HISTOGRAM)
+      {
+         buffer_string(out, " histogram\n");
+      }
+      else
+      {
+         buffer_string(out, " unknown\n");
+      }
+
+      if (family->help != NULL && *family->help != '\0')
+      {
+         buffer_string(out, "# HELP ");
+         buffer_append(out, family->name, length);
+         buffer_string(out, " ");
+         buffer_escape(out, family->help);
+         buffer_string(out, "\n");
+      }
+
+      for (int j = family->sent; j < family->size; j++)
+      {
+         sample = &family->samples[j];
+
+         if (!sample_value(sample->value, &d) ||
+             (type == TYPE_HISTOGRAM && sample->kind == SAMPLE_VALUE))
+         {
+            continue;
+         }
+
+         buffer_append(out, family->name, length);
+
+         if (type == TYPE_COUNTER)
+         {
+            buffer_string(out, "_total");
+         }
+         else if (sample->kind == SAMPLE_BUCKET)
+         {
+            buffer_string(out, "_bucket");
+         }
+         else if (sample->kind == SAMPLE_SUM)
+         {
+            buffer_string(out, "_sum");
+         }
+         else if (sample->kind == SAMPLE_COUNT)
+         {
+            buffer_string(out, "_count");
+         }
+
+         if (sample->n_labels > 0 || sample->le != NULL)
+         {
+            buffer_string(out, "{");
+
+            for (int k = 0; k < sample->n_labels; k++)
+            {
+               key = families->labels[2 * (sample->labels + k)];
+
+               if (k > 0)
+               {
+                  buffer_string(out, ",");
+               }
+
+               buffer_string(out, key);
+               buffer_string(out, "=\"");
+               buffer_escape(out, families->labels[2 * (sample->labels + k) + 1]);
+               buffer_string(out, "\"");
+            }
+
+            if (sample->le != NULL)
+            {
+               buffer_string(out, sample->n_labels > 0 ? ",le=\"" : "le=\"");
+               buffer_escape(out, sample->le);
+               buffer_string(out, "\"");
+            }
+
+            buffer_string(out, "}");
+         }
+
+         buffer_string(out, " ");
+         buffer_string(out, sample->value);
+         buffer_string(out, "\n");
+      }
+
+      family->sent = family->size;
+      family->encoded = true;
+   }
+}
+
+static void
+encode_protobuf(struct families* families, struct buffer* out)
+{
+   int type;
+   int j;
+   double d;
+   struct family* family = NULL;
+   struct sample* sample = NULL;
+   struct buffer mf;
+   struct buffer metric;
+   struct buffer value;
+   struct buffer field;
+
+   memset(&mf, 0, sizeof(struct buffer));
+   memset(&metric, 0, sizeof(struct buffer));
+   memset(&value, 0, sizeof(struct buffer));
+   memset(&field, 0, sizeof(struct buffer));
+
+   for (int i = 0; i < families->size; i++)
+   {
+      family = families->families[i];
+      type = family->type != -1 ? family->type : TYPE_UNTYPED;
+
+      if (family->sent == family->size)
+      {
+         continue;
+      }
+
+      /* MetricFamily */
+      mf.size = 0;
+      buffer_string_field(&mf, 1, family->name);
+      if (family->help != NULL && *family->help != '\0')
+      {
+         buffer_string_field(&mf, 2, family->help);
+      }
+      buffer_varint_field(&mf, 3, type);
+
+      j = family->sent;
+      while (j < family->size)
+      {
+         sample = &family->samples[j];
+
+         /* Metric */
+         metric.size = 0;
+         for (int k = 0; k < sample->n_labels; k++)
+         {
+            field.size = 0;
+            buffer_string_field(&field, 1, families->labels[2 * (sample->labels + k)]);
+            buffer_string_field(&field, 2, families->labels[2 * (sample->labels + k) + 1]);
+            buffer_message_field(&metric, 1, &field);
+         }
+
+         value.size = 0;
+
+         if (type == TYPE_HISTOGRAM)
+         {
+            /* A histogram is the run of samples with the same labels. +Inf is implied by the count */
+            while (j < family->size && same_labels(families, sample, &family->samples[j]))
+            {
+               if (sample_value(family->samples[j].value, &d))
+               {
+                  if (family->samples[j].kind == SAMPLE_BUCKET && strcmp(family->samples[j].le, "+Inf"))
+                  {
+                     field.size = 0;
+                     buffer_varint_field(&field, 1, d > 0.0 ? (uint64_t)d : 0);
+                     buffer_double_field(&field, 2, strtod(family->samples[j].le, NULL));
+                     buffer_message_field(&value, 3, &field);
+                  }
+                  else if (family->samples[j].kind == SAMPLE_COUNT)
+                  {
+                     buffer_varint_field(&value, 1, d > 0.0 ? (uint64_t)d : 0);
+                  }
+                  else if (family->samples[j].kind == SAMPLE_SUM)
+                  {
+                     buffer_double_field(&value, 2, d);
+                  }
+               }
+
+               j++;
+            }
+
+            buffer_message_field(&metric, 7, &value);
+         }
+         else
+         {
+            j++;
+
+            if (!sample_value(sample->value, &d))
+            {
+               continue;
+            }
+
+            buffer_double_field(&value, 1, d);
+
+            if (type == TYPE_COUNTER)
+            {
+               buffer_message_field(&metric, 3, &value);
+            }
+            else if (type == TYPE_GAUGE)
+            {
+               buffer_message_field(&metric, 2, &value);
+            }
+            else
+            {
+               buffer_message_field(&metric, 5, &value);
+            }
+         }
+
+         buffer_message_field(&mf, 4, &metric);
+      }
+
+      /* Length delimited */
+      buffer_varint(out, mf.size);
+      buffer_append(out, mf.data, mf.size);
+      out->error = out->error || mf.error;
+
+      family->sent = family->size;
+      family->encoded = true;
+   }
+
+   free(mf.data);
+   free(metric.data);
+   free(value.data);
+   free(field.data);
+}
+
+static void
+buffer_append(struct buffer* buffer, void* data, size_t size)
+{
+   size_t capacity;
+   char* d = NULL;
+
+   if (buffer->error || size == 0)
+   {
+      return;
+   }
+
+   if (buffer->size + size > buffer->capacity)
+   {
+      capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+
+      while (buffer->size + size > capacity)
+      {
+         capacity *= 2;
+      }
+
+      d = realloc(buffer->data, capacity);
+      if (d == NULL)
+      {
+         buffer->error = true;
+         return;
+      }
+
+      buffer->data = d;
+      buffer->capacity = capacity;
+   }
+
+   memcpy(buffer->data + buffer->size, data, size);
+   buffer->size += size;
+}
+
+static void
+buffer_string(struct buffer* buffer, char* s)
+{
+   buffer_append(buffer, s, strlen(s));
+}
+
+static void
+buffer_escape(struct buffer* buffer, char* s)
+{
+   char* start = s;
+
+   while (*s != '\0')
+   {
+      if (*s == '\\' || *s == '"' || *s == '\n')
+      {
+         buffer_append(buffer, start, s - start);
+         buffer_string(buffer, *s == '\\' ? "\\\\" : *s == '"' ? "\\\"" : "\\n");
+         start = s + 1;
+      }
+
+      s++;
+   }
+
+   buffer_append(buffer, start, s - start);
+}
+
+static void
+buffer_varint(struct buffer* buffer, uint64_t value)
+{
+   uint8_t bytes[10];
+   int n = 0;
+
+   do
+   {
+      bytes[n] = value & 0x7F;
+      value >>= 7;
+
+      if (value != 0)
+      {
+         bytes[n] |= 0x80;
+      }
+
+      n++;
+   }
+   while (value != 0);
+
+   buffer_append(buffer, &bytes[0], n);
+}
+
+static void
+buffer_varint_field(struct buffer* buffer, int field, uint64_t value)
+{
+   buffer_varint(buffer, (uint64_t)field << 3 | WIRE_VARINT);
+   buffer_varint(buffer, value);
+}
+
+static void
+buffer_double_field(struct buffer* buffer, int field, double value)
+{
+   uint8_t bytes[8];
+   uint64_t bits;
+
+   memcpy(&bits, &value, sizeof(bits));
+
+   /* Little endian on the wire */
+   for (int i = 0; i < 8; i++)
+   {
+      bytes[i] = (bits >> (8 * i)) & 0xFF;
+   }
+
+   buffer_varint(buffer, (uint64_t)field << 3 | WIRE_DOUBLE);
+   buffer_append(buffer, &bytes[0], sizeof(bytes));
+}
+
+static void
+buffer_string_field(struct buffer* buffer, int field, char* s)
+{
+   size_t length = strlen(s);
+
+   buffer_varint(buffer, (uint64_t)field << 3 | WIRE_LENGTH);
+   buffer_varint(buffer, length);
+   buffer_append(buffer, s, length);
+}
+
+static void
+buffer_message_field(struct buffer* buffer, int field, struct buffer* message)
+{
+   buffer_varint(buffer, (uint64_t)field << 3 | WIRE_LENGTH);
+   buffer_varint(buffer, message->size);
+   buffer_append(buffer, message->data, message->size);
+
+   buffer->error = buffer->error || message->error;
+}
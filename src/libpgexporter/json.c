@@ -39,15 +39,37 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
+
+/** @struct json_writer
+ * Defines a writer that serializes a json object into a buffer,
+ * and flushes the buffer to a descriptor if there is one
+ */
+struct json_writer
+{
+   int fd;            /**< The descriptor, or -1 */
+   char* buffer;      /**< The buffer */
+   size_t length;     /**< The length of the buffer */
+   size_t capacity;   /**< The capacity of the buffer */
+   bool failed;       /**< If a flush failed */
+};
 
 static bool type_allowed(enum value_type type);
 static char* item_to_string(struct json* item, int32_t format, char* tag, int indent);
 static char* array_to_string(struct json* array, int32_t format, char* tag, int indent);
-static int parse_string(char* str, uint64_t* index, struct json** obj);
+static int json_parse(char* str, uint64_t len, struct json** obj);
+static int parse_string(char* str, uint64_t len, uint64_t* index, struct json** obj);
+static int parse_text(char* str, uint64_t len, uint64_t* index, char** text);
 static int json_add(struct json* obj, char* key, uintptr_t val, enum value_type type);
-static int fill_value(char* str, char* key, uint64_t* index, struct json* o);
+static int fill_value(char* str, uint64_t len, char* key, uint64_t* index, struct json* o);
 static bool value_start(char ch);
 static int handle_escape_char(char* str, uint64_t* index, uint64_t len, char* ch);
+static void writer_append(struct json_writer* w, char* data, size_t size);
+static void writer_indent(struct json_writer* w, int indent);
+static void writer_string(struct json_writer* w, char* str);
+static void writer_value(struct json_writer* w, struct value* value, int32_t format, int indent);
+static void writer_json(struct json_writer* w, struct json* object, int32_t format, int indent);
+static int writer_flush(struct json_writer* w);
 
 int
 pgexporter_json_append(struct json* array, uintptr_t entry, enum value_type type)
@@ -177,6 +199,18 @@ pgexporter_json_to_string(struct json* object, int32_t format, char* tag, int in
       str = pgexporter_append(str, "{}");
       return str;
    }
+   if (format == FORMAT_JSON || format == FORMAT_JSON_COMPACT)
+   {
+      struct json_writer w = {.fd = -1};
+
+      writer_indent(&w, indent);
+      if (tag != NULL)
+      {
+         writer_append(&w, tag, strlen(tag));
+      }
+      writer_json(&w, object, format, indent);
+      return w.buffer;
+   }
    if (object->type != JSONArray)
    {
       return item_to_string(object, format, tag, indent);
@@ -318,42 +352,87 @@ pgexporter_json_iterator_has_next(struct json_iterator* iter)
 int
 pgexporter_json_parse_string(char* str, struct json** obj)
 {
-   uint64_t idx = 0;
-   if (str == NULL || strlen(str) < 2)
+   if (str == NULL)
    {
       return 1;
    }
 
-   return parse_string(str, &idx, obj);
+   return json_parse(str, strlen(str), obj);
 }
 
 int
 pgexporter_json_clone(struct json* from, struct json** to)
 {
    struct json* o = NULL;
-   char* str = NULL;
-   str = pgexporter_json_to_string(from, FORMAT_JSON, NULL, 0);
-   if (pgexporter_json_parse_string(str, &o))
+   struct json* child = NULL;
+   struct json_iterator* iter = NULL;
+
+   pgexporter_json_create(&o);
+
+   if (from == NULL || from->type == JSONUnknown || from->elements == NULL)
+   {
+      *to = o;
+      return 0;
+   }
+
+   if (pgexporter_json_iterator_create(from, &iter))
    {
       goto error;
    }
+
+   while (pgexporter_json_iterator_next(iter))
+   {
+      if (iter->value->type == ValueJSON)
+      {
+         if (pgexporter_json_clone((struct json*)iter->value->data, &child))
+         {
+            goto error;
+         }
+         if (json_add(o, iter->key, (uintptr_t)child, ValueJSON))
+         {
+            pgexporter_json_destroy(child);
+            goto error;
+         }
+      }
+      // The strings are copied by the value, the other types are held inline
+      else if (json_add(o, iter->key, iter->value->data, iter->value->type))
+      {
+         goto error;
+      }
+   }
+
+   pgexporter_json_iterator_destroy(iter);
+
    *to = o;
-   free(str);
    return 0;
+
 error:
-   free(str);
+   pgexporter_json_iterator_destroy(iter);
+   pgexporter_json_destroy(o);
    return 1;
 }
 
 static int
-parse_string(char* str, uint64_t* index, struct json** obj)
+json_parse(char* str, uint64_t len, struct json** obj)
+{
+   // TODO: allocate the nodes of a document from one arena, they are still malloc'ed one by one
+   uint64_t idx = 0;
+   if (str == NULL || len < 2)
+   {
+      return 1;
+   }
+
+   return parse_string(str, len, &idx, obj);
+}
+
+static int
+parse_string(char* str, uint64_t len, uint64_t* index, struct json** obj)
 {
    enum json_type type;
    struct json* o = NULL;
    uint64_t idx = *index;
    char ch = str[idx];
    char* key = NULL;
-   uint64_t len = strlen(str);
 
    if (ch == '{')
    {
@@ -406,28 +485,12 @@ parse_string(char* str, uint64_t* index, struct json** obj)
          }
          idx++;
          // The key
-         while (idx < len && str[idx] != '"')
-         {
-            char ec_ch;
-            // handle escape character
-            if (str[idx] == '\\')
-            {
-               if (handle_escape_char(str, &idx, len, &ec_ch))
-               {
-                  goto error;
-               }
-               key = pgexporter_append_char(key, ec_ch);
-               continue;
-            }
-
-            key = pgexporter_append_char(key, str[idx++]);
-         }
-         if (idx == len || key == NULL)
+         if (parse_text(str, len, &idx, &key) || strlen(key) == 0)
          {
             goto error;
          }
          // The lands between
-         while (idx < len && (str[idx] == '"' || isspace(str[idx])))
+         while (idx < len && isspace(str[idx]))
          {
             idx++;
          }
@@ -444,7 +507,7 @@ parse_string(char* str, uint64_t* index, struct json** obj)
             goto error;
          }
          // The value
-         if (fill_value(str, key, &idx, o))
+         if (fill_value(str, len, key, &idx, o))
          {
             goto error;
          }
@@ -487,7 +550,7 @@ parse_string(char* str, uint64_t* index, struct json** obj)
             goto error;
          }
 
-         if (fill_value(str, key, &idx, o))
+         if (fill_value(str, len, key, &idx, o))
          {
             goto error;
          }
@@ -503,6 +566,64 @@ error:
    return 1;
 }
 
+static int
+parse_text(char* str, uint64_t len, uint64_t* index, char** text)
+{
+   uint64_t idx = *index;
+   uint64_t size = 0;
+   char* t = NULL;
+   char ec_ch;
+
+   *text = NULL;
+
+   // Size the text first, so it is copied once
+   while (idx < len && str[idx] != '"')
+   {
+      if (str[idx] == '\\')
+      {
+         if (handle_escape_char(str, &idx, len, &ec_ch))
+         {
+            return 1;
+         }
+      }
+      else
+      {
+         idx++;
+      }
+      size++;
+   }
+   if (idx == len)
+   {
+      return 1;
+   }
+
+   t = malloc(size + 1);
+   if (t == NULL)
+   {
+      return 1;
+   }
+
+   size = 0;
+   idx = *index;
+   while (str[idx] != '"')
+   {
+      if (str[idx] == '\\')
+      {
+         handle_escape_char(str, &idx, len, &t[size++]);
+      }
+      else
+      {
+         t[size++] = str[idx++];
+      }
+   }
+   t[size] = '\0';
+
+   // Skip the closing quote
+   *index = idx + 1;
+   *text = t;
+   return 0;
+}
+
 static int
 json_add(struct json* obj, char* key, uintptr_t val, enum value_type type)
 {
@@ -528,83 +649,64 @@ value_start(char ch)
 }
 
 static int
-fill_value(char* str, char* key, uint64_t* index, struct json* o)
+fill_value(char* str, uint64_t len, char* key, uint64_t* index, struct json* o)
 {
    uint64_t idx = *index;
-   uint64_t len = strlen(str);
+   uint64_t start = 0;
+   char buf[MISC_LENGTH];
+
    if (str[idx] == '"')
    {
       char* val = NULL;
       idx++;
-      while (idx < len && str[idx] != '"')
-      {
-         char ec_ch;
-         if (str[idx] == '\\')
-         {
-            if (handle_escape_char(str, &idx, len, &ec_ch))
-            {
-               goto error;
-            }
-            val = pgexporter_append_char(val, ec_ch);
-            continue;
-         }
-
-         val = pgexporter_append_char(val, str[idx++]);
-      }
-      if (idx == len)
+      if (parse_text(str, len, &idx, &val))
       {
          goto error;
       }
-      if (val == NULL)
-      {
-         json_add(o, key, (uintptr_t)"", ValueString);
-      }
-      else
-      {
-         json_add(o, key, (uintptr_t)val, ValueString);
-      }
-      idx++;
+      json_add(o, key, (uintptr_t)val, ValueString);
       free(val);
    }
    else if (str[idx] == '-' || str[idx] == '+' || isdigit(str[idx]))
    {
       bool has_digit = false;
-      char* val_str = NULL;
+      start = idx;
       while (idx < len && (isdigit(str[idx]) || str[idx] == '.' || str[idx] == '-' || str[idx] == '+'))
       {
          if (str[idx] == '.')
          {
             has_digit = true;
          }
-         val_str = pgexporter_append_char(val_str, str[idx++]);
+         idx++;
+      }
+      if (idx - start >= sizeof(buf))
+      {
+         goto error;
       }
+      memcpy(buf, str + start, idx - start);
+      buf[idx - start] = '\0';
       if (has_digit)
       {
          double val = 0.;
-         if (sscanf(val_str, "%lf", &val) != 1)
+         if (sscanf(buf, "%lf", &val) != 1)
          {
-            free(val_str);
             goto error;
          }
          json_add(o, key, pgexporter_value_from_double(val), ValueDouble);
-         free(val_str);
       }
       else
       {
          int64_t val = 0;
-         if (sscanf(val_str, "%" PRId64, &val) != 1)
+         if (sscanf(buf, "%" PRId64, &val) != 1)
          {
-            free(val_str);
             goto error;
          }
          json_add(o, key, (uintptr_t)val, ValueInt64);
-         free(val_str);
       }
    }
    else if (str[idx] == '{')
    {
       struct json* val = NULL;
-      if (parse_string(str, &idx, &val))
+      if (parse_string(str, len, &idx, &val))
       {
          goto error;
       }
@@ -613,7 +715,7 @@ fill_value(char* str, char* key, uint64_t* index, struct json* o)
    else if (str[idx] == '[')
    {
       struct json* val = NULL;
-      if (parse_string(str, &idx, &val))
+      if (parse_string(str, len, &idx, &val))
       {
          goto error;
       }
@@ -621,29 +723,27 @@ fill_value(char* str, char* key, uint64_t* index, struct json* o)
    }
    else if (str[idx] == 'n' || str[idx] == 't' || str[idx] == 'f')
    {
-      char* val = NULL;
+      start = idx;
       while (idx < len && str[idx] >= 'a' && str[idx] <= 'z')
       {
-         val = pgexporter_append_char(val, str[idx++]);
+         idx++;
       }
-      if (pgexporter_compare_string(val, "null"))
+      if (idx - start == 4 && !strncmp(str + start, "null", 4))
       {
          json_add(o, key, 0, ValueString);
       }
-      else if (pgexporter_compare_string(val, "true"))
+      else if (idx - start == 4 && !strncmp(str + start, "true", 4))
       {
          json_add(o, key, true, ValueBool);
       }
-      else if (pgexporter_compare_string(val, "false"))
+      else if (idx - start == 5 && !strncmp(str + start, "false", 5))
       {
          json_add(o, key, false, ValueBool);
       }
       else
       {
-         free(val);
          goto error;
       }
-      free(val);
    }
    else
    {
@@ -690,9 +790,12 @@ handle_escape_char(char* str, uint64_t* index, uint64_t len, char* ch)
 int
 pgexporter_json_read_file(char* path, struct json** obj)
 {
-   FILE* file = NULL;
-   char buf[DEFAULT_BUFFER_SIZE];
+   int fd = -1;
+   struct stat st;
    char* str = NULL;
+   size_t length = 0;
+   size_t capacity = 0;
+   ssize_t n = 0;
    struct json* j = NULL;
 
    *obj = NULL;
@@ -702,24 +805,47 @@ pgexporter_json_read_file(char* path, struct json** obj)
       goto error;
    }
 
-   file = fopen(path, "r");
+   fd = open(path, O_RDONLY);
 
-   if (file == NULL)
+   if (fd == -1 || fstat(fd, &st))
    {
       pgexporter_log_error("Failed to open json file %s", path);
       goto error;
    }
 
-   memset(buf, 0, sizeof(buf));
+   // Read the file into a single buffer, it only grows if the file does
+   // TODO: mmap the file instead, once the parser no longer needs a terminated string
+   capacity = st.st_size + 1;
+   str = malloc(capacity);
+   if (str == NULL)
+   {
+      goto error;
+   }
+
+   while ((n = read(fd, str + length, capacity - length - 1)) > 0)
+   {
+      length += n;
+      if (length == capacity - 1)
+      {
+         char* s = realloc(str, capacity * 2);
+         if (s == NULL)
+         {
+            goto error;
+         }
+         str = s;
+         capacity *= 2;
+      }
+   }
 
-   // save the last one for ending so that we get to use append
-   while (fread(buf, 1, DEFAULT_BUFFER_SIZE - 1, file) > 0)
+   if (n == -1)
    {
-      str = pgexporter_append(str, buf);
-      memset(buf, 0, sizeof(buf));
+      pgexporter_log_error("Failed to read json file %s", path);
+      goto error;
    }
 
-   if (pgexporter_json_parse_string(str, &j))
+   str[length] = '\0';
+
+   if (json_parse(str, length, &j))
    {
       pgexporter_log_error("Failed to parse json file %s", path);
       goto error;
@@ -727,7 +853,7 @@ pgexporter_json_read_file(char* path, struct json** obj)
 
    *obj = j;
 
-   fclose(file);
+   close(fd);
    free(str);
    return 0;
 
@@ -735,9 +861,9 @@ error:
 
    pgexporter_json_destroy(j);
 
-   if (file != NULL)
+   if (fd != -1)
    {
-      fclose(file);
+      close(fd);
    }
 
    free(str);
@@ -748,42 +874,37 @@ error:
 int
 pgexporter_json_write_file(char* path, struct json* obj)
 {
-   FILE* file = NULL;
-   char* str = NULL;
+   struct json_writer w = {.fd = -1};
 
    if (path == NULL || obj == NULL)
    {
       goto error;
    }
 
-   file = fopen(path, "wb");
-   if (file == NULL)
+   w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (w.fd == -1)
    {
       pgexporter_log_error("Failed to create json file %s", path);
       goto error;
    }
 
-   str = pgexporter_json_to_string(obj, FORMAT_JSON, NULL, 0);
-   if (str == NULL)
-   {
-      goto error;
-   }
+   writer_json(&w, obj, FORMAT_JSON, 0);
 
-   if (fputs(str, file) == EOF)
+   if (writer_flush(&w) || w.failed)
    {
       pgexporter_log_error("Failed to write json file %s", path);
       goto error;
    }
 
-   free(str);
-   fclose(file);
+   free(w.buffer);
+   close(w.fd);
    return 0;
 
 error:
-   free(str);
-   if (file != NULL)
+   free(w.buffer);
+   if (w.fd != -1)
    {
-      fclose(file);
+      close(w.fd);
    }
    return 1;
 }
@@ -824,3 +945,264 @@ array_to_string(struct json* array, int32_t format, char* tag, int indent)
 {
    return pgexporter_deque_to_string(array->elements, format, tag, indent);
 }
+
+static void
+writer_append(struct json_writer* w, char* data, size_t size)
+{
+   if (w->length + size + 1 > w->capacity)
+   {
+      size_t capacity = w->capacity == 0 ? 1024 : w->capacity;
+      char* buffer = NULL;
+
+      while (w->length + size + 1 > capacity)
+      {
+         capacity *= 2;
+      }
+      buffer = realloc(w->buffer, capacity);
+      if (buffer == NULL)
+      {
+         w->failed = true;
+         return;
+      }
+      w->buffer = buffer;
+      w->capacity = capacity;
+   }
+
+   memcpy(w->buffer + w->length, data, size);
+   w->length += size;
+   w->buffer[w->length] = '\0';
+
+   if (w->fd != -1 && w->length >= DEFAULT_BUFFER_SIZE)
+   {
+      writer_flush(w);
+   }
+}
+
+static void
+writer_indent(struct json_writer* w, int indent)
+{
+   for (int i = 0; i < indent; i++)
+   {
+      writer_append(w, " ", 1);
+   }
+}
+
+static void
+writer_string(struct json_writer* w, char* str)
+{
+   char* start = str;
+
+   if (str == NULL)
+   {
+      writer_append(w, "null", 4);
+      return;
+   }
+
+   writer_append(w, "\"", 1);
+   for (char* c = str; *c != '\0'; c++)
+   {
+      char* escaped = NULL;
+
+      switch (*c)
+      {
+         case '\\':
+            escaped = "\\\\";
+            break;
+         case '\"':
+            escaped = "\\\"";
+            break;
+         case '\n':
+            escaped = "\\n";
+            break;
+         case '\t':
+            escaped = "\\t";
+            break;
+         case '\r':
+            escaped = "\\r";
+            break;
+         default:
+            continue;
+      }
+      writer_append(w, start, c - start);
+      writer_append(w, escaped, 2);
+      start = c + 1;
+   }
+   writer_append(w, start, strlen(start));
+   writer_append(w, "\"", 1);
+}
+
+static void
+writer_value(struct json_writer* w, struct value* value, int32_t format, int indent)
+{
+   char buf[MISC_LENGTH];
+   char* str = NULL;
+
+   switch (value->type)
+   {
+      case ValueInt8:
+         snprintf(buf, sizeof(buf), "%" PRId8, (int8_t)value->data);
+         break;
+      case ValueUInt8:
+         snprintf(buf, sizeof(buf), "%" PRIu8, (uint8_t)value->data);
+         break;
+      case ValueInt16:
+         snprintf(buf, sizeof(buf), "%" PRId16, (int16_t)value->data);
+         break;
+      case ValueUInt16:
+         snprintf(buf, sizeof(buf), "%" PRIu16, (uint16_t)value->data);
+         break;
+      case ValueInt32:
+         snprintf(buf, sizeof(buf), "%" PRId32, (int32_t)value->data);
+         break;
+      case ValueUInt32:
+         snprintf(buf, sizeof(buf), "%" PRIu32, (uint32_t)value->data);
+         break;
+      case ValueInt64:
+         snprintf(buf, sizeof(buf), "%" PRId64, (int64_t)value->data);
+         break;
+      case ValueUInt64:
+         snprintf(buf, sizeof(buf), "%" PRIu64, (uint64_t)value->data);
+         break;
+      case ValueFloat:
+         snprintf(buf, sizeof(buf), "%f", pgexporter_value_to_float(value->data));
+         break;
+      case ValueDouble:
+         snprintf(buf, sizeof(buf), "%f", pgexporter_value_to_double(value->data));
+         break;
+      case ValueBool:
+         snprintf(buf, sizeof(buf), "%s", value->data ? "true" : "false");
+         break;
+      case ValueString:
+      case ValueStringRef:
+      case ValueBASE64:
+      case ValueBASE64Ref:
+         writer_string(w, (char*)value->data);
+         return;
+      case ValueJSON:
+      case ValueJSONRef:
+         writer_json(w, (struct json*)value->data, format, indent);
+         return;
+      default:
+         str = pgexporter_value_to_string(value, format, NULL, 0);
+         if (str != NULL)
+         {
+            writer_append(w, str, strlen(str));
+         }
+         free(str);
+         return;
+   }
+
+   writer_append(w, buf, strlen(buf));
+}
+
+static void
+writer_json(struct json_writer* w, struct json* object, int32_t format, int indent)
+{
+   bool pretty = format == FORMAT_JSON;
+   int next_indent = pretty ? indent + INDENT_PER_LEVEL : indent;
+
+   if (object == NULL || object->type == JSONUnknown || object->elements == NULL)
+   {
+      writer_append(w, "{}", 2);
+      return;
+   }
+
+   if (object->type == JSONItem)
+   {
+      struct art* t = (struct art*)object->elements;
+      struct art_iterator* iter = NULL;
+      uint64_t cnt = 0;
+
+      if (t->size == 0 || pgexporter_art_iterator_create(t, &iter))
+      {
+         writer_append(w, "{}", 2);
+         return;
+      }
+
+      writer_append(w, pretty ? "{\n" : "{", pretty ? 2 : 1);
+      while (pgexporter_art_iterator_next(iter))
+      {
+         cnt++;
+         writer_indent(w, next_indent);
+         writer_string(w, iter->key);
+         writer_append(w, pretty ? ": " : ":", pretty ? 2 : 1);
+         writer_value(w, iter->value, format, next_indent);
+         if (cnt < t->size)
+         {
+            writer_append(w, pretty ? ",\n" : ",", pretty ? 2 : 1);
+         }
+         else if (pretty)
+         {
+            writer_append(w, "\n", 1);
+         }
+      }
+      pgexporter_art_iterator_destroy(iter);
+      if (pretty)
+      {
+         writer_indent(w, indent);
+      }
+      writer_append(w, "}", 1);
+   }
+   else
+   {
+      struct deque* d = (struct deque*)object->elements;
+      struct deque_iterator* iter = NULL;
+
+      if (pgexporter_deque_empty(d) || pgexporter_deque_iterator_create(d, &iter))
+      {
+         writer_append(w, "[]", 2);
+         return;
+      }
+
+      writer_append(w, pretty ? "[\n" : "[", pretty ? 2 : 1);
+      while (pgexporter_deque_iterator_next(iter))
+      {
+         writer_indent(w, next_indent);
+         writer_value(w, iter->value, format, next_indent);
+         if (pgexporter_deque_iterator_has_next(iter))
+         {
+            writer_append(w, pretty ? ",\n" : ",", pretty ? 2 : 1);
+         }
+         else if (pretty)
+         {
+            writer_append(w, "\n", 1);
+         }
+      }
+      pgexporter_deque_iterator_destroy(iter);
+      if (pretty)
+      {
+         writer_indent(w, indent);
+      }
+      writer_append(w, "]", 1);
+   }
+}
+
+static int
+writer_flush(struct json_writer* w)
+{
+   size_t offset = 0;
+   ssize_t n = 0;
+
+   if (w->fd == -1 || w->failed)
+   {
+      return w->failed ? 1 : 0;
+   }
+
+   while (offset < w->length)
+   {
+      n = write(w->fd, w->buffer + offset, w->length - offset);
+      if (n == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         w->failed = true;
+         return 1;
+      }
+      offset += n;
+   }
+   w->length = 0;
+
+   return 0;
+}
@@ -28,10 +28,11 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <configuration.h>
 #include <internal.h>
 #include <logging.h>
 #include <query_alts.h>
-#include <shmem.h>
+#include <registry.h>
 #include <utils.h>
 #include <json_configuration.h>
 
@@ -57,6 +58,7 @@ typedef struct json_query
    bool is_histogram;
    char* query;
    char version;
+   int timeout;
    json_column_t* columns;
    int n_columns;
 } __attribute__ ((aligned (64))) json_query_t;
@@ -70,6 +72,7 @@ typedef struct json_metric
    char* sort;
    char* collector;
    char* server;
+   int timeout;
 } __attribute__ ((aligned (64))) json_metric_t;
 
 // Config's Structure
@@ -101,11 +104,11 @@ static void free_json_metrics(json_metric_t** metrics, size_t n_metrics);
 // Free allocated memory for JSON config
 static void free_json_config(json_config_t* config);
 
-// Extract the meaning of the `json_config` and load the metrics into `prometheus`
-static int semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t* json_config);
+// Extract the meaning of the `json_config` and load the metrics into `config`
+static int semantics_json(struct configuration* config, int prometheus_idx, json_config_t* json_config);
 
 // Read and parse a single JSON file into the prometheus metrics structure
-int pgexporter_read_json(struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics);
+int pgexporter_read_json(struct configuration* config, int prometheus_idx, char* filename, int* number_of_metrics);
 
 // Get all JSON files from a directory
 int get_json_files(char* base, int* number_of_json_files, char*** files);
@@ -129,7 +132,7 @@ pgexporter_read_json_metrics_configuration(void* shmem)
    if (pgexporter_is_file(config->metrics_path))
    {
       number_of_metrics = 0;
-      if (pgexporter_read_json(config->prometheus, idx_metrics, config->metrics_path, &number_of_metrics))
+      if (pgexporter_read_json(config, idx_metrics, config->metrics_path, &number_of_metrics))
       {
          pgexporter_log_error("pgexporter_read_json_metrics_configuration error JSON metrics file: %s", config->metrics_path);
          return 1;
@@ -149,7 +152,7 @@ pgexporter_read_json_metrics_configuration(void* shmem)
                                         json_files[i]
                                         );
 
-         if (pgexporter_read_json(config->prometheus, idx_metrics, json_path, &number_of_metrics))
+         if (pgexporter_read_json(config, idx_metrics, json_path, &number_of_metrics))
          {
             free(json_path);
             json_path = NULL;
@@ -178,7 +181,7 @@ pgexporter_read_json_metrics_configuration(void* shmem)
 }
 
 int
-pgexporter_read_json(struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics)
+pgexporter_read_json(struct configuration* config, int prometheus_idx, char* filename, int* number_of_metrics)
 {
    struct json* root = NULL;
    json_config_t json_config;
@@ -215,7 +218,7 @@ pgexporter_read_json(struct prometheus* prometheus, int prometheus_idx, char* fi
 
    *number_of_metrics += json_config.n_metrics;
 
-   ret = semantics_json(prometheus, prometheus_idx, &json_config);
+   ret = semantics_json(config, prometheus_idx, &json_config);
 
    pgexporter_json_destroy(root);
    free_json_config(&json_config);
@@ -320,6 +323,12 @@ parse_queries(struct json* queries_array, json_metric_t* metric)
          current_query->version = (char)version_val;
       }
 
+      // Timeout - optional with default from metric
+      if (pgexporter_json_contains_key(query, "timeout"))
+      {
+         current_query->timeout = (int)pgexporter_json_get(query, "timeout");
+      }
+
       if (pgexporter_json_contains_key(query, "columns"))
       {
          struct json* columns = (struct json*)pgexporter_json_get(query, "columns");
@@ -386,6 +395,11 @@ parse_metrics(struct json* metrics_array, json_config_t* config)
          current_metric->server = strdup("both");     // default
       }
 
+      if (pgexporter_json_contains_key(metric, "timeout"))
+      {
+         current_metric->timeout = (int)pgexporter_json_get(metric, "timeout");
+      }
+
       if (pgexporter_json_contains_key(metric, "queries"))
       {
          struct json* queries = (struct json*)pgexporter_json_get(metric, "queries");
@@ -544,18 +558,17 @@ free_json_config(json_config_t* config)
 }
 
 static int
-semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t* json_config)
+semantics_json(struct configuration* config, int prometheus_idx, json_config_t* json_config)
 {
    struct prometheus* prom = NULL;
 
-   for (int i = 0; i < json_config->n_metrics; i++)
+   if (pgexporter_reserve_metrics(config, prometheus_idx + json_config->n_metrics))
    {
-      if (prometheus_idx + i >= NUMBER_OF_METRICS)
-      {
-         pgexporter_log_error("The number of metrics exceed the maximum limit of %d.", NUMBER_OF_METRICS);
-         return 1;
-      }
+      return 1;
+   }
 
+   for (int i = 0; i < json_config->n_metrics; i++)
+   {
       if (json_config->metrics[i].tag == NULL)
       {
          pgexporter_log_error("No tag defined for '%s' (%d)",
@@ -572,10 +585,10 @@ semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t*
          return 1;
       }
 
-      prom = &prometheus[prometheus_idx + i];
+      prom = &config->prometheus[prometheus_idx + i];
 
       memcpy(prom->tag, json_config->metrics[i].tag, MIN(MISC_LENGTH - 1, strlen(json_config->metrics[i].tag)));
-      memcpy(prom->collector, json_config->metrics[i].collector, MIN(MAX_COLLECTOR_LENGTH - 1, strlen(json_config->metrics[i].collector)));
+      prom->collector = pgexporter_registry_intern(config->registry, json_config->metrics[i].collector);
 
       // Sort Type
       if (!json_config->metrics[i].sort || !strcmp(json_config->metrics[i].sort, "name"))
@@ -615,30 +628,34 @@ semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t*
       for (int j = 0; j < json_config->metrics[i].n_queries; j++)
       {
          struct query_alts* new_query = NULL;
-         void* new_query_shmem = NULL;
 
-         pgexporter_create_shared_memory(sizeof(struct query_alts), HUGEPAGE_OFF, &new_query_shmem);
-         new_query = (struct query_alts*) new_query_shmem;
+         new_query = pgexporter_registry_allocate(config->registry, sizeof(struct query_alts));
+         if (new_query == NULL)
+         {
+            return 1;
+         }
 
          new_query->n_columns = MIN(json_config->metrics[i].queries[j].n_columns, MAX_NUMBER_OF_COLUMNS);
 
-         memcpy(new_query->query, json_config->metrics[i].queries[j].query, MIN(MAX_QUERY_LENGTH - 1, strlen(json_config->metrics[i].queries[j].query)));
+         new_query->query = pgexporter_registry_intern(config->registry, json_config->metrics[i].queries[j].query);
          new_query->version = json_config->metrics[i].queries[j].version;
 
+         // Timeout, of the query or else of the metric
+         new_query->timeout = json_config->metrics[i].queries[j].timeout > 0 ? json_config->metrics[i].queries[j].timeout : json_config->metrics[i].timeout;
+         if (new_query->timeout < 0)
+         {
+            pgexporter_log_error("pgexporter: unexpected timeout %d", new_query->timeout);
+            return 1;
+         }
+
          // Columns
          for (int k = 0; k < new_query->n_columns; k++)
          {
             // Name
-            if (json_config->metrics[i].queries[j].columns[k].name)
-            {
-               memcpy(new_query->columns[k].name, json_config->metrics[i].queries[j].columns[k].name, MIN(MISC_LENGTH - 1, strlen(json_config->metrics[i].queries[j].columns[k].name)));
-            }
+            new_query->columns[k].name = pgexporter_registry_intern(config->registry, json_config->metrics[i].queries[j].columns[k].name ? json_config->metrics[i].queries[j].columns[k].name : "");
 
             // Description
-            if (json_config->metrics[i].queries[j].columns[k].description)
-            {
-               memcpy(new_query->columns[k].description, json_config->metrics[i].queries[j].columns[k].description, MIN(MISC_LENGTH - 1, strlen(json_config->metrics[i].queries[j].columns[k].description)));
-            }
+            new_query->columns[k].description = pgexporter_registry_intern(config->registry, json_config->metrics[i].queries[j].columns[k].description ? json_config->metrics[i].queries[j].columns[k].description : "");
 
             // Type
             if (!strcmp(json_config->metrics[i].queries[j].columns[k].type, "label"))
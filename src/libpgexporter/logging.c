@@ -30,19 +30,30 @@
 #include <pgexporter.h>
 #include <logging.h>
 #include <prometheus.h>
+#include <shmem.h>
+#include <utils.h>
 
 /* system */
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
 
 #define LINE_LENGTH 32
+#define RECORD_LENGTH 1024
+
+/* The microseconds a record may take to be claimed, or to be written once claimed */
+#define RECORD_TIMEOUT 1000000
 
 FILE* log_file;
 
@@ -50,6 +61,21 @@ time_t next_log_rotation_age;  /* number of seconds at which the next location w
 
 char current_log_path[MAX_PATH]; /* the current log file */
 
+static bool log_writer = false;   /* is this the logging process */
+static time_t log_time = 0;       /* the second of the cached timestamp */
+static char log_timestamp[256];   /* the cached timestamp */
+
+static char* timestamp(void);
+static struct log_buffer* buffer_enter(void);
+static void buffer_leave(struct log_buffer* buffer);
+static int buffer_line(struct log_buffer* buffer, int level, char* filename, int line, char* fmt, va_list vl);
+static int buffer_write(struct log_buffer* buffer, int level, char* data, size_t length);
+static void buffer_wakeup(struct log_buffer* buffer);
+static bool buffer_ready(struct log_buffer* buffer);
+static bool buffer_drain(struct log_buffer* buffer);
+static void buffer_output(struct log_buffer* buffer, unsigned long position, int slots);
+static void buffer_reopen(void);
+
 static const char* levels[] =
 {
    "TRACE",
@@ -187,6 +213,181 @@ pgexporter_init_logging(void)
    return 0;
 }
 
+int
+pgexporter_init_logging_buffer(size_t* p_size, void** p_shmem)
+{
+   struct log_buffer* buffer = NULL;
+   struct configuration* config;
+   size_t struct_size = 0;
+
+   config = (struct configuration*)shmem;
+
+   struct_size = sizeof(struct log_buffer);
+
+   if (pgexporter_create_shared_memory(struct_size, config->hugepage, (void*) &buffer))
+   {
+      goto error;
+   }
+
+   memset(buffer, 0, struct_size);
+
+   for (unsigned long i = 0; i < LOGGING_BUFFER_SLOTS; i++)
+   {
+      atomic_init(&buffer->slots[i].sequence, i);
+   }
+
+   atomic_init(&buffer->active, false);
+   atomic_init(&buffer->running, true);
+   atomic_init(&buffer->sleeping, false);
+   atomic_init(&buffer->producers, 0);
+   atomic_init(&buffer->head, 0);
+   atomic_init(&buffer->tail, 0);
+   buffer->ppid = getpid();
+
+   if (pipe(buffer->wakeup))
+   {
+      pgexporter_destroy_shared_memory(buffer, struct_size);
+      goto error;
+   }
+
+   fcntl(buffer->wakeup[0], F_SETFL, fcntl(buffer->wakeup[0], F_GETFL) | O_NONBLOCK);
+   fcntl(buffer->wakeup[1], F_SETFL, fcntl(buffer->wakeup[1], F_GETFL) | O_NONBLOCK);
+
+   *p_shmem = buffer;
+   *p_size = struct_size;
+   return 0;
+
+error:
+   pgexporter_log_error("Cannot allocate shared memory for the logging buffer!");
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   return 1;
+}
+
+void
+pgexporter_logging_process(void)
+{
+   char discard[64];
+   uint64_t stopping = 0;
+   struct pollfd fds;
+   struct log_buffer* buffer;
+
+   buffer = (struct log_buffer*)logging_shmem;
+
+   if (buffer == NULL)
+   {
+      return;
+   }
+
+   log_writer = true;
+
+   /* The main process stops us once everything is logged */
+   signal(SIGINT, SIG_IGN);
+   signal(SIGTERM, SIG_IGN);
+   signal(SIGHUP, SIG_IGN);
+   signal(SIGALRM, SIG_IGN);
+
+   fds.fd = buffer->wakeup[0];
+   fds.events = POLLIN;
+
+   while (true)
+   {
+      if (buffer_drain(buffer))
+      {
+         continue;
+      }
+
+      if (!atomic_load(&buffer->running) || getppid() != buffer->ppid)
+      {
+         /* Processes that are still writing a record finish it, the rest log directly */
+         atomic_store(&buffer->active, false);
+
+         if (stopping == 0)
+         {
+            stopping = pgexporter_get_monotonic_time();
+         }
+
+         /* A process that died while writing a record is not waited for */
+         if ((atomic_load(&buffer->producers) == 0 || pgexporter_get_monotonic_time() - stopping >= RECORD_TIMEOUT) &&
+             !buffer_ready(buffer))
+         {
+            break;
+         }
+
+         SLEEP(1000000L);
+         continue;
+      }
+
+      atomic_store(&buffer->sleeping, true);
+
+      if (!buffer_ready(buffer))
+      {
+         poll(&fds, 1, 1000);
+      }
+
+      atomic_store(&buffer->sleeping, false);
+
+      while (read(buffer->wakeup[0], &discard[0], sizeof(discard)) > 0)
+      {
+      }
+
+      buffer_reopen();
+   }
+}
+
+void
+pgexporter_logging_activate(void)
+{
+   struct log_buffer* buffer;
+
+   buffer = (struct log_buffer*)logging_shmem;
+
+   if (buffer != NULL)
+   {
+      atomic_store(&buffer->active, true);
+   }
+}
+
+void
+pgexporter_logging_suspend(void)
+{
+   struct log_buffer* buffer;
+
+   buffer = (struct log_buffer*)logging_shmem;
+
+   if (buffer != NULL)
+   {
+      atomic_store(&buffer->active, false);
+   }
+}
+
+void
+pgexporter_logging_deactivate(pid_t pid)
+{
+   struct log_buffer* buffer;
+
+   buffer = (struct log_buffer*)logging_shmem;
+
+   if (buffer == NULL)
+   {
+      return;
+   }
+
+   atomic_store(&buffer->running, false);
+   buffer_wakeup(buffer);
+
+   if (pid > 0)
+   {
+      waitpid(pid, NULL, 0);
+   }
+
+   atomic_store(&buffer->active, false);
+
+   close(buffer->wakeup[0]);
+   close(buffer->wakeup[1]);
+}
+
 /**
  *
  */
@@ -310,6 +511,8 @@ void
 pgexporter_log_line(int level, char* file, int line, char* fmt, ...)
 {
    signed char isfree;
+   char* filename;
+   struct log_buffer* buffer;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -339,42 +542,47 @@ pgexporter_log_line(int level, char* file, int line, char* fmt, ...)
             break;
       }
 
-retry:
-      isfree = STATE_FREE;
+      filename = strrchr(file, '/');
+      if (filename != NULL)
+      {
+         filename = filename + 1;
+      }
+      else
+      {
+         filename = file;
+      }
 
-      if (atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
+      buffer = buffer_enter();
+      if (buffer != NULL)
       {
-         char buf[256];
+         int written;
          va_list vl;
-         struct tm* tm;
-         time_t t;
-         char* filename;
 
-         t = time(NULL);
-         tm = localtime(&t);
+         va_start(vl, fmt);
+         written = buffer_line(buffer, level, filename, line, fmt, vl);
+         va_end(vl);
 
-         filename = strrchr(file, '/');
-         if (filename != NULL)
-         {
-            filename = filename + 1;
-         }
-         else
-         {
-            filename = file;
-         }
+         buffer_leave(buffer);
 
-         if (strlen(config->log_line_prefix) == 0)
+         if (!written)
          {
-            memcpy(config->log_line_prefix, PGEXPORTER_LOGGING_DEFAULT_LOG_LINE_PREFIX, strlen(PGEXPORTER_LOGGING_DEFAULT_LOG_LINE_PREFIX));
+            return;
          }
+      }
+
+retry:
+      isfree = STATE_FREE;
+
+      if (atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
+      {
+         va_list vl;
 
          va_start(vl, fmt);
 
          if (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE)
          {
-            buf[strftime(buf, sizeof(buf), config->log_line_prefix, tm)] = '\0';
             fprintf(stdout, "%s %s%-5s\x1b[0m \x1b[90m%s:%d\x1b[0m ",
-                    buf, colors[level - 1], levels[level - 1],
+                    timestamp(), colors[level - 1], levels[level - 1],
                     filename, line);
             vfprintf(stdout, fmt, vl);
             fprintf(stdout, "\n");
@@ -382,9 +590,8 @@ retry:
          }
          else if (config->log_type == PGEXPORTER_LOGGING_TYPE_FILE)
          {
-            buf[strftime(buf, sizeof(buf), config->log_line_prefix, tm)] = '\0';
             fprintf(log_file, "%s %-5s %s:%d ",
-                    buf, levels[level - 1], filename, line);
+                    timestamp(), levels[level - 1], filename, line);
             vfprintf(log_file, fmt, vl);
             fprintf(log_file, "\n");
             fflush(log_file);
@@ -435,6 +642,7 @@ void
 pgexporter_log_mem(void* data, size_t size)
 {
    signed char isfree;
+   struct log_buffer* buffer;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -448,10 +656,12 @@ pgexporter_log_mem(void* data, size_t size)
        size > 0 &&
        (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE || config->log_type == PGEXPORTER_LOGGING_TYPE_FILE))
    {
+      buffer = buffer_enter();
+
 retry:
       isfree = STATE_FREE;
 
-      if (atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
+      if (buffer != NULL || atomic_compare_exchange_strong(&config->log_lock, &isfree, STATE_IN_USE))
       {
          char buf[(3 * size) + (2 * ((size / LINE_LENGTH) + 1)) + 1 + 1];
          int j = 0;
@@ -497,6 +707,22 @@ retry:
             k++;
          }
 
+         if (buffer != NULL)
+         {
+            buf[j] = '\n';
+            j++;
+
+            if (!buffer_write(buffer, PGEXPORTER_LOGGING_LEVEL_DEBUG5, &buf[0], j))
+            {
+               buffer_leave(buffer);
+               return;
+            }
+
+            buffer_leave(buffer);
+            buffer = NULL;
+            goto retry;
+         }
+
          if (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE)
          {
             fprintf(stdout, "%s", buf);
@@ -531,3 +757,455 @@ pgexporter_log_is_enabled(int level)
 
    return false;
 }
+
+/**
+ * The timestamp of a logging line, which is only formatted
+ * once per second
+ * @return The timestamp
+ */
+static char*
+timestamp(void)
+{
+   time_t t;
+   struct tm tm;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   t = time(NULL);
+
+   if (t != log_time)
+   {
+      if (strlen(config->log_line_prefix) == 0)
+      {
+         memcpy(config->log_line_prefix, PGEXPORTER_LOGGING_DEFAULT_LOG_LINE_PREFIX, strlen(PGEXPORTER_LOGGING_DEFAULT_LOG_LINE_PREFIX));
+      }
+
+      localtime_r(&t, &tm);
+      log_timestamp[strftime(log_timestamp, sizeof(log_timestamp), config->log_line_prefix, &tm)] = '\0';
+      log_time = t;
+   }
+
+   return &log_timestamp[0];
+}
+
+/**
+ * Enter the logging buffer
+ * @return The buffer, or NULL if the logging must be done directly
+ */
+static struct log_buffer*
+buffer_enter(void)
+{
+   struct log_buffer* buffer;
+
+   buffer = (struct log_buffer*)logging_shmem;
+
+   if (buffer == NULL || log_writer)
+   {
+      return NULL;
+   }
+
+   atomic_fetch_add(&buffer->producers, 1);
+
+   if (!atomic_load(&buffer->active))
+   {
+      atomic_fetch_sub(&buffer->producers, 1);
+      return NULL;
+   }
+
+   return buffer;
+}
+
+/**
+ * Leave the logging buffer
+ * @param buffer The buffer
+ */
+static void
+buffer_leave(struct log_buffer* buffer)
+{
+   atomic_fetch_sub(&buffer->producers, 1);
+}
+
+/**
+ * Format a logging line into the logging buffer
+ * @param buffer The buffer
+ * @param level The logging level
+ * @param filename The file name
+ * @param line The line number
+ * @param fmt The format
+ * @param vl The arguments
+ * @return 0 upon success, otherwise 1 if the line must be logged directly
+ */
+static int
+buffer_line(struct log_buffer* buffer, int level, char* filename, int line, char* fmt, va_list vl)
+{
+   char buf[RECORD_LENGTH];
+   char* data = &buf[0];
+   int offset = 0;
+   int length = 0;
+   int ret;
+   va_list copy;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE)
+   {
+      offset = snprintf(buf, sizeof(buf), "%s %s%-5s\x1b[0m \x1b[90m%s:%d\x1b[0m ",
+                        timestamp(), colors[level - 1], levels[level - 1],
+                        filename, line);
+   }
+   else if (config->log_type == PGEXPORTER_LOGGING_TYPE_FILE)
+   {
+      offset = snprintf(buf, sizeof(buf), "%s %-5s %s:%d ",
+                        timestamp(), levels[level - 1], filename, line);
+   }
+
+   offset = MAX(MIN(offset, (int)sizeof(buf) - 2), 0);
+
+   va_copy(copy, vl);
+   length = vsnprintf(&buf[offset], sizeof(buf) - offset, fmt, copy);
+   va_end(copy);
+
+   if (length < 0)
+   {
+      return 0;
+   }
+
+   /* Room for the new line, and the terminator */
+   if (offset + length + 2 > (int)sizeof(buf))
+   {
+      data = (char*)malloc(offset + length + 2);
+
+      if (data != NULL)
+      {
+         memcpy(data, &buf[0], offset);
+         vsnprintf(data + offset, length + 2, fmt, vl);
+      }
+      else
+      {
+         data = &buf[0];
+         length = sizeof(buf) - offset - 2;
+      }
+   }
+
+   length += offset;
+
+   if (config->log_type != PGEXPORTER_LOGGING_TYPE_SYSLOG)
+   {
+      data[length] = '\n';
+      length++;
+   }
+
+   ret = buffer_write(buffer, level, data, length);
+
+   if (data != &buf[0])
+   {
+      free(data);
+   }
+
+   return ret;
+}
+
+/**
+ * Write a record into the logging buffer.
+ *
+ * The record claims enough consecutive slots, and waits
+ * for the logging process if the buffer is full. The wait
+ * ends if the logging process is gone, or after a second
+ * @param buffer The buffer
+ * @param level The logging level
+ * @param data The record
+ * @param length The length of the record
+ * @return 0 upon success, otherwise 1 if the record must be logged directly
+ */
+static int
+buffer_write(struct log_buffer* buffer, int level, char* data, size_t length)
+{
+   unsigned long position;
+   unsigned long last;
+   unsigned long sequence;
+   uint64_t start = 0;
+   size_t offset = 0;
+   int slots;
+   struct log_slot* slot = NULL;
+
+   length = MIN(length, (size_t)LOGGING_SLOT_SIZE * LOGGING_RECORD_SLOTS);
+   slots = MAX((int)((length + LOGGING_SLOT_SIZE - 1) / LOGGING_SLOT_SIZE), 1);
+
+   position = atomic_load(&buffer->head);
+
+   /* The slots are released in order, so the record fits once its last slot is free */
+   while (true)
+   {
+      last = position + slots - 1;
+      sequence = atomic_load(&buffer->slots[last & (LOGGING_BUFFER_SLOTS - 1)].sequence);
+
+      if (sequence == last)
+      {
+         if (atomic_compare_exchange_weak(&buffer->head, &position, position + slots))
+         {
+            break;
+         }
+      }
+      else if ((long)(sequence - last) < 0)
+      {
+         if (!atomic_load(&buffer->active))
+         {
+            return 1;
+         }
+
+         /* The buffer doesn't drain while a record of a dead process blocks it */
+         if (start == 0)
+         {
+            start = pgexporter_get_monotonic_time();
+         }
+         else if (pgexporter_get_monotonic_time() - start >= RECORD_TIMEOUT)
+         {
+            return 1;
+         }
+
+         buffer_wakeup(buffer);
+         SLEEP(1000000L);
+         position = atomic_load(&buffer->head);
+      }
+      else
+      {
+         position = atomic_load(&buffer->head);
+      }
+   }
+
+   for (int i = 0; i < slots; i++)
+   {
+      slot = &buffer->slots[(position + i) & (LOGGING_BUFFER_SLOTS - 1)];
+
+      slot->level = level;
+      slot->slots = slots;
+      slot->length = MIN(length - offset, (size_t)LOGGING_SLOT_SIZE);
+      memcpy(&slot->data[0], data + offset, slot->length);
+
+      offset += slot->length;
+   }
+
+   /* The first slot is published last, so the record is complete once it is ready */
+   for (int i = slots - 1; i >= 0; i--)
+   {
+      atomic_store(&buffer->slots[(position + i) & (LOGGING_BUFFER_SLOTS - 1)].sequence, position + i + 1);
+   }
+
+   if (atomic_load(&buffer->sleeping))
+   {
+      buffer_wakeup(buffer);
+   }
+
+   return 0;
+}
+
+/**
+ * Wake up the logging process
+ * @param buffer The buffer
+ */
+static void
+buffer_wakeup(struct log_buffer* buffer)
+{
+   char c = 0;
+
+   if (write(buffer->wakeup[1], &c, 1) < 0)
+   {
+      errno = 0;
+   }
+}
+
+/**
+ * Is there a record to write
+ * @param buffer The buffer
+ * @return True if there is, otherwise false
+ */
+static bool
+buffer_ready(struct log_buffer* buffer)
+{
+   unsigned long tail;
+
+   tail = atomic_load(&buffer->tail);
+
+   return atomic_load(&buffer->slots[tail & (LOGGING_BUFFER_SLOTS - 1)].sequence) == tail + 1;
+}
+
+/**
+ * Write the records of the logging buffer.
+ *
+ * A record claimed by a process that died before writing it would
+ * block the buffer, so the claims not written within a second are
+ * released, up to the next record written
+ * @param buffer The buffer
+ * @return True if any record was written or released, otherwise false
+ */
+static bool
+buffer_drain(struct log_buffer* buffer)
+{
+   static unsigned long claimed = 0;
+   static uint64_t claimed_time = 0;
+   unsigned long tail;
+   unsigned long head;
+   int slots;
+   bool written = false;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   tail = atomic_load(&buffer->tail);
+   head = atomic_load(&buffer->head);
+
+   if (tail != head && !buffer_ready(buffer))
+   {
+      if (claimed_time == 0 || claimed != tail)
+      {
+         claimed = tail;
+         claimed_time = pgexporter_get_monotonic_time();
+      }
+      else if (pgexporter_get_monotonic_time() - claimed_time >= RECORD_TIMEOUT)
+      {
+         while (tail != head && atomic_load(&buffer->slots[tail & (LOGGING_BUFFER_SLOTS - 1)].sequence) != tail + 1)
+         {
+            atomic_store(&buffer->slots[tail & (LOGGING_BUFFER_SLOTS - 1)].sequence, tail + LOGGING_BUFFER_SLOTS);
+            tail++;
+         }
+
+         atomic_store(&buffer->tail, tail);
+         claimed_time = 0;
+         written = true;
+      }
+   }
+
+   while (atomic_load(&buffer->slots[tail & (LOGGING_BUFFER_SLOTS - 1)].sequence) == tail + 1)
+   {
+      slots = buffer->slots[tail & (LOGGING_BUFFER_SLOTS - 1)].slots;
+
+      buffer_output(buffer, tail, slots);
+
+      for (int i = 0; i < slots; i++)
+      {
+         atomic_store(&buffer->slots[(tail + i) & (LOGGING_BUFFER_SLOTS - 1)].sequence, tail + i + LOGGING_BUFFER_SLOTS);
+      }
+
+      tail += slots;
+      atomic_store(&buffer->tail, tail);
+
+      written = true;
+   }
+
+   if (written)
+   {
+      if (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE)
+      {
+         fflush(stdout);
+      }
+      else if (config->log_type == PGEXPORTER_LOGGING_TYPE_FILE && log_file != NULL)
+      {
+         fflush(log_file);
+
+         if (log_rotation_required())
+         {
+            log_file_rotate();
+         }
+      }
+   }
+
+   return written;
+}
+
+/**
+ * Output a record of the logging buffer
+ * @param buffer The buffer
+ * @param position The position of the record
+ * @param slots The number of slots of the record
+ */
+static void
+buffer_output(struct log_buffer* buffer, unsigned long position, int slots)
+{
+   static char message[LOGGING_SLOT_SIZE * LOGGING_RECORD_SLOTS + 1];
+   size_t length = 0;
+   struct log_slot* slot = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < slots; i++)
+   {
+      slot = &buffer->slots[(position + i) & (LOGGING_BUFFER_SLOTS - 1)];
+
+      if (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE)
+      {
+         fwrite(&slot->data[0], 1, slot->length, stdout);
+      }
+      else if (config->log_type == PGEXPORTER_LOGGING_TYPE_FILE)
+      {
+         if (log_file != NULL)
+         {
+            fwrite(&slot->data[0], 1, slot->length, log_file);
+         }
+      }
+      else if (config->log_type == PGEXPORTER_LOGGING_TYPE_SYSLOG)
+      {
+         memcpy(&message[length], &slot->data[0], slot->length);
+         length += slot->length;
+      }
+   }
+
+   if (config->log_type == PGEXPORTER_LOGGING_TYPE_SYSLOG)
+   {
+      message[length] = '\0';
+
+      switch (buffer->slots[position & (LOGGING_BUFFER_SLOTS - 1)].level)
+      {
+         case PGEXPORTER_LOGGING_LEVEL_DEBUG5:
+         case PGEXPORTER_LOGGING_LEVEL_DEBUG1:
+            syslog(LOG_DEBUG, "%s", message);
+            break;
+         case PGEXPORTER_LOGGING_LEVEL_WARN:
+            syslog(LOG_WARNING, "%s", message);
+            break;
+         case PGEXPORTER_LOGGING_LEVEL_ERROR:
+            syslog(LOG_ERR, "%s", message);
+            break;
+         case PGEXPORTER_LOGGING_LEVEL_FATAL:
+            syslog(LOG_CRIT, "%s", message);
+            break;
+         default:
+            syslog(LOG_INFO, "%s", message);
+            break;
+      }
+   }
+}
+
+/**
+ * Reopen the log file if the main process changed it during a reload
+ */
+static void
+buffer_reopen(void)
+{
+   static char path[MISC_LENGTH];
+   static int mode = -1;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->log_type != PGEXPORTER_LOGGING_TYPE_FILE)
+   {
+      return;
+   }
+
+   if (mode != -1 && (mode != config->log_mode || strncmp(path, config->log_path, MISC_LENGTH)))
+   {
+      if (log_file != NULL)
+      {
+         fclose(log_file);
+         log_file = NULL;
+      }
+
+      log_file_open();
+   }
+
+   memcpy(path, config->log_path, MISC_LENGTH);
+   mode = config->log_mode;
+}
@@ -36,6 +36,7 @@
 
 /* system */
 #include <dirent.h>
+#include <limits.h>
 #include "lz4.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -66,6 +67,7 @@ pgexporter_lz4c_string(char* s, unsigned char** buffer, size_t* buffer_size)
    {
       pgexporter_log_error("LZ4: Compress failed");
       free(*buffer);
+      *buffer = NULL;
       return 1;
    }
 
@@ -78,26 +80,42 @@ int
 pgexporter_lz4d_string(unsigned char* compressed_buffer, size_t compressed_size, char** output_string)
 {
    size_t max_decompressed_size;
-   int decompressed_size;
+   int decompressed_size = -1;
+   char* output = NULL;
 
-   max_decompressed_size = compressed_size * 4;
+   *output_string = NULL;
 
-   *output_string = (char*)malloc(max_decompressed_size);
-   if (*output_string == NULL)
+   /* The block does not hold its size, so the output grows up to the largest ratio of lz4 */
+   for (max_decompressed_size = compressed_size * 4;
+        decompressed_size < 0 && max_decompressed_size <= compressed_size * 256 + 16 && max_decompressed_size <= INT_MAX;
+        max_decompressed_size *= 2)
    {
-      pgexporter_log_error("LZ4: Allocation failed");
-      return 1;
+      output = (char*)realloc(*output_string, max_decompressed_size + 1);
+      if (output == NULL)
+      {
+         pgexporter_log_error("LZ4: Allocation failed");
+         goto error;
+      }
+
+      *output_string = output;
+
+      decompressed_size = LZ4_decompress_safe((const char*)compressed_buffer, *output_string, compressed_size, max_decompressed_size);
    }
 
-   decompressed_size = LZ4_decompress_safe((const char*)compressed_buffer, *output_string, compressed_size, max_decompressed_size);
    if (decompressed_size < 0)
    {
       pgexporter_log_error("LZ4: Decompress failed");
-      free(*output_string);
-      return 1;
+      goto error;
    }
 
    (*output_string)[decompressed_size] = '\0';
 
    return 0;
+
+error:
+
+   free(*output_string);
+   *output_string = NULL;
+
+   return 1;
 }
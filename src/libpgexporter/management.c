@@ -30,6 +30,7 @@
 #include <pgexporter.h>
 #include <aes.h>
 #include <bzip2_compression.h>
+#include <compression.h>
 #include <gzip_compression.h>
 #include <json.h>
 #include <logging.h>
@@ -38,6 +39,7 @@
 #include <memory.h>
 #include <network.h>
 #include <queries.h>
+#include <security.h>
 #include <utils.h>
 #include <zstandard_compression.h>
 
@@ -57,9 +59,15 @@
 
 static int read_uint8(char* prefix, SSL* ssl, int socket, uint8_t* i);
 static int read_string(char* prefix, SSL* ssl, int socket, char** str);
+static int read_frame(char* prefix, SSL* ssl, int socket, uint8_t compression, uint8_t encryption, char** str);
 static int read_complete(SSL* ssl, int socket, void* buf, size_t size);
 static int write_uint8(char* prefix, SSL* ssl, int socket, uint8_t i);
 static int write_string(char* prefix, SSL* ssl, int socket, char* str);
+static int write_frame(char* prefix, SSL* ssl, int socket, uint8_t compression, uint8_t encryption, char* str);
+static int frame_create(uint8_t compression, uint8_t encryption, bool encrypt, struct compressor** compressor, struct cipher** cipher);
+static int frame_append(unsigned char** buffer, size_t* length, void* data, size_t size);
+static int frame_decompress(struct compressor* compressor, void* data, size_t size, unsigned char** buffer, size_t* length);
+static int frame_encrypt(struct cipher* cipher, void* data, size_t size, unsigned char** buffer, size_t* length);
 static int write_complete(SSL* ssl, int socket, void* buf, size_t size);
 static int write_socket(int socket, void* buf, size_t size);
 static int write_ssl(SSL* ssl, void* buf, size_t size);
@@ -374,8 +382,8 @@ pgexporter_management_create_response(struct json* json, int server, struct json
 
    if (server >= 0)
    {
-      pgexporter_json_put(r, MANAGEMENT_ARGUMENT_MAJOR_VERSION, (uintptr_t)config->servers[server].version, ValueInt32);
-      pgexporter_json_put(r, MANAGEMENT_ARGUMENT_MINOR_VERSION, (uintptr_t)config->servers[server].minor_version, ValueInt32);
+      pgexporter_json_put(r, MANAGEMENT_ARGUMENT_MAJOR_VERSION, (uintptr_t)config->states[server].version, ValueInt32);
+      pgexporter_json_put(r, MANAGEMENT_ARGUMENT_MINOR_VERSION, (uintptr_t)config->states[server].minor_version, ValueInt32);
       pgexporter_json_put(r, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[server].name, ValueString);
    }
 
@@ -471,6 +479,7 @@ pgexporter_management_read_json(SSL* ssl, int socket, uint8_t* compression, uint
 {
    uint8_t compress_method = MANAGEMENT_COMPRESSION_NONE;
    uint8_t encrypt_method = MANAGEMENT_ENCRYPTION_NONE;
+   bool binary = false;
    char* s = NULL;
    struct json* r = NULL;
 
@@ -492,6 +501,9 @@ pgexporter_management_read_json(SSL* ssl, int socket, uint8_t* compression, uint
       *compression = compress_method;
    }
 
+   binary = (compress_method & MANAGEMENT_FRAME_BINARY) != 0;
+   compress_method &= ~MANAGEMENT_FRAME_BINARY;
+
    if (read_uint8("pgexporter-cli", ssl, socket, &encrypt_method))
    {
       goto error;
@@ -502,12 +514,19 @@ pgexporter_management_read_json(SSL* ssl, int socket, uint8_t* compression, uint
       *encryption = encrypt_method;
    }
 
-   if (read_string("pgexporter-cli", ssl, socket, &s))
+   if (binary)
+   {
+      if (read_frame("pgexporter-cli", ssl, socket, compress_method, encrypt_method, &s))
+      {
+         goto error;
+      }
+   }
+   else if (read_string("pgexporter-cli", ssl, socket, &s))
    {
       goto error;
    }
 
-   if (compress_method || encrypt_method)
+   if (!binary && (compress_method || encrypt_method))
    {
       // First, perform decode
       if (pgexporter_base64_decode(s, strlen(s), (void**)&decoded_buffer, &decoded_size) != 0)
@@ -670,6 +689,7 @@ pgexporter_management_write_json(SSL* ssl, int socket, uint8_t compression, uint
    size_t compressed_size = 0;
    size_t encrypted_size = 0;
    size_t encoded_size = 0;
+   bool binary = (compression & MANAGEMENT_FRAME_BINARY) != 0;
 
    s = pgexporter_json_to_string(json, FORMAT_JSON_COMPACT, NULL, 0);
 
@@ -683,6 +703,20 @@ pgexporter_management_write_json(SSL* ssl, int socket, uint8_t compression, uint
       goto error;
    }
 
+   compression &= ~MANAGEMENT_FRAME_BINARY;
+
+   if (binary)
+   {
+      if (write_frame("pgexporter-cli", ssl, socket, compression, encryption, s))
+      {
+         goto error;
+      }
+
+      free(s);
+
+      return 0;
+   }
+
    if (compression || encryption)
    {
       // First, perform compress
@@ -865,7 +899,7 @@ pgexporter_management_create_header(int32_t command, uint8_t compression, uint8_
    pgexporter_json_put(header, MANAGEMENT_ARGUMENT_CLIENT_VERSION, (uintptr_t)VERSION, ValueString);
    pgexporter_json_put(header, MANAGEMENT_ARGUMENT_OUTPUT, (uintptr_t)output_format, ValueUInt8);
    pgexporter_json_put(header, MANAGEMENT_ARGUMENT_TIMESTAMP, (uintptr_t)timestamp, ValueString);
-   pgexporter_json_put(header, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)compression, ValueUInt8);
+   pgexporter_json_put(header, MANAGEMENT_ARGUMENT_COMPRESSION, (uintptr_t)(compression & ~MANAGEMENT_FRAME_BINARY), ValueUInt8);
    pgexporter_json_put(header, MANAGEMENT_ARGUMENT_ENCRYPTION, (uintptr_t)encryption, ValueUInt8);
 
    pgexporter_json_put(j, MANAGEMENT_CATEGORY_HEADER, (uintptr_t)header, ValueJSON);
@@ -1152,6 +1186,263 @@ error:
    return 1;
 }
 
+static int
+read_frame(char* prefix, SSL* ssl, int socket, uint8_t compression, uint8_t encryption, char** str)
+{
+   char buf4[4] = {0};
+   unsigned char chunk[16384];
+   uint32_t remaining;
+   size_t n;
+   unsigned char* s = NULL;
+   size_t length = 0;
+   struct compressor* compressor = NULL;
+   struct cipher* cipher = NULL;
+
+   *str = NULL;
+
+   if (read_complete(ssl, socket, &buf4[0], sizeof(buf4)))
+   {
+      pgexporter_log_warn("%s: read_frame: %p %d %s", prefix, ssl, socket, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   remaining = pgexporter_read_uint32(&buf4);
+
+   if (frame_create(compression, encryption, false, &compressor, &cipher))
+   {
+      goto error;
+   }
+
+   /* The frame is decrypted and decompressed while it is read */
+   while (remaining > 0)
+   {
+      n = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+
+      if (read_complete(ssl, socket, &chunk[0], n))
+      {
+         pgexporter_log_warn("%s: read_frame: %p %d %s", prefix, ssl, socket, strerror(errno));
+         errno = 0;
+         goto error;
+      }
+
+      remaining -= n;
+
+      if (cipher != NULL)
+      {
+         if (pgexporter_cipher_update(cipher, &chunk[0], n) ||
+             frame_decompress(compressor, cipher->output, cipher->output_size, &s, &length))
+         {
+            goto error;
+         }
+      }
+      else if (frame_decompress(compressor, &chunk[0], n, &s, &length))
+      {
+         goto error;
+      }
+   }
+
+   if (cipher != NULL)
+   {
+      if (pgexporter_cipher_finish(cipher) ||
+          frame_decompress(compressor, cipher->output, cipher->output_size, &s, &length))
+      {
+         goto error;
+      }
+   }
+
+   if (compressor != NULL && pgexporter_compressor_finish(compressor))
+   {
+      goto error;
+   }
+
+   if (s == NULL && frame_append(&s, &length, NULL, 0))
+   {
+      goto error;
+   }
+
+   pgexporter_compressor_destroy(compressor);
+   pgexporter_cipher_destroy(cipher);
+
+   *str = (char*)s;
+
+   return 0;
+
+error:
+
+   pgexporter_compressor_destroy(compressor);
+   pgexporter_cipher_destroy(cipher);
+
+   free(s);
+
+   return 1;
+}
+
+static int
+write_frame(char* prefix, SSL* ssl, int socket, uint8_t compression, uint8_t encryption, char* str)
+{
+   char buf4[4] = {0};
+   unsigned char* frame = NULL;
+   size_t length = 0;
+   struct compressor* compressor = NULL;
+   struct cipher* cipher = NULL;
+
+   if (frame_create(compression, encryption, true, &compressor, &cipher))
+   {
+      goto error;
+   }
+
+   if (compressor != NULL)
+   {
+      if (pgexporter_compressor_update(compressor, str, strlen(str)) ||
+          frame_encrypt(cipher, compressor->output, compressor->output_size, &frame, &length) ||
+          pgexporter_compressor_finish(compressor) ||
+          frame_encrypt(cipher, compressor->output, compressor->output_size, &frame, &length))
+      {
+         goto error;
+      }
+   }
+   else if (frame_encrypt(cipher, str, strlen(str), &frame, &length))
+   {
+      goto error;
+   }
+
+   if (cipher != NULL)
+   {
+      if (pgexporter_cipher_finish(cipher) ||
+          frame_append(&frame, &length, cipher->output, cipher->output_size))
+      {
+         goto error;
+      }
+   }
+
+   if (length > UINT32_MAX)
+   {
+      pgexporter_log_error("%s: write_frame: Frame too large (%zu)", prefix, length);
+      goto error;
+   }
+
+   pgexporter_write_uint32(&buf4, length);
+   if (write_complete(ssl, socket, &buf4, sizeof(buf4)) ||
+       (length > 0 && write_complete(ssl, socket, frame, length)))
+   {
+      pgexporter_log_warn("%s: write_frame: %p %d %s", prefix, ssl, socket, strerror(errno));
+      errno = 0;
+      goto error;
+   }
+
+   pgexporter_compressor_destroy(compressor);
+   pgexporter_cipher_destroy(cipher);
+   free(frame);
+
+   return 0;
+
+error:
+
+   pgexporter_compressor_destroy(compressor);
+   pgexporter_cipher_destroy(cipher);
+   free(frame);
+
+   return 1;
+}
+
+static int
+frame_create(uint8_t compression, uint8_t encryption, bool encrypt, struct compressor** compressor, struct cipher** cipher)
+{
+   char* master_key = NULL;
+
+   *compressor = NULL;
+   *cipher = NULL;
+
+   if (compression != MANAGEMENT_COMPRESSION_NONE &&
+       pgexporter_compressor_create(compression, encrypt, 0, compressor))
+   {
+      goto error;
+   }
+
+   if (encryption != MANAGEMENT_ENCRYPTION_NONE)
+   {
+      if (pgexporter_get_master_key(&master_key))
+      {
+         pgexporter_log_error("pgexporter_get_master_key: Invalid master key");
+         goto error;
+      }
+
+      if (pgexporter_cipher_create(master_key, encryption, encrypt, cipher))
+      {
+         goto error;
+      }
+   }
+
+   free(master_key);
+
+   return 0;
+
+error:
+
+   pgexporter_compressor_destroy(*compressor);
+   *compressor = NULL;
+
+   free(master_key);
+
+   return 1;
+}
+
+static int
+frame_append(unsigned char** buffer, size_t* length, void* data, size_t size)
+{
+   unsigned char* b = NULL;
+
+   b = realloc(*buffer, *length + size + 1);
+   if (b == NULL)
+   {
+      return 1;
+   }
+
+   if (size > 0)
+   {
+      memcpy(b + *length, data, size);
+   }
+
+   *length += size;
+   b[*length] = '\0';
+   *buffer = b;
+
+   return 0;
+}
+
+static int
+frame_decompress(struct compressor* compressor, void* data, size_t size, unsigned char** buffer, size_t* length)
+{
+   if (compressor == NULL)
+   {
+      return frame_append(buffer, length, data, size);
+   }
+
+   if (pgexporter_compressor_update(compressor, data, size))
+   {
+      return 1;
+   }
+
+   return frame_append(buffer, length, compressor->output, compressor->output_size);
+}
+
+static int
+frame_encrypt(struct cipher* cipher, void* data, size_t size, unsigned char** buffer, size_t* length)
+{
+   if (cipher == NULL)
+   {
+      return frame_append(buffer, length, data, size);
+   }
+
+   if (pgexporter_cipher_update(cipher, data, size))
+   {
+      return 1;
+   }
+
+   return frame_append(buffer, length, cipher->output, cipher->output_size);
+}
+
 static int
 write_complete(SSL* ssl, int socket, void* buf, size_t size)
 {
@@ -53,7 +53,8 @@ pgexporter_memory_init(void)
          goto error;
       }
 
-      data = malloc(DEFAULT_BUFFER_SIZE);
+      /* Room for a terminator after a full read */
+      data = malloc(DEFAULT_BUFFER_SIZE + 1);
 
       if (data == NULL)
       {
@@ -99,8 +100,9 @@ pgexporter_memory_free(void)
    assert(data != NULL);
 #endif
 
+   /* The data is bounded by the length of the message, so it isn't cleared */
    memset(message, 0, sizeof(struct message));
-   memset(data, 0, DEFAULT_BUFFER_SIZE);
+   *((char*)data) = '\0';
 
    message->kind = 0;
    message->length = 0;
@@ -36,18 +36,24 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
-#include <sys/time.h>
 
-static int read_message(int socket, bool block, int timeout, struct message** msg);
+static int read_message(int socket, bool block, uint64_t deadline, struct message** msg);
+static int read_data(int socket, bool block, uint64_t deadline, void* data, size_t size, size_t* length);
 static int write_message(int socket, struct message* msg);
 
-static int ssl_read_message(SSL* ssl, int timeout, struct message** msg);
+static int ssl_read_message(SSL* ssl, uint64_t deadline, struct message** msg);
+static int ssl_read_data(SSL* ssl, uint64_t deadline, void* data, size_t size, size_t* length);
 static int ssl_write_message(SSL* ssl, struct message* msg);
 
+static uint64_t timeout_deadline(int timeout);
+static int wait_socket(int socket, short events, uint64_t deadline);
+
 int
 pgexporter_read_block_message(SSL* ssl, int socket, struct message** msg)
 {
@@ -61,13 +67,36 @@ pgexporter_read_block_message(SSL* ssl, int socket, struct message** msg)
 
 int
 pgexporter_read_timeout_message(SSL* ssl, int socket, int timeout, struct message** msg)
+{
+   return pgexporter_read_deadline_message(ssl, socket, timeout_deadline(timeout), msg);
+}
+
+int
+pgexporter_read_deadline_message(SSL* ssl, int socket, uint64_t deadline, struct message** msg)
+{
+   if (ssl == NULL)
+   {
+      return read_message(socket, true, deadline, msg);
+   }
+
+   return ssl_read_message(ssl, deadline, msg);
+}
+
+int
+pgexporter_read_block_data(SSL* ssl, int socket, void* data, size_t size, size_t* length)
+{
+   return pgexporter_read_deadline_data(ssl, socket, 0, data, size, length);
+}
+
+int
+pgexporter_read_deadline_data(SSL* ssl, int socket, uint64_t deadline, void* data, size_t size, size_t* length)
 {
    if (ssl == NULL)
    {
-      return read_message(socket, true, timeout, msg);
+      return read_data(socket, true, deadline, data, size, length);
    }
 
-   return ssl_read_message(ssl, timeout, msg);
+   return ssl_read_data(ssl, deadline, data, size, length);
 }
 
 int
@@ -297,6 +326,27 @@ pgexporter_write_terminate(SSL* ssl, int socket)
    return ssl_write_message(ssl, &msg);
 }
 
+int
+pgexporter_write_cancel_request(int socket, int pid, int secret)
+{
+   char cancel[16];
+   struct message msg;
+
+   memset(&msg, 0, sizeof(struct message));
+   memset(&cancel, 0, sizeof(cancel));
+
+   pgexporter_write_int32(&cancel, 16);
+   pgexporter_write_int32(&(cancel[4]), 80877102);
+   pgexporter_write_int32(&(cancel[8]), pid);
+   pgexporter_write_int32(&(cancel[12]), secret);
+
+   msg.kind = 0;
+   msg.length = 16;
+   msg.data = &cancel;
+
+   return write_message(socket, &msg);
+}
+
 int
 pgexporter_write_connection_refused(SSL* ssl, int socket)
 {
@@ -623,45 +673,58 @@ pgexporter_create_startup_message(char* username, char* database, struct message
 }
 
 static int
-read_message(int socket, bool block, int timeout, struct message** msg)
+read_message(int socket, bool block, uint64_t deadline, struct message** msg)
 {
-   bool keep_read = false;
-   ssize_t numbytes;
-   struct timeval tv;
+   int status;
+   size_t length = 0;
    struct message* m = NULL;
 
-   if (unlikely(timeout > 0))
+   m = pgexporter_memory_message();
+
+   status = read_data(socket, block, deadline, m->data, DEFAULT_BUFFER_SIZE, &length);
+
+   if (likely(status == MESSAGE_STATUS_OK))
    {
-      tv.tv_sec = timeout;
-      tv.tv_usec = 0;
-      setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+      *((char*)m->data + length) = '\0';
+
+      m->kind = (signed char)(*((char*)m->data));
+      m->length = length;
+      *msg = m;
+   }
+   else
+   {
+      pgexporter_memory_free();
    }
 
+   return status;
+}
+
+static int
+read_data(int socket, bool block, uint64_t deadline, void* data, size_t size, size_t* length)
+{
+   bool keep_read = false;
+   ssize_t numbytes;
+
+   *length = 0;
+
    do
    {
-      m = pgexporter_memory_message();
+      /* A blocking socket is only read once there is data, so the deadline holds */
+      if (unlikely(deadline > 0) && wait_socket(socket, POLLIN, deadline))
+      {
+         return MESSAGE_STATUS_ZERO;
+      }
 
-      numbytes = read(socket, m->data, DEFAULT_BUFFER_SIZE);
+      numbytes = read(socket, data, size);
 
       if (likely(numbytes > 0))
       {
-         m->kind = (signed char)(*((char*)m->data));
-         m->length = numbytes;
-         *msg = m;
-
-         if (unlikely(timeout > 0))
-         {
-            tv.tv_sec = 0;
-            tv.tv_usec = 0;
-            setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-         }
+         *length = numbytes;
 
          return MESSAGE_STATUS_OK;
       }
       else if (numbytes == 0)
       {
-         pgexporter_memory_free();
-
          if ((errno == EAGAIN || errno == EWOULDBLOCK) && block)
          {
             keep_read = true;
@@ -669,24 +732,22 @@ read_message(int socket, bool block, int timeout, struct message** msg)
          }
          else
          {
-            if (unlikely(timeout > 0))
-            {
-               tv.tv_sec = 0;
-               tv.tv_usec = 0;
-               setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-            }
-
             return MESSAGE_STATUS_ZERO;
          }
       }
       else
       {
-         pgexporter_memory_free();
-
          if ((errno == EAGAIN || errno == EWOULDBLOCK) && block)
          {
-            keep_read = true;
             errno = 0;
+
+            /* Wait for the non-blocking socket, instead of spinning on it */
+            if (wait_socket(socket, POLLIN, deadline))
+            {
+               return MESSAGE_STATUS_ZERO;
+            }
+
+            keep_read = true;
          }
          else
          {
@@ -696,15 +757,6 @@ read_message(int socket, bool block, int timeout, struct message** msg)
    }
    while (keep_read);
 
-   if (unlikely(timeout > 0))
-   {
-      tv.tv_sec = 0;
-      tv.tv_usec = 0;
-      setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-
-      pgexporter_memory_free();
-   }
-
    return MESSAGE_STATUS_ERROR;
 }
 
@@ -767,7 +819,7 @@ write_message(int socket, struct message* msg)
          switch (errno)
          {
             case EAGAIN:
-               keep_write = true;
+               keep_write = wait_socket(socket, POLLOUT, 0) == 0;
                break;
             default:
                keep_write = false;
@@ -782,53 +834,71 @@ write_message(int socket, struct message* msg)
 }
 
 static int
-ssl_read_message(SSL* ssl, int timeout, struct message** msg)
+ssl_read_message(SSL* ssl, uint64_t deadline, struct message** msg)
 {
-   bool keep_read = false;
-   ssize_t numbytes;
-   time_t start_time;
+   int status;
+   size_t length = 0;
    struct message* m = NULL;
-   unsigned long err;
 
-   if (unlikely(timeout > 0))
+   m = pgexporter_memory_message();
+
+   status = ssl_read_data(ssl, deadline, m->data, DEFAULT_BUFFER_SIZE, &length);
+
+   if (likely(status == MESSAGE_STATUS_OK))
    {
-      start_time = time(NULL);
+      *((char*)m->data + length) = '\0';
+
+      m->kind = (signed char)(*((char*)m->data));
+      m->length = length;
+      *msg = m;
+   }
+   else
+   {
+      pgexporter_memory_free();
    }
 
+   return status;
+}
+
+static int
+ssl_read_data(SSL* ssl, uint64_t deadline, void* data, size_t size, size_t* length)
+{
+   bool keep_read = false;
+   ssize_t numbytes;
+   unsigned long err;
+
+   *length = 0;
+
    do
    {
-      m = pgexporter_memory_message();
+      /* Data already decrypted by OpenSSL doesn't show up on the socket */
+      if (unlikely(deadline > 0) && SSL_pending(ssl) == 0 && wait_socket(SSL_get_fd(ssl), POLLIN, deadline))
+      {
+         return MESSAGE_STATUS_ZERO;
+      }
 
-      numbytes = SSL_read(ssl, m->data, DEFAULT_BUFFER_SIZE);
+      numbytes = SSL_read(ssl, data, size);
 
       if (likely(numbytes > 0))
       {
-         m->kind = (signed char)(*((char*)m->data));
-         m->length = numbytes;
-         *msg = m;
+         *length = numbytes;
 
          return MESSAGE_STATUS_OK;
       }
       else
       {
-         pgexporter_memory_free();
-
          err = SSL_get_error(ssl, numbytes);
          switch (err)
          {
             case SSL_ERROR_ZERO_RETURN:
-               if (timeout > 0)
-               {
-                  if (difftime(time(NULL), start_time) >= timeout)
-                  {
-                     return MESSAGE_STATUS_ZERO;
-                  }
-
-                  /* Sleep for 100ms */
-                  SLEEP(100000000L);
-               }
+               ERR_clear_error();
+               return MESSAGE_STATUS_ZERO;
             case SSL_ERROR_WANT_READ:
+               keep_read = wait_socket(SSL_get_fd(ssl), POLLIN, deadline) == 0;
+               break;
             case SSL_ERROR_WANT_WRITE:
+               keep_read = wait_socket(SSL_get_fd(ssl), POLLOUT, deadline) == 0;
+               break;
             case SSL_ERROR_WANT_CONNECT:
             case SSL_ERROR_WANT_ACCEPT:
             case SSL_ERROR_WANT_X509_LOOKUP:
@@ -854,6 +924,11 @@ ssl_read_message(SSL* ssl, int timeout, struct message** msg)
                break;
          }
          ERR_clear_error();
+
+         if (!keep_read && (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE))
+         {
+            return MESSAGE_STATUS_ZERO;
+         }
       }
    }
    while (keep_read);
@@ -909,9 +984,15 @@ ssl_write_message(SSL* ssl, struct message* msg)
 
          switch (err)
          {
-            case SSL_ERROR_ZERO_RETURN:
             case SSL_ERROR_WANT_READ:
+               errno = 0;
+               keep_write = wait_socket(SSL_get_fd(ssl), POLLIN, 0) == 0;
+               break;
             case SSL_ERROR_WANT_WRITE:
+               errno = 0;
+               keep_write = wait_socket(SSL_get_fd(ssl), POLLOUT, 0) == 0;
+               break;
+            case SSL_ERROR_ZERO_RETURN:
             case SSL_ERROR_WANT_CONNECT:
             case SSL_ERROR_WANT_ACCEPT:
             case SSL_ERROR_WANT_X509_LOOKUP:
@@ -950,3 +1031,65 @@ ssl_write_message(SSL* ssl, struct message* msg)
 
    return MESSAGE_STATUS_ERROR;
 }
+
+/**
+ * The deadline of a timeout
+ * @param timeout The timeout in seconds, or 0 for none
+ * @return The deadline, or 0 for none
+ */
+static uint64_t
+timeout_deadline(int timeout)
+{
+   if (timeout <= 0)
+   {
+      return 0;
+   }
+
+   return pgexporter_get_monotonic_time() + (uint64_t)timeout * 1000000;
+}
+
+/**
+ * Wait for a socket to be ready
+ * @param socket The socket descriptor
+ * @param events The events, POLLIN or POLLOUT
+ * @param deadline The deadline, or 0 for none
+ * @return 0 when the socket is ready, 1 if the deadline passed or upon error
+ */
+static int
+wait_socket(int socket, short events, uint64_t deadline)
+{
+   int ret;
+   int timeout = -1;
+   uint64_t now;
+   struct pollfd fds;
+
+   fds.fd = socket;
+   fds.events = events;
+   fds.revents = 0;
+
+   do
+   {
+      if (deadline > 0)
+      {
+         now = pgexporter_get_monotonic_time();
+
+         if (now >= deadline)
+         {
+            return 1;
+         }
+
+         /* Round up, so the deadline has passed when the poll times out */
+         timeout = (int)MIN((deadline - now + 999) / 1000, (uint64_t)INT32_MAX);
+      }
+
+      ret = poll(&fds, 1, timeout);
+   }
+   while (ret == -1 && errno == EINTR);
+
+   if (ret == -1)
+   {
+      errno = 0;
+   }
+
+   return ret > 0 ? 0 : 1;
+}
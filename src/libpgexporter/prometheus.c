@@ -28,6 +28,8 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <compression.h>
+#include <exposition.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
@@ -40,10 +42,13 @@
 #include <utils.h>
 
 /* system */
+#include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/types.h>
 
@@ -54,13 +59,36 @@
 #define PAGE_METRICS 2
 #define BAD_REQUEST  3
 
-#define MAX_ARR_LENGTH 256
 #define NUMBER_OF_HISTOGRAM_COLUMNS 4
 
 #define INPUT_NO   0
 #define INPUT_DATA 1
 #define INPUT_WAL  2
 
+#define TAG_CLAIMED 2
+
+/* Upper bounds of the duration buckets in microseconds */
+static const uint64_t buckets[NUMBER_OF_BUCKETS] = {1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000, 10000000};
+static const char* bucket_names[NUMBER_OF_BUCKETS] = {"0.001", "0.005", "0.01", "0.05", "0.1", "0.5", "1", "5", "10"};
+
+/* The time this process spent waiting for the servers during the scrape */
+static uint64_t scrape_wait = 0;
+
+/* The collectors selected by the request, pointing into a copy of its query string */
+static char* selection = NULL;
+static int number_of_collect = 0;
+static char* collect[NUMBER_OF_COLLECTORS];
+static int number_of_exclude = 0;
+static char* exclude[NUMBER_OF_COLLECTORS];
+
+/* The format negotiated by the request, and its text while the response is collected */
+static int format = EXPOSITION_TEXT;
+static struct exposition* exposition = NULL;
+
+/* Is a gzip encoded response accepted, and the encoder of the chunks while the response is sent */
+static bool gzip = false;
+static struct compressor* encoder = NULL;
+
 /**
  * This is a linked list of queries with the data received from the server
  * as well as the query sent to the server and other meta data.
@@ -107,35 +135,77 @@ typedef struct column_store
    int sort_type;
 } column_store_t;
 
+/**
+ * A decoded PostgreSQL array of numbers. The elements are kept
+ * as text in `buffer` for the output, and as numbers for the checks.
+ *
+ * The storage is reused between the rows, and grows as needed.
+ **/
+typedef struct array
+{
+   int size;
+   int capacity;
+   char** values;
+   double* numbers;
+   char* buffer;
+   size_t buffer_size;
+} array_t;
+
+static struct query_alts* plan_metric(int server, int metric);
 static int resolve_page(struct message* msg);
+static int resolve_collectors(char* query);
+static void url_decode(char* s);
+static uint64_t scrape_timeout(struct message* msg);
 static int badrequest_page(int client_fd);
 static int unknown_page(int client_fd);
 static int home_page(int client_fd);
-static int metrics_page(int client_fd);
+static int metrics_page(int client_fd, uint64_t timeout);
 static int bad_request(int client_fd);
+static char* metrics_header(int f);
 
+static bool collector_configured(const char* collector);
 static bool collector_pass(const char* collector);
+static bool collector_key(char* key, size_t size);
+static void collector_sort(char** names, int* n);
+static int collector_compare(const void* a, const void* b);
 
 static void add_column_to_store(column_store_t* store, int n_store, char* data, int sort_type, struct tuple* current);
 
 static void general_information(int client_fd);
+static void statistics_information(int client_fd);
 static void core_information(int client_fd);
 static void extension_information(int client_fd);
-static void extension_function(int client_fd, char* function, int input, char* description, char* type);
+static void extension_function(int client_fd, char* function, int input, char* description, char* type, struct query** queries);
+static int extension_catalogue(int server);
+static void extension_disable(int server);
+static int extension_batch(int server, int first, int count, char** sql);
+static void extension_retry(int server, int failed, int n, struct query** batch);
+static int extension_lookup(int server, char* function);
+static char* extension_location(int server, int input);
 static void server_information(int client_fd);
 static void version_information(int client_fd);
 static void uptime_information(int client_fd);
 static void primary_information(int client_fd);
 static void settings_information(int client_fd);
+static void partial_information(int client_fd);
 static void custom_metrics(int client_fd); // Handles custom metrics provided in YAML format, both internal and external
+static char* row_labels(struct query_alts* query_alt, int* columns, int n_columns, struct tuple* tuple);
 static void append_help_info(char** data, char* tag, char* name, char* description);
 static void append_type_info(char** data, char* tag, char* name, int typeId);
 
+static int compile_query_alts(struct registry* registry, struct prometheus* prom, struct query_alts* query_alt);
+static bool is_plan_valid(int server);
+
 static void handle_histogram(column_store_t* store, int* n_store, query_list_t* temp);
 static void handle_gauge_counter(column_store_t* store, int* n_store, query_list_t* temp);
 
 static int send_chunk(int client_fd, char* data);
-static int parse_list(char* list_str, char** strs, int* n_strs);
+static int send_chunk_size(int client_fd, char* data, size_t size);
+static int send_exposition(int client_fd);
+static int flush_exposition(int client_fd);
+static int send_encoding_end(int client_fd);
+static int write_chunk(int client_fd, void* data, size_t size);
+static int parse_array(char* list, array_t* array, bool increasing);
 
 static char* get_value(char* tag, char* name, char* val);
 static int safe_prometheus_key_additional_length(char* key);
@@ -149,11 +219,26 @@ static bool metrics_cache_finalize(void);
 static size_t metrics_cache_size_to_alloc(void);
 static void metrics_cache_invalidate(void);
 
+static void statistics_observe(struct histogram* histogram, uint64_t duration);
+static int statistics_tag(char* tag);
+static struct query_statistics* statistics_query(int slot, int server);
+static int statistics_servers(void);
+static int statistics_reserve(struct configuration* config);
+static char* statistics_histogram(char* data, char* name, char* labels, struct histogram* histogram);
+static char* statistics_seconds(char* data, uint64_t duration);
+
+static void settings_fingerprint(int server, struct settings_fingerprint* fingerprint);
+static bool same_fingerprint(struct settings_fingerprint* f1, struct settings_fingerprint* f2);
+static void settings_invalidate(void);
+static bool settings_append(char* data);
+static void settings_finalize(struct settings_fingerprint* fingerprints);
+
 void
 pgexporter_prometheus(int client_fd)
 {
    int status;
    int page;
+   uint64_t timeout;
    struct message* msg = NULL;
    struct configuration* config;
 
@@ -169,6 +254,9 @@ pgexporter_prometheus(int client_fd)
       goto error;
    }
 
+   timeout = scrape_timeout(msg);
+   format = pgexporter_exposition_negotiate(msg);
+   gzip = pgexporter_exposition_gzip(msg);
    page = resolve_page(msg);
 
    if (page == PAGE_HOME)
@@ -177,7 +265,7 @@ pgexporter_prometheus(int client_fd)
    }
    else if (page == PAGE_METRICS)
    {
-      metrics_page(client_fd);
+      metrics_page(client_fd, timeout);
    }
    else if (page == PAGE_UNKNOWN)
    {
@@ -190,6 +278,8 @@ pgexporter_prometheus(int client_fd)
 
    pgexporter_disconnect(client_fd);
 
+   free(selection);
+
    pgexporter_memory_destroy();
    pgexporter_stop_logging();
 
@@ -201,6 +291,8 @@ error:
 
    pgexporter_disconnect(client_fd);
 
+   free(selection);
+
    pgexporter_memory_destroy();
    pgexporter_stop_logging();
 
@@ -228,6 +320,24 @@ retry_cache_locking:
       atomic_store(&config->logging_error, 0);
       atomic_store(&config->logging_fatal, 0);
 
+      if (prometheus_statistics_shmem != NULL)
+      {
+         struct prometheus_statistics* stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+         for (int i = 0; i < statistics_servers(); i++)
+         {
+            memset(&config->statistics[i].connect, 0, sizeof(struct histogram));
+            memset(config->statistics[i].queries, 0, stats->number_of_tags * sizeof(struct query_statistics));
+         }
+         memset(&stats->scrape, 0, sizeof(stats->scrape));
+         memset(&stats->render, 0, sizeof(stats->render));
+         atomic_store(&stats->bytes, 0);
+         atomic_store(&stats->cache_hits, 0);
+         atomic_store(&stats->cache_misses, 0);
+         atomic_store(&stats->settings_hits, 0);
+         atomic_store(&stats->settings_misses, 0);
+      }
+
       atomic_store(&cache->lock, STATE_FREE);
    }
    else
@@ -263,10 +373,254 @@ pgexporter_prometheus_logging(int type)
    }
 }
 
+void
+pgexporter_prometheus_query(int server, char* tag, uint64_t duration, unsigned long rows, unsigned long bytes)
+{
+   int slot;
+   struct query_statistics* qs = NULL;
+   struct prometheus_statistics* stats;
+
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+   scrape_wait += duration;
+
+   if (stats == NULL || server < 0 || server >= statistics_servers())
+   {
+      return;
+   }
+
+   slot = statistics_tag(tag);
+   if (slot == -1)
+   {
+      return;
+   }
+
+   qs = statistics_query(slot, server);
+
+   statistics_observe(&qs->duration, duration);
+   atomic_fetch_add(&qs->rows, rows);
+   atomic_fetch_add(&qs->bytes, bytes);
+}
+
+void
+pgexporter_prometheus_timeout(int server, char* tag)
+{
+   int slot;
+   struct prometheus_statistics* stats;
+
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+   if (stats == NULL || server < 0 || server >= statistics_servers())
+   {
+      return;
+   }
+
+   slot = statistics_tag(tag);
+   if (slot == -1)
+   {
+      return;
+   }
+
+   atomic_fetch_add(&statistics_query(slot, server)->timeouts, 1);
+}
+
+void
+pgexporter_prometheus_connect(int server, uint64_t duration)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   scrape_wait += duration;
+
+   if (server < 0 || server >= statistics_servers())
+   {
+      return;
+   }
+
+   statistics_observe(&config->statistics[server].connect, duration);
+}
+
+int
+pgexporter_prometheus_compile(struct configuration* config)
+{
+   size_t number_of_plans;
+
+   for (int i = 0; i < config->number_of_metrics; i++)
+   {
+      /* A metric kept over a reload is already compiled */
+      if (config->prometheus[i].compiled)
+      {
+         continue;
+      }
+
+      if (compile_query_alts(config->registry, &config->prometheus[i], config->prometheus[i].root))
+      {
+         pgexporter_log_error("Unable to compile metric %s", config->prometheus[i].tag);
+         return 1;
+      }
+
+      config->prometheus[i].compiled = true;
+   }
+
+   /* The plans are built by the workers, so their room is reserved here */
+   number_of_plans = (size_t)config->number_of_servers * config->number_of_metrics;
+
+   if (number_of_plans > config->max_plans)
+   {
+      config->plans = pgexporter_registry_allocate(config->registry, number_of_plans * sizeof(struct query_alts*));
+      config->max_plans = config->plans != NULL ? number_of_plans : 0;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      config->states[i].plan.valid = false;
+      atomic_store(&config->states[i].plan.lock, STATE_FREE);
+      config->states[i].plan.query_alts = config->plans != NULL ? config->plans + (size_t)i * config->number_of_metrics : NULL;
+   }
+
+   if (config->plans == NULL && number_of_plans > 0)
+   {
+      pgexporter_log_error("Unable to allocate the plans of the servers");
+      return 1;
+   }
+
+   /* The servers are still scraped when their statistics are not tracked */
+   statistics_reserve(config);
+
+   return 0;
+}
+
+void
+pgexporter_prometheus_plan(int server)
+{
+   signed char plan_is_free;
+   struct plan* plan = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   plan = &config->states[server].plan;
+
+   if (plan->query_alts == NULL)
+   {
+      return;
+   }
+
+retry_plan_locking:
+
+   /* The plan of a reconnected server is kept as long as its version and its role are the same */
+   if (is_plan_valid(server))
+   {
+      return;
+   }
+
+   plan_is_free = STATE_FREE;
+   if (!atomic_compare_exchange_strong(&plan->lock, &plan_is_free, STATE_IN_USE))
+   {
+      /* Sleep for 1ms, and use the plan built by the other process */
+      SLEEP_AND_GOTO(1000000L, retry_plan_locking);
+   }
+
+   plan->valid = false;
+
+   for (int i = 0; i < config->number_of_metrics; i++)
+   {
+      plan->query_alts[i] = plan_metric(server, i);
+   }
+
+   plan->version = config->states[server].version;
+   plan->state = config->states[server].state;
+   plan->valid = true;
+
+   atomic_store(&plan->lock, STATE_FREE);
+
+   pgexporter_log_debug("Plan: %s (version %d, state %d)", config->servers[server].name, plan->version, plan->state);
+}
+
+void
+pgexporter_prometheus_statistics_transfer(struct configuration* config, struct configuration* reload, int* servers)
+{
+   struct prometheus_statistics* stats;
+
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+   if (stats == NULL || config->statistics == NULL || reload->statistics == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < reload->number_of_servers; i++)
+   {
+      if (servers[i] == -1)
+      {
+         continue;
+      }
+
+      memcpy(&reload->statistics[i].connect, &config->statistics[servers[i]].connect, sizeof(struct histogram));
+      memcpy(reload->statistics[i].queries, config->statistics[servers[i]].queries, stats->number_of_tags * sizeof(struct query_statistics));
+   }
+}
+
+void
+pgexporter_prometheus_invalidate(void)
+{
+   signed char cache_is_free;
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   if (cache == NULL)
+   {
+      return;
+   }
+
+retry_cache_locking:
+   cache_is_free = STATE_FREE;
+   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   {
+      metrics_cache_invalidate();
+      settings_invalidate();
+
+      atomic_store(&cache->lock, STATE_FREE);
+   }
+   else
+   {
+      /* Sleep for 1ms */
+      SLEEP_AND_GOTO(1000000L, retry_cache_locking);
+   }
+}
+
+static struct query_alts*
+plan_metric(int server, int metric)
+{
+   struct prometheus* prom = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   prom = &config->prometheus[metric];
+
+   /* Expose only if default or specified */
+   if (!collector_configured(prom->collector))
+   {
+      return NULL;
+   }
+
+   if ((prom->server_query_type == SERVER_QUERY_PRIMARY && config->states[server].state != SERVER_PRIMARY) ||
+       (prom->server_query_type == SERVER_QUERY_REPLICA && config->states[server].state != SERVER_REPLICA))
+   {
+      return NULL;
+   }
+
+   return pgexporter_get_query_alt(prom->root, server);
+}
+
 static int
 resolve_page(struct message* msg)
 {
    char* from = NULL;
+   char* query = NULL;
    int index;
 
    if (msg->length < 3 || strncmp((char*)msg->data, "GET", 3) != 0)
@@ -285,18 +639,169 @@ resolve_page(struct message* msg)
 
    pgexporter_write_byte(msg->data + index, '\0');
 
+   query = strchr(from, '?');
+   if (query != NULL)
+   {
+      *query = '\0';
+      query++;
+   }
+
    if (strcmp(from, "/") == 0 || strcmp(from, "/index.html") == 0)
    {
       return PAGE_HOME;
    }
    else if (strcmp(from, "/metrics") == 0)
    {
+      if (query != NULL && resolve_collectors(query))
+      {
+         return BAD_REQUEST;
+      }
+
       return PAGE_METRICS;
    }
 
    return PAGE_UNKNOWN;
 }
 
+/**
+ * Select the collectors of the scrape from the collect[] and
+ * exclude[] parameters of the query string.
+ * Other parameters are ignored.
+ * @param query The query string
+ * @return 0 upon success, otherwise 1
+ */
+static int
+resolve_collectors(char* query)
+{
+   char* parameter = NULL;
+   char* value = NULL;
+   char* next = NULL;
+
+   number_of_collect = 0;
+   number_of_exclude = 0;
+
+   /* The request is overwritten by the messages of the servers */
+   free(selection);
+   selection = strdup(query);
+
+   if (selection == NULL)
+   {
+      return 1;
+   }
+
+   parameter = selection;
+
+   while (parameter != NULL && *parameter != '\0')
+   {
+      next = strchr(parameter, '&');
+      if (next != NULL)
+      {
+         *next = '\0';
+         next++;
+      }
+
+      value = strchr(parameter, '=');
+      if (value != NULL)
+      {
+         *value = '\0';
+         value++;
+
+         url_decode(parameter);
+         url_decode(value);
+
+         if (!strcmp(parameter, "collect[]") && strlen(value) > 0)
+         {
+            if (number_of_collect >= NUMBER_OF_COLLECTORS)
+            {
+               pgexporter_log_debug("Prometheus: Too many collectors");
+               return 1;
+            }
+
+            collect[number_of_collect++] = value;
+         }
+         else if (!strcmp(parameter, "exclude[]") && strlen(value) > 0)
+         {
+            if (number_of_exclude >= NUMBER_OF_COLLECTORS)
+            {
+               pgexporter_log_debug("Prometheus: Too many excluded collectors");
+               return 1;
+            }
+
+            exclude[number_of_exclude++] = value;
+         }
+      }
+
+      parameter = next;
+   }
+
+   /* The same selection in any order gives the same cached response */
+   collector_sort(collect, &number_of_collect);
+   collector_sort(exclude, &number_of_exclude);
+
+   return 0;
+}
+
+static void
+url_decode(char* s)
+{
+   char* out = s;
+   char hex[3] = {0};
+
+   while (*s != '\0')
+   {
+      if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2]))
+      {
+         hex[0] = s[1];
+         hex[1] = s[2];
+         *out++ = (char)strtol(hex, NULL, 16);
+         s += 3;
+      }
+      else if (*s == '+')
+      {
+         *out++ = ' ';
+         s++;
+      }
+      else
+      {
+         *out++ = *s++;
+      }
+   }
+
+   *out = '\0';
+}
+
+static uint64_t
+scrape_timeout(struct message* msg)
+{
+   char* line = NULL;
+   char* end = NULL;
+   double seconds = 0.0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   line = strchr((char*)msg->data, '\n');
+
+   while (line != NULL)
+   {
+      line++;
+
+      if (!strncasecmp(line, "X-Prometheus-Scrape-Timeout-Seconds:", 36))
+      {
+         seconds = strtod(line + 36, &end);
+
+         if (end != line + 36 && seconds > 0.0)
+         {
+            return (uint64_t)(seconds * 1000000.0);
+         }
+      }
+
+      line = strchr(line, '\n');
+   }
+
+   return (uint64_t)MAX(config->metrics_scrape_timeout, 0) * 1000000;
+}
+
 static int
 badrequest_page(int client_fd)
 {
@@ -493,27 +998,39 @@ error:
 }
 
 static int
-metrics_page(int client_fd)
+metrics_page(int client_fd, uint64_t timeout)
 {
    char* data = NULL;
+   char* body = NULL;
    time_t start_time;
    int dt;
-   time_t now;
-   char time_buf[32];
    int status;
+   bool partial;
+   uint64_t scrape_start;
+   uint64_t collect_start;
+   uint64_t render;
    struct message msg;
    struct prometheus_cache* cache;
+   struct prometheus_statistics* stats;
    signed char cache_is_free;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
 
    memset(&msg, 0, sizeof(struct message));
 
    start_time = time(NULL);
+   scrape_start = pgexporter_get_monotonic_time();
 
-retry_cache_locking:
+   /* A fast level, as the scrape is sent while it is collected */
+   if (gzip && pgexporter_compressor_create(COMPRESSION_CLIENT_GZIP, true, 1, &encoder))
+   {
+      pgexporter_log_warn("Unable to compress the metrics");
+   }
+
+retry_cache_locking:
    cache_is_free = STATE_FREE;
    if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
    {
@@ -526,35 +1043,121 @@ retry_cache_locking:
                               cache->size,
                               cache->valid_until);
 
-         msg.kind = 0;
-         msg.length = strlen(cache->data);
-         msg.data = cache->data;
+         if (stats != NULL)
+         {
+            atomic_fetch_add(&stats->cache_hits, 1);
+         }
 
-         status = pgexporter_write_message(NULL, client_fd, &msg);
-         if (status != MESSAGE_STATUS_OK)
+         if (format == EXPOSITION_TEXT && encoder == NULL)
          {
-            goto error;
+            msg.kind = 0;
+            msg.length = strlen(cache->data);
+            msg.data = cache->data;
+
+            if (stats != NULL)
+            {
+               atomic_fetch_add(&stats->bytes, msg.length);
+            }
+
+            status = pgexporter_write_message(NULL, client_fd, &msg);
+            if (status != MESSAGE_STATUS_OK)
+            {
+               goto error;
+            }
+         }
+         else
+         {
+            /* The cache holds the text exposition, so encode its body */
+            body = strstr(cache->data, "\r\n\r\n");
+            body = body != NULL ? body + 4 : "";
+
+            data = metrics_header(format);
+            if (encoder != NULL)
+            {
+               data = pgexporter_append(data, "Content-Encoding: gzip\r\n");
+            }
+            data = pgexporter_vappend(data, 2,
+                                      "Transfer-Encoding: chunked\r\n",
+                                      "\r\n"
+                                      );
+
+            msg.kind = 0;
+            msg.length = strlen(data);
+            msg.data = data;
+
+            status = pgexporter_write_message(NULL, client_fd, &msg);
+            if (status != MESSAGE_STATUS_OK)
+            {
+               goto error;
+            }
+
+            free(data);
+            data = NULL;
+
+            if (format != EXPOSITION_TEXT)
+            {
+               if (pgexporter_exposition_create(format, &exposition) ||
+                   pgexporter_exposition_append(exposition, body))
+               {
+                  goto error;
+               }
+
+               status = send_exposition(client_fd);
+            }
+            else
+            {
+               status = send_chunk_size(client_fd, body, strlen(body));
+            }
+
+            if (status != MESSAGE_STATUS_OK || send_encoding_end(client_fd) != MESSAGE_STATUS_OK)
+            {
+               goto error;
+            }
+
+            data = pgexporter_append(data, "0\r\n\r\n");
+
+            msg.kind = 0;
+            msg.length = strlen(data);
+            msg.data = data;
+
+            status = pgexporter_write_message(NULL, client_fd, &msg);
+            if (status != MESSAGE_STATUS_OK)
+            {
+               goto error;
+            }
          }
       }
       else
       {
+         if (stats != NULL && is_metrics_cache_configured())
+         {
+            atomic_fetch_add(&stats->cache_misses, 1);
+         }
+
          // build the message without the cache
          metrics_cache_invalidate();
 
-         now = time(NULL);
+         data = metrics_header(EXPOSITION_TEXT);
+         metrics_cache_append(data);  // cache here to avoid the chunking for the cache
+         metrics_cache_append("\r\n"); // and end the headers of the cached response
 
-         memset(&time_buf, 0, sizeof(time_buf));
-         ctime_r(&now, &time_buf[0]);
-         time_buf[strlen(time_buf) - 1] = 0;
+         /* The response is collected as text, and encoded as each collector is done */
+         if (format != EXPOSITION_TEXT)
+         {
+            free(data);
+            data = metrics_header(format);
+
+            if (pgexporter_exposition_create(format, &exposition))
+            {
+               goto error;
+            }
+         }
+
+         if (encoder != NULL)
+         {
+            data = pgexporter_append(data, "Content-Encoding: gzip\r\n");
+         }
 
-         data = pgexporter_vappend(data, 5,
-                                   "HTTP/1.1 200 OK\r\n",
-                                   "Content-Type: text/plain; version=0.0.1; charset=utf-8\r\n",
-                                   "Date: ",
-                                   &time_buf[0],
-                                   "\r\n"
-                                   );
-         metrics_cache_append(data);  // cache here to avoid the chunking for the cache
          data = pgexporter_vappend(data, 2,
                                    "Transfer-Encoding: chunked\r\n",
                                    "\r\n"
@@ -564,6 +1167,11 @@ retry_cache_locking:
          msg.length = strlen(data);
          msg.data = data;
 
+         if (stats != NULL)
+         {
+            atomic_fetch_add(&stats->bytes, msg.length);
+         }
+
          status = pgexporter_write_message(NULL, client_fd, &msg);
          if (status != MESSAGE_STATUS_OK)
          {
@@ -573,22 +1181,58 @@ retry_cache_locking:
          free(data);
          data = NULL;
 
+         scrape_wait = 0;
+         collect_start = pgexporter_get_monotonic_time();
+
+         /* Keep a tenth of the time for the rest of the response */
+         pgexporter_set_query_deadline(timeout > 0 ? scrape_start + timeout - timeout / 10 : 0);
+
          pgexporter_open_connections();
 
          /* General Metric Collector */
          general_information(client_fd);
+         flush_exposition(client_fd);
+         statistics_information(client_fd);
+         flush_exposition(client_fd);
          core_information(client_fd);
+         flush_exposition(client_fd);
          server_information(client_fd);
+         flush_exposition(client_fd);
          version_information(client_fd);
+         flush_exposition(client_fd);
          uptime_information(client_fd);
+         flush_exposition(client_fd);
          primary_information(client_fd);
+         flush_exposition(client_fd);
          settings_information(client_fd);
+         flush_exposition(client_fd);
          extension_information(client_fd);
+         flush_exposition(client_fd);
 
          custom_metrics(client_fd);
+         flush_exposition(client_fd);
+
+         partial_information(client_fd);
 
          pgexporter_close_connections();
 
+         if (exposition != NULL)
+         {
+            status = send_exposition(client_fd);
+            if (status != MESSAGE_STATUS_OK)
+            {
+               goto error;
+            }
+         }
+
+         if (send_encoding_end(client_fd) != MESSAGE_STATUS_OK)
+         {
+            goto error;
+         }
+
+         render = pgexporter_get_monotonic_time() - collect_start;
+         render = render > scrape_wait ? render - scrape_wait : 0;
+
          /* Footer */
          data = pgexporter_append(data, "0\r\n\r\n");
 
@@ -596,17 +1240,42 @@ retry_cache_locking:
          msg.length = strlen(data);
          msg.data = data;
 
+         if (stats != NULL)
+         {
+            statistics_observe(&stats->render, render);
+            atomic_fetch_add(&stats->bytes, msg.length);
+         }
+
          status = pgexporter_write_message(NULL, client_fd, &msg);
          if (status != MESSAGE_STATUS_OK)
          {
             goto error;
          }
 
-         metrics_cache_finalize();
+         partial = false;
+         for (int server = 0; server < config->number_of_servers; server++)
+         {
+            partial = partial || pgexporter_query_partial(server);
+         }
+
+         /* A partial response is not served again */
+         if (partial)
+         {
+            metrics_cache_invalidate();
+         }
+         else
+         {
+            metrics_cache_finalize();
+         }
       }
 
       // free the cache
       atomic_store(&cache->lock, STATE_FREE);
+
+      if (stats != NULL)
+      {
+         statistics_observe(&stats->scrape, pgexporter_get_monotonic_time() - scrape_start);
+      }
    }
    else
    {
@@ -620,17 +1289,52 @@ retry_cache_locking:
       SLEEP_AND_GOTO(10000000L, retry_cache_locking);
    }
 
+   pgexporter_compressor_destroy(encoder);
+   encoder = NULL;
+
    free(data);
 
    return 0;
 
 error:
 
+   pgexporter_exposition_destroy(exposition);
+   exposition = NULL;
+
+   pgexporter_compressor_destroy(encoder);
+   encoder = NULL;
+
    free(data);
 
    return 1;
 }
 
+static char*
+metrics_header(int f)
+{
+   char* data = NULL;
+   time_t now;
+   char time_buf[32];
+
+   now = time(NULL);
+
+   memset(&time_buf, 0, sizeof(time_buf));
+   ctime_r(&now, &time_buf[0]);
+   time_buf[strlen(time_buf) - 1] = 0;
+
+   data = pgexporter_vappend(data, 7,
+                             "HTTP/1.1 200 OK\r\n",
+                             "Content-Type: ",
+                             pgexporter_exposition_content_type(f),
+                             "\r\n",
+                             "Date: ",
+                             &time_buf[0],
+                             "\r\n"
+                             );
+
+   return data;
+}
+
 static int
 bad_request(int client_fd)
 {
@@ -668,7 +1372,7 @@ bad_request(int client_fd)
 }
 
 static bool
-collector_pass(const char* collector)
+collector_configured(const char* collector)
 {
    struct configuration* config = NULL;
 
@@ -690,6 +1394,91 @@ collector_pass(const char* collector)
    return false;
 }
 
+static bool
+collector_pass(const char* collector)
+{
+   bool selected = number_of_collect == 0;
+
+   if (!collector_configured(collector))
+   {
+      return false;
+   }
+
+   for (int i = 0; !selected && i < number_of_collect; i++)
+   {
+      selected = !strcmp(collect[i], collector);
+   }
+
+   for (int i = 0; selected && i < number_of_exclude; i++)
+   {
+      selected = strcmp(exclude[i], collector) != 0;
+   }
+
+   return selected;
+}
+
+/**
+ * Describe the collectors selected by the request, as the key
+ * of the cached response. The names are sorted and unique, so
+ * the key is the same for the same selection
+ * @param key The key
+ * @param size The size of the key
+ * @return true if the key fits
+ */
+static bool
+collector_key(char* key, size_t size)
+{
+   size_t length = 0;
+   char* name = NULL;
+
+   memset(key, 0, size);
+
+   for (int i = 0; i < number_of_collect + number_of_exclude; i++)
+   {
+      name = i < number_of_collect ? collect[i] : exclude[i - number_of_collect];
+
+      if (length + 1 + strlen(name) >= size)
+      {
+         return false;
+      }
+
+      key[length++] = i < number_of_collect ? '+' : '-';
+      memcpy(key + length, name, strlen(name));
+      length += strlen(name);
+   }
+
+   return true;
+}
+
+/**
+ * Sort the names of collectors, and remove the duplicates
+ * @param names The names
+ * @param n The number of names, updated
+ */
+static void
+collector_sort(char** names, int* n)
+{
+   int unique = 0;
+
+   qsort(names, *n, sizeof(char*), collector_compare);
+
+   for (int i = 0; i < *n; i++)
+   {
+      if (unique == 0 || strcmp(names[unique - 1], names[i]))
+      {
+         names[unique++] = names[i];
+      }
+   }
+
+   *n = unique;
+}
+
+static int
+collector_compare(const void* a, const void* b)
+{
+   return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
 static void
 general_information(int client_fd)
 {
@@ -736,85 +1525,288 @@ general_information(int client_fd)
 }
 
 static void
-server_information(int client_fd)
+statistics_information(int client_fd)
 {
    char* data = NULL;
+   char* labels = NULL;
+   struct query_statistics* qs = NULL;
+   struct prometheus_statistics* stats;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+   if (stats == NULL)
+   {
+      return;
+   }
 
    data = pgexporter_vappend(data, 2,
-                             "#HELP pgexporter_postgresql_active The state of PostgreSQL\n",
-                             "#TYPE pgexporter_postgresql_active gauge\n"
-                             );
+                             "#HELP pgexporter_query_duration_seconds The duration of the queries\n",
+                             "#TYPE pgexporter_query_duration_seconds histogram\n");
 
-   for (int server = 0; server < config->number_of_servers; server++)
+   for (int slot = 0; slot < stats->number_of_tags; slot++)
    {
-      data = pgexporter_vappend(data, 3,
-                                "pgexporter_postgresql_active{server=\"",
-                                &config->servers[server].name[0],
-                                "\"} "
-                                );
-      if (config->servers[server].fd != -1)
+      if (atomic_load(&stats->states[slot]) != STATE_IN_USE)
       {
-         data = pgexporter_append(data, "1");
+         continue;
       }
-      else
+
+      for (int server = 0; server < statistics_servers(); server++)
       {
-         data = pgexporter_append(data, "0");
-      }
-      data = pgexporter_append(data, "\n");
-   }
-   data = pgexporter_append(data, "\n");
+         qs = statistics_query(slot, server);
 
-   if (data != NULL)
-   {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+         if (atomic_load(&qs->duration.count) > 0)
+         {
+            labels = pgexporter_vappend(labels, 5,
+                                        "tag=\"",
+                                        &stats->tags[slot][0],
+                                        "\",server=\"",
+                                        &config->servers[server].name[0],
+                                        "\"");
+
+            data = statistics_histogram(data, "pgexporter_query_duration_seconds", labels, &qs->duration);
+
+            free(labels);
+            labels = NULL;
+         }
+      }
    }
-}
 
-static void
-version_information(int client_fd)
-{
-   int ret;
-   int server;
-   char* data = NULL;
-   char* safe_key1 = NULL;
-   char* safe_key2 = NULL;
-   struct query* all = NULL;
-   struct query* query = NULL;
-   struct tuple* current = NULL;
-   struct configuration* config;
+   data = pgexporter_append(data, "\n");
 
-   config = (struct configuration*)shmem;
+   send_chunk(client_fd, data);
+   metrics_cache_append(data);
+   free(data);
+   data = NULL;
 
-   for (server = 0; server < config->number_of_servers; server++)
+   for (int counter = 0; counter < 2; counter++)
    {
-      if (config->servers[server].fd != -1)
+      if (counter == 0)
       {
-         ret = pgexporter_query_version(server, &query);
-         if (ret == 0)
+         data = pgexporter_vappend(data, 2,
+                                   "#HELP pgexporter_query_rows_total The number of rows returned by the queries\n",
+                                   "#TYPE pgexporter_query_rows_total counter\n");
+      }
+      else
+      {
+         data = pgexporter_vappend(data, 2,
+                                   "#HELP pgexporter_query_bytes_total The number of bytes returned by the queries\n",
+                                   "#TYPE pgexporter_query_bytes_total counter\n");
+      }
+
+      for (int slot = 0; slot < stats->number_of_tags; slot++)
+      {
+         if (atomic_load(&stats->states[slot]) != STATE_IN_USE)
          {
-            all = pgexporter_merge_queries(all, query, SORT_NAME);
+            continue;
+         }
+
+         for (int server = 0; server < statistics_servers(); server++)
+         {
+            qs = statistics_query(slot, server);
+
+            if (atomic_load(&qs->duration.count) > 0)
+            {
+               data = pgexporter_vappend(data, 5,
+                                         counter == 0 ? "pgexporter_query_rows_total{tag=\"" : "pgexporter_query_bytes_total{tag=\"",
+                                         &stats->tags[slot][0],
+                                         "\",server=\"",
+                                         &config->servers[server].name[0],
+                                         "\"} ");
+               data = pgexporter_append_ulong(data, atomic_load(counter == 0 ? &qs->rows : &qs->bytes));
+               data = pgexporter_append(data, "\n");
+            }
          }
-         query = NULL;
       }
+
+      data = pgexporter_append(data, "\n");
    }
 
-   if (all != NULL)
+   data = pgexporter_vappend(data, 2,
+                             "#HELP pgexporter_query_timeouts_total The number of queries cancelled at their timeout\n",
+                             "#TYPE pgexporter_query_timeouts_total counter\n");
+
+   for (int slot = 0; slot < stats->number_of_tags; slot++)
    {
-      current = all->tuples;
-      if (current != NULL)
+      if (atomic_load(&stats->states[slot]) != STATE_IN_USE)
       {
-         data = pgexporter_vappend(data, 2,
-                                   "#HELP pgexporter_postgresql_version The PostgreSQL version\n",
-                                   "#TYPE pgexporter_postgresql_version gauge\n"
-                                   );
+         continue;
+      }
 
-         server = 0;
+      for (int server = 0; server < statistics_servers(); server++)
+      {
+         qs = statistics_query(slot, server);
+
+         if (atomic_load(&qs->timeouts) > 0)
+         {
+            data = pgexporter_vappend(data, 5,
+                                      "pgexporter_query_timeouts_total{tag=\"",
+                                      &stats->tags[slot][0],
+                                      "\",server=\"",
+                                      &config->servers[server].name[0],
+                                      "\"} ");
+            data = pgexporter_append_ulong(data, atomic_load(&qs->timeouts));
+            data = pgexporter_append(data, "\n");
+         }
+      }
+   }
+
+   data = pgexporter_append(data, "\n");
+
+   data = pgexporter_vappend(data, 2,
+                             "#HELP pgexporter_connect_duration_seconds The duration of the connects and authentications\n",
+                             "#TYPE pgexporter_connect_duration_seconds histogram\n");
+
+   for (int server = 0; server < statistics_servers(); server++)
+   {
+      if (atomic_load(&config->statistics[server].connect.count) > 0)
+      {
+         labels = pgexporter_vappend(labels, 3,
+                                     "server=\"",
+                                     &config->servers[server].name[0],
+                                     "\"");
+
+         data = statistics_histogram(data, "pgexporter_connect_duration_seconds", labels, &config->statistics[server].connect);
+
+         free(labels);
+         labels = NULL;
+      }
+   }
+
+   data = pgexporter_vappend(data, 3,
+                             "\n",
+                             "#HELP pgexporter_scrape_duration_seconds The duration of the scrapes\n",
+                             "#TYPE pgexporter_scrape_duration_seconds histogram\n");
+   data = statistics_histogram(data, "pgexporter_scrape_duration_seconds", NULL, &stats->scrape);
+
+   data = pgexporter_vappend(data, 3,
+                             "\n",
+                             "#HELP pgexporter_scrape_render_duration_seconds The duration of the scrapes not spent waiting for the servers\n",
+                             "#TYPE pgexporter_scrape_render_duration_seconds histogram\n");
+   data = statistics_histogram(data, "pgexporter_scrape_render_duration_seconds", NULL, &stats->render);
+
+   data = pgexporter_vappend(data, 4,
+                             "\n",
+                             "#HELP pgexporter_scrape_bytes_total The number of bytes written by the scrapes\n",
+                             "#TYPE pgexporter_scrape_bytes_total counter\n",
+                             "pgexporter_scrape_bytes_total ");
+   data = pgexporter_append_ulong(data, atomic_load(&stats->bytes));
+   data = pgexporter_append(data, "\n\n");
+
+   data = pgexporter_vappend(data, 3,
+                             "#HELP pgexporter_cache_hits_total The number of cache hits\n",
+                             "#TYPE pgexporter_cache_hits_total counter\n",
+                             "pgexporter_cache_hits_total{cache=\"metrics\"} ");
+   data = pgexporter_append_ulong(data, atomic_load(&stats->cache_hits));
+   data = pgexporter_append(data, "\npgexporter_cache_hits_total{cache=\"settings\"} ");
+   data = pgexporter_append_ulong(data, atomic_load(&stats->settings_hits));
+   data = pgexporter_append(data, "\n\n");
+
+   data = pgexporter_vappend(data, 3,
+                             "#HELP pgexporter_cache_misses_total The number of cache misses\n",
+                             "#TYPE pgexporter_cache_misses_total counter\n",
+                             "pgexporter_cache_misses_total{cache=\"metrics\"} ");
+   data = pgexporter_append_ulong(data, atomic_load(&stats->cache_misses));
+   data = pgexporter_append(data, "\npgexporter_cache_misses_total{cache=\"settings\"} ");
+   data = pgexporter_append_ulong(data, atomic_load(&stats->settings_misses));
+   data = pgexporter_append(data, "\n\n");
+
+   send_chunk(client_fd, data);
+   metrics_cache_append(data);
+   free(data);
+   data = NULL;
+}
+
+static void
+server_information(int client_fd)
+{
+   char* data = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   data = pgexporter_vappend(data, 2,
+                             "#HELP pgexporter_postgresql_active The state of PostgreSQL\n",
+                             "#TYPE pgexporter_postgresql_active gauge\n"
+                             );
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      data = pgexporter_vappend(data, 3,
+                                "pgexporter_postgresql_active{server=\"",
+                                &config->servers[server].name[0],
+                                "\"} "
+                                );
+      if (config->states[server].fd != -1)
+      {
+         data = pgexporter_append(data, "1");
+      }
+      else
+      {
+         data = pgexporter_append(data, "0");
+      }
+      data = pgexporter_append(data, "\n");
+   }
+   data = pgexporter_append(data, "\n");
+
+   if (data != NULL)
+   {
+      send_chunk(client_fd, data);
+      metrics_cache_append(data);
+      free(data);
+      data = NULL;
+   }
+}
+
+static void
+version_information(int client_fd)
+{
+   int ret;
+   int server;
+   char* data = NULL;
+   char* safe_key1 = NULL;
+   char* safe_key2 = NULL;
+   struct query* all = NULL;
+   struct query* query = NULL;
+   struct query** queries = NULL;
+   struct tuple* current = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   queries = calloc(config->number_of_servers, sizeof(struct query*));
+   if (queries == NULL)
+   {
+      return;
+   }
+
+   for (server = 0; server < config->number_of_servers; server++)
+   {
+      if (config->states[server].fd != -1)
+      {
+         ret = pgexporter_query_version(server, &query);
+         if (ret == 0)
+         {
+            queries[server] = query;
+         }
+         query = NULL;
+      }
+   }
+
+   all = pgexporter_merge_all_queries(&queries[0], config->number_of_servers, SORT_NAME);
+
+   if (all != NULL)
+   {
+      current = all->tuples;
+      if (current != NULL)
+      {
+         data = pgexporter_vappend(data, 2,
+                                   "#HELP pgexporter_postgresql_version The PostgreSQL version\n",
+                                   "#TYPE pgexporter_postgresql_version gauge\n"
+                                   );
+
+         server = 0;
 
          while (current != NULL)
          {
@@ -850,6 +1842,7 @@ version_information(int client_fd)
    }
 
    pgexporter_free_query(all);
+   free(queries);
 }
 
 static void
@@ -861,24 +1854,33 @@ uptime_information(int client_fd)
    char* safe_key = NULL;
    struct query* all = NULL;
    struct query* query = NULL;
+   struct query** queries = NULL;
    struct tuple* current = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
+   queries = calloc(config->number_of_servers, sizeof(struct query*));
+   if (queries == NULL)
+   {
+      return;
+   }
+
    for (server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->states[server].fd != -1)
       {
          ret = pgexporter_query_uptime(server, &query);
          if (ret == 0)
          {
-            all = pgexporter_merge_queries(all, query, SORT_NAME);
+            queries[server] = query;
          }
          query = NULL;
       }
    }
 
+   all = pgexporter_merge_all_queries(&queries[0], config->number_of_servers, SORT_NAME);
+
    if (all != NULL)
    {
       current = all->tuples;
@@ -920,6 +1922,7 @@ uptime_information(int client_fd)
    }
 
    pgexporter_free_query(all);
+   free(queries);
 }
 
 static void
@@ -930,24 +1933,33 @@ primary_information(int client_fd)
    char* data = NULL;
    struct query* all = NULL;
    struct query* query = NULL;
+   struct query** queries = NULL;
    struct tuple* current = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
+   queries = calloc(config->number_of_servers, sizeof(struct query*));
+   if (queries == NULL)
+   {
+      return;
+   }
+
    for (server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->states[server].fd != -1)
       {
          ret = pgexporter_query_primary(server, &query);
          if (ret == 0)
          {
-            all = pgexporter_merge_queries(all, query, SORT_NAME);
+            queries[server] = query;
          }
          query = NULL;
       }
    }
 
+   all = pgexporter_merge_all_queries(&queries[0], config->number_of_servers, SORT_NAME);
+
    if (all != NULL)
    {
       current = all->tuples;
@@ -995,6 +2007,7 @@ primary_information(int client_fd)
    }
 
    pgexporter_free_query(all);
+   free(queries);
 }
 
 static void
@@ -1023,9 +2036,17 @@ core_information(int client_fd)
 static void
 extension_information(int client_fd)
 {
-   bool cont = true;
-   struct query* query = NULL;
-   struct tuple* tuple = NULL;
+   int idx;
+   int inputs;
+   int completed;
+   bool seen;
+   char* sql = NULL;
+   bool* sent = NULL;
+   int* statements = NULL;
+   struct query* batch[NUMBER_OF_EXTENSION_FUNCTIONS * 2];
+   struct query* (*results)[NUMBER_OF_EXTENSION_FUNCTIONS][2] = NULL;
+   struct query** queries = NULL;
+   struct extension_function* function = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
@@ -1037,57 +2058,163 @@ extension_information(int client_fd)
       return;
    }
 
-   for (int server = 0; cont && server < config->number_of_servers; server++)
+   sent = calloc(config->number_of_servers, sizeof(bool));
+   statements = calloc(config->number_of_servers, sizeof(int));
+   results = calloc(config->number_of_servers, sizeof(*results));
+   queries = calloc(config->number_of_servers, sizeof(struct query*));
+
+   if (sent == NULL || statements == NULL || results == NULL || queries == NULL)
+   {
+      goto error;
+   }
+
+   /* Send the batch to all servers first, so they execute it at the same time */
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      if (config->states[server].extension && config->states[server].fd != -1)
+      {
+         if (extension_catalogue(server))
+         {
+            extension_disable(server);
+            continue;
+         }
+
+         statements[server] = extension_batch(server, 0, NUMBER_OF_EXTENSION_FUNCTIONS * 2, &sql);
+
+         if (statements[server] > 0)
+         {
+            if (pgexporter_query_send(server, sql) == 0)
+            {
+               sent[server] = true;
+            }
+            else
+            {
+               extension_disable(server);
+            }
+         }
+
+         free(sql);
+         sql = NULL;
+      }
+   }
+
+   for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].extension && config->servers[server].fd != -1)
+      if (sent[server])
       {
-         pgexporter_query_get_functions(server, &query);
+         if (pgexporter_query_receive(server, "pgexporter_ext", statements[server], &batch[0], &completed))
+         {
+            if (completed < 0)
+            {
+               sent[server] = false;
+               extension_disable(server);
+               continue;
+            }
 
-         if (query != NULL)
+            /* The server skipped the statements after the failing one */
+            extension_retry(server, completed, statements[server], &batch[0]);
+         }
+
+         idx = 0;
+         for (int i = 0; i < config->servers[server].catalogue.number_of_functions; i++)
          {
-            tuple = query->tuples;
+            function = &config->servers[server].catalogue.functions[i];
 
-            while (tuple != NULL)
+            if (!function->input)
+            {
+               results[server][i][0] = batch[idx++];
+            }
+            else
             {
-               if (!strcmp(tuple->data[1], "f") || !strcmp(tuple->data[1], "false"))
+               if (extension_location(server, INPUT_DATA) != NULL)
                {
-                  if (strcmp(tuple->data[0], "pgexporter_get_functions"))
-                  {
-                     extension_function(client_fd, tuple->data[0], false, tuple->data[2], tuple->data[3]);
-                  }
+                  results[server][i][0] = batch[idx++];
                }
-               else
+               if (extension_location(server, INPUT_WAL) != NULL)
                {
-                  if (strcmp(tuple->data[0], "pgexporter_is_supported"))
-                  {
-                     extension_function(client_fd, tuple->data[0], INPUT_DATA, tuple->data[2], tuple->data[3]);
-                     extension_function(client_fd, tuple->data[0], INPUT_WAL, tuple->data[2], tuple->data[3]);
-                  }
+                  results[server][i][1] = batch[idx++];
                }
-
-               tuple = tuple->next;
             }
+         }
+      }
+   }
+
+   /* A function is rendered once for all servers, the first server having it */
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      if (!sent[server])
+      {
+         continue;
+      }
+
+      for (int i = 0; i < config->servers[server].catalogue.number_of_functions; i++)
+      {
+         function = &config->servers[server].catalogue.functions[i];
 
-            cont = false;
+         seen = false;
+         for (int s = 0; !seen && s < server; s++)
+         {
+            seen = sent[s] && extension_lookup(s, &function->name[0]) != -1;
          }
-         else
+
+         if (seen)
          {
-            config->servers[server].extension = false;
-            pgexporter_log_trace("extension_information disabled for server %d", server);
+            continue;
          }
 
-         pgexporter_free_query(query);
-         query = NULL;
+         inputs = function->input ? 2 : 1;
+         for (int slot = 0; slot < inputs; slot++)
+         {
+            memset(queries, 0, config->number_of_servers * sizeof(struct query*));
+
+            for (int s = server; s < config->number_of_servers; s++)
+            {
+               if (sent[s])
+               {
+                  idx = extension_lookup(s, &function->name[0]);
+                  if (idx != -1 && config->servers[s].catalogue.functions[idx].input == function->input)
+                  {
+                     queries[s] = results[s][idx][slot];
+                  }
+               }
+            }
+
+            extension_function(client_fd, &function->name[0],
+                               function->input ? (slot == 0 ? INPUT_DATA : INPUT_WAL) : INPUT_NO,
+                               &function->description[0], &function->type[0], &queries[0]);
+         }
+      }
+   }
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      for (int i = 0; i < NUMBER_OF_EXTENSION_FUNCTIONS; i++)
+      {
+         pgexporter_free_query(results[server][i][0]);
+         pgexporter_free_query(results[server][i][1]);
       }
    }
+
+   free(sent);
+   free(statements);
+   free(results);
+   free(queries);
+
+   return;
+
+error:
+
+   free(sent);
+   free(statements);
+   free(results);
+   free(queries);
 }
 
 static void
-extension_function(int client_fd, char* function, int input, char* description, char* type)
+extension_function(int client_fd, char* function, int input, char* description, char* type, struct query** queries)
 {
    char* data = NULL;
    bool header = false;
-   char* sql = NULL;
    struct query* query = NULL;
    struct tuple* tuple = NULL;
    struct configuration* config;
@@ -1096,189 +2223,395 @@ extension_function(int client_fd, char* function, int input, char* description,
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].extension && config->servers[server].fd != -1)
+      query = queries[server];
+
+      if (query == NULL)
       {
-         bool execute = true;
+         continue;
+      }
 
-         sql = pgexporter_append(sql, "SELECT * FROM ");
-         sql = pgexporter_append(sql, function);
-         sql = pgexporter_append_char(sql, '(');
+      if (!header)
+      {
+         data = pgexporter_append(data, "#HELP ");
+         data = pgexporter_append(data, function);
 
-         if (input != INPUT_NO)
+         if (input == INPUT_DATA)
          {
-            if (input == INPUT_DATA && strlen(config->servers[server].data) > 0)
-            {
-               sql = pgexporter_append_char(sql, '\'');
-               sql = pgexporter_append(sql, config->servers[server].data);
-               sql = pgexporter_append_char(sql, '\'');
-            }
-            else if (input == INPUT_WAL && strlen(config->servers[server].wal) > 0)
-            {
-               sql = pgexporter_append_char(sql, '\'');
-               sql = pgexporter_append(sql, config->servers[server].wal);
-               sql = pgexporter_append_char(sql, '\'');
-            }
-            else
-            {
-               execute = false;
-            }
+            data = pgexporter_append(data, "_data");
          }
-         sql = pgexporter_append(sql, ");");
-
-         if (execute)
+         else if (input == INPUT_WAL)
          {
-            pgexporter_query_execute(server, sql, "pgexporter_ext", &query);
+            data = pgexporter_append(data, "_wal");
          }
 
-         if (query == NULL)
+         data = pgexporter_vappend(data, 3,
+                                   " ",
+                                   description,
+                                   "\n");
+
+         data = pgexporter_append(data, "#TYPE ");
+         data = pgexporter_append(data, function);
+
+         if (input == INPUT_DATA)
          {
-            config->servers[server].extension = false;
+            data = pgexporter_append(data, "_data");
+         }
+         else if (input == INPUT_WAL)
+         {
+            data = pgexporter_append(data, "_wal");
+         }
+
+         data = pgexporter_vappend(data, 3,
+                                   " ",
+                                   type,
+                                   "\n");
 
-            free(sql);
-            sql = NULL;
+         header = true;
+      }
 
-            continue;
+      tuple = query->tuples;
+
+      while (tuple != NULL)
+      {
+         data = pgexporter_append(data, function);
+
+         if (input == INPUT_DATA)
+         {
+            data = pgexporter_append(data, "_data");
          }
+         else if (input == INPUT_WAL)
+         {
+            data = pgexporter_append(data, "_wal");
+         }
+
+         data = pgexporter_vappend(data, 3,
+                                   "{server=\"",
+                                   &config->servers[server].name[0],
+                                   "\"");
 
-         if (!header)
+         if (query->number_of_columns > 0)
          {
-            data = pgexporter_append(data, "#HELP ");
-            data = pgexporter_append(data, function);
+            data = pgexporter_append(data, ", ");
+         }
 
-            if (input == INPUT_DATA)
-            {
-               data = pgexporter_append(data, "_data");
-            }
-            else if (input == INPUT_WAL)
+         if (input == INPUT_NO)
+         {
+            for (int col = 0; col < query->number_of_columns; col++)
             {
-               data = pgexporter_append(data, "_wal");
-            }
+               data = pgexporter_vappend(data, 4,
+                                         query->names[col],
+                                         "=\"",
+                                         tuple->data[col],
+                                         "\"");
 
-            data = pgexporter_vappend(data, 3,
-                                      " ",
-                                      description,
-                                      "\n");
+               if (col < query->number_of_columns - 1)
+               {
+                  data = pgexporter_append(data, ", ");
+               }
+            }
 
-            data = pgexporter_append(data, "#TYPE ");
-            data = pgexporter_append(data, function);
+            data = pgexporter_append(data, "} 1\n");
+         }
+         else
+         {
+            data = pgexporter_append(data, "location=\"");
 
             if (input == INPUT_DATA)
             {
-               data = pgexporter_append(data, "_data");
+               data = pgexporter_append(data, config->servers[server].data);
             }
             else if (input == INPUT_WAL)
             {
-               data = pgexporter_append(data, "_wal");
+               data = pgexporter_append(data, config->servers[server].wal);
             }
 
-            data = pgexporter_vappend(data, 3,
-                                      " ",
-                                      type,
-                                      "\n");
-
-            header = true;
+            data = pgexporter_append(data, "\"} ");
+            data = pgexporter_append(data, tuple->data[0]);
+            data = pgexporter_append(data, "\n");
          }
 
-         config->servers[server].extension = true;
+         tuple = tuple->next;
+      }
+   }
 
-         tuple = query->tuples;
+   if (header)
+   {
+      data = pgexporter_append(data, "\n");
+   }
 
-         while (tuple != NULL)
-         {
-            data = pgexporter_append(data, function);
+   if (data != NULL)
+   {
+      send_chunk(client_fd, data);
+      metrics_cache_append(data);
+      free(data);
+      data = NULL;
+   }
+}
 
-            if (input == INPUT_DATA)
-            {
-               data = pgexporter_append(data, "_data");
-            }
-            else if (input == INPUT_WAL)
-            {
-               data = pgexporter_append(data, "_wal");
-            }
+/**
+ * Read the function catalogue of the pgexporter_ext extension of a server,
+ * unless it is already read for the version of the server
+ * @param server The server
+ * @return 0 upon success, otherwise 1
+ */
+static int
+extension_catalogue(int server)
+{
+   bool input;
+   struct query* query = NULL;
+   struct tuple* tuple = NULL;
+   struct catalogue* catalogue = NULL;
+   struct extension_function* function = NULL;
+   struct configuration* config;
 
-            data = pgexporter_vappend(data, 3,
-                                      "{server=\"",
-                                      &config->servers[server].name[0],
-                                      "\"");
+   config = (struct configuration*)shmem;
+   catalogue = &config->servers[server].catalogue;
 
-            if (query->number_of_columns > 0)
-            {
-               data = pgexporter_append(data, ", ");
-            }
+   if (catalogue->valid && catalogue->version == config->states[server].version)
+   {
+      return 0;
+   }
 
-            if (input == INPUT_NO)
-            {
-               for (int col = 0; col < query->number_of_columns; col++)
-               {
-                  data = pgexporter_vappend(data, 4,
-                                            query->names[col],
-                                            "=\"",
-                                            tuple->data[col],
-                                            "\"");
+   memset(catalogue, 0, sizeof(struct catalogue));
 
-                  if (col < query->number_of_columns - 1)
-                  {
-                     data = pgexporter_append(data, ", ");
-                  }
-               }
+   pgexporter_query_get_functions(server, &query);
 
-               data = pgexporter_append(data, "} 1\n");
-            }
-            else
-            {
-               data = pgexporter_append(data, "location=\"");
+   if (query == NULL)
+   {
+      goto error;
+   }
 
-               if (input == INPUT_DATA)
-               {
-                  data = pgexporter_append(data, config->servers[server].data);
-               }
-               else if (input == INPUT_WAL)
+   tuple = query->tuples;
+
+   while (tuple != NULL)
+   {
+      input = strcmp(tuple->data[1], "f") && strcmp(tuple->data[1], "false");
+
+      if ((!input && !strcmp(tuple->data[0], "pgexporter_get_functions")) ||
+          (input && !strcmp(tuple->data[0], "pgexporter_is_supported")))
+      {
+         tuple = tuple->next;
+         continue;
+      }
+
+      if (catalogue->number_of_functions >= NUMBER_OF_EXTENSION_FUNCTIONS)
+      {
+         pgexporter_log_warn("Too many extension functions for server %s", &config->servers[server].name[0]);
+         break;
+      }
+
+      function = &catalogue->functions[catalogue->number_of_functions];
+
+      snprintf(&function->name[0], MISC_LENGTH, "%s", tuple->data[0]);
+      function->input = input;
+      snprintf(&function->description[0], MISC_LENGTH, "%s", tuple->data[2] != NULL ? tuple->data[2] : "");
+      snprintf(&function->type[0], MISC_LENGTH, "%s", tuple->data[3] != NULL ? tuple->data[3] : "");
+
+      catalogue->number_of_functions++;
+
+      tuple = tuple->next;
+   }
+
+   catalogue->version = config->states[server].version;
+   catalogue->valid = true;
+
+   pgexporter_log_debug("Catalogue: %s (version %d, %d functions)", &config->servers[server].name[0],
+                        catalogue->version, catalogue->number_of_functions);
+
+   pgexporter_free_query(query);
+
+   return 0;
+
+error:
+
+   pgexporter_free_query(query);
+
+   return 1;
+}
+
+static void
+extension_disable(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   /* A query cut short by the scrape deadline says nothing about the extension */
+   if (pgexporter_query_partial(server))
+   {
+      return;
+   }
+
+   config->states[server].extension = false;
+   pgexporter_log_trace("extension_information disabled for server %d", server);
+}
+
+/**
+ * Build the batch of the extension functions of a server, which is
+ * one statement per function, and per location for the functions
+ * taking a location
+ * @param server The server
+ * @param first The first statement
+ * @param count The maximum number of statements
+ * @param sql The resulting SQL
+ * @return The number of statements
+ */
+static int
+extension_batch(int server, int first, int count, char** sql)
+{
+   int n = 0;
+   int statement = 0;
+   int inputs[2] = {INPUT_DATA, INPUT_WAL};
+   char* location = NULL;
+   struct extension_function* function = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *sql = NULL;
+
+   for (int i = 0; i < config->servers[server].catalogue.number_of_functions; i++)
+   {
+      function = &config->servers[server].catalogue.functions[i];
+
+      if (!function->input)
+      {
+         if (statement >= first && n < count)
+         {
+            *sql = pgexporter_vappend(*sql, 3,
+                                      "SELECT * FROM ",
+                                      &function->name[0],
+                                      "();");
+            n++;
+         }
+         statement++;
+      }
+      else
+      {
+         for (int j = 0; j < 2; j++)
+         {
+            location = extension_location(server, inputs[j]);
+
+            if (location != NULL)
+            {
+               if (statement >= first && n < count)
                {
-                  data = pgexporter_append(data, config->servers[server].wal);
+                  *sql = pgexporter_vappend(*sql, 5,
+                                            "SELECT * FROM ",
+                                            &function->name[0],
+                                            "('",
+                                            location,
+                                            "');");
+                  n++;
                }
-
-               data = pgexporter_append(data, "\"} ");
-               data = pgexporter_append(data, tuple->data[0]);
-               data = pgexporter_append(data, "\n");
+               statement++;
             }
-
-            tuple = tuple->next;
          }
+      }
+   }
 
-         free(sql);
-         sql = NULL;
+   return n;
+}
 
-         pgexporter_free_query(query);
-         query = NULL;
+/**
+ * Run the statements of a batch after a failing one, one at a
+ * time, so a failing function only loses its own result
+ * @param server The server
+ * @param failed The failing statement
+ * @param n The number of statements
+ * @param batch The results of the batch
+ */
+static void
+extension_retry(int server, int failed, int n, struct query** batch)
+{
+   int completed;
+   char* sql = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_log_debug("Extension statement %d failed on server %s", failed, &config->servers[server].name[0]);
+
+   for (int i = failed + 1; i < n; i++)
+   {
+      if (extension_batch(server, i, 1, &sql) != 1 || pgexporter_query_send(server, sql))
+      {
+         break;
+      }
+
+      free(sql);
+      sql = NULL;
+
+      if (pgexporter_query_receive(server, "pgexporter_ext", 1, &batch[i], &completed))
+      {
+         if (completed < 0)
+         {
+            break;
+         }
+
+         pgexporter_log_debug("Extension statement %d failed on server %s", i, &config->servers[server].name[0]);
       }
    }
 
-   if (header)
+   free(sql);
+}
+
+static int
+extension_lookup(int server, char* function)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < config->servers[server].catalogue.number_of_functions; i++)
    {
-      data = pgexporter_append(data, "\n");
+      if (!strcmp(&config->servers[server].catalogue.functions[i].name[0], function))
+      {
+         return i;
+      }
    }
 
-   if (data != NULL)
+   return -1;
+}
+
+static char*
+extension_location(int server, int input)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (input == INPUT_DATA && strlen(config->servers[server].data) > 0)
    {
-      send_chunk(client_fd, data);
-      metrics_cache_append(data);
-      free(data);
-      data = NULL;
+      return &config->servers[server].data[0];
+   }
+   else if (input == INPUT_WAL && strlen(config->servers[server].wal) > 0)
+   {
+      return &config->servers[server].wal[0];
    }
+
+   return NULL;
 }
 
 static void
 settings_information(int client_fd)
 {
    int ret;
+   bool cached;
+   bool keep = true;
    char* data = NULL;
    char* safe_key = NULL;
+   int number_of_fingerprints;
+   struct settings_fingerprint* fingerprints = NULL;
    struct query* all = NULL;
    struct query* query = NULL;
+   struct query** queries = NULL;
    struct tuple* current = NULL;
+   struct prometheus_settings* settings;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
+   settings = (struct prometheus_settings*)prometheus_settings_shmem;
 
    /* Expose only if default or specified */
    if (!collector_pass("settings"))
@@ -1286,19 +2619,75 @@ settings_information(int client_fd)
       return;
    }
 
+   /* The servers removed by a reload must not match the block either */
+   number_of_fingerprints = config->number_of_servers;
+   if (settings != NULL)
+   {
+      number_of_fingerprints = MAX(number_of_fingerprints, settings->number_of_servers);
+   }
+
+   fingerprints = calloc(number_of_fingerprints, sizeof(struct settings_fingerprint));
+   queries = calloc(config->number_of_servers, sizeof(struct query*));
+
+   if (fingerprints == NULL || queries == NULL)
+   {
+      goto error;
+   }
+
+   cached = settings != NULL && settings->valid && config->number_of_servers <= settings->number_of_servers;
+   for (int server = 0; server < number_of_fingerprints; server++)
+   {
+      if (server < config->number_of_servers && config->states[server].fd != -1)
+      {
+         settings_fingerprint(server, &fingerprints[server]);
+      }
+
+      if (cached && !same_fingerprint(&fingerprints[server], &settings->fingerprints[server]))
+      {
+         cached = false;
+      }
+   }
+
+   if (prometheus_statistics_shmem != NULL && settings != NULL)
+   {
+      atomic_fetch_add(cached ? &((struct prometheus_statistics*)prometheus_statistics_shmem)->settings_hits
+                       : &((struct prometheus_statistics*)prometheus_statistics_shmem)->settings_misses, 1);
+   }
+
+   if (cached)
+   {
+      pgexporter_log_debug("Serving settings out of cache (%zu bytes)", strlen(settings->data));
+
+      send_chunk(client_fd, settings->data);
+      metrics_cache_append(settings->data);
+
+      free(fingerprints);
+      free(queries);
+
+      return;
+   }
+
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (fingerprints[server].load_time[0] != '\0')
       {
          ret = pgexporter_query_settings(server, &query);
          if (ret == 0)
          {
-            all = pgexporter_merge_queries(all, query, SORT_DATA0);
+            queries[server] = query;
+         }
+         else
+         {
+            memset(&fingerprints[server], 0, sizeof(struct settings_fingerprint));
          }
          query = NULL;
       }
    }
 
+   all = pgexporter_merge_all_queries(&queries[0], config->number_of_servers, SORT_DATA0);
+
+   settings_invalidate();
+
    if (all != NULL)
    {
       current = all->tuples;
@@ -1348,6 +2737,7 @@ data:
 
             send_chunk(client_fd, data);
             metrics_cache_append(data);
+            keep = settings_append(data) && keep;
             free(data);
             data = NULL;
          }
@@ -1360,11 +2750,57 @@ data:
    {
       send_chunk(client_fd, data);
       metrics_cache_append(data);
+      keep = settings_append(data) && keep;
       free(data);
       data = NULL;
    }
 
+   if (keep)
+   {
+      settings_finalize(fingerprints);
+   }
+
    pgexporter_free_query(all);
+
+   free(fingerprints);
+   free(queries);
+
+   return;
+
+error:
+
+   free(fingerprints);
+   free(queries);
+}
+
+static void
+partial_information(int client_fd)
+{
+   char* data = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   data = pgexporter_vappend(data, 2,
+                             "#HELP pgexporter_scrape_partial Are the metrics of the server partial because queries ran out of time\n",
+                             "#TYPE pgexporter_scrape_partial gauge\n"
+                             );
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      data = pgexporter_vappend(data, 4,
+                                "pgexporter_scrape_partial{server=\"",
+                                &config->servers[server].name[0],
+                                "\"} ",
+                                pgexporter_query_partial(server) ? "1\n" : "0\n"
+                                );
+   }
+
+   data = pgexporter_append(data, "\n");
+
+   send_chunk(client_fd, data);
+   metrics_cache_append(data);
+   free(data);
 }
 
 static void
@@ -1378,12 +2814,20 @@ custom_metrics(int client_fd)
    query_list_t* q_list = NULL;
    query_list_t* temp = q_list;
 
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      if (config->states[server].fd != -1 && !is_plan_valid(server))
+      {
+         pgexporter_prometheus_plan(server);
+      }
+   }
+
    // Iterate through each metric to send its query to PostgreSQL server
    for (int i = 0; i < config->number_of_metrics; i++)
    {
       struct prometheus* prom = &config->prometheus[i];
 
-      /* Expose only if default or specified */
+      /* The plan holds the configured collectors, the request may select fewer */
       if (!collector_pass(prom->collector))
       {
          continue;
@@ -1392,20 +2836,13 @@ custom_metrics(int client_fd)
       // Iterate through each server and send appropriate query to PostgreSQL server
       for (int server = 0; server < config->number_of_servers; server++)
       {
-         if (config->servers[server].fd == -1)
-         {
-            /* Skip */
-            continue;
-         }
-
-         if ((prom->server_query_type == SERVER_QUERY_PRIMARY && config->servers[server].state != SERVER_PRIMARY) ||
-             (prom->server_query_type == SERVER_QUERY_REPLICA && config->servers[server].state != SERVER_REPLICA))
+         if (config->states[server].fd == -1 || !is_plan_valid(server))
          {
             /* Skip */
             continue;
          }
 
-         struct query_alts* query_alt = pgexporter_get_query_alt(prom->root, server);
+         struct query_alts* query_alt = config->states[server].plan.query_alts[i];
 
          if (!query_alt)
          {
@@ -1427,36 +2864,27 @@ custom_metrics(int client_fd)
             temp->next = next;
             temp = next;
          }
-         else if (temp && !temp->query)
+         else
          {
             free(next);
             next = NULL;
             memset(temp, 0, sizeof(query_list_t));
          }
 
-         /* Names */
-         char** names = malloc(query_alt->n_columns * sizeof(char*));
-         for (int j = 0; j < query_alt->n_columns; j++)
-         {
-            names[j] = query_alt->columns[j].name;
-         }
          memcpy(temp->tag, prom->tag, MISC_LENGTH);
          temp->query_alt = query_alt;
 
          // Gather all the queries in a linked list, with each query's result (linked list of tuples in it) as a node.
          if (query_alt->is_histogram)
          {
-            temp->error = pgexporter_custom_query(server, query_alt->query, prom->tag, -1, NULL, &temp->query);
+            temp->error = pgexporter_custom_query(server, query_alt->query, prom->tag, -1, NULL, query_alt->timeout, &temp->query);
             temp->sort_type = prom->sort_type;
          }
          else
          {
-            temp->error = pgexporter_custom_query(server, query_alt->query, prom->tag, query_alt->n_columns, names, &temp->query);
+            temp->error = pgexporter_custom_query(server, query_alt->query, prom->tag, query_alt->n_columns, query_alt->names, query_alt->timeout, &temp->query);
             temp->sort_type = prom->sort_type;
          }
-
-         free(names);
-         names = NULL;
       }
    }
 
@@ -1523,47 +2951,145 @@ custom_metrics(int client_fd)
    q_list = NULL;
 }
 
+/**
+ * Decode a PostgreSQL array literal of numbers, like {1,5,10}, in one pass.
+ *
+ * The elements must be numbers, and increasing, or non-decreasing
+ * for cumulative counts.
+ *
+ * @param list The array literal
+ * @param array The array
+ * @param increasing Must the elements be strictly increasing
+ * @return 0 upon success, otherwise 1
+ */
 static int
-parse_list(char* list_str, char** strs, int* n_strs)
+parse_array(char* list, array_t* array, bool increasing)
 {
-   int idx = 0;
-   char* data = NULL;
+   size_t length;
    char* p = NULL;
-   int len = strlen(list_str);
-
-   /**
-    * If the `list_str` is `{c1,c2,c3,...,cn}`, and if the `strlen(list_str)`
-    * is `x`, then it takes `x + 1` bytes in memory including the null character.
-    *
-    * `data` will have `list_str` without the first and last bracket (so `data` will
-    * just be `c1,c2,c3,...,cn`) and thus `strlen(data)` will be `x - 2`, and
-    * so will take `x - 1` bytes in memory including the null character.
-    */
-   data = (char*) malloc((len - 1) * sizeof(char));
-   memset(data, 0, (len - 1) * sizeof(char));
-
-   /**
-    * If list_str is `{c1,c2,c3,...,cn}`, then and if `len(list_str)` is `len`
-    * then this starts from `c1`, and goes for `len - 2`, so till `cn`, so the
-    * `data` string becomes `c1,c2,c3,...,cn`
-    */
-   strncpy(data, list_str + 1, len - 2);
-
-   p = strtok(data, ",");
-   while (p)
-   {
-      strs[idx] = NULL;
-      strs[idx] = pgexporter_append(strs[idx], p);
-      idx++;
-      p = strtok(NULL, ",");
-   }
-
-   *n_strs = idx;
-   free(data);
-   return 0;
-}
+   char* out = NULL;
+   char* end = NULL;
+   char* value = NULL;
+   double number;
 
-static void
+   array->size = 0;
+
+   if (list == NULL)
+   {
+      return 1;
+   }
+
+   length = strlen(list);
+
+   if (length < 2 || list[0] != '{' || list[length - 1] != '}')
+   {
+      return 1;
+   }
+
+   /* The elements and their terminators never take more than the literal */
+   if (array->buffer_size < length)
+   {
+      char* buffer = (char*)realloc(array->buffer, length);
+
+      if (buffer == NULL)
+      {
+         return 1;
+      }
+
+      array->buffer = buffer;
+      array->buffer_size = length;
+   }
+
+   p = list + 1;
+   out = array->buffer;
+
+   while (*p != '}')
+   {
+      value = out;
+
+      if (*p == '"')
+      {
+         p++;
+         while (*p != '"' && *p != '\0')
+         {
+            if (*p == '\\' && *(p + 1) != '\0')
+            {
+               p++;
+            }
+            *out++ = *p++;
+         }
+
+         if (*p != '"')
+         {
+            return 1;
+         }
+         p++;
+      }
+      else
+      {
+         while (*p != ',' && *p != '}' && *p != '\0')
+         {
+            *out++ = *p++;
+         }
+      }
+
+      *out++ = '\0';
+
+      if (*p != ',' && *p != '}')
+      {
+         return 1;
+      }
+
+      number = strtod(value, &end);
+      if (end == value || *end != '\0')
+      {
+         return 1;
+      }
+
+      if (array->size > 0)
+      {
+         if (increasing ? number <= array->numbers[array->size - 1] : number < array->numbers[array->size - 1])
+         {
+            return 1;
+         }
+      }
+
+      if (array->size == array->capacity)
+      {
+         int capacity = array->capacity > 0 ? array->capacity * 2 : 16;
+         char** values = (char**)realloc(array->values, capacity * sizeof(char*));
+         double* numbers = NULL;
+
+         if (values == NULL)
+         {
+            return 1;
+         }
+         array->values = values;
+
+         numbers = (double*)realloc(array->numbers, capacity * sizeof(double));
+         if (numbers == NULL)
+         {
+            return 1;
+         }
+         array->numbers = numbers;
+
+         array->capacity = capacity;
+      }
+
+      array->values[array->size] = value;
+      array->numbers[array->size] = number;
+      array->size++;
+
+      if (*p == ',')
+      {
+         p++;
+      }
+   }
+
+   return 0;
+}
+
+static void
 add_column_to_store(column_store_t* store, int store_idx, char* data, int sort_type, struct tuple* current)
 {
    column_node_t* new_node = malloc(sizeof(column_node_t));
@@ -1629,28 +3155,31 @@ static void
 handle_histogram(column_store_t* store, int* n_store, query_list_t* temp)
 {
    char* data = NULL;
-   char* safe_key = NULL;
+   char* labels = NULL;
+   int columns[MAX_NUMBER_OF_COLUMNS];
+   int indexes[4] = {-1, -1, -1, -1};
+   char* count = NULL;
+   array_t bounds;
+   array_t buckets;
    struct configuration* config;
-   int n_bounds = 0;
-   int n_buckets = 0;
-   char* bounds_arr[MAX_ARR_LENGTH] = {0};
-   char* buckets_arr[MAX_ARR_LENGTH] = {0};
    int idx = 0;
 
    config = (struct configuration*)shmem;
 
-   int h_idx = 0;
-   for (; h_idx < temp->query_alt->n_columns; h_idx++)
+   memset(&bounds, 0, sizeof(array_t));
+   memset(&buckets, 0, sizeof(array_t));
+
+   if (!temp || !temp->query || !temp->query->tuples || temp->query_alt->histogram < 0)
    {
-      if (temp->query_alt->columns[h_idx].type == HISTOGRAM_TYPE)
-      {
-         break;
-      }
+      return;
    }
 
-   if (!temp || !temp->query || !temp->query->tuples)
+   int h_idx = temp->query_alt->histogram;
+
+   /* The label columns are the ones before the histogram */
+   for (int j = 0; j < h_idx; j++)
    {
-      return;
+      columns[j] = j;
    }
 
    struct tuple* tp = temp->query->tuples;
@@ -1679,6 +3208,18 @@ handle_histogram(column_store_t* store, int* n_store, query_list_t* temp)
                                  "_bucket"
                                  );
 
+   /* Resolve the columns once for all the rows */
+   for (int i = 0; i < 4; i++)
+   {
+      indexes[i] = pgexporter_get_column_index(names[i], temp->query);
+
+      if (indexes[i] == -1)
+      {
+         pgexporter_log_error("Histogram %s is missing the %s column", temp->tag, names[i]);
+         goto done;
+      }
+   }
+
    for (; idx < *n_store; idx++)
    {
       if (store[idx].type == HISTOGRAM_TYPE &&
@@ -1699,145 +3240,77 @@ append:
       {
          data = NULL;
 
-         /* bucket */
-         char* bounds_str = pgexporter_get_column_by_name(names[2], temp->query, current);
-         parse_list(bounds_str, bounds_arr, &n_bounds);
+         count = pgexporter_get_column(indexes[1], current);
+
+         /* The bounds must increase, and the buckets are cumulative up to the count */
+         if (parse_array(pgexporter_get_column(indexes[2], current), &bounds, true) ||
+             parse_array(pgexporter_get_column(indexes[3], current), &buckets, false) ||
+             bounds.size != buckets.size ||
+             count == NULL ||
+             (buckets.size > 0 && strtod(count, NULL) < buckets.numbers[buckets.size - 1]))
+         {
+            pgexporter_log_warn("Invalid histogram %s on server %s", temp->tag, &config->servers[current->server].name[0]);
+            current = current->next;
+            continue;
+         }
 
-         char* buckets_str = pgexporter_get_column_by_name(names[3], temp->query, current);
-         parse_list(buckets_str, buckets_arr, &n_buckets);
+         /* The label set is the same for all the series of the row */
+         labels = row_labels(temp->query_alt, &columns[0], h_idx, current);
 
-         for (int i = 0; i < n_bounds; i++)
+         /* bucket */
+         for (int i = 0; i < bounds.size; i++)
          {
             data = pgexporter_vappend(data, 8,
                                       "pgexporter_",
                                       temp->tag,
                                       "_bucket{le=\"",
-                                      bounds_arr[i],
+                                      bounds.values[i],
                                       "\",",
-                                      "server=\"",
-                                      &config->servers[current->server].name[0],
-                                      "\""
-                                      );
-
-            for (int j = 0; j < h_idx; j++)
-            {
-               safe_key = safe_prometheus_key(pgexporter_get_column(j, current));
-               data = pgexporter_vappend(data, 5,
-                                         ",",
-                                         temp->query_alt->columns[j].name,
-                                         "=\"",
-                                         safe_key,
-                                         "\""
-                                         );
-               safe_prometheus_key_free(safe_key);
-            }
-
-            data = pgexporter_vappend(data, 3,
+                                      labels,
                                       "} ",
-                                      buckets_arr[i],
-                                      "\n"
+                                      buckets.values[i]
                                       );
+            data = pgexporter_append_char(data, '\n');
          }
 
-         data = pgexporter_vappend(data, 6,
+         data = pgexporter_vappend(data, 7,
                                    "pgexporter_",
                                    temp->tag,
                                    "_bucket{le=\"+Inf\",",
-                                   "server=\"",
-                                   &config->servers[current->server].name[0],
-                                   "\""
-                                   );
-
-         for (int j = 0; j < h_idx; j++)
-         {
-            safe_key = safe_prometheus_key(pgexporter_get_column(j, current));
-            data = pgexporter_vappend(data, 5,
-                                      ",",
-                                      temp->query_alt->columns[j].name,
-                                      "=\"",
-                                      safe_key,
-                                      "\""
-                                      );
-            safe_prometheus_key_free(safe_key);
-         }
-
-         data = pgexporter_vappend(data, 3,
+                                   labels,
                                    "} ",
-                                   pgexporter_get_column_by_name(names[1], temp->query, current),
+                                   count,
                                    "\n"
                                    );
 
          /* sum */
-         data = pgexporter_vappend(data, 6,
+         data = pgexporter_vappend(data, 7,
                                    "pgexporter_",
                                    temp->tag,
-                                   "_sum",
-                                   "{server=\"",
-                                   &config->servers[current->server].name[0],
-                                   "\""
-                                   );
-
-         for (int j = 0; j < h_idx; j++)
-         {
-            safe_key = safe_prometheus_key(pgexporter_get_column(j, current));
-            data = pgexporter_vappend(data, 5,
-                                      ",",
-                                      temp->query_alt->columns[j].name,
-                                      "=\"",
-                                      safe_key,
-                                      "\""
-                                      );
-            safe_prometheus_key_free(safe_key);
-         }
-
-         data = pgexporter_vappend(data, 3,
+                                   "_sum{",
+                                   labels,
                                    "} ",
-                                   pgexporter_get_column_by_name(names[0], temp->query, current),
+                                   pgexporter_get_column(indexes[0], current),
                                    "\n"
                                    );
 
          /* count */
-         data = pgexporter_vappend(data, 6,
+         data = pgexporter_vappend(data, 7,
                                    "pgexporter_",
                                    temp->tag,
-                                   "_count",
-                                   "{server=\"",
-                                   &config->servers[current->server].name[0],
-                                   "\""
-                                   );
-
-         for (int j = 0; j < h_idx; j++)
-         {
-            safe_key = safe_prometheus_key(pgexporter_get_column(j, current));
-            data = pgexporter_vappend(data, 5,
-                                      ",",
-                                      temp->query_alt->columns[j].name,
-                                      "=\"",
-                                      safe_key,
-                                      "\""
-                                      );
-            safe_prometheus_key_free(safe_key);
-         }
-
-         data = pgexporter_vappend(data, 3,
+                                   "_count{",
+                                   labels,
                                    "} ",
-                                   pgexporter_get_column_by_name(names[1], temp->query, current),
+                                   count,
                                    "\n"
                                    );
 
          add_column_to_store(store, idx, data, temp->sort_type, current);
 
-         current = current->next;
-      }
-
-      for (int i = 0; i < n_bounds; i++)
-      {
-         free(bounds_arr[i]);
-      }
+         free(labels);
+         labels = NULL;
 
-      for (int i = 0; i < n_buckets; i++)
-      {
-         free(buckets_arr[i]);
+         current = current->next;
       }
    }
    else
@@ -1855,11 +3328,10 @@ append:
       store[idx].type = HISTOGRAM_TYPE;
       store[idx].sort_type = temp->sort_type;
       memcpy(store[idx].tag, temp->tag, MISC_LENGTH);
-      memcpy(store[idx].name, temp->query_alt->columns[h_idx].name, MISC_LENGTH);
+      snprintf(store[idx].name, MISC_LENGTH, "%s", temp->query_alt->columns[h_idx].name);
 
       data = NULL;
-      append_help_info(&data, store[idx].tag, "", temp->query_alt->columns[h_idx].description);
-      append_type_info(&data, store[idx].tag, "", temp->query_alt->columns[h_idx].type);
+      data = pgexporter_append(data, temp->query_alt->headers[h_idx]);
 
       add_column_to_store(store, idx, data, SORT_NAME, NULL);
 
@@ -1870,6 +3342,15 @@ append:
       goto append;
    }
 
+done:
+
+   free(bounds.values);
+   free(bounds.numbers);
+   free(bounds.buffer);
+   free(buckets.values);
+   free(buckets.numbers);
+   free(buckets.buffer);
+
    free(names[0]);
    free(names[1]);
    free(names[2]);
@@ -1880,10 +3361,34 @@ append:
 static void
 handle_gauge_counter(column_store_t* store, int* n_store, query_list_t* temp)
 {
+   int n_rows = 0;
+   int row;
    char* data = NULL;
-   char* safe_key = NULL;
-   struct configuration* config;
-   config = (struct configuration*)shmem;
+   char** labels = NULL;
+   struct tuple* tuple = NULL;
+
+   if (!temp || !temp->query || !temp->query->tuples)
+   {
+      return;
+   }
+
+   /* The label set of a row is the same for all the columns of the row */
+   for (tuple = temp->query->tuples; tuple != NULL; tuple = tuple->next)
+   {
+      n_rows++;
+   }
+
+   labels = (char**)malloc(n_rows * sizeof(char*));
+   if (labels == NULL)
+   {
+      return;
+   }
+
+   row = 0;
+   for (tuple = temp->query->tuples; tuple != NULL; tuple = tuple->next)
+   {
+      labels[row++] = row_labels(temp->query_alt, &temp->query_alt->labels[0], temp->query_alt->n_labels, tuple);
+   }
 
    for (int i = 0; i < temp->query_alt->n_columns; i++)
    {
@@ -1917,53 +3422,17 @@ append:
       {
          /* Found Match */
 
-         struct tuple* tuple = temp->query->tuples;
+         tuple = temp->query->tuples;
+         row = 0;
 
          while (tuple)
          {
             data = NULL;
 
-            data = pgexporter_vappend(data, 2,
-                                      "pgexporter_",
-                                      store[idx].tag
-                                      );
-
-            if (strlen(store[idx].name) > 0)
-            {
-               data = pgexporter_vappend(data, 2,
-                                         "_",
-                                         store[idx].name
-                                         );
-
-            }
-
-            data = pgexporter_vappend(data, 3,
-                                      "{server=\"",
-                                      config->servers[temp->query->tuples->server].name,
-                                      "\""
-                                      );
-
-            /* Labels */
-            for (int j = 0; j < temp->query_alt->n_columns; j++)
-            {
-               if (temp->query_alt->columns[j].type != LABEL_TYPE)
-               {
-                  continue;
-               }
-
-               safe_key = safe_prometheus_key(pgexporter_get_column(j, tuple));
-               data = pgexporter_vappend(data, 5,
-                                         ",",
-                                         temp->query_alt->columns[j].name,
-                                         "=\"",
-                                         safe_key,
-                                         "\""
-                                         );
-               safe_prometheus_key_free(safe_key);
-
-            }
-
-            data = pgexporter_vappend(data, 3,
+            data = pgexporter_vappend(data, 6,
+                                      temp->query_alt->metrics[i],
+                                      "{",
+                                      labels[row],
                                       "} ",
                                       get_value(store[idx].tag, store[idx].name, pgexporter_get_column(i, tuple)),
                                       "\n"
@@ -1972,6 +3441,7 @@ append:
             add_column_to_store(store, idx, data, temp->sort_type, tuple);
 
             tuple = tuple->next;
+            row++;
          }
 
       }
@@ -1980,13 +3450,12 @@ append:
          /* New Column */
          (*n_store)++;
 
-         memcpy(store[idx].name, temp->query_alt->columns[i].name, MISC_LENGTH);
+         snprintf(store[idx].name, MISC_LENGTH, "%s", temp->query_alt->columns[i].name);
          store[idx].type = temp->query_alt->columns[i].type;
          memcpy(store[idx].tag, temp->tag, MISC_LENGTH);
 
          data = NULL;
-         append_help_info(&data, store[idx].tag, store[idx].name, temp->query_alt->columns[i].description);
-         append_type_info(&data, store[idx].tag, store[idx].name, temp->query_alt->columns[i].type);
+         data = pgexporter_append(data, temp->query_alt->headers[i]);
 
          add_column_to_store(store, idx, data, SORT_NAME, NULL);
 
@@ -1997,6 +3466,53 @@ append:
          goto append;
       }
    }
+
+   for (row = 0; row < n_rows; row++)
+   {
+      free(labels[row]);
+   }
+   free(labels);
+}
+
+/**
+ * Render the label set of a row, which is the server followed by
+ * the label columns, escaped and without the braces
+ * @param query_alt The query alternative
+ * @param columns The label columns
+ * @param n_columns The number of label columns
+ * @param tuple The row
+ * @return The label set
+ */
+static char*
+row_labels(struct query_alts* query_alt, int* columns, int n_columns, struct tuple* tuple)
+{
+   char* labels = NULL;
+   char* safe_key = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   labels = pgexporter_vappend(labels, 3,
+                               "server=\"",
+                               &config->servers[tuple->server].name[0],
+                               "\"");
+
+   for (int l = 0; l < n_columns; l++)
+   {
+      int j = columns[l];
+
+      safe_key = safe_prometheus_key(pgexporter_get_column(j, tuple));
+      labels = pgexporter_vappend(labels, 5,
+                                  ",",
+                                  query_alt->columns[j].name,
+                                  "=\"",
+                                  safe_key,
+                                  "\""
+                                  );
+      safe_prometheus_key_free(safe_key);
+   }
+
+   return labels;
 }
 
 static void
@@ -2072,44 +3588,272 @@ append_type_info(char** data, char* tag, char* name, int typeId)
    *data = pgexporter_append(*data, "\n");
 }
 
+static int
+compile_query_alts(struct registry* registry, struct prometheus* prom, struct query_alts* query_alt)
+{
+   char* metrics[MAX_NUMBER_OF_COLUMNS] = {0};
+   char* headers[MAX_NUMBER_OF_COLUMNS] = {0};
+   char* name = NULL;
+   size_t size = 0;
+   size_t offset = 0;
+   void* text = NULL;
+
+   if (query_alt == NULL)
+   {
+      return 0;
+   }
+
+   if (compile_query_alts(registry, prom, query_alt->left) || compile_query_alts(registry, prom, query_alt->right))
+   {
+      return 1;
+   }
+
+   query_alt->histogram = -1;
+   query_alt->n_labels = 0;
+
+   for (int i = 0; i < query_alt->n_columns; i++)
+   {
+      query_alt->names[i] = query_alt->columns[i].name;
+      query_alt->metrics[i] = NULL;
+      query_alt->headers[i] = NULL;
+
+      if (query_alt->columns[i].type == LABEL_TYPE)
+      {
+         query_alt->labels[query_alt->n_labels++] = i;
+         continue;
+      }
+
+      if (query_alt->columns[i].type == HISTOGRAM_TYPE)
+      {
+         if (query_alt->histogram == -1)
+         {
+            query_alt->histogram = i;
+         }
+         name = "";
+      }
+      else
+      {
+         name = query_alt->columns[i].name;
+      }
+
+      metrics[i] = pgexporter_append(metrics[i], "pgexporter_");
+      metrics[i] = pgexporter_append(metrics[i], prom->tag);
+      if (strlen(name) > 0)
+      {
+         metrics[i] = pgexporter_vappend(metrics[i], 2, "_", name);
+      }
+
+      append_help_info(&headers[i], prom->tag, name, query_alt->columns[i].description);
+      append_type_info(&headers[i], prom->tag, name, query_alt->columns[i].type);
+
+      size += strlen(metrics[i]) + 1 + strlen(headers[i]) + 1;
+   }
+
+   if (size > 0)
+   {
+      text = pgexporter_registry_allocate(registry, size);
+      if (text == NULL)
+      {
+         goto error;
+      }
+
+      for (int i = 0; i < query_alt->n_columns; i++)
+      {
+         if (metrics[i] == NULL)
+         {
+            continue;
+         }
+
+         query_alt->metrics[i] = (char*)text + offset;
+         memcpy(query_alt->metrics[i], metrics[i], strlen(metrics[i]) + 1);
+         offset += strlen(metrics[i]) + 1;
+
+         query_alt->headers[i] = (char*)text + offset;
+         memcpy(query_alt->headers[i], headers[i], strlen(headers[i]) + 1);
+         offset += strlen(headers[i]) + 1;
+      }
+
+      query_alt->text = text;
+   }
+
+   for (int i = 0; i < MAX_NUMBER_OF_COLUMNS; i++)
+   {
+      free(metrics[i]);
+      free(headers[i]);
+   }
+
+   return 0;
+
+error:
+
+   for (int i = 0; i < MAX_NUMBER_OF_COLUMNS; i++)
+   {
+      free(metrics[i]);
+      free(headers[i]);
+   }
+
+   return 1;
+}
+
+static bool
+is_plan_valid(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return config->states[server].plan.valid &&
+          config->states[server].plan.version == config->states[server].version &&
+          config->states[server].plan.state == config->states[server].state;
+}
+
 static int
 send_chunk(int client_fd, char* data)
+{
+   /* A response in another format is encoded once its families are complete */
+   if (exposition != NULL)
+   {
+      return pgexporter_exposition_append(exposition, data) ? MESSAGE_STATUS_ERROR : MESSAGE_STATUS_OK;
+   }
+
+   return send_chunk_size(client_fd, data, strlen(data));
+}
+
+static int
+send_chunk_size(int client_fd, char* data, size_t size)
+{
+   /* The encoder keeps what it has not compressed yet for the next chunk */
+   if (encoder != NULL)
+   {
+      if (pgexporter_compressor_update(encoder, data, size))
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      return write_chunk(client_fd, encoder->output, encoder->output_size);
+   }
+
+   return write_chunk(client_fd, data, size);
+}
+
+static int
+send_encoding_end(int client_fd)
+{
+   if (encoder == NULL)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   if (pgexporter_compressor_finish(encoder))
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   return write_chunk(client_fd, encoder->output, encoder->output_size);
+}
+
+static int
+write_chunk(int client_fd, void* data, size_t size)
 {
    int status;
+   int offset;
    char* m = NULL;
    struct message msg;
 
    memset(&msg, 0, sizeof(struct message));
 
-   m = malloc(20);
+   /* An empty chunk would end the response */
+   if (size == 0)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   m = malloc(size + 20);
+
+   if (m == NULL)
+   {
+      goto error;
+   }
+
+   offset = sprintf(m, "%zX\r\n", size);
+   memcpy(m + offset, data, size);
+   memcpy(m + offset + size, "\r\n", 2);
+
+   msg.kind = 0;
+   msg.length = offset + size + 2;
+   msg.data = m;
+
+   if (prometheus_statistics_shmem != NULL)
+   {
+      atomic_fetch_add(&((struct prometheus_statistics*)prometheus_statistics_shmem)->bytes, msg.length);
+   }
+
+   status = pgexporter_write_message(NULL, client_fd, &msg);
+
+   free(m);
+
+   return status;
+
+error:
+
+   return MESSAGE_STATUS_ERROR;
+}
+
+static int
+send_exposition(int client_fd)
+{
+   int status;
+   char* data = NULL;
+   size_t size = 0;
+   struct exposition* e = exposition;
+
+   /* From here on the chunks go to the client */
+   exposition = NULL;
+
+   if (pgexporter_exposition_encode(e, &data, &size))
+   {
+      pgexporter_log_error("Unable to encode the metrics");
+      goto error;
+   }
+
+   status = send_chunk_size(client_fd, data, size);
+
+   free(data);
+   pgexporter_exposition_destroy(e);
+
+   return status;
+
+error:
+
+   pgexporter_exposition_destroy(e);
+
+   return MESSAGE_STATUS_ERROR;
+}
+
+static int
+flush_exposition(int client_fd)
+{
+   int status;
+   char* data = NULL;
+   size_t size = 0;
 
-   if (m == NULL)
+   /* A collector writes its families whole, so they are complete once it is done */
+   if (exposition == NULL)
    {
-      goto error;
+      return MESSAGE_STATUS_OK;
    }
 
-   memset(m, 0, 20);
-
-   sprintf(m, "%zX\r\n", strlen(data));
-
-   m = pgexporter_vappend(m, 2,
-                          data,
-                          "\r\n"
-                          );
-
-   msg.kind = 0;
-   msg.length = strlen(m);
-   msg.data = m;
+   if (pgexporter_exposition_flush(exposition, &data, &size))
+   {
+      pgexporter_log_error("Unable to encode the metrics");
+      return MESSAGE_STATUS_ERROR;
+   }
 
-   status = pgexporter_write_message(NULL, client_fd, &msg);
+   status = send_chunk_size(client_fd, data, size);
 
-   free(m);
+   free(data);
 
    return status;
-
-error:
-
-   return MESSAGE_STATUS_ERROR;
 }
 
 static char*
@@ -2267,6 +4011,7 @@ static bool
 is_metrics_cache_valid(void)
 {
    time_t now;
+   char key[MAX_PATH];
 
    struct prometheus_cache* cache;
 
@@ -2277,6 +4022,12 @@ is_metrics_cache_valid(void)
       return false;
    }
 
+   /* The response is only valid for the same collectors */
+   if (!collector_key(&key[0], sizeof(key)) || strcmp(&key[0], &cache->collectors[0]))
+   {
+      return false;
+   }
+
    now = time(NULL);
    return now <= cache->valid_until;
 }
@@ -2367,6 +4118,7 @@ metrics_cache_invalidate(void)
    cache = (struct prometheus_cache*)prometheus_cache_shmem;
 
    memset(cache->data, 0, cache->size);
+   memset(cache->collectors, 0, sizeof(cache->collectors));
    cache->valid_until = 0;
 }
 
@@ -2446,7 +4198,440 @@ metrics_cache_finalize(void)
       return false;
    }
 
+   if (!collector_key(&cache->collectors[0], sizeof(cache->collectors)))
+   {
+      metrics_cache_invalidate();
+      return false;
+   }
+
    now = time(NULL);
    cache->valid_until = now + config->metrics_cache_max_age;
    return cache->valid_until > now;
 }
+
+int
+pgexporter_init_prometheus_settings(size_t* p_size, void** p_shmem)
+{
+   int number_of_servers;
+   struct prometheus_settings* settings;
+   struct configuration* config;
+   size_t struct_size = 0;
+   size_t fingerprints_size = 0;
+
+   config = (struct configuration*)shmem;
+
+   /* Room for the servers added by a reload */
+   number_of_servers = MAX(2 * config->number_of_servers, INITIAL_NUMBER_OF_SERVERS);
+
+   struct_size = sizeof(struct prometheus_settings);
+   fingerprints_size = number_of_servers * sizeof(struct settings_fingerprint);
+
+   if (pgexporter_create_shared_memory(struct_size + PROMETHEUS_SETTINGS_SIZE + fingerprints_size, config->hugepage, (void*) &settings))
+   {
+      goto error;
+   }
+
+   settings->valid = false;
+   settings->number_of_servers = number_of_servers;
+   settings->fingerprints = (void*)(settings->data + PROMETHEUS_SETTINGS_SIZE);
+   settings->size = PROMETHEUS_SETTINGS_SIZE;
+
+   *p_shmem = settings;
+   *p_size = struct_size + PROMETHEUS_SETTINGS_SIZE + fingerprints_size;
+   return 0;
+
+error:
+   pgexporter_log_error("Cannot allocate shared memory for the Prometheus settings!");
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   return 1;
+}
+
+/**
+ * Computes the configuration fingerprint of a server.
+ *
+ * The fingerprint is the time the configuration was loaded and
+ * the time the server was started, so any reload or restart of
+ * the server changes it. A reload of pgexporter that changes the
+ * servers invalidates the rendered settings.
+ *
+ * The fingerprint is left empty if it can't be queried.
+ *
+ * @param server The server
+ * @param fingerprint The fingerprint
+ */
+static void
+settings_fingerprint(int server, struct settings_fingerprint* fingerprint)
+{
+   char* load_time = NULL;
+   char* start_time = NULL;
+   struct query* query = NULL;
+
+   if (pgexporter_query_settings_fingerprint(server, &query) == 0 && query != NULL && query->tuples != NULL)
+   {
+      load_time = pgexporter_get_column(0, query->tuples);
+      start_time = pgexporter_get_column(1, query->tuples);
+
+      if (load_time != NULL && start_time != NULL)
+      {
+         memcpy(&fingerprint->load_time[0], load_time, MIN(strlen(load_time), MISC_LENGTH - 1));
+         memcpy(&fingerprint->start_time[0], start_time, MIN(strlen(start_time), MISC_LENGTH - 1));
+      }
+   }
+
+   pgexporter_free_query(query);
+}
+
+static bool
+same_fingerprint(struct settings_fingerprint* f1, struct settings_fingerprint* f2)
+{
+   return !strcmp(&f1->load_time[0], &f2->load_time[0]) &&
+          !strcmp(&f1->start_time[0], &f2->start_time[0]);
+}
+
+/**
+ * Invalidates the rendered settings.
+ *
+ * Requires the caller to hold the lock on the Prometheus cache!
+ */
+static void
+settings_invalidate(void)
+{
+   struct prometheus_settings* settings;
+
+   settings = (struct prometheus_settings*)prometheus_settings_shmem;
+
+   if (settings == NULL)
+   {
+      return;
+   }
+
+   settings->valid = false;
+   memset(settings->fingerprints, 0, settings->number_of_servers * sizeof(struct settings_fingerprint));
+   settings->data[0] = '\0';
+}
+
+/**
+ * Appends data to the rendered settings.
+ *
+ * Requires the caller to hold the lock on the Prometheus cache!
+ *
+ * If the data does not fit the block is flushed, and
+ * the block must not be finalized.
+ *
+ * @param data the string to append
+ * @return true on success
+ */
+static bool
+settings_append(char* data)
+{
+   size_t origin_length = 0;
+   size_t append_length = 0;
+   struct prometheus_settings* settings;
+
+   settings = (struct prometheus_settings*)prometheus_settings_shmem;
+
+   if (settings == NULL || data == NULL)
+   {
+      return false;
+   }
+
+   origin_length = strlen(settings->data);
+   append_length = strlen(data);
+
+   if (origin_length + append_length >= settings->size)
+   {
+      pgexporter_log_debug("Settings do not fit in the cache (%zu bytes)", settings->size);
+      settings->data[0] = '\0';
+      return false;
+   }
+
+   memcpy(settings->data + origin_length, data, append_length + 1);
+
+   return true;
+}
+
+/**
+ * Marks the rendered settings as valid for the given fingerprints.
+ * The block is not kept when there are more servers than fingerprints.
+ *
+ * Requires the caller to hold the lock on the Prometheus cache!
+ *
+ * @param fingerprints The fingerprints of the servers in the block,
+ * at least as many as the settings have
+ */
+static void
+settings_finalize(struct settings_fingerprint* fingerprints)
+{
+   struct prometheus_settings* settings;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   settings = (struct prometheus_settings*)prometheus_settings_shmem;
+
+   if (settings == NULL || config->number_of_servers > settings->number_of_servers)
+   {
+      return;
+   }
+
+   memcpy(settings->fingerprints, fingerprints, settings->number_of_servers * sizeof(struct settings_fingerprint));
+   settings->valid = strlen(settings->data) > 0;
+}
+
+int
+pgexporter_init_prometheus_statistics(size_t* p_size, void** p_shmem)
+{
+   int number_of_tags;
+   struct prometheus_statistics* stats;
+   struct configuration* config;
+   size_t struct_size = 0;
+   size_t tags_size = 0;
+   size_t states_size = 0;
+
+   config = (struct configuration*)shmem;
+
+   /* Room for the metrics added by a reload */
+   number_of_tags = 2 * config->number_of_metrics + NUMBER_OF_INTERNAL_TAGS;
+
+   struct_size = sizeof(struct prometheus_statistics);
+   tags_size = number_of_tags * MISC_LENGTH;
+   states_size = number_of_tags * sizeof(atomic_schar);
+
+   if (pgexporter_create_shared_memory(struct_size + tags_size + states_size, config->hugepage, (void*) &stats))
+   {
+      goto error;
+   }
+
+   stats->number_of_tags = number_of_tags;
+   atomic_init(&stats->full, false);
+   stats->tags = (void*)((char*)stats + struct_size);
+   stats->states = (atomic_schar*)((char*)stats->tags + tags_size);
+
+   for (int i = 0; i < number_of_tags; i++)
+   {
+      atomic_init(&stats->states[i], STATE_FREE);
+   }
+
+   *p_shmem = stats;
+   *p_size = struct_size + tags_size + states_size;
+
+   /* The servers of a reloaded configuration get theirs when it is compiled */
+   statistics_reserve(config);
+
+   return 0;
+
+error:
+   pgexporter_log_error("Cannot allocate shared memory for the Prometheus statistics!");
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   return 1;
+}
+
+/**
+ * Add an observation to a duration histogram
+ * @param histogram The histogram
+ * @param duration The duration in microseconds
+ */
+static void
+statistics_observe(struct histogram* histogram, uint64_t duration)
+{
+   for (int i = 0; i < NUMBER_OF_BUCKETS; i++)
+   {
+      if (duration <= buckets[i])
+      {
+         atomic_fetch_add(&histogram->buckets[i], 1);
+      }
+   }
+
+   atomic_fetch_add(&histogram->sum, duration);
+   atomic_fetch_add(&histogram->count, 1);
+}
+
+/**
+ * Find the slot of a tag, and claim a free slot
+ * the first time the tag is seen
+ * @param tag The tag
+ * @return The slot, or -1 if all slots are taken
+ */
+static int
+statistics_tag(char* tag)
+{
+   int slot;
+   uint32_t hash = 2166136261u;
+   signed char state;
+   struct prometheus_statistics* stats;
+
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+   for (char* c = tag; *c != '\0'; c++)
+   {
+      hash = (hash ^ (unsigned char)*c) * 16777619u;
+   }
+
+   for (int probe = 0; probe < stats->number_of_tags; probe++)
+   {
+      slot = (hash + probe) % stats->number_of_tags;
+      state = atomic_load(&stats->states[slot]);
+
+      if (state == STATE_FREE)
+      {
+         if (atomic_compare_exchange_strong(&stats->states[slot], &state, TAG_CLAIMED))
+         {
+            snprintf(&stats->tags[slot][0], MISC_LENGTH, "%s", tag);
+            atomic_store(&stats->states[slot], STATE_IN_USE);
+            return slot;
+         }
+         state = atomic_load(&stats->states[slot]);
+      }
+
+      if (state == STATE_IN_USE && !strncmp(&stats->tags[slot][0], tag, MISC_LENGTH - 1))
+      {
+         return slot;
+      }
+   }
+
+   if (!atomic_exchange(&stats->full, true))
+   {
+      pgexporter_log_warn("Unable to track the statistics of %s, all %d tags are taken", tag, stats->number_of_tags);
+   }
+
+   return -1;
+}
+
+/**
+ * Get the statistics of a tag slot on a server
+ * @param stats The statistics
+ * @param slot The tag slot
+ * @param server The server
+ * @return The query statistics
+ */
+static struct query_statistics*
+statistics_query(int slot, int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return &config->statistics[server].queries[slot];
+}
+
+/**
+ * Get the number of servers whose statistics are tracked
+ * @return The number of servers
+ */
+static int
+statistics_servers(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (prometheus_statistics_shmem == NULL || config->statistics == NULL)
+   {
+      return 0;
+   }
+
+   return config->number_of_servers;
+}
+
+/**
+ * Allocate the statistics of the servers of a configuration
+ * in its registry. The servers are not tracked if there is
+ * no room for them.
+ * @param config The configuration
+ * @return 0 upon success, otherwise 1
+ */
+static int
+statistics_reserve(struct configuration* config)
+{
+   struct query_statistics* queries = NULL;
+   struct prometheus_statistics* stats;
+
+   stats = (struct prometheus_statistics*)prometheus_statistics_shmem;
+
+   config->statistics = NULL;
+
+   if (stats == NULL || config->number_of_servers == 0)
+   {
+      return 0;
+   }
+
+   config->statistics = pgexporter_registry_allocate(config->registry, config->number_of_servers * sizeof(struct server_statistics));
+   queries = pgexporter_registry_allocate(config->registry, (size_t)config->number_of_servers * stats->number_of_tags * sizeof(struct query_statistics));
+
+   if (config->statistics == NULL || queries == NULL)
+   {
+      pgexporter_log_warn("Unable to track the statistics of %d servers", config->number_of_servers);
+      config->statistics = NULL;
+      return 1;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      config->statistics[i].queries = queries + (size_t)i * stats->number_of_tags;
+   }
+
+   return 0;
+}
+
+static char*
+statistics_histogram(char* data, char* name, char* labels, struct histogram* histogram)
+{
+   for (int i = 0; i < NUMBER_OF_BUCKETS; i++)
+   {
+      data = pgexporter_vappend(data, 4,
+                                name,
+                                "_bucket{le=\"",
+                                bucket_names[i],
+                                "\"");
+      if (labels != NULL)
+      {
+         data = pgexporter_vappend(data, 2, ",", labels);
+      }
+      data = pgexporter_append(data, "} ");
+      data = pgexporter_append_ulong(data, atomic_load(&histogram->buckets[i]));
+      data = pgexporter_append(data, "\n");
+   }
+
+   data = pgexporter_vappend(data, 2, name, "_bucket{le=\"+Inf\"");
+   if (labels != NULL)
+   {
+      data = pgexporter_vappend(data, 2, ",", labels);
+   }
+   data = pgexporter_append(data, "} ");
+   data = pgexporter_append_ulong(data, atomic_load(&histogram->count));
+   data = pgexporter_append(data, "\n");
+
+   data = pgexporter_vappend(data, 2, name, "_sum");
+   if (labels != NULL)
+   {
+      data = pgexporter_vappend(data, 3, "{", labels, "}");
+   }
+   data = pgexporter_append(data, " ");
+   data = statistics_seconds(data, atomic_load(&histogram->sum));
+   data = pgexporter_append(data, "\n");
+
+   data = pgexporter_vappend(data, 2, name, "_count");
+   if (labels != NULL)
+   {
+      data = pgexporter_vappend(data, 3, "{", labels, "}");
+   }
+   data = pgexporter_append(data, " ");
+   data = pgexporter_append_ulong(data, atomic_load(&histogram->count));
+   data = pgexporter_append(data, "\n");
+
+   return data;
+}
+
+static char*
+statistics_seconds(char* data, uint64_t duration)
+{
+   char buf[32];
+
+   memset(&buf, 0, sizeof(buf));
+   snprintf(&buf[0], sizeof(buf), "%" PRIu64 ".%06" PRIu64, duration / 1000000, duration % 1000000);
+
+   return pgexporter_append(data, &buf[0]);
+}
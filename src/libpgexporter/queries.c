@@ -33,26 +33,53 @@
 #include <logging.h>
 #include <message.h>
 #include <network.h>
+#include <prometheus.h>
 #include <queries.h>
 #include <security.h>
 #include <server.h>
 #include <utils.h>
 
 /* system */
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/* The time a cancelled query has to end its response, in microseconds */
+#define CANCEL_TIMEOUT 250000
 
 static int query_execute(int server, char* qs, char* tag, int columns, char* names[], struct query** query);
-static void* data_append(void* orig, size_t orig_size, void* n, size_t n_size);
+static int query_send(int server, char* qs);
+static int query_receive(int server, void** data, size_t* data_size);
+static void query_cancel(int server);
+static bool query_states(int server);
+static uint64_t query_server_deadline(int server);
 static int create_D_tuple(int server, int number_of_columns, struct message* msg, struct tuple** tuple);
 static int get_number_of_columns(struct message* msg);
 static int get_column_name(struct message* msg, int index, char** name);
 static int process_server_parameters(int server, struct deque* server_parameters);
+static struct tuple* concat_tuples(struct query** queries, int n);
+static int merge_tuples(struct query** queries, int n, struct tuple** tuples);
+static int compare_tuples(struct tuple* t1, struct tuple* t2);
+static bool is_sorted_tuples(struct tuple* tuples);
+static struct tuple* sort_tuples(struct tuple* tuples);
+static void sift_down_tuples(struct tuple** heads, int* heap, int size, int i);
+
+static uint64_t query_deadline = 0;
+static uint64_t query_share = 0;
+static uint64_t statement_deadline = 0;
+static int number_of_states = 0;
+static bool* query_partial = NULL;
+static bool* query_cancelled = NULL;
+static uint64_t* query_spent = NULL;
 
 void
 pgexporter_open_connections(void)
 {
    int ret;
    int user;
+   int connected = 0;
+   uint64_t start;
+   uint64_t now;
    struct configuration* config;
    struct deque* server_parameters;
 
@@ -60,16 +87,16 @@ pgexporter_open_connections(void)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->states[server].fd != -1)
       {
-         if (!pgexporter_connection_isvalid(config->servers[server].ssl, config->servers[server].fd))
+         if (!pgexporter_connection_isvalid(config->states[server].ssl, config->states[server].fd))
          {
-            pgexporter_disconnect(config->servers[server].fd);
-            config->servers[server].fd = -1;
+            pgexporter_disconnect(config->states[server].fd);
+            config->states[server].fd = -1;
          }
       }
 
-      if (config->servers[server].fd == -1)
+      if (config->states[server].fd == -1)
       {
          user = -1;
          for (int usr = 0; user == -1 && usr < config->number_of_users; usr++)
@@ -80,27 +107,46 @@ pgexporter_open_connections(void)
             }
          }
 
-         config->servers[server].new = false;
+         config->states[server].new = false;
+
+         start = pgexporter_get_monotonic_time();
 
          ret = pgexporter_server_authenticate(server, "postgres",
                                               &config->users[user].username[0], &config->users[user].password[0],
-                                              &config->servers[server].ssl,
-                                              &config->servers[server].fd);
+                                              &config->states[server].ssl,
+                                              &config->states[server].fd);
+
+         pgexporter_prometheus_connect(server, pgexporter_get_monotonic_time() - start);
+
          if (ret == AUTH_SUCCESS)
          {
-            config->servers[server].new = true;
+            config->states[server].new = true;
+            pgexporter_extract_backend_key(&config->states[server].backend_pid, &config->states[server].backend_secret);
             pgexporter_server_info(server);
             if (!pgexporter_extract_server_parameters(&server_parameters))
             {
                process_server_parameters(server, server_parameters);
                pgexporter_deque_destroy(server_parameters);
             }
+            pgexporter_prometheus_plan(server);
          }
          else
          {
             pgexporter_log_error("Failed login for '%s' on server '%s'", &config->users[user].username, &config->servers[server].name);
          }
       }
+
+      if (config->states[server].fd != -1)
+      {
+         connected++;
+      }
+   }
+
+   /* The servers are queried one after the other, so each gets a share of the time left */
+   if (query_deadline > 0 && connected > 0)
+   {
+      now = pgexporter_get_monotonic_time();
+      query_share = query_deadline > now ? (query_deadline - now) / connected : 0;
    }
 }
 
@@ -115,23 +161,24 @@ pgexporter_close_connections(void)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->states[server].fd != -1)
       {
          nuke = true;
 
-         if (config->cache)
+         /* A cancelled connection may still have a response on the way */
+         if (config->cache && !(query_states(server) && query_cancelled[server]))
          {
-            if (config->servers[server].new)
+            if (config->states[server].new)
             {
                ret = pgexporter_transfer_connection_write(server);
 
                if (ret == 0)
                {
-                  config->servers[server].new = false;
+                  config->states[server].new = false;
                }
             }
 
-            if (!config->servers[server].new)
+            if (!config->states[server].new)
             {
                nuke = false;
             }
@@ -139,19 +186,19 @@ pgexporter_close_connections(void)
 
          if (nuke)
          {
-            pgexporter_write_terminate(config->servers[server].ssl, config->servers[server].fd);
-            if (config->servers[server].ssl != NULL)
+            pgexporter_write_terminate(config->states[server].ssl, config->states[server].fd);
+            if (config->states[server].ssl != NULL)
             {
-               pgexporter_close_ssl(config->servers[server].ssl);
+               pgexporter_close_ssl(config->states[server].ssl);
             }
             else
             {
-               pgexporter_disconnect(config->servers[server].fd);
+               pgexporter_disconnect(config->states[server].fd);
             }
-            config->servers[server].ssl = NULL;
-            config->servers[server].fd = -1;
-            config->servers[server].new = false;
-            config->servers[server].state = SERVER_UNKNOWN;
+            config->states[server].ssl = NULL;
+            config->states[server].fd = -1;
+            config->states[server].new = false;
+            config->states[server].state = SERVER_UNKNOWN;
          }
       }
    }
@@ -178,6 +225,167 @@ pgexporter_query_execute(int server, char* sql, char* tag, struct query** query)
    return query_execute(server, sql, tag, -1, NULL, query);
 }
 
+void
+pgexporter_set_query_deadline(uint64_t deadline)
+{
+   query_deadline = deadline;
+   query_share = 0;
+
+   if (number_of_states > 0)
+   {
+      memset(query_partial, 0, number_of_states * sizeof(bool));
+      memset(query_cancelled, 0, number_of_states * sizeof(bool));
+      memset(query_spent, 0, number_of_states * sizeof(uint64_t));
+   }
+}
+
+bool
+pgexporter_query_partial(int server)
+{
+   return query_states(server) && query_partial[server];
+}
+
+int
+pgexporter_query_send(int server, char* sql)
+{
+   return query_send(server, sql);
+}
+
+int
+pgexporter_query_receive(int server, char* tag, int n, struct query** queries, int* completed)
+{
+   int idx = 0;
+   int cols = 0;
+   unsigned long rows = 0;
+   uint64_t start;
+   char* name = NULL;
+   struct message msg;
+   struct query* q = NULL;
+   struct tuple* current = NULL;
+   void* data = NULL;
+   size_t data_size = 0;
+   size_t offset = 0;
+
+   *completed = -1;
+
+   for (int i = 0; i < n; i++)
+   {
+      queries[i] = NULL;
+   }
+
+   start = pgexporter_get_monotonic_time();
+
+   if (query_receive(server, &data, &data_size))
+   {
+      goto error;
+   }
+
+   *completed = 0;
+
+   /* Each statement gives a RowDescription, its DataRows and a CommandComplete */
+   while (offset < data_size)
+   {
+      offset = pgexporter_view_message_offset(offset, data, &msg);
+
+      if (msg.kind == 'E')
+      {
+         /* The server skips the rest of the query, so only the completed statements are kept */
+         for (int i = *completed; i < n; i++)
+         {
+            pgexporter_free_query(queries[i]);
+            queries[i] = NULL;
+         }
+
+         free(data);
+
+         return 1;
+      }
+      else if (msg.kind == 'T')
+      {
+         if (idx >= n)
+         {
+            goto error;
+         }
+
+         cols = get_number_of_columns(&msg);
+
+         q = (struct query*)malloc(sizeof(struct query));
+         memset(q, 0, sizeof(struct query));
+
+         q->number_of_columns = cols;
+         memcpy(&q->tag[0], tag, strlen(tag));
+
+         queries[idx++] = q;
+         current = NULL;
+
+         for (int i = 0; i < cols; i++)
+         {
+            if (get_column_name(&msg, i, &name))
+            {
+               goto error;
+            }
+
+            memcpy(&q->names[i][0], name, strlen(name));
+
+            free(name);
+            name = NULL;
+         }
+      }
+      else if (msg.kind == 'D' && q != NULL)
+      {
+         struct tuple* dtuple = NULL;
+
+         create_D_tuple(server, cols, &msg, &dtuple);
+
+         if (q->tuples == NULL)
+         {
+            q->tuples = dtuple;
+         }
+         else
+         {
+            current->next = dtuple;
+         }
+
+         current = dtuple;
+         rows++;
+      }
+      else if (msg.kind == 'C')
+      {
+         if (q != NULL)
+         {
+            *completed = idx;
+         }
+
+         q = NULL;
+      }
+   }
+
+   if (idx != n)
+   {
+      goto error;
+   }
+
+   pgexporter_prometheus_query(server, tag, pgexporter_get_monotonic_time() - start, rows, data_size);
+
+   free(data);
+
+   return 0;
+
+error:
+
+   *completed = -1;
+
+   for (int i = 0; i < n; i++)
+   {
+      pgexporter_free_query(queries[i]);
+      queries[i] = NULL;
+   }
+
+   free(data);
+
+   return 1;
+}
+
 int
 pgexporter_query_used_disk_space(int server, bool data, struct query** query)
 {
@@ -407,88 +615,81 @@ pgexporter_query_settings(int server, struct query** query)
 }
 
 int
-pgexporter_custom_query(int server, char* qs, char* tag, int columns, char** names, struct query** query)
+pgexporter_query_settings_fingerprint(int server, struct query** query)
 {
-   return query_execute(server, qs, tag, columns, names, query);
+   return query_execute(server, "SELECT pg_conf_load_time(), pg_postmaster_start_time();",
+                        "pg_settings_fingerprint", 2, NULL, query);
 }
 
-struct query*
-pgexporter_merge_queries(struct query* q1, struct query* q2, int sort)
+int
+pgexporter_custom_query(int server, char* qs, char* tag, int columns, char** names, int timeout, struct query** query)
 {
-   struct tuple* last = NULL;
-   struct tuple* ct1 = NULL;
-   struct tuple* ct2 = NULL;
-   struct tuple* tmp1 = NULL;
-   struct tuple* tmp2 = NULL;
+   int ret;
+   uint64_t deadline;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
-   if (q1 == NULL)
+   statement_deadline = timeout > 0 ? pgexporter_get_monotonic_time() + (uint64_t)timeout * 1000 : 0;
+   deadline = query_server_deadline(server);
+
+   ret = query_execute(server, qs, tag, columns, names, query);
+
+   /* Only count the timeouts of the query, not the ones of the scrape */
+   if (ret != 0 && statement_deadline > 0 && (deadline == 0 || statement_deadline < deadline) &&
+       pgexporter_get_monotonic_time() >= statement_deadline)
    {
-      return q2;
+      pgexporter_log_warn("Query %s timed out after %dms on server %s", tag, timeout, &config->servers[server].name[0]);
+      pgexporter_prometheus_timeout(server, tag);
    }
 
-   if (q2 == NULL)
+   statement_deadline = 0;
+
+   return ret;
+}
+
+struct query*
+pgexporter_merge_all_queries(struct query** queries, int n, int sort)
+{
+   struct tuple* tuples = NULL;
+   struct query* result = NULL;
+
+   for (int i = 0; i < n && result == NULL; i++)
    {
-      return q1;
+      result = queries[i];
    }
 
-   ct1 = q1->tuples;
-   ct2 = q2->tuples;
+   if (result == NULL)
+   {
+      return NULL;
+   }
 
-   if (sort == SORT_NAME)
+   if (sort == SORT_DATA0)
    {
-      while (ct1 != NULL)
+      if (merge_tuples(queries, n, &tuples))
       {
-         last = ct1;
-         ct1 = ct1->next;
+         pgexporter_log_error("Unable to merge the queries for %s", &result->tag[0]);
+         tuples = concat_tuples(queries, n);
       }
-
-      last->next = ct2;
    }
    else
    {
+      tuples = concat_tuples(queries, n);
+   }
 
-      if (ct1 != NULL)
-      {
-         while (ct1 != NULL && ct2 != NULL)
-         {
-
-            tmp1 = ct1;
-
-            if (strcmp(tmp1->data[0], ct2->data[0]))
-            {
-               while (tmp1 != NULL && tmp1->next != NULL && strcmp(tmp1->next->data[0], ct2->data[0]))
-               {
-                  tmp1 = tmp1->next;
-               }
-            }
-            while (tmp1 != NULL && tmp1->next != NULL && !strcmp(tmp1->next->data[0], ct2->data[0]))
-            {
-               tmp1 = tmp1->next;
-            }
-
-            if (tmp1 == NULL)
-            {
-               continue;
-            }
-
-            tmp2 = ct2->next;
-
-            ct2->next = tmp1->next;
-            tmp1->next = ct2;
-            ct2 = tmp2;
-         }
-      }
-      else
+   for (int i = 0; i < n; i++)
+   {
+      if (queries[i] != NULL && queries[i] != result)
       {
-         ct1 = ct2;
-         ct2 = NULL;
+         queries[i]->tuples = NULL;
+         pgexporter_free_query(queries[i]);
       }
+      queries[i] = NULL;
    }
 
-   q2->tuples = NULL;
-   pgexporter_free_query(q2);
+   result->tuples = tuples;
 
-   return q1;
+   return result;
 }
 
 int
@@ -564,85 +765,55 @@ pgexporter_query_debug(struct query* query)
    pgexporter_log_trace("Tuples: %d", number_of_tuples);
 }
 
-char*
-pgexporter_get_column_by_name(char* name, struct query* query, struct tuple* tuple)
+int
+pgexporter_get_column_index(char* name, struct query* query)
 {
    for (int i = 0; i < query->number_of_columns; i++)
    {
       if (!strcmp(query->names[i], name))
       {
-         return pgexporter_get_column(i, tuple);
+         return i;
       }
    }
 
-   return NULL;
+   return -1;
+}
+
+char*
+pgexporter_get_column_by_name(char* name, struct query* query, struct tuple* tuple)
+{
+   int i = pgexporter_get_column_index(name, query);
+
+   return i != -1 ? pgexporter_get_column(i, tuple) : NULL;
 }
 
 static int
 query_execute(int server, char* qs, char* tag, int columns, char* names[], struct query** query)
 {
-   int status;
-   bool cont;
    int cols;
+   unsigned long rows = 0;
+   uint64_t start;
    char* name = NULL;
-   struct message qmsg = {0};
    struct message* tmsg = NULL;
-   size_t size = 0;
-   char* content = NULL;
-   struct message* msg = NULL;
+   struct message msg;
    struct query* q = NULL;
    struct tuple* current = NULL;
    void* data = NULL;
    size_t data_size = 0;
    size_t offset = 0;
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
 
    *query = NULL;
 
-   memset(&qmsg, 0, sizeof(struct message));
-
-   size = 1 + 4 + strlen(qs) + 1;
-   content = (char*)malloc(size);
-   memset(content, 0, size);
-
-   pgexporter_write_byte(content, 'Q');
-   pgexporter_write_int32(content + 1, size - 1);
-   pgexporter_write_string(content + 5, qs);
-
-   qmsg.kind = 'Q';
-   qmsg.length = size;
-   qmsg.data = content;
+   start = pgexporter_get_monotonic_time();
 
-   status = pgexporter_write_message(config->servers[server].ssl, config->servers[server].fd, &qmsg);
-   if (status != MESSAGE_STATUS_OK)
+   if (query_send(server, qs))
    {
       goto error;
    }
 
-   cont = true;
-   while (cont)
+   if (query_receive(server, &data, &data_size))
    {
-      status = pgexporter_read_block_message(config->servers[server].ssl, config->servers[server].fd, &msg);
-
-      if (status == MESSAGE_STATUS_OK)
-      {
-         data = data_append(data, data_size, msg->data, msg->length);
-         data_size += msg->length;
-
-         if (pgexporter_has_message('Z', data, data_size))
-         {
-            cont = false;
-         }
-      }
-      else
-      {
-         goto error;
-      }
-
-      pgexporter_clear_message(msg);
-      msg = NULL;
+      goto error;
    }
 
    if (pgexporter_has_message('E', data, data_size))
@@ -692,13 +863,13 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
 
    while (offset < data_size)
    {
-      offset = pgexporter_extract_message_offset(offset, data, &msg);
+      offset = pgexporter_view_message_offset(offset, data, &msg);
 
-      if (msg != NULL && msg->kind == 'D')
+      if (msg.kind == 'D')
       {
          struct tuple* dtuple = NULL;
 
-         create_D_tuple(server, cols, msg, &dtuple);
+         create_D_tuple(server, cols, &msg, &dtuple);
 
          if (q->tuples == NULL)
          {
@@ -710,43 +881,337 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
          }
 
          current = dtuple;
+         rows++;
       }
-
-      pgexporter_free_message(msg);
-      msg = NULL;
    }
 
+   pgexporter_prometheus_query(server, tag, pgexporter_get_monotonic_time() - start, rows, data_size);
+
    *query = q;
 
    pgexporter_free_message(tmsg);
 
-   free(content);
    free(data);
 
    return 0;
 
 error:
 
-   pgexporter_clear_message(msg);
    pgexporter_free_message(tmsg);
-   free(content);
    free(data);
 
    return 1;
 }
 
-static void*
-data_append(void* orig, size_t orig_size, void* n, size_t n_size)
+static int
+query_send(int server, char* qs)
 {
+   int status;
+   size_t size = 0;
+   uint64_t deadline;
+   char* content = NULL;
+   struct message qmsg = {0};
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!query_states(server))
+   {
+      return 1;
+   }
+
+   if (query_cancelled[server])
+   {
+      query_partial[server] = true;
+      return 1;
+   }
+
+   deadline = query_server_deadline(server);
+   if (deadline > 0 && pgexporter_get_monotonic_time() >= deadline)
+   {
+      query_partial[server] = true;
+      return 1;
+   }
+
+   memset(&qmsg, 0, sizeof(struct message));
+
+   size = 1 + 4 + strlen(qs) + 1;
+   content = (char*)malloc(size);
+   memset(content, 0, size);
+
+   pgexporter_write_byte(content, 'Q');
+   pgexporter_write_int32(content + 1, size - 1);
+   pgexporter_write_string(content + 5, qs);
+
+   qmsg.kind = 'Q';
+   qmsg.length = size;
+   qmsg.data = content;
+
+   status = pgexporter_write_message(config->states[server].ssl, config->states[server].fd, &qmsg);
+
+   free(content);
+
+   return status == MESSAGE_STATUS_OK ? 0 : 1;
+}
+
+static int
+query_receive(int server, void** data, size_t* data_size)
+{
+   int status;
+   bool cont;
+   size_t capacity = 0;
+   size_t offset = 0;
+   size_t length = 0;
+   int32_t m_length;
    void* d = NULL;
+   bool cancelled = false;
+   uint64_t start;
+   uint64_t scrape;
+   uint64_t deadline;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *data = NULL;
+   *data_size = 0;
+
+   if (!query_states(server))
+   {
+      return 1;
+   }
+
+   start = pgexporter_get_monotonic_time();
+
+   scrape = query_server_deadline(server);
+   deadline = scrape;
+   if (statement_deadline > 0 && (deadline == 0 || statement_deadline < deadline))
+   {
+      deadline = statement_deadline;
+   }
+
+   cont = true;
+   while (cont)
+   {
+      /* Read straight into the buffer, which doubles when it runs low */
+      if (capacity - *data_size < DEFAULT_BUFFER_SIZE)
+      {
+         capacity = MAX(capacity * 2, *data_size + DEFAULT_BUFFER_SIZE);
+
+         d = realloc(*data, capacity);
+         if (d == NULL)
+         {
+            goto error;
+         }
+
+         *data = d;
+      }
+
+      status = pgexporter_read_deadline_data(config->states[server].ssl, config->states[server].fd, deadline,
+                                             *data + *data_size, capacity - *data_size, &length);
+
+      if (status != MESSAGE_STATUS_OK)
+      {
+         /* Cancel the query at the deadline, and wait a little for the server to end the response */
+         if (!cancelled && deadline > 0 && pgexporter_get_monotonic_time() >= deadline)
+         {
+            if (scrape > 0 && deadline >= scrape)
+            {
+               query_partial[server] = true;
+            }
+
+            query_cancel(server);
+            cancelled = true;
+            deadline += CANCEL_TIMEOUT;
+            continue;
+         }
+
+         goto error;
+      }
+
+      *data_size += length;
+
+      /* Frame the complete messages, only once, until the ReadyForQuery */
+      while (offset + 5 <= *data_size)
+      {
+         m_length = pgexporter_read_int32(*data + offset + 1);
+
+         /* The length counts itself, anything less would never advance or wrap around */
+         if (m_length < 4)
+         {
+            pgexporter_log_error("Invalid message length %d from server %s", m_length, &config->servers[server].name[0]);
+            goto protocol_error;
+         }
+
+         length = 1 + (size_t)m_length;
+
+         if (offset + length > *data_size)
+         {
+            break;
+         }
+
+         if (pgexporter_read_byte(*data + offset) == 'Z')
+         {
+            /* Only the framed messages are handed over */
+            *data_size = offset + length;
+            cont = false;
+            break;
+         }
+
+         offset += length;
+      }
+   }
+
+   if (cancelled)
+   {
+      /* The response ended, so the connection can be used again */
+      query_cancelled[server] = false;
+      goto error;
+   }
+
+   query_spent[server] += pgexporter_get_monotonic_time() - start;
+
+   return 0;
+
+protocol_error:
+
+   /* The connection is out of step, so it is neither used again nor kept */
+   query_cancelled[server] = true;
+
+error:
+
+   query_spent[server] += pgexporter_get_monotonic_time() - start;
+
+   free(*data);
+   *data = NULL;
+   *data_size = 0;
+
+   return 1;
+}
+
+static void
+query_cancel(int server)
+{
+   int ret;
+   int fd = -1;
+   char pgsql[MISC_LENGTH];
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (query_states(server))
+   {
+      query_cancelled[server] = true;
+   }
+
+   pgexporter_log_warn("Cancelling query on server %s", &config->servers[server].name[0]);
+
+   if (config->states[server].backend_pid == 0)
+   {
+      return;
+   }
+
+   if (config->servers[server].host[0] == '/')
+   {
+      memset(&pgsql, 0, sizeof(pgsql));
+      snprintf(&pgsql[0], sizeof(pgsql), ".s.PGSQL.%d", config->servers[server].port);
+      ret = pgexporter_connect_unix_socket(config->servers[server].host, &pgsql[0], &fd);
+   }
+   else
+   {
+      ret = pgexporter_connect(config->servers[server].host, config->servers[server].port, &fd);
+   }
+
+   if (ret == 0)
+   {
+      if (pgexporter_write_cancel_request(fd, config->states[server].backend_pid, config->states[server].backend_secret) != MESSAGE_STATUS_OK)
+      {
+         pgexporter_log_debug("Cancel request failed for server %s", &config->servers[server].name[0]);
+      }
+
+      pgexporter_disconnect(fd);
+   }
+}
+
+/**
+ * Make room for the state of the queries of a server in this process
+ * @param server The server
+ * @return true if there is room for the server, otherwise false
+ */
+static bool
+query_states(int server)
+{
+   int number;
+   bool* partial = NULL;
+   bool* cancelled = NULL;
+   uint64_t* spent = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (server < number_of_states)
+   {
+      return true;
+   }
+
+   if (server < 0 || server >= config->max_servers)
+   {
+      return false;
+   }
+
+   number = config->max_servers;
+
+   partial = calloc(number, sizeof(bool));
+   cancelled = calloc(number, sizeof(bool));
+   spent = calloc(number, sizeof(uint64_t));
+
+   if (partial == NULL || cancelled == NULL || spent == NULL)
+   {
+      free(partial);
+      free(cancelled);
+      free(spent);
+      return false;
+   }
+
+   if (number_of_states > 0)
+   {
+      memcpy(partial, query_partial, number_of_states * sizeof(bool));
+      memcpy(cancelled, query_cancelled, number_of_states * sizeof(bool));
+      memcpy(spent, query_spent, number_of_states * sizeof(uint64_t));
+   }
+
+   free(query_partial);
+   free(query_cancelled);
+   free(query_spent);
+
+   query_partial = partial;
+   query_cancelled = cancelled;
+   query_spent = spent;
+   number_of_states = number;
 
-   if (n != NULL)
+   return true;
+}
+
+/**
+ * The deadline of the queries of a server, which is the deadline
+ * of the scrape or the end of the share of the server when sooner
+ * @param server The server
+ * @return The deadline, or 0 for none
+ */
+static uint64_t
+query_server_deadline(int server)
+{
+   uint64_t left;
+   uint64_t deadline;
+
+   deadline = query_deadline;
+
+   if (deadline > 0 && query_share > 0 && query_states(server))
    {
-      d = realloc(orig, orig_size + n_size);
-      memcpy(d + orig_size, n, n_size);
+      left = query_share > query_spent[server] ? query_share - query_spent[server] : 0;
+      deadline = MIN(deadline, pgexporter_get_monotonic_time() + left);
    }
 
-   return d;
+   return deadline;
 }
 
 static int
@@ -773,8 +1238,8 @@ create_D_tuple(int server, int number_of_columns, struct message* msg, struct tu
       if (length > 0)
       {
          result->data[i] = (char*)malloc(length + 1);
-         memset(result->data[i], 0, length + 1);
          memcpy(result->data[i], msg->data + offset, length);
+         result->data[i][length] = '\0';
          offset += length;
       }
       else
@@ -849,36 +1314,253 @@ process_server_parameters(int server, struct deque* server_parameters)
    int status = 0;
    int major = 0;
    int minor = 0;
-   struct deque_iterator* iter = NULL;
+   char* server_version = NULL;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
-   config->servers[server].version = 0;
-   config->servers[server].minor_version = 0;
+   config->states[server].version = 0;
+   config->states[server].minor_version = 0;
+
+   server_version = (char*)pgexporter_deque_get(server_parameters, "server_version");
+   if (server_version != NULL)
+   {
+      pgexporter_log_trace("%s/process server_parameter 'server_version'", config->servers[server].name);
+      if (sscanf(server_version, "%d.%d", &major, &minor) == 2)
+      {
+         config->states[server].version = major;
+         config->states[server].minor_version = minor;
+      }
+      else
+      {
+         pgexporter_log_error("Unable to parse server_version '%s' for %s",
+                              server_version, config->servers[server].name);
+         status = 1;
+      }
+   }
+
+   return status;
+}
+
+static struct tuple*
+concat_tuples(struct query** queries, int n)
+{
+   struct tuple* head = NULL;
+   struct tuple* tail = NULL;
 
-   pgexporter_deque_iterator_create(server_parameters, &iter);
-   while (pgexporter_deque_iterator_next(iter))
+   for (int i = 0; i < n; i++)
    {
-      pgexporter_log_trace("%s/process server_parameter '%s'", config->servers[server].name, iter->tag);
-      if (!strcmp("server_version", iter->tag))
+      if (queries[i] != NULL && queries[i]->tuples != NULL)
       {
-         char* server_version = pgexporter_value_to_string(iter->value, FORMAT_TEXT, NULL, 0);
-         if (sscanf(server_version, "%d.%d", &major, &minor) == 2)
+         if (tail == NULL)
          {
-            config->servers[server].version = major;
-            config->servers[server].minor_version = minor;
+            head = queries[i]->tuples;
          }
          else
          {
-            pgexporter_log_error("Unable to parse server_version '%s' for %s",
-                                 server_version, config->servers[server].name);
-            status = 1;
+            tail->next = queries[i]->tuples;
          }
-         free(server_version);
+
+         tail = queries[i]->tuples;
+         while (tail->next != NULL)
+         {
+            tail = tail->next;
+         }
+
+         queries[i]->tuples = NULL;
       }
    }
 
-   pgexporter_deque_iterator_destroy(iter);
-   return status;
+   return head;
+}
+
+static int
+merge_tuples(struct query** queries, int n, struct tuple** tuples)
+{
+   int idx;
+   int size = 0;
+   int* heap = NULL;
+   struct tuple* head = NULL;
+   struct tuple* tail = NULL;
+   struct tuple* current = NULL;
+   struct tuple** heads = NULL;
+
+   *tuples = NULL;
+
+   heads = (struct tuple**)calloc(n, sizeof(struct tuple*));
+   heap = (int*)calloc(n, sizeof(int));
+
+   if (heads == NULL || heap == NULL)
+   {
+      goto error;
+   }
+
+   /* Each run must be sorted on data[0] */
+   for (int i = 0; i < n; i++)
+   {
+      if (queries[i] != NULL && queries[i]->tuples != NULL)
+      {
+         heads[i] = queries[i]->tuples;
+         if (!is_sorted_tuples(heads[i]))
+         {
+            heads[i] = sort_tuples(heads[i]);
+         }
+         queries[i]->tuples = NULL;
+
+         heap[size++] = i;
+      }
+   }
+
+   for (int i = size / 2 - 1; i >= 0; i--)
+   {
+      sift_down_tuples(heads, heap, size, i);
+   }
+
+   /* Take the smallest head each time; ties go to the lowest run, so the servers keep their order */
+   while (size > 0)
+   {
+      idx = heap[0];
+
+      current = heads[idx];
+      heads[idx] = current->next;
+      current->next = NULL;
+
+      if (tail == NULL)
+      {
+         head = current;
+      }
+      else
+      {
+         tail->next = current;
+      }
+      tail = current;
+
+      if (heads[idx] == NULL)
+      {
+         heap[0] = heap[--size];
+      }
+
+      sift_down_tuples(heads, heap, size, 0);
+   }
+
+   *tuples = head;
+
+   free(heads);
+   free(heap);
+
+   return 0;
+
+error:
+
+   free(heads);
+   free(heap);
+
+   return 1;
+}
+
+static int
+compare_tuples(struct tuple* t1, struct tuple* t2)
+{
+   char* d1 = t1->data[0] != NULL ? t1->data[0] : "";
+   char* d2 = t2->data[0] != NULL ? t2->data[0] : "";
+
+   return strcmp(d1, d2);
+}
+
+static bool
+is_sorted_tuples(struct tuple* tuples)
+{
+   while (tuples != NULL && tuples->next != NULL)
+   {
+      if (compare_tuples(tuples, tuples->next) > 0)
+      {
+         return false;
+      }
+      tuples = tuples->next;
+   }
+
+   return true;
+}
+
+static struct tuple*
+sort_tuples(struct tuple* tuples)
+{
+   struct tuple* slow = NULL;
+   struct tuple* fast = NULL;
+   struct tuple* left = NULL;
+   struct tuple* right = NULL;
+   struct tuple head;
+   struct tuple* tail = &head;
+
+   if (tuples == NULL || tuples->next == NULL)
+   {
+      return tuples;
+   }
+
+   slow = tuples;
+   fast = tuples->next;
+   while (fast != NULL && fast->next != NULL)
+   {
+      slow = slow->next;
+      fast = fast->next->next;
+   }
+
+   right = slow->next;
+   slow->next = NULL;
+
+   left = sort_tuples(tuples);
+   right = sort_tuples(right);
+
+   /* Stable merge; equal keys keep their order */
+   while (left != NULL && right != NULL)
+   {
+      if (compare_tuples(left, right) <= 0)
+      {
+         tail->next = left;
+         left = left->next;
+      }
+      else
+      {
+         tail->next = right;
+         right = right->next;
+      }
+      tail = tail->next;
+   }
+
+   tail->next = left != NULL ? left : right;
+
+   return head.next;
+}
+
+static void
+sift_down_tuples(struct tuple** heads, int* heap, int size, int i)
+{
+   int c;
+   int smallest;
+   int tmp;
+
+   while (true)
+   {
+      smallest = i;
+
+      for (int child = 2 * i + 1; child <= 2 * i + 2 && child < size; child++)
+      {
+         c = compare_tuples(heads[heap[child]], heads[heap[smallest]]);
+         if (c < 0 || (c == 0 && heap[child] < heap[smallest]))
+         {
+            smallest = child;
+         }
+      }
+
+      if (smallest == i)
+      {
+         return;
+      }
+
+      tmp = heap[i];
+      heap[i] = heap[smallest];
+      heap[smallest] = tmp;
+
+      i = smallest;
+   }
 }
@@ -28,7 +28,9 @@
 
 #include <pgexporter.h>
 #include <query_alts.h>
+#include <registry.h>
 #include <shmem.h>
+#include <utils.h>
 
 // Get height of AVL Tree Node
 static int height(struct query_alts* A);
@@ -43,7 +45,7 @@ static struct query_alts* node_right_rotate(struct query_alts* root);
 static struct query_alts* node_left_rotate(struct query_alts* root);
 
 void
-pgexporter_copy_query_alts(struct query_alts** dst, struct query_alts* src)
+pgexporter_copy_query_alts(struct registry* registry, struct query_alts** dst, struct query_alts* src)
 {
 
    if (!src)
@@ -51,21 +53,60 @@ pgexporter_copy_query_alts(struct query_alts** dst, struct query_alts* src)
       return;
    }
 
-   void* new_query_alt = NULL;
+   *dst = pgexporter_registry_allocate(registry, sizeof(struct query_alts));
 
-   pgexporter_create_shared_memory(sizeof(struct query_alts), HUGEPAGE_OFF, &new_query_alt);
-   *dst = (struct query_alts*) new_query_alt;
+   if (*dst == NULL)
+   {
+      return;
+   }
 
    (*dst)->height = src->height;
    (*dst)->is_histogram = src->is_histogram;
+   (*dst)->timeout = src->timeout;
    (*dst)->n_columns = src->n_columns;
    (*dst)->version = src->version;
 
-   memcpy((*dst)->query, src->query, MAX_QUERY_LENGTH);
-   memcpy((*dst)->columns, src->columns, MAX_NUMBER_OF_COLUMNS * sizeof(struct column));
+   (*dst)->query = pgexporter_registry_intern(registry, src->query);
+   for (int i = 0; i < src->n_columns; i++)
+   {
+      (*dst)->columns[i].type = src->columns[i].type;
+      (*dst)->columns[i].name = pgexporter_registry_intern(registry, src->columns[i].name);
+      (*dst)->columns[i].description = pgexporter_registry_intern(registry, src->columns[i].description);
+   }
+
+   pgexporter_copy_query_alts(registry, &(*dst)->left, src->left);
+   pgexporter_copy_query_alts(registry, &(*dst)->right, src->right);
+}
+
+bool
+pgexporter_equal_query_alts(struct query_alts* a, struct query_alts* b)
+{
+   if (a == NULL || b == NULL)
+   {
+      return a == b;
+   }
+
+   if (a->version != b->version ||
+       a->is_histogram != b->is_histogram ||
+       a->timeout != b->timeout ||
+       a->n_columns != b->n_columns ||
+       !pgexporter_compare_string(a->query, b->query))
+   {
+      return false;
+   }
+
+   for (int i = 0; i < a->n_columns; i++)
+   {
+      if (a->columns[i].type != b->columns[i].type ||
+          !pgexporter_compare_string(a->columns[i].name, b->columns[i].name) ||
+          !pgexporter_compare_string(a->columns[i].description, b->columns[i].description))
+      {
+         return false;
+      }
+   }
 
-   pgexporter_copy_query_alts(&(*dst)->left, src->left);
-   pgexporter_copy_query_alts(&(*dst)->right, src->right);
+   return pgexporter_equal_query_alts(a->left, b->left) &&
+          pgexporter_equal_query_alts(a->right, b->right);
 }
 
 static int
@@ -184,7 +225,7 @@ pgexporter_get_query_alt(struct query_alts* root, int server)
    int ver;
 
    config = (struct configuration*)shmem;
-   ver = config->servers[server].version;
+   ver = config->states[server].version;
 
    // Traversing the AVL tree
    while (temp)
@@ -222,6 +263,7 @@ pgexporter_free_query_alts(struct configuration* config)
    for (int i = 0; i < config->number_of_metrics; i++)
    {
       pgexporter_free_node_avl(&config->prometheus[i].root);
+      config->prometheus[i].compiled = false;
    }
 }
 
@@ -237,5 +279,6 @@ pgexporter_free_node_avl(struct query_alts** root)
    pgexporter_free_node_avl(&(*root)->left);
    pgexporter_free_node_avl(&(*root)->right);
 
-   pgexporter_destroy_shared_memory(&root, sizeof(struct query_alts*));
+   /* The node and its text belong to the registry */
+   *root = NULL;
 }
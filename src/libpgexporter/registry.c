@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2025 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <art.h>
+#include <logging.h>
+#include <registry.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+
+/* system */
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define REGISTRY_ARENA_SIZE   134217728
+#define REGISTRY_ALIGNMENT           64
+#define REGISTRY_RETIRE_TIMEOUT    5000
+
+static bool arena_free(struct registry* registry, int arena);
+static void arena_reset(struct registry* registry, int arena);
+static size_t align(struct registry* registry, size_t alignment);
+static void* allocate(struct registry* registry, size_t size, size_t alignment);
+
+int
+pgexporter_registry_create(struct registry** registry)
+{
+   void* arenas = NULL;
+   struct registry* r = NULL;
+
+   *registry = NULL;
+
+   if (pgexporter_create_shared_memory(sizeof(struct registry), HUGEPAGE_OFF, (void**)&r))
+   {
+      goto error;
+   }
+
+   r->pipes[0][0] = -1;
+   r->pipes[0][1] = -1;
+   r->pipes[1][0] = -1;
+   r->pipes[1][1] = -1;
+
+   if (pgexporter_reserve_shared_memory(2 * (size_t)REGISTRY_ARENA_SIZE, &arenas))
+   {
+      goto error;
+   }
+
+   r->size = REGISTRY_ARENA_SIZE;
+   r->arenas[0] = (char*)arenas;
+   r->arenas[1] = (char*)arenas + REGISTRY_ARENA_SIZE;
+
+   if (pipe(r->pipes[0]))
+   {
+      errno = 0;
+      goto error;
+   }
+
+   if (pgexporter_art_create(&r->strings[0]))
+   {
+      goto error;
+   }
+
+   *registry = r;
+
+   return 0;
+
+error:
+
+   pgexporter_log_error("Cannot allocate shared memory for the registry");
+
+   pgexporter_registry_destroy(r);
+
+   return 1;
+}
+
+void*
+pgexporter_registry_allocate(struct registry* registry, size_t size)
+{
+   return allocate(registry, size, REGISTRY_ALIGNMENT);
+}
+
+char*
+pgexporter_registry_intern(struct registry* registry, char* s)
+{
+   char* interned = NULL;
+
+   if (registry == NULL || s == NULL)
+   {
+      return NULL;
+   }
+
+   interned = (char*)pgexporter_art_search(registry->strings[registry->current], s);
+
+   if (interned != NULL)
+   {
+      return interned;
+   }
+
+   interned = allocate(registry, strlen(s) + 1, 1);
+
+   if (interned == NULL)
+   {
+      return NULL;
+   }
+
+   memcpy(interned, s, strlen(s));
+
+   if (pgexporter_art_insert(registry->strings[registry->current], s, (uintptr_t)interned, ValueRef))
+   {
+      return NULL;
+   }
+
+   return interned;
+}
+
+int
+pgexporter_registry_begin(struct registry* registry)
+{
+   int next;
+
+   if (registry == NULL || registry->current != registry->active)
+   {
+      return 1;
+   }
+
+   next = 1 - registry->active;
+
+   if (!arena_free(registry, next))
+   {
+      return 1;
+   }
+
+   /* The processes forked from now on hold the arena */
+   if (pipe(registry->pipes[next]))
+   {
+      errno = 0;
+      registry->pipes[next][0] = -1;
+      registry->pipes[next][1] = -1;
+      return 1;
+   }
+
+   arena_reset(registry, next);
+
+   if (pgexporter_art_create(&registry->strings[next]))
+   {
+      close(registry->pipes[next][0]);
+      close(registry->pipes[next][1]);
+      registry->pipes[next][0] = -1;
+      registry->pipes[next][1] = -1;
+      return 1;
+   }
+
+   registry->current = next;
+
+   return 0;
+}
+
+void
+pgexporter_registry_commit(struct registry* registry)
+{
+   int previous;
+
+   if (registry == NULL || registry->current == registry->active)
+   {
+      return;
+   }
+
+   previous = registry->active;
+   registry->active = registry->current;
+
+   /* The previous arena is free once the processes holding its write end are gone */
+   close(registry->pipes[previous][1]);
+   registry->pipes[previous][1] = -1;
+
+   pgexporter_art_destroy(registry->strings[previous]);
+   registry->strings[previous] = NULL;
+}
+
+void
+pgexporter_registry_rollback(struct registry* registry)
+{
+   int current;
+
+   if (registry == NULL || registry->current == registry->active)
+   {
+      return;
+   }
+
+   current = registry->current;
+   registry->current = registry->active;
+
+   close(registry->pipes[current][0]);
+   close(registry->pipes[current][1]);
+   registry->pipes[current][0] = -1;
+   registry->pipes[current][1] = -1;
+
+   pgexporter_art_destroy(registry->strings[current]);
+   registry->strings[current] = NULL;
+}
+
+void
+pgexporter_registry_detach(struct registry* registry)
+{
+   if (registry == NULL)
+   {
+      return;
+   }
+
+   /* Only the descriptors of this process are closed, the registry is shared */
+   for (int i = 0; i < 2; i++)
+   {
+      if (registry->pipes[i][0] != -1)
+      {
+         close(registry->pipes[i][0]);
+      }
+
+      if (registry->pipes[i][1] != -1)
+      {
+         close(registry->pipes[i][1]);
+      }
+   }
+}
+
+size_t
+pgexporter_registry_size(struct registry* registry)
+{
+   if (registry == NULL)
+   {
+      return 0;
+   }
+
+   return sizeof(struct registry) + registry->used[registry->active];
+}
+
+void
+pgexporter_registry_destroy(struct registry* registry)
+{
+   if (registry == NULL)
+   {
+      return;
+   }
+
+   for (int i = 0; i < 2; i++)
+   {
+      if (registry->pipes[i][0] != -1)
+      {
+         close(registry->pipes[i][0]);
+      }
+
+      if (registry->pipes[i][1] != -1)
+      {
+         close(registry->pipes[i][1]);
+      }
+
+      pgexporter_art_destroy(registry->strings[i]);
+   }
+
+   if (registry->arenas[0] != NULL)
+   {
+      pgexporter_destroy_shared_memory(registry->arenas[0], 2 * registry->size);
+   }
+
+   pgexporter_destroy_shared_memory(registry, sizeof(struct registry));
+}
+
+/**
+ * Is an arena free, which is when all the processes that
+ * could use it are gone
+ * @param registry The registry
+ * @param arena The arena
+ * @return True if free, otherwise false
+ */
+static bool
+arena_free(struct registry* registry, int arena)
+{
+   char c;
+   ssize_t n;
+   struct pollfd fds;
+
+   if (registry->pipes[arena][0] == -1)
+   {
+      return true;
+   }
+
+   fds.fd = registry->pipes[arena][0];
+   fds.events = POLLIN;
+
+   if (poll(&fds, 1, REGISTRY_RETIRE_TIMEOUT) <= 0)
+   {
+      errno = 0;
+      return false;
+   }
+
+   n = read(registry->pipes[arena][0], &c, 1);
+   if (n != 0)
+   {
+      errno = 0;
+      return false;
+   }
+
+   close(registry->pipes[arena][0]);
+   registry->pipes[arena][0] = -1;
+
+   return true;
+}
+
+/**
+ * Empty an arena, and give its memory back
+ * @param registry The registry
+ * @param arena The arena
+ */
+static void
+arena_reset(struct registry* registry, int arena)
+{
+#ifdef HAVE_LINUX
+   if (madvise(registry->arenas[arena], registry->size, MADV_REMOVE))
+   {
+      errno = 0;
+      memset(registry->arenas[arena], 0, registry->used[arena]);
+   }
+#else
+   memset(registry->arenas[arena], 0, registry->used[arena]);
+#endif
+
+   registry->used[arena] = 0;
+}
+
+static size_t
+align(struct registry* registry, size_t alignment)
+{
+   uintptr_t start;
+   size_t used;
+
+   used = registry->used[registry->current];
+   start = (uintptr_t)(registry->arenas[registry->current] + used);
+
+   return used + (((start + alignment - 1) & ~(uintptr_t)(alignment - 1)) - start);
+}
+
+static void*
+allocate(struct registry* registry, size_t size, size_t alignment)
+{
+   size_t offset;
+
+   if (registry == NULL)
+   {
+      return NULL;
+   }
+
+   offset = align(registry, alignment);
+
+   if (offset + size > registry->size)
+   {
+      pgexporter_log_error("Cannot allocate %zu bytes in the registry", size);
+      return NULL;
+   }
+
+   registry->used[registry->current] = offset + size;
+
+   return registry->arenas[registry->current] + offset;
+}
@@ -1032,6 +1032,7 @@ pgexporter_server_authenticate(int server, char* database, char* username, char*
    for (int i = 0; i < NUMBER_OF_SECURITY_MESSAGES; i++)
    {
       memset(&security_messages[i], 0, SECURITY_BUFFER_SIZE);
+      security_lengths[i] = 0;
    }
 
    if (config->servers[server].host[0] == '/')
@@ -2740,8 +2741,9 @@ pgexporter_extract_server_parameters(struct deque** server_parameters)
    struct deque* sp = NULL;
    *server_parameters = NULL;
 
-   if (pgexporter_deque_create(false, &sp))
+   if (pgexporter_deque_create(false, &sp) || pgexporter_deque_index(sp))
    {
+      pgexporter_deque_destroy(sp);
       return 1;
    }
 
@@ -2769,3 +2771,39 @@ pgexporter_extract_server_parameters(struct deque** server_parameters)
    *server_parameters = sp;
    return 0;
 }
+
+int
+pgexporter_extract_backend_key(int* pid, int* secret)
+{
+   char* data = NULL;
+   ssize_t data_length;
+   size_t offset;
+   bool found = false;
+   struct message* msg = NULL;
+
+   *pid = 0;
+   *secret = 0;
+
+   for (int i = 0; !found && i < NUMBER_OF_SECURITY_MESSAGES; ++i)
+   {
+      if ((data_length = security_lengths[i]) > 0)
+      {
+         data = &security_messages[i][0];
+         offset = 0;
+
+         while (!found && offset < data_length)
+         {
+            offset = pgexporter_extract_message_offset(offset, data, &msg);
+            if (msg->kind == 'K')
+            {
+               *pid = pgexporter_read_int32(msg->data + 5);
+               *secret = pgexporter_read_int32(msg->data + 9);
+               found = true;
+            }
+            pgexporter_free_message(msg);
+         }
+      }
+   }
+
+   return found ? 0 : 1;
+}
@@ -56,8 +56,8 @@ pgexporter_server_info(int srv)
    struct configuration* config;
 
    config = (struct configuration*)shmem;
-   ssl = config->servers[srv].ssl;
-   socket = config->servers[srv].fd;
+   ssl = config->states[srv].ssl;
+   socket = config->states[srv].fd;
 
    memset(&qmsg, 0, sizeof(struct message));
    memset(&is_recovery, 0, size);
@@ -89,11 +89,11 @@ pgexporter_server_info(int srv)
 
    if (state == 'f')
    {
-      config->servers[srv].state = SERVER_PRIMARY;
+      config->states[srv].state = SERVER_PRIMARY;
    }
    else
    {
-      config->servers[srv].state = SERVER_REPLICA;
+      config->states[srv].state = SERVER_REPLICA;
    }
 
    pgexporter_clear_message(tmsg);
@@ -39,6 +39,9 @@ void* shmem = NULL;
 void* prometheus_cache_shmem = NULL;
 void* bridge_cache_shmem = NULL;
 void* bridge_json_cache_shmem = NULL;
+void* prometheus_settings_shmem = NULL;
+void* prometheus_statistics_shmem = NULL;
+void* logging_shmem = NULL;
 
 int
 pgexporter_create_shared_memory(size_t size, unsigned char hp, void** shmem)
@@ -87,6 +90,25 @@ pgexporter_create_shared_memory(size_t size, unsigned char hp, void** shmem)
    return 0;
 }
 
+int
+pgexporter_reserve_shared_memory(size_t size, void** shmem)
+{
+   void* s = NULL;
+
+   *shmem = NULL;
+
+   s = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED | MAP_NORESERVE, -1, 0);
+   if (s == (void*)-1)
+   {
+      errno = 0;
+      return 1;
+   }
+
+   *shmem = s;
+
+   return 0;
+}
+
 int
 pgexporter_destroy_shared_memory(void* shmem, size_t size)
 {
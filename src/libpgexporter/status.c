@@ -69,7 +69,7 @@ pgexporter_status(SSL* ssl, int client_fd, uint8_t compression, uint8_t encrypti
 
       pgexporter_json_create(&js);
 
-      pgexporter_json_put(js, MANAGEMENT_ARGUMENT_ACTIVE, (uintptr_t)config->servers[i].fd != -1 ? true : false, ValueBool);
+      pgexporter_json_put(js, MANAGEMENT_ARGUMENT_ACTIVE, (uintptr_t)config->states[i].fd != -1 ? true : false, ValueBool);
       pgexporter_json_put(js, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[i].name, ValueString);
 
       pgexporter_json_append(servers, (uintptr_t)js, ValueJSON);
@@ -145,7 +145,7 @@ pgexporter_status_details(SSL* ssl, int client_fd, uint8_t compression, uint8_t
 
       pgexporter_json_create(&js);
 
-      pgexporter_json_put(js, MANAGEMENT_ARGUMENT_ACTIVE, (uintptr_t)config->servers[i].fd != -1 ? true : false, ValueBool);
+      pgexporter_json_put(js, MANAGEMENT_ARGUMENT_ACTIVE, (uintptr_t)config->states[i].fd != -1 ? true : false, ValueBool);
       pgexporter_json_put(js, MANAGEMENT_ARGUMENT_SERVER, (uintptr_t)config->servers[i].name, ValueString);
 
       pgexporter_json_append(servers, (uintptr_t)js, ValueJSON);
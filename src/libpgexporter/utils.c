@@ -45,6 +45,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 #include <openssl/pem.h>
 #include <sys/statvfs.h>
@@ -273,6 +274,20 @@ pgexporter_extract_message_offset(size_t offset, void* data, struct message** ex
    return offset + 1 + m_length;
 }
 
+size_t
+pgexporter_view_message_offset(size_t offset, void* data, struct message* view)
+{
+   int m_length;
+
+   m_length = pgexporter_read_int32(data + offset + 1);
+
+   view->kind = (char)pgexporter_read_byte(data + offset);
+   view->length = 1 + m_length;
+   view->data = data + offset;
+
+   return offset + 1 + m_length;
+}
+
 int
 pgexporter_extract_message_from_data(char type, void* data, size_t data_size, struct message** extracted)
 {
@@ -1409,6 +1424,16 @@ pgexporter_get_timestamp_string(time_t start_time, time_t end_time, int32_t* sec
    return result;
 }
 
+uint64_t
+pgexporter_get_monotonic_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
 int
 pgexporter_delete_file(char* file)
 {
@@ -141,7 +141,8 @@ pgexporter_value_create(enum value_type type, uintptr_t data, struct value** val
    {
       case ValueString:
       {
-         val->data = (uintptr_t)pgexporter_append(NULL, (char*)data);
+         // A NULL string is the null of a json
+         val->data = data != 0 ? (uintptr_t)pgexporter_append(NULL, (char*)data) : 0;
          val->destroy_data = free_destroy_cb;
          break;
       }
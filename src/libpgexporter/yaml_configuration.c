@@ -28,10 +28,11 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <configuration.h>
 #include <internal.h>
 #include <logging.h>
 #include <query_alts.h>
-#include <shmem.h>
+#include <registry.h>
 #include <utils.h>
 #include <yaml_configuration.h>
 
@@ -39,7 +40,7 @@
 #include <yaml.h>
 #include <errno.h>
 
-static int pgexporter_read_yaml(struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics);
+static int pgexporter_read_yaml(struct configuration* config, int prometheus_idx, char* filename, int* number_of_metrics);
 
 static int get_yaml_files(char* base, int* number_of_yaml_files, char*** files);
 static bool is_yaml_file(char* filename);
@@ -62,6 +63,7 @@ typedef struct yaml_query
    bool is_histogram;
    char* query;
    char version;
+   int timeout;
    yaml_column_t* columns;
    int n_columns;
 } __attribute__ ((aligned (64))) yaml_query_t;
@@ -75,6 +77,7 @@ typedef struct yaml_metric
    char* sort;
    char* collector;
    char* server;
+   int timeout;
 } __attribute__ ((aligned (64))) yaml_metric_t;
 
 // Config's Structure
@@ -136,8 +139,8 @@ static void free_yaml_queries(yaml_query_t** queries, size_t n_queries);
 // Free allocated memory for YAML columns
 static void free_yaml_columns(yaml_column_t** columns, size_t n_columns);
 
-// Extract the meaning of the `yaml_config` and load the metrics into `prometheus`
-static int semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t* yaml_config);
+// Extract the meaning of the `yaml_config` and load the metrics into `config`
+static int semantics_yaml(struct configuration* config, int prometheus_idx, yaml_config_t* yaml_config);
 
 int
 pgexporter_read_metrics_configuration(void* shmem)
@@ -155,7 +158,7 @@ pgexporter_read_metrics_configuration(void* shmem)
    if (pgexporter_is_file(config->metrics_path))
    {
       number_of_metrics = 0;
-      if (pgexporter_read_yaml(config->prometheus, idx_metrics, config->metrics_path, &number_of_metrics))
+      if (pgexporter_read_yaml(config, idx_metrics, config->metrics_path, &number_of_metrics))
       {
          return 1;
       }
@@ -174,7 +177,7 @@ pgexporter_read_metrics_configuration(void* shmem)
                                         yaml_files[i]
                                         );
 
-         if (pgexporter_read_yaml(config->prometheus, idx_metrics, yaml_path, &number_of_metrics))
+         if (pgexporter_read_yaml(config, idx_metrics, yaml_path, &number_of_metrics))
          {
             free(yaml_path);
             yaml_path = NULL;
@@ -209,7 +212,7 @@ pgexporter_read_internal_yaml_metrics(struct configuration* config, bool start)
    int ret;
    FILE* internal_yaml_ptr = fmemopen(INTERNAL_YAML, strlen(INTERNAL_YAML), "r");
 
-   ret = pgexporter_read_yaml_from_file_pointer(config->prometheus, 0, &number_of_metrics, internal_yaml_ptr);
+   ret = pgexporter_read_yaml_from_file_pointer(config, 0, &number_of_metrics, internal_yaml_ptr);
    fclose(internal_yaml_ptr);
 
    if (ret)
@@ -228,7 +231,7 @@ pgexporter_read_internal_yaml_metrics(struct configuration* config, bool start)
 }
 
 static int
-pgexporter_read_yaml(struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics)
+pgexporter_read_yaml(struct configuration* config, int prometheus_idx, char* filename, int* number_of_metrics)
 {
    FILE* file;
 
@@ -239,7 +242,7 @@ pgexporter_read_yaml(struct prometheus* prometheus, int prometheus_idx, char* fi
       return 1;
    }
 
-   int ret = pgexporter_read_yaml_from_file_pointer(prometheus, prometheus_idx, number_of_metrics, file);
+   int ret = pgexporter_read_yaml_from_file_pointer(config, prometheus_idx, number_of_metrics, file);
 
    fclose(file);
 
@@ -247,7 +250,7 @@ pgexporter_read_yaml(struct prometheus* prometheus, int prometheus_idx, char* fi
 }
 
 int
-pgexporter_read_yaml_from_file_pointer(struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, FILE* file)
+pgexporter_read_yaml_from_file_pointer(struct configuration* config, int prometheus_idx, int* number_of_metrics, FILE* file)
 {
    int ret = 0;
    yaml_config_t yaml_config;
@@ -262,7 +265,7 @@ pgexporter_read_yaml_from_file_pointer(struct prometheus* prometheus, int promet
 
    *number_of_metrics += yaml_config.n_metrics;
 
-   if (semantics_yaml(prometheus, prometheus_idx, &yaml_config))
+   if (semantics_yaml(config, prometheus_idx, &yaml_config))
    {
       ret = 1;
       goto end;
@@ -586,6 +589,13 @@ parse_metrics(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t
                   goto error;
                }
             }
+            else if (!strcmp(buf, "timeout"))
+            {
+               if (parse_int(parser_ptr, event_ptr, state_ptr, &(*metrics)[*n_metrics].timeout))
+               {
+                  goto error;
+               }
+            }
             else if (!strcmp(buf, "queries"))
             {
                if (parse_queries(parser_ptr, event_ptr, state_ptr, yaml_config, &(*metrics)[*n_metrics].queries, &(*metrics)[*n_metrics].n_queries))
@@ -718,6 +728,13 @@ parse_queries(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t
                   goto error;
                }
             }
+            else if (!strcmp(buf, "timeout"))
+            {
+               if (parse_int(parser_ptr, event_ptr, state_ptr, &(*queries)[*n_queries].timeout))
+               {
+                  goto error;
+               }
+            }
             else if (!strcmp(buf, "columns"))
             {
                if (parse_columns(parser_ptr, event_ptr, state_ptr, &(*queries)[*n_queries], &(*queries)[*n_queries].columns, &(*queries)[*n_queries].n_columns))
@@ -1068,18 +1085,17 @@ free_yaml_columns(yaml_column_t** columns, size_t n_columns)
 }
 
 static int
-semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t* yaml_config)
+semantics_yaml(struct configuration* config, int prometheus_idx, yaml_config_t* yaml_config)
 {
    struct prometheus* prom = NULL;
 
-   for (int i = 0; i < yaml_config->n_metrics; i++)
+   if (pgexporter_reserve_metrics(config, prometheus_idx + yaml_config->n_metrics))
    {
-      if (prometheus_idx + i >= NUMBER_OF_METRICS)
-      {
-         pgexporter_log_error("The number of metrics exceed the maximum limit of %d.", NUMBER_OF_METRICS);
-         return 1;
-      }
+      return 1;
+   }
 
+   for (int i = 0; i < yaml_config->n_metrics; i++)
+   {
       if (yaml_config->metrics[i].tag == NULL)
       {
          pgexporter_log_error("No tag defined for '%s' (%d)",
@@ -1096,10 +1112,10 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
          return 1;
       }
 
-      prom = &prometheus[prometheus_idx + i];
+      prom = &config->prometheus[prometheus_idx + i];
 
       memcpy(prom->tag, yaml_config->metrics[i].tag, MIN(MISC_LENGTH - 1, strlen(yaml_config->metrics[i].tag)));
-      memcpy(prom->collector, yaml_config->metrics[i].collector, MIN(MAX_COLLECTOR_LENGTH - 1, strlen(yaml_config->metrics[i].collector)));
+      prom->collector = pgexporter_registry_intern(config->registry, yaml_config->metrics[i].collector);
 
       // Sort Type
       if (!yaml_config->metrics[i].sort || !strcmp(yaml_config->metrics[i].sort, "name"))
@@ -1140,31 +1156,35 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
       {
 
          struct query_alts* new_query = NULL;
-         void* new_query_shmem = NULL;
 
-         pgexporter_create_shared_memory(sizeof(struct query_alts), HUGEPAGE_OFF, &new_query_shmem);
-         new_query = (struct query_alts*) new_query_shmem;
+         new_query = pgexporter_registry_allocate(config->registry, sizeof(struct query_alts));
+         if (new_query == NULL)
+         {
+            return 1;
+         }
 
          new_query->n_columns = MIN(yaml_config->metrics[i].queries[j].n_columns, MAX_NUMBER_OF_COLUMNS);
 
-         memcpy(new_query->query, yaml_config->metrics[i].queries[j].query, MIN(MAX_QUERY_LENGTH - 1, strlen(yaml_config->metrics[i].queries[j].query)));
+         new_query->query = pgexporter_registry_intern(config->registry, yaml_config->metrics[i].queries[j].query);
          new_query->version = yaml_config->metrics[i].queries[j].version;
 
+         // Timeout, of the query or else of the metric
+         new_query->timeout = yaml_config->metrics[i].queries[j].timeout > 0 ? yaml_config->metrics[i].queries[j].timeout : yaml_config->metrics[i].timeout;
+         if (new_query->timeout < 0)
+         {
+            pgexporter_log_error("pgexporter: unexpected timeout %d", new_query->timeout);
+            return 1;
+         }
+
          // Columns
          for (int k = 0; k < new_query->n_columns; k++)
          {
 
             // Name
-            if (yaml_config->metrics[i].queries[j].columns[k].name)
-            {
-               memcpy(new_query->columns[k].name, yaml_config->metrics[i].queries[j].columns[k].name, MIN(MISC_LENGTH - 1, strlen(yaml_config->metrics[i].queries[j].columns[k].name)));
-            }
+            new_query->columns[k].name = pgexporter_registry_intern(config->registry, yaml_config->metrics[i].queries[j].columns[k].name ? yaml_config->metrics[i].queries[j].columns[k].name : "");
 
             // Description
-            if (yaml_config->metrics[i].queries[j].columns[k].description)
-            {
-               memcpy(new_query->columns[k].description, yaml_config->metrics[i].queries[j].columns[k].description, MIN(MISC_LENGTH - 1, strlen(yaml_config->metrics[i].queries[j].columns[k].description)));
-            }
+            new_query->columns[k].description = pgexporter_registry_intern(config->registry, yaml_config->metrics[i].queries[j].columns[k].description ? yaml_config->metrics[i].queries[j].columns[k].description : "");
 
             // Type
             if (!strcmp(yaml_config->metrics[i].queries[j].columns[k].type, "label"))
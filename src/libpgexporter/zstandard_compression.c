@@ -66,6 +66,7 @@ pgexporter_zstdc_string(char* s, unsigned char** buffer, size_t* buffer_size)
    {
       pgexporter_log_error("ZSTD: Compression error: %s", ZSTD_getErrorName(compressed_size));
       free(*buffer);
+      *buffer = NULL;
       return 1;
    }
 
@@ -105,6 +106,7 @@ pgexporter_zstdd_string(unsigned char* compressed_buffer, size_t compressed_size
    {
       pgexporter_log_error("ZSTD: Compression error: %s", ZSTD_getErrorName(result));
       free(*output_string);
+      *output_string = NULL;
       return 1;
    }
 
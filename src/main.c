@@ -41,6 +41,7 @@
 #include <prometheus.h>
 #include <queries.h>
 #include <query_alts.h>
+#include <registry.h>
 #include <remote.h>
 #include <security.h>
 #include <server.h>
@@ -86,6 +87,7 @@ static void accept_management_cb(struct ev_loop* loop, struct ev_io* watcher, in
 static void shutdown_cb(struct ev_loop* loop, ev_signal* w, int revents);
 static void reload_cb(struct ev_loop* loop, ev_signal* w, int revents);
 static void coredump_cb(struct ev_loop* loop, ev_signal* w, int revents);
+static void logging_cb(struct ev_loop* loop, ev_child* w, int revents);
 static bool accept_fatal(int error);
 static bool reload_configuration(void);
 static int  create_pidfile(void);
@@ -121,6 +123,8 @@ static struct accept_io io_management[MAX_FDS];
 static int* management_fds = NULL;
 static int management_fds_length = -1;
 static struct accept_io io_transfer;
+static pid_t logging_pid = 0;
+static ev_child logging_watcher;
 
 static void
 start_mgt(void)
@@ -377,12 +381,15 @@ main(int argc, char** argv)
    char* yaml_path = NULL;
    char* json_path = NULL;
    char* collector = NULL;
-   char collectors[NUMBER_OF_COLLECTORS][MAX_COLLECTOR_LENGTH];
+   char* collectors[NUMBER_OF_COLLECTORS];
    bool daemon = false;
    pid_t pid, sid;
    struct signal_info signal_watcher[5];
    size_t shmem_size;
    size_t prometheus_cache_shmem_size = 0;
+   size_t prometheus_settings_shmem_size = 0;
+   size_t prometheus_statistics_shmem_size = 0;
+   size_t logging_shmem_size = 0;
    size_t bridge_cache_shmem_size = 0;
    size_t bridge_json_cache_shmem_size = 0;
    struct configuration* config = NULL;
@@ -459,7 +466,7 @@ main(int argc, char** argv)
       }
       else if (!strcmp(optname, "collectors") || !strcmp(optname, "C"))
       {
-         memset(collectors, 0, (NUMBER_OF_COLLECTORS * MAX_COLLECTOR_LENGTH) * sizeof(char));
+         memset(collectors, 0, sizeof(collectors));
 
          collector_idx = 0;
          collector = optarg;
@@ -489,7 +496,7 @@ main(int argc, char** argv)
 
             for (int i = 0; i < collector_idx; i++)
             {
-               if (!strncmp(collector, collectors[i], MAX_COLLECTOR_LENGTH - 1))
+               if (!strcmp(collector, collectors[i]))
                {
                   found = true;
                   break;
@@ -498,7 +505,7 @@ main(int argc, char** argv)
 
             if (!found)
             {
-               strncpy(collectors[collector_idx++], collector, MAX_COLLECTOR_LENGTH - 1);
+               collectors[collector_idx++] = collector;
             }
          }
       }
@@ -530,9 +537,21 @@ main(int argc, char** argv)
       exit(1);
    }
 
-   pgexporter_init_configuration(shmem);
+   if (pgexporter_init_configuration(shmem))
+   {
+      warnx("pgexporter: Error in creating the registry");
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating the registry");
+#endif
+      exit(1);
+   }
    config = (struct configuration*)shmem;
-   memcpy(config->collectors, collectors, (NUMBER_OF_COLLECTORS * MAX_COLLECTOR_LENGTH) * sizeof(char));
+
+   config->collectors = pgexporter_registry_allocate(config->registry, collector_idx * sizeof(char*));
+   for (int i = 0; i < collector_idx; i++)
+   {
+      config->collectors[i] = pgexporter_registry_intern(config->registry, collectors[i]);
+   }
    config->number_of_collectors = collector_idx;
 
    /* Configuration File */
@@ -751,6 +770,14 @@ main(int argc, char** argv)
       pgexporter_log_debug("Reading : %d metrics from path", config->number_of_metrics);
    }
 
+   if (pgexporter_prometheus_compile(config))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notify(0, "STATUS=Unable to compile the metrics");
+#endif
+      exit(1);
+   }
+
    if (daemon)
    {
       if (config->log_type == PGEXPORTER_LOGGING_TYPE_CONSOLE)
@@ -798,6 +825,49 @@ main(int argc, char** argv)
       errx(1, "Error in creating and initializing prometheus cache shared memory");
    }
 
+   if (pgexporter_init_prometheus_settings(&prometheus_settings_shmem_size, &prometheus_settings_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing prometheus settings shared memory");
+#endif
+      errx(1, "Error in creating and initializing prometheus settings shared memory");
+   }
+
+   if (pgexporter_init_prometheus_statistics(&prometheus_statistics_shmem_size, &prometheus_statistics_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing prometheus statistics shared memory");
+#endif
+      errx(1, "Error in creating and initializing prometheus statistics shared memory");
+   }
+
+   if (pgexporter_init_logging_buffer(&logging_shmem_size, &logging_shmem))
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notifyf(0, "STATUS=Error in creating and initializing logging shared memory");
+#endif
+      errx(1, "Error in creating and initializing logging shared memory");
+   }
+
+   logging_pid = fork();
+   if (logging_pid == -1)
+   {
+#ifdef HAVE_SYSTEMD
+      sd_notify(0, "STATUS=Unable to start the logging process");
+#endif
+      errx(1, "Unable to start the logging process");
+   }
+   else if (logging_pid == 0)
+   {
+      /* The logging process does not use the configuration sections */
+      pgexporter_registry_detach(config->registry);
+      pgexporter_set_proc_title(argc, argv, "logging", NULL);
+      pgexporter_logging_process();
+      exit(0);
+   }
+
+   pgexporter_logging_activate();
+
    if (config->bridge > 0 && config->bridge_cache_max_age > 0 && config->bridge_cache_max_size > 0)
    {
       if (pgexporter_bridge_init_cache(&bridge_cache_shmem_size, &bridge_cache_shmem))
@@ -864,6 +934,9 @@ main(int argc, char** argv)
       ev_signal_start(main_loop, (struct ev_signal*)&signal_watcher[i]);
    }
 
+   ev_child_init(&logging_watcher, logging_cb, logging_pid, 0);
+   ev_child_start(main_loop, &logging_watcher);
+
    if (pgexporter_tls_valid())
    {
       pgexporter_log_fatal("pgexporter: Invalid TLS configuration");
@@ -1003,6 +1076,7 @@ main(int argc, char** argv)
    pgexporter_log_debug("%s", OpenSSL_version(OPENSSL_VERSION));
 #endif
    pgexporter_log_debug("Configuration size: %lu", shmem_size);
+   pgexporter_log_debug("Registry size: %lu", pgexporter_registry_size(config->registry));
    pgexporter_log_debug("Known users: %d", config->number_of_users);
    pgexporter_log_debug("Known admins: %d", config->number_of_admins);
 
@@ -1017,10 +1091,10 @@ main(int argc, char** argv)
    for (int i = 0; i < config->number_of_servers; i++)
    {
       pgexporter_log_trace("Server: %s/%d.%d -> %s", config->servers[i].name,
-                           config->servers[i].version, config->servers[i].minor_version,
-                           config->servers[i].fd != -1 ? "true" : "false");
+                           config->states[i].version, config->states[i].minor_version,
+                           config->states[i].fd != -1 ? "true" : "false");
 
-      if (config->servers[i].fd != -1)
+      if (config->states[i].fd != -1)
       {
          struct query* query = NULL;
 
@@ -1029,11 +1103,11 @@ main(int argc, char** argv)
 
          if (query != NULL)
          {
-            config->servers[i].extension = true;
+            config->states[i].extension = true;
          }
          else
          {
-            config->servers[i].extension = false;
+            config->states[i].extension = false;
          }
 
          pgexporter_free_query(query);
@@ -1076,6 +1150,8 @@ main(int argc, char** argv)
       ev_signal_stop(main_loop, (struct ev_signal*)&signal_watcher[i]);
    }
 
+   ev_child_stop(main_loop, &logging_watcher);
+
    ev_loop_destroy(main_loop);
 
    free(metrics_fds);
@@ -1088,13 +1164,20 @@ main(int argc, char** argv)
    remove_lockfile(config->bridge);
    remove_lockfile(config->bridge_json);
 
+   pgexporter_logging_deactivate(logging_pid);
    pgexporter_stop_logging();
 
    pgexporter_free_query_alts(config);
+   pgexporter_registry_destroy(config->registry);
 
    pgexporter_destroy_shared_memory(shmem, shmem_size);
    pgexporter_destroy_shared_memory(prometheus_cache_shmem,
                                     prometheus_cache_shmem_size);
+   pgexporter_destroy_shared_memory(prometheus_settings_shmem,
+                                    prometheus_settings_shmem_size);
+   pgexporter_destroy_shared_memory(prometheus_statistics_shmem,
+                                    prometheus_statistics_shmem_size);
+   pgexporter_destroy_shared_memory(logging_shmem, logging_shmem_size);
 
    pgexporter_memory_destroy();
 
@@ -1407,7 +1490,7 @@ accept_transfer_cb(struct ev_loop* loop, struct ev_io* watcher, int revents)
    }
 
    pgexporter_log_debug("pgexporter: Transfer connection: Server %d FD %d", srv, fd);
-   config->servers[srv].fd = fd;
+   config->states[srv].fd = fd;
 
    pgexporter_disconnect(client_fd);
 
@@ -1787,6 +1870,48 @@ coredump_cb(struct ev_loop* loop, ev_signal* w, int revents)
    abort();
 }
 
+static void
+logging_cb(struct ev_loop* loop, ev_child* w, int revents)
+{
+   pid_t pid;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   /* Nobody drains the logging buffer, so log directly until it is restarted */
+   pgexporter_logging_suspend();
+   ev_child_stop(loop, w);
+
+   if (!keep_running)
+   {
+      return;
+   }
+
+   pgexporter_log_warn("pgexporter: Logging process %d exited (%d)", w->rpid, w->rstatus);
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgexporter_log_error("pgexporter: Unable to restart the logging process");
+      logging_pid = 0;
+      return;
+   }
+   else if (pid == 0)
+   {
+      pgexporter_registry_detach(config->registry);
+      pgexporter_set_proc_title(1, argv_ptr, "logging", NULL);
+      pgexporter_logging_process();
+      exit(0);
+   }
+
+   logging_pid = pid;
+
+   ev_child_set(w, logging_pid, 0);
+   ev_child_start(loop, w);
+
+   pgexporter_logging_activate();
+}
+
 static bool
 accept_fatal(int error)
 {